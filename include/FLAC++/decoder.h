@@ -124,6 +124,10 @@ namespace FLAC {
 
 			virtual bool set_ogg_serial_number(long value);                        ///< See FLAC__stream_decoder_set_ogg_serial_number()
 			virtual bool set_md5_checking(bool value);                             ///< See FLAC__stream_decoder_set_md5_checking()
+			virtual bool set_threaded_md5(bool value);                             ///< See FLAC__stream_decoder_set_threaded_md5()
+			virtual bool set_num_threads(unsigned value);                          ///< See FLAC__stream_decoder_set_num_threads()
+			virtual bool set_pcm_format(::FLAC__StreamDecoderPCMFormat format);    ///< See FLAC__stream_decoder_set_pcm_format()
+			virtual bool set_frame_index(bool value);                              ///< See FLAC__stream_decoder_set_frame_index()
 			virtual bool set_metadata_respond(::FLAC__MetadataType type);          ///< See FLAC__stream_decoder_set_metadata_respond()
 			virtual bool set_metadata_respond_application(const FLAC__byte id[4]); ///< See FLAC__stream_decoder_set_metadata_respond_application()
 			virtual bool set_metadata_respond_all();                               ///< See FLAC__stream_decoder_set_metadata_respond_all()
@@ -134,6 +138,12 @@ namespace FLAC {
 			/* get_state() is not virtual since we want subclasses to be able to return their own state */
 			State get_state() const;                                          ///< See FLAC__stream_decoder_get_state()
 			virtual bool get_md5_checking() const;                            ///< See FLAC__stream_decoder_get_md5_checking()
+			virtual bool get_threaded_md5() const;                            ///< See FLAC__stream_decoder_get_threaded_md5()
+			virtual unsigned get_num_threads() const;                         ///< See FLAC__stream_decoder_get_num_threads()
+			virtual ::FLAC__StreamDecoderPCMFormat get_pcm_format() const;    ///< See FLAC__stream_decoder_get_pcm_format()
+			virtual const void *get_pcm(size_t *bytes) const;                 ///< See FLAC__stream_decoder_get_pcm()
+			virtual bool get_frame_index() const;                             ///< See FLAC__stream_decoder_get_frame_index()
+			virtual const ::FLAC__StreamMetadata_SeekPoint *get_frame_index_points(unsigned *num_points) const; ///< See FLAC__stream_decoder_get_frame_index_points()
 			virtual FLAC__uint64 get_total_samples() const;                   ///< See FLAC__stream_decoder_get_total_samples()
 			virtual unsigned get_channels() const;                            ///< See FLAC__stream_decoder_get_channels()
 			virtual ::FLAC__ChannelAssignment get_channel_assignment() const; ///< See FLAC__stream_decoder_get_channel_assignment()
@@ -154,8 +164,14 @@ namespace FLAC {
 			virtual bool process_until_end_of_metadata(); ///< See FLAC__stream_decoder_process_until_end_of_metadata()
 			virtual bool process_until_end_of_stream();   ///< See FLAC__stream_decoder_process_until_end_of_stream()
 			virtual bool skip_single_frame();             ///< See FLAC__stream_decoder_skip_single_frame()
+			virtual bool scan_until_end_of_stream(FLAC__uint64 *total_samples); ///< See FLAC__stream_decoder_scan_until_end_of_stream(); calls scan_callback() for each frame
 
 			virtual bool seek_absolute(FLAC__uint64 sample); ///< See FLAC__stream_decoder_seek_absolute()
+			virtual bool find_total_samples(FLAC__uint64 *total_samples); ///< See FLAC__stream_decoder_find_total_samples()
+			virtual bool compute_md5_signature(FLAC__byte md5sum[16]); ///< See FLAC__stream_decoder_compute_md5_signature()
+
+			virtual bool save_frame_index(const char *filename); ///< See FLAC__stream_decoder_save_frame_index()
+			virtual bool load_frame_index(const char *filename); ///< See FLAC__stream_decoder_load_frame_index()
 		protected:
 			/// see FLAC__StreamDecoderReadCallback
 			virtual ::FLAC__StreamDecoderReadStatus read_callback(FLAC__byte buffer[], size_t *bytes) = 0;
@@ -181,6 +197,9 @@ namespace FLAC {
 			/// see FLAC__StreamDecoderErrorCallback
 			virtual void error_callback(::FLAC__StreamDecoderErrorStatus status) = 0;
 
+			/// see FLAC__StreamDecoderScanCallback
+			virtual bool scan_callback(const ::FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes);
+
 #if (defined _MSC_VER) || (defined __BORLANDC__) || (defined __GNUG__ && (__GNUG__ < 2 || (__GNUG__ == 2 && __GNUC_MINOR__ < 96))) || (defined __SUNPRO_CC)
 			// lame hack: some MSVC/GCC versions can't see a protected decoder_ from nested State::resolved_as_cstring()
 			friend State;
@@ -195,6 +214,7 @@ namespace FLAC {
 			static ::FLAC__StreamDecoderWriteStatus write_callback_(const ::FLAC__StreamDecoder *decoder, const ::FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 			static void metadata_callback_(const ::FLAC__StreamDecoder *decoder, const ::FLAC__StreamMetadata *metadata, void *client_data);
 			static void error_callback_(const ::FLAC__StreamDecoder *decoder, ::FLAC__StreamDecoderErrorStatus status, void *client_data);
+			static FLAC__bool scan_callback_(const ::FLAC__StreamDecoder *decoder, const ::FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data);
 		private:
 			// Private and undefined so you can't use them:
 			Stream(const Stream &);
@@ -231,6 +251,12 @@ namespace FLAC {
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(FILE *file);                  ///< See FLAC__stream_decoder_init_ogg_FILE()
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(const char *filename);        ///< See FLAC__stream_decoder_init_ogg_file()
 			virtual ::FLAC__StreamDecoderInitStatus init_ogg(const std::string &filename); ///< See FLAC__stream_decoder_init_ogg_file()
+			virtual ::FLAC__StreamDecoderInitStatus init_memory(const FLAC__byte *data, size_t bytes);     ///< See FLAC__stream_decoder_init_memory()
+			virtual ::FLAC__StreamDecoderInitStatus init_ogg_memory(const FLAC__byte *data, size_t bytes); ///< See FLAC__stream_decoder_init_ogg_memory()
+			virtual ::FLAC__StreamDecoderInitStatus init_mapped(const char *filename);                    ///< See FLAC__stream_decoder_init_mapped_file()
+			virtual ::FLAC__StreamDecoderInitStatus init_mapped(const std::string &filename);             ///< See FLAC__stream_decoder_init_mapped_file()
+			virtual ::FLAC__StreamDecoderInitStatus init_ogg_mapped(const char *filename);                ///< See FLAC__stream_decoder_init_ogg_mapped_file()
+			virtual ::FLAC__StreamDecoderInitStatus init_ogg_mapped(const std::string &filename);         ///< See FLAC__stream_decoder_init_ogg_mapped_file()
 		protected:
 			// this is a dummy implementation to satisfy the pure virtual in Stream that is actually supplied internally by the C layer
 			virtual ::FLAC__StreamDecoderReadStatus read_callback(FLAC__byte buffer[], size_t *bytes);
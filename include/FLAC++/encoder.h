@@ -147,6 +147,11 @@ namespace FLAC {
 			virtual bool set_total_samples_estimate(FLAC__uint64 value);    ///< See FLAC__stream_encoder_set_total_samples_estimate()
 			virtual bool set_metadata(::FLAC__StreamMetadata **metadata, unsigned num_blocks);    ///< See FLAC__stream_encoder_set_metadata()
 			virtual bool set_metadata(FLAC::Metadata::Prototype **metadata, unsigned num_blocks); ///< See FLAC__stream_encoder_set_metadata()
+			virtual bool set_num_threads(unsigned value);                   ///< See FLAC__stream_encoder_set_num_threads()
+			virtual bool set_do_parallel_subframes(bool value);             ///< See FLAC__stream_encoder_set_do_parallel_subframes()
+			virtual bool set_do_variable_blocksize(bool value);             ///< See FLAC__stream_encoder_set_do_variable_blocksize()
+			virtual bool set_threaded_verify(bool value);                   ///< See FLAC__stream_encoder_set_threaded_verify()
+			virtual bool set_threaded_md5(bool value);                      ///< See FLAC__stream_encoder_set_threaded_md5()
 
 			/* get_state() is not virtual since we want subclasses to be able to return their own state */
 			State get_state() const;                                   ///< See FLAC__stream_encoder_get_state()
@@ -169,6 +174,11 @@ namespace FLAC {
 			virtual unsigned get_max_residual_partition_order() const; ///< See FLAC__stream_encoder_get_max_residual_partition_order()
 			virtual unsigned get_rice_parameter_search_dist() const;   ///< See FLAC__stream_encoder_get_rice_parameter_search_dist()
 			virtual FLAC__uint64 get_total_samples_estimate() const;   ///< See FLAC__stream_encoder_get_total_samples_estimate()
+			virtual unsigned get_num_threads() const;                  ///< See FLAC__stream_encoder_get_num_threads()
+			virtual bool     get_do_parallel_subframes() const;        ///< See FLAC__stream_encoder_get_do_parallel_subframes()
+			virtual bool     get_do_variable_blocksize() const;        ///< See FLAC__stream_encoder_get_do_variable_blocksize()
+			virtual bool     get_threaded_verify() const;              ///< See FLAC__stream_encoder_get_threaded_verify()
+			virtual bool     get_threaded_md5() const;                 ///< See FLAC__stream_encoder_get_threaded_md5()
 
 			virtual ::FLAC__StreamEncoderInitStatus init();            ///< See FLAC__stream_encoder_init_stream()
 			virtual ::FLAC__StreamEncoderInitStatus init_ogg();        ///< See FLAC__stream_encoder_init_ogg_stream()
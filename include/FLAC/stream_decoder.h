@@ -88,9 +88,11 @@ extern "C" {
  * - The program initializes the instance to validate the settings and
  *   prepare for decoding using
  *   - FLAC__stream_decoder_init_stream() or FLAC__stream_decoder_init_FILE()
- *     or FLAC__stream_decoder_init_file() for native FLAC,
+ *     or FLAC__stream_decoder_init_file() or FLAC__stream_decoder_init_memory()
+ *     or FLAC__stream_decoder_init_mapped_file() for native FLAC,
  *   - FLAC__stream_decoder_init_ogg_stream() or FLAC__stream_decoder_init_ogg_FILE()
- *     or FLAC__stream_decoder_init_ogg_file() for Ogg FLAC
+ *     or FLAC__stream_decoder_init_ogg_file() or FLAC__stream_decoder_init_ogg_memory()
+ *     or FLAC__stream_decoder_init_ogg_mapped_file() for Ogg FLAC
  * - The program calls the FLAC__stream_decoder_process_*() functions
  *   to decode data, which subsequently calls the callbacks.
  * - The program finishes the decoding with FLAC__stream_decoder_finish(),
@@ -104,9 +106,10 @@ extern "C" {
  * functions to override the default decoder options, and call
  * one of the FLAC__stream_decoder_init_*() functions.
  *
- * There are three initialization functions for native FLAC, one for
+ * There are five initialization functions for native FLAC, one for
  * setting up the decoder to decode FLAC data from the client via
- * callbacks, and two for decoding directly from a FLAC file.
+ * callbacks, three for decoding directly from a FLAC file, and one for
+ * decoding from memory.
  *
  * For decoding via callbacks, use FLAC__stream_decoder_init_stream().
  * You must also supply several callbacks for handling I/O.  Some (like
@@ -115,9 +118,14 @@ extern "C" {
  * For decoding directly from a file, use FLAC__stream_decoder_init_FILE()
  * or FLAC__stream_decoder_init_file().  Then you must only supply an open
  * \c FILE* or filename and fewer callbacks; the decoder will handle
- * the other callbacks internally.
+ * the other callbacks internally.  FLAC__stream_decoder_init_mapped_file()
+ * maps the file into memory where it can instead of reading it.
  *
- * There are three similarly-named init functions for decoding from Ogg
+ * For decoding a stream the client already has in memory, use
+ * FLAC__stream_decoder_init_memory().  The decoder reads and seeks in
+ * the buffer directly, without copying it through I/O callbacks.
+ *
+ * There are five similarly-named init functions for decoding from Ogg
  * FLAC streams.  Check \c FLAC_API_SUPPORTS_OGG_FLAC to find out if the
  * library has been built with Ogg support.
  *
@@ -138,6 +146,10 @@ extern "C" {
  *   FLAC__STREAM_DECODER_READ_STATUS_ABORT.  The client will get one metadata,
  *   write, or error callback per metadata block, audio frame, or sync error,
  *   respectively.
+ * - FLAC__stream_decoder_scan_until_end_of_stream() - Tells the decoder to
+ *   find where the rest of the frames are and how many samples they hold,
+ *   without decoding them.  This is much faster than decoding, for when
+ *   only the layout of the stream is needed.
  *
  * When the decoder has finished decoding (normally or through an abort),
  * the instance is finished by calling FLAC__stream_decoder_finish(), which
@@ -151,6 +163,13 @@ extern "C" {
  * Subsequently, the first time the write callback is called it will be
  * passed a (possibly partial) block starting at that sample.
  *
+ * With FLAC__stream_decoder_set_frame_index(), the decoder remembers where
+ * every frame it decodes starts, so later seeks into that part of the
+ * stream go straight to the right frame instead of searching for it.  The
+ * index can be saved to a file with FLAC__stream_decoder_save_frame_index()
+ * and loaded the next time the stream is opened with
+ * FLAC__stream_decoder_load_frame_index().
+ *
  * If the client cannot seek via the callback interface provided, but still
  * has another way of seeking, it can flush the decoder using
  * FLAC__stream_decoder_flush() and start feeding data from the new position
@@ -448,6 +467,44 @@ typedef enum {
 extern FLAC_API const char * const FLAC__StreamDecoderErrorStatusString[];
 
 
+/** Interleaved PCM formats the decoder can convert each frame to, see
+ *  FLAC__stream_decoder_set_pcm_format().
+ */
+typedef enum {
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_NONE = 0,
+	/**< No conversion; only the usual \c FLAC__int32 buffers are given to
+	 * the write callback.
+	 */
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_S16LE,
+	/**< Signed 16-bit samples, little-endian. */
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_S16BE,
+	/**< Signed 16-bit samples, big-endian. */
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_S24LE,
+	/**< Signed 24-bit samples packed into 3 bytes, little-endian. */
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_S24BE,
+	/**< Signed 24-bit samples packed into 3 bytes, big-endian. */
+
+	FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT
+	/**< 32-bit floats in host byte order, from -1.0 to just under 1.0.
+	 * Not available if libFLAC was built with
+	 * \c FLAC__INTEGER_ONLY_LIBRARY.
+	 */
+
+} FLAC__StreamDecoderPCMFormat;
+
+/** Maps a FLAC__StreamDecoderPCMFormat to a C string.
+ *
+ *  Using a FLAC__StreamDecoderPCMFormat as the index to this array
+ *  will give the string equivalent.  The contents should not be modified.
+ */
+extern FLAC_API const char * const FLAC__StreamDecoderPCMFormatString[];
+
+
 /***********************************************************************
  *
  * class FLAC__StreamDecoder
@@ -726,6 +783,31 @@ typedef void (*FLAC__StreamDecoderMetadataCallback)(const FLAC__StreamDecoder *d
  */
 typedef void (*FLAC__StreamDecoderErrorCallback)(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
 
+/** Signature for the scan callback.
+ *
+ *  A function pointer matching this signature is passed to
+ *  FLAC__stream_decoder_scan_until_end_of_stream().  The supplied function
+ *  will be called for each frame found in the stream, in stream order,
+ *  with the frame's header and where it is in the stream.
+ *
+ * \note In general, FLAC__StreamDecoder functions which change the
+ * state should not be called on the \a decoder while in the callback.
+ *
+ * \param  decoder       The decoder instance calling the callback.
+ * \param  header        The header of the frame.  The frame number is
+ *                       always given as a sample number.
+ * \param  frame_offset  The byte offset of the first byte of the frame
+ *                       in the stream, as FLAC__stream_decoder_get_decode_position()
+ *                       would return it just before the frame.
+ * \param  frame_bytes   The size of the frame in bytes.
+ * \param  client_data   The callee's client data set through
+ *                       FLAC__stream_decoder_init_*().
+ * \retval FLAC__bool
+ *    \c true to continue scanning, or \c false to stop.  The decoder
+ *    will then be in the \c FLAC__STREAM_DECODER_ABORTED state.
+ */
+typedef FLAC__bool (*FLAC__StreamDecoderScanCallback)(const FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data);
+
 
 /***********************************************************************
  *
@@ -797,6 +879,96 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_ogg_serial_number(FLAC__StreamDecod
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_set_md5_checking(FLAC__StreamDecoder *decoder, FLAC__bool value);
 
+/** Set to \c true to compute the MD5 signature (see
+ *  FLAC__stream_decoder_set_md5_checking()) on a thread of its own.
+ *  Each decoded frame is copied and hashed in the background while the
+ *  next one is decoded; the result of the check in
+ *  FLAC__stream_decoder_finish() is the same.  This has no effect if MD5
+ *  checking is off or if libFLAC was built without thread support.
+ *
+ * \default \c false
+ * \param  decoder  A decoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_threaded_md5(FLAC__StreamDecoder *decoder, FLAC__bool value);
+
+/** Set the number of threads to use for decoding.  With more than one
+ *  thread, FLAC__stream_decoder_process_until_end_of_stream() reads the
+ *  input ahead, splits it at frame boundaries (found with the SEEKTABLE
+ *  if there is one) and decodes several parts of it at the same time.
+ *  The frames are passed to the write callback in stream order from the
+ *  thread that called FLAC__stream_decoder_process_until_end_of_stream(),
+ *  which counts as one of the threads, and the frames and errors the
+ *  client gets are the same as with a single thread.  Values above 64
+ *  are treated as 64.
+ *
+ *  The other processing functions always decode in the calling thread.
+ *  While decoding in parallel, the residual and verbatim data pointers
+ *  in the frame passed to the write callback are \c NULL, and
+ *  FLAC__stream_decoder_get_decode_position() does not refer to the
+ *  frame being written.  The setting is ignored (i.e. a single thread is
+ *  used) for Ogg FLAC, for streams without a \c STREAMINFO block, and if
+ *  libFLAC was built without thread support.
+ *
+ * \default \c 1
+ * \param  decoder  A decoder instance to set.
+ * \param  value    The number of threads.  \c 0 is the same as \c 1.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value);
+
+/** Set an interleaved PCM format to convert each decoded frame to.  The
+ *  usual \c FLAC__int32 buffers are still passed to the write callback;
+ *  from within it, the same samples in the given format can be had with
+ *  FLAC__stream_decoder_get_pcm().  The conversion uses SIMD routines
+ *  where the CPU has them.
+ *
+ *  Samples are shifted to the width of the format: left if they are
+ *  narrower, and right if they are wider, i.e. they are truncated
+ *  without dithering.  For \c FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT,
+ *  each sample is divided by 2^(bits-per-sample - 1); this is exact for
+ *  up to 24 bits per sample.
+ *
+ * \default \c FLAC__STREAM_DECODER_PCM_FORMAT_NONE
+ * \param  decoder  A decoder instance to set.
+ * \param  format   See above.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, or if \a format is
+ *    not valid or not available in this build of libFLAC, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_pcm_format(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderPCMFormat format);
+
+/** Set whether the decoder keeps an index of where each frame it
+ *  decodes starts.  FLAC__stream_decoder_seek_absolute() uses the index
+ *  to go straight to a frame it has already seen, and to narrow the
+ *  search for one it hasn't.  The index can be saved and loaded with
+ *  FLAC__stream_decoder_save_frame_index() and
+ *  FLAC__stream_decoder_load_frame_index().
+ *
+ *  Only frames decoded one at a time are indexed, i.e. not those decoded
+ *  in parallel when FLAC__stream_decoder_set_num_threads() is more than
+ *  \c 1.  There is no index for Ogg FLAC streams, and none when the tell
+ *  callback is not supported.
+ *
+ * \default \c false
+ * \param  decoder  A decoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the decoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_index(FLAC__StreamDecoder *decoder, FLAC__bool value);
+
 /** Direct the decoder to pass on all metadata blocks of type \a type.
  *
  * \default By default, only the \c STREAMINFO block is returned via the
@@ -913,6 +1085,80 @@ FLAC_API const char *FLAC__stream_decoder_get_resolved_state_string(const FLAC__
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDecoder *decoder);
 
+/** Get the threaded MD5 flag.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_decoder_set_threaded_md5().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_get_threaded_md5(const FLAC__StreamDecoder *decoder);
+
+/** Get the number of threads setting.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_decoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder);
+
+/** Get the interleaved PCM format setting.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderPCMFormat
+ *    See FLAC__stream_decoder_set_pcm_format().
+ */
+FLAC_API FLAC__StreamDecoderPCMFormat FLAC__stream_decoder_get_pcm_format(const FLAC__StreamDecoder *decoder);
+
+/** Get the frame being written in the format set with
+ *  FLAC__stream_decoder_set_pcm_format().  The channels are interleaved,
+ *  and there are \c blocksize samples per channel as given in the frame
+ *  header passed to the write callback.  Only valid from within the
+ *  write callback; the buffer is overwritten by the next frame.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \param  bytes    If not \c NULL, the size of the PCM data in bytes is
+ *                  stored here.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval const void*
+ *    The PCM data, or \c NULL if no format is set or no frame is being
+ *    written.
+ */
+FLAC_API const void *FLAC__stream_decoder_get_pcm(const FLAC__StreamDecoder *decoder, size_t *bytes);
+
+/** Get the frame index setting.
+ *
+ * \param  decoder  A decoder instance to query.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_decoder_set_frame_index().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_index(const FLAC__StreamDecoder *decoder);
+
+/** Get the frame index built so far.  There is one point per frame, in
+ *  order of ascending sample number, laid out as in a \c SEEKTABLE:
+ *  \a stream_offset is counted from the first byte of the first frame
+ *  and \a frame_samples is the blocksize of the frame.  The points are
+ *  only valid until the next call that decodes, seeks, or loads an
+ *  index.
+ *
+ * \param  decoder     A decoder instance to query.
+ * \param  num_points  The number of points is stored here.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code num_points != NULL \endcode
+ * \retval const FLAC__StreamMetadata_SeekPoint*
+ *    The points, or \c NULL if the index is empty.
+ */
+FLAC_API const FLAC__StreamMetadata_SeekPoint *FLAC__stream_decoder_get_frame_index_points(const FLAC__StreamDecoder *decoder, unsigned *num_points);
+
 /** Get the total number of samples in the stream being decoded.
  *  Will only be valid after decoding has started and will contain the
  *  value from the \c STREAMINFO block.  A value of \c 0 means "unknown".
@@ -1348,6 +1594,180 @@ FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_file(
 	void *client_data
 );
 
+/** Initialize the decoder instance to decode a native FLAC stream held
+ *  in memory.
+ *
+ *  This flavor of initialization sets up the decoder to decode from a
+ *  buffer supplied by the client.  The decoder reads the buffer in place
+ *  and seeks within it without any read, seek, tell, length or eof
+ *  callbacks, so it is the fastest way to decode a stream that is already
+ *  in memory.  The buffer must stay valid and unchanged until
+ *  FLAC__stream_decoder_finish() is called; the decoder does not free it.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  data               The stream.  May only be \c NULL if \a bytes is 0.
+ * \param  bytes              The size of \a data in bytes.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_memory(
+	FLAC__StreamDecoder *decoder,
+	const FLAC__byte *data,
+	size_t bytes,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
+/** Initialize the decoder instance to decode an Ogg FLAC stream held in
+ *  memory.
+ *
+ *  This flavor of initialization sets up the decoder to decode from a
+ *  buffer supplied by the client, as with
+ *  FLAC__stream_decoder_init_memory(); the stream is in an Ogg container.
+ *  The buffer must stay valid and unchanged until
+ *  FLAC__stream_decoder_finish() is called; the decoder does not free it.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  data               The stream.  May only be \c NULL if \a bytes is 0.
+ * \param  bytes              The size of \a data in bytes.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_memory(
+	FLAC__StreamDecoder *decoder,
+	const FLAC__byte *data,
+	size_t bytes,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
+/** Initialize the decoder instance to decode a native FLAC file by
+ *  mapping it into memory.
+ *
+ *  This is like FLAC__stream_decoder_init_file(), but on systems with
+ *  mmap() the file is mapped and decoded in place as with
+ *  FLAC__stream_decoder_init_memory(), which saves copying it through
+ *  the stdio buffers.  The mapping is removed by
+ *  FLAC__stream_decoder_finish().  If the file cannot be mapped, e.g.
+ *  because it is not a regular file, or mmap() is not available, it is
+ *  read with stdio as FLAC__stream_decoder_init_file() would.
+ *
+ *  \note
+ *  As with any mapped file, if the file is truncated by another process
+ *  while it is being decoded, the process may get a \c SIGBUS signal.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  filename           The name of the file to decode from.  Use \c NULL
+ *                            to decode from \c stdin, which is not mapped.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_mapped_file(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
+/** Initialize the decoder instance to decode an Ogg FLAC file by mapping
+ *  it into memory.
+ *
+ *  This is like FLAC__stream_decoder_init_ogg_file(), but maps the file
+ *  where it can, as FLAC__stream_decoder_init_mapped_file() does.
+ *
+ *  This function should be called after FLAC__stream_decoder_new() and
+ *  FLAC__stream_decoder_set_*() but before any of the
+ *  FLAC__stream_decoder_process_*() functions.  Will set and return the
+ *  decoder state, which will be FLAC__STREAM_DECODER_SEARCH_FOR_METADATA
+ *  if initialization succeeded.
+ *
+ * \param  decoder            An uninitialized decoder instance.
+ * \param  filename           The name of the file to decode from.  Use \c NULL
+ *                            to decode from \c stdin, which is not mapped.
+ * \param  write_callback     See FLAC__StreamDecoderWriteCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  metadata_callback  See FLAC__StreamDecoderMetadataCallback.  This
+ *                            pointer may be \c NULL if the callback is not
+ *                            desired.
+ * \param  error_callback     See FLAC__StreamDecoderErrorCallback.  This
+ *                            pointer must not be \c NULL.
+ * \param  client_data        This value will be supplied to callbacks in their
+ *                            \a client_data argument.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__StreamDecoderInitStatus
+ *    \c FLAC__STREAM_DECODER_INIT_STATUS_OK if initialization was successful;
+ *    see FLAC__StreamDecoderInitStatus for the meanings of other return values.
+ */
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_mapped_file(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+);
+
 /** Finish the decoding process.
  *  Flushes the decoding buffer, releases resources, resets the decoder
  *  settings to their defaults, and returns the decoder state to
@@ -1533,6 +1953,41 @@ FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_stream(FLAC__Strea
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_skip_single_frame(FLAC__StreamDecoder *decoder);
 
+/** Find the rest of the frames in the stream without decoding them.
+ *  This is much faster than FLAC__stream_decoder_process_until_end_of_stream()
+ *  or FLAC__stream_decoder_skip_single_frame(), which have to read every
+ *  residual to find where a frame ends.  Instead, the frames are found by
+ *  their headers, and each one is checked by the CRC-16 in its footer.
+ *  The write callback is not called; for each frame, the \a scan_callback
+ *  is called instead.  If the metadata has not been processed yet, it is
+ *  processed first, as by
+ *  FLAC__stream_decoder_process_until_end_of_metadata().
+ *
+ *  A frame whose CRC-16 does not match is still passed on if it is
+ *  followed by the frame that should come next, but the error callback
+ *  gets a \c FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH first.
+ *  Data after the last frame, such as an ID3v1 tag, is skipped.  Frames
+ *  seen are added to the index (see FLAC__stream_decoder_set_frame_index()).
+ *
+ *  As with seeking, MD5 checking is turned off, since no audio is
+ *  decoded.  Ogg FLAC streams cannot be scanned.
+ *
+ * \param  decoder        An initialized decoder instance.
+ * \param  scan_callback  See above.  May be \c NULL.
+ * \param  total_samples  If not \c NULL, the sample number just after the
+ *                        last frame, i.e. the total number of samples in
+ *                        the stream, is stored here.
+ * \assert
+ *    \code decoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if any fatal read or memory allocation error occurred, if
+ *    the scan was stopped by the \a scan_callback, if the stream is Ogg
+ *    FLAC, or if the decoder cannot tell where it is in the stream, else
+ *    \c true; for more information about the decoder, check the decoder
+ *    state with FLAC__stream_decoder_get_state().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_scan_until_end_of_stream(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderScanCallback scan_callback, FLAC__uint64 *total_samples);
+
 /** Flush the input and seek to an absolute sample.
  *  Decoding will resume at the given sample.  Note that because of
  *  this, the next write callback may contain a partial block.  The
@@ -1551,6 +2006,101 @@ FLAC_API FLAC__bool FLAC__stream_decoder_skip_single_frame(FLAC__StreamDecoder *
  */
 FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *decoder, FLAC__uint64 sample);
 
+/** Find the total number of samples in the stream, even if the STREAMINFO
+ *  block does not say, as happens when the encoder could not seek back
+ *  to fill it in.  Instead of decoding the whole stream, the decoder
+ *  reads just the end of it, finds the last frame by its header and the
+ *  CRC-16 in its footer, and takes the total from its sample number and
+ *  block size.  If the metadata has not been processed yet, it is
+ *  processed first, as by
+ *  FLAC__stream_decoder_process_until_end_of_metadata().
+ *
+ *  Afterwards, the decoder is back where it was in the stream, and
+ *  FLAC__stream_decoder_get_total_samples() returns the total found.  As
+ *  with seeking, the client must support seeking the input and telling
+ *  the position, and Ogg FLAC streams are not supported.
+ *
+ * \param  decoder        An initialized decoder instance.
+ * \param  total_samples  Address at which to return the total number of
+ *                        samples in the stream.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code total_samples != NULL \endcode
+ * \retval FLAC__bool
+ *    \c true if successful, else \c false; for more information about
+ *    the decoder, check the decoder state with
+ *    FLAC__stream_decoder_get_state().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_find_total_samples(FLAC__StreamDecoder *decoder, FLAC__uint64 *total_samples);
+
+/** Decode the whole stream only to compute the MD5 signature of the
+ *  audio, e.g. to fill in a STREAMINFO block written by an encoder that
+ *  could not seek back to do so.  Unlike MD5 checking (see
+ *  FLAC__stream_decoder_set_md5_checking()), this works even if the
+ *  signature in the STREAMINFO block is all zeroes.  The write callback
+ *  is not called, but the error callback is.  If the metadata has not
+ *  been processed yet, it is processed first, as by
+ *  FLAC__stream_decoder_process_until_end_of_metadata().
+ *
+ *  Since the signature covers all of the audio, this must be called
+ *  before any frames are decoded.  Afterwards, the decoder is at the
+ *  end of the stream.
+ *
+ * \param  decoder  An initialized decoder instance.
+ * \param  md5sum   Address of a 16-byte buffer in which to return the
+ *                  signature.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code md5sum != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if any frames have already been decoded, if there is no
+ *    STREAMINFO block, or if the whole stream could not be decoded, else
+ *    \c true; for more information about the decoder, check the decoder
+ *    state with FLAC__stream_decoder_get_state().
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_compute_md5_signature(FLAC__StreamDecoder *decoder, FLAC__byte md5sum[16]);
+
+/** Save the frame index built so far to a file.  Along with the points,
+ *  the file records the MD5 signature and total samples from the
+ *  \c STREAMINFO block and the length of the audio data, so that
+ *  FLAC__stream_decoder_load_frame_index() can tell whether it belongs
+ *  to the stream.  If the decoder is still in a metadata state, the
+ *  metadata is processed first.
+ *
+ * \param  decoder   An initialized decoder instance.
+ * \param  filename  The name of the file to write.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code filename != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the stream is Ogg FLAC or has no \c STREAMINFO block,
+ *    or if processing the metadata or writing the file failed, else
+ *    \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_save_frame_index(FLAC__StreamDecoder *decoder, const char *filename);
+
+/** Load a frame index saved with FLAC__stream_decoder_save_frame_index(),
+ *  adding its points to the index.  The index is only loaded if it was
+ *  saved for a stream with the same \c STREAMINFO MD5 signature, total
+ *  samples, and length of audio data.  If the decoder is still in a
+ *  metadata state, the metadata is processed first.
+ *
+ *  The index is used by FLAC__stream_decoder_seek_absolute() even if
+ *  FLAC__stream_decoder_set_frame_index() is off; that only controls
+ *  whether new frames are added as they are decoded.
+ *
+ * \param  decoder   An initialized decoder instance.
+ * \param  filename  The name of the file to read.
+ * \assert
+ *    \code decoder != NULL \endcode
+ *    \code filename != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the stream is Ogg FLAC or has no \c STREAMINFO block,
+ *    if processing the metadata failed, or if the file cannot be read or
+ *    is not an index for this stream, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_decoder_load_frame_index(FLAC__StreamDecoder *decoder, const char *filename);
+
 /* \} */
 
 #ifdef __cplusplus
@@ -1202,6 +1202,133 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_total_samples_estimate(FLAC__Stream
  */
 FLAC_API FLAC__bool FLAC__stream_encoder_set_metadata(FLAC__StreamEncoder *encoder, FLAC__StreamMetadata **metadata, unsigned num_blocks);
 
+/** Set the number of threads to use for encoding.  With more than one
+ *  thread, several blocks are encoded at the same time and the frames
+ *  are written in order as they are finished, so the output is exactly
+ *  the same as with a single thread.  The thread that calls
+ *  FLAC__stream_encoder_process() or
+ *  FLAC__stream_encoder_process_interleaved() counts as one of them;
+ *  the write callback is always called from that thread.  Values above
+ *  64 are treated as 64.
+ *
+ *  Memory use grows with the number of threads, since two blocks per
+ *  thread are buffered.  Loose mid-side stereo makes each frame depend
+ *  on the one before, so with it the threads are only used if parallel
+ *  subframes are enabled; see
+ *  FLAC__stream_encoder_set_do_parallel_subframes().  The setting is
+ *  ignored (i.e. a single thread is used) if libFLAC was built without
+ *  thread support.
+ *
+ * \default \c 1
+ * \param  encoder  An encoder instance to set.
+ * \param  value    The number of threads.  \c 0 is the same as \c 1.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value);
+
+/** Set to \c true to use the threads set with
+ *  FLAC__stream_encoder_set_num_threads() to search the subframes of
+ *  each frame in parallel instead of encoding several frames at once.
+ *  The independent channels and, with mid-side stereo, the mid and
+ *  side candidates are searched at the same time, then the best
+ *  combination is chosen as usual.  Every frame is then written before
+ *  FLAC__stream_encoder_process() or
+ *  FLAC__stream_encoder_process_interleaved() returns, which keeps the
+ *  latency as low as with a single thread, e.g. for live encoding.
+ *  The speedup is limited by the number of channels (plus 2 for
+ *  stereo with mid-side).  The output is the same as with a single
+ *  thread.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_do_parallel_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
+/** Set to \c true to let the encoder vary the blocksize from frame to
+ *  frame.  Each pair of blocks of the size set with
+ *  FLAC__stream_encoder_set_blocksize() is also encoded as one frame,
+ *  and the merged frame is kept where it is smaller.  Each block is
+ *  checked for transients with a cheap detector; where one is found,
+ *  its halves and quarters are encoded as well.  The combination of
+ *  frames that codes the audio in the fewest bits, counting each
+ *  frame's header, is kept.  Encoding takes about twice as long as
+ *  with a fixed blocksize, since every block is encoded at least twice.
+ *
+ *  Frames carry their first sample number instead of a frame number,
+ *  as the format requires for variable blocksize streams.  That costs
+ *  one to three bytes more per frame, which merging normally more than
+ *  makes up for.  Blocks are only merged where the frame would be no
+ *  longer than FLAC__MAX_BLOCK_SIZE and, for a Subset stream, than the
+ *  Subset allows; the default blocksize with this option is 2304
+ *  instead of 4096 for Subset streams up to 48kHz for this reason.
+ *  With a blocksize too large to merge, audio without transients comes
+ *  out a little larger than with a fixed blocksize.
+ *
+ *  Blocks are only split into parts that are a multiple of 16 samples
+ *  and longer than the maximum LPC order, so small or odd blocksizes
+ *  may not be split or merged at all.  The blocksizes actually used are
+ *  reported in the STREAMINFO block.  All FLAC decoders handle variable
+ *  blocksize streams, but some hardware players are known not to.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_do_variable_blocksize(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
+/** Set to \c true to run the verify decoder (see
+ *  FLAC__stream_encoder_set_verify()) on a thread of its own instead of
+ *  after each frame is written.  Encoding and verification then overlap,
+ *  so verify costs little extra wall time when there is a spare CPU.
+ *  The verify thread may fall up to a few frames behind; a mismatch is
+ *  reported by the first FLAC__stream_encoder_process() or
+ *  FLAC__stream_encoder_process_interleaved() call that writes a frame
+ *  after it is found, and at the latest by FLAC__stream_encoder_finish().
+ *  In either case FLAC__stream_encoder_get_verify_decoder_error_stats()
+ *  describes the mismatch as usual.  The setting has no effect unless
+ *  verify is also set, or if libFLAC was built without thread support.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_threaded_verify(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
+/** Set to \c true to compute the MD5 signature (see
+ *  FLAC__stream_encoder_set_do_md5()) on a thread of its own.  Each
+ *  block of input is copied and hashed in the background while the
+ *  next one is encoded; the signature written to STREAMINFO is the
+ *  same.  This pays off when there is a spare CPU and the input is
+ *  wide, e.g. 24-bit multichannel, where MD5 is a noticeable part of
+ *  the encoding time.  The setting has no effect if libFLAC was built
+ *  without thread support.
+ *
+ * \default \c false
+ * \param  encoder  An encoder instance to set.
+ * \param  value    Flag value (see above).
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    \c false if the encoder is already initialized, else \c true.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_set_threaded_md5(FLAC__StreamEncoder *encoder, FLAC__bool value);
+
 /** Get the current encoder state.
  *
  * \param  encoder  An encoder instance to query.
@@ -1429,6 +1556,56 @@ FLAC_API unsigned FLAC__stream_encoder_get_rice_parameter_search_dist(const FLAC
  */
 FLAC_API FLAC__uint64 FLAC__stream_encoder_get_total_samples_estimate(const FLAC__StreamEncoder *encoder);
 
+/** Get the number of threads setting.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval unsigned
+ *    See FLAC__stream_encoder_set_num_threads().
+ */
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder);
+
+/** Get the parallel subframes flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_do_parallel_subframes().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_do_parallel_subframes(const FLAC__StreamEncoder *encoder);
+
+/** Get the variable blocksize flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_do_variable_blocksize().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_do_variable_blocksize(const FLAC__StreamEncoder *encoder);
+
+/** Get the threaded verify flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_threaded_verify().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_threaded_verify(const FLAC__StreamEncoder *encoder);
+
+/** Get the threaded MD5 flag.
+ *
+ * \param  encoder  An encoder instance to query.
+ * \assert
+ *    \code encoder != NULL \endcode
+ * \retval FLAC__bool
+ *    See FLAC__stream_encoder_set_threaded_md5().
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_get_threaded_md5(const FLAC__StreamEncoder *encoder);
+
 /** Initialize the encoder instance to encode native FLAC streams.
  *
  *  This flavor of initialization sets up the encoder to encode to a
@@ -76,6 +76,14 @@
 #define inline __inline
 #endif
 
+#if defined _MSC_VER
+#define FLAC__ALWAYS_INLINE __forceinline
+#elif defined __GNUC__
+#define FLAC__ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define FLAC__ALWAYS_INLINE inline
+#endif
+
 #if defined __INTEL_COMPILER || (defined _MSC_VER && defined _WIN64)
 /* MSVS generates VERY slow 32-bit code with __restrict */
 #define flac_restrict __restrict
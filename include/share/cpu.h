@@ -0,0 +1,70 @@
+/* cpu.h - Run-time detection of x86 SIMD extensions for the tools and the share libraries
+ * Copyright (C) 2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* It is assumed that this header will be included after "config.h". */
+
+/* libFLAC's own CPU detection is private to the library, so code outside
+ * it uses this instead.  Only GCC 4.9+ and clang are supported: they can
+ * compile single functions for an instruction set with the target attribute
+ * and have __builtin_cpu_supports().  Elsewhere SHARE__X86_SIMD is not
+ * defined and all the extensions are reported as missing.
+ */
+
+#ifndef SHARE__CPU_H
+#define SHARE__CPU_H
+
+#include "FLAC/ordinals.h"
+
+#if !defined FLAC__NO_ASM && (defined FLAC__CPU_IA32 || defined FLAC__CPU_X86_64) && defined FLAC__HAS_X86INTRIN && \
+	(defined __clang__ || (defined __GNUC__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SHARE__X86_SIMD 1
+#define SHARE__SIMD_TARGET(x) __attribute__ ((__target__ (x)))
+#endif
+
+typedef struct {
+	FLAC__bool sse2;
+	FLAC__bool ssse3;
+	FLAC__bool avx2;
+} share__CPUInfo;
+
+static inline void share__cpu_info(share__CPUInfo *info)
+{
+#ifdef SHARE__X86_SIMD
+	/* __builtin_cpu_supports() also checks that the OS saves the AVX registers */
+	info->sse2 = __builtin_cpu_supports("sse2")? true : false;
+	info->ssse3 = __builtin_cpu_supports("ssse3")? true : false;
+	info->avx2 = __builtin_cpu_supports("avx2")? true : false;
+#else
+	info->sse2 = info->ssse3 = info->avx2 = false;
+#endif
+}
+
+#endif
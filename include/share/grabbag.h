@@ -23,8 +23,10 @@
 /* These can't be included by themselves, only from within grabbag.h */
 #include "grabbag/cuesheet.h"
 #include "grabbag/file.h"
+#include "grabbag/loudness.h"
 #include "grabbag/picture.h"
 #include "grabbag/replaygain.h"
 #include "grabbag/seektable.h"
+#include "grabbag/splice.h"
 
 #endif
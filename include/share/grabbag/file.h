@@ -31,6 +31,7 @@
 
 #include <sys/types.h> /* for off_t */
 #include <stdio.h> /* for FILE */
+#include "FLAC/metadata.h"
 #include "FLAC/ordinals.h"
 #include "share/compat.h"
 
@@ -54,6 +55,15 @@ FLAC__bool grabbag__file_are_same(const char *f1, const char *f2);
 /* attempts to make writable before unlinking */
 FLAC__bool grabbag__file_remove_file(const char *filename);
 
+/* Reads the metadata of a FLAC file into a new chain and points 'block' at
+ * its VORBIS_COMMENT block, adding an empty one if there is none.  After the
+ * block has been changed grabbag__file_write_metadata_chain() writes the
+ * chain back to the file and deletes it.  Both return an error string on
+ * error (with the chain deleted), or NULL if successful.
+ */
+const char *grabbag__file_read_vorbis_comment(const char *filename, FLAC__Metadata_Chain **chain, FLAC__StreamMetadata **block);
+const char *grabbag__file_write_metadata_chain(const char *filename, FLAC__Metadata_Chain *chain, FLAC__bool preserve_modtime);
+
 /* these will forcibly set stdin/stdout to binary mode (for OSes that require it) */
 FILE *grabbag__file_get_binary_stdin(void);
 FILE *grabbag__file_get_binary_stdout(void);
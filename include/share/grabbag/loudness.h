@@ -0,0 +1,95 @@
+/* grabbag - Convenience lib for various routines common to several tools
+ * Copyright (C) 2014  Xiph.Org Foundation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Loudness measurement after EBU R128: integrated loudness and loudness
+ * range (EBU Tech 3341/3342) from K-weighted, gated blocks, and the maximum
+ * true peak, all as specified in ITU-R BS.1770.  The samples are fed in as
+ * they are encoded or decoded, like with grabbag__replaygain_analyze().
+ */
+
+/* This .h cannot be included by itself; #include "share/grabbag.h" instead. */
+
+#ifndef GRABBAG__LOUDNESS_H
+#define GRABBAG__LOUDNESS_H
+
+#include "FLAC/metadata.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const unsigned GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED;
+
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_LOUDNESS; /* = "R128_TRACK_LOUDNESS" */
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_RANGE; /* = "R128_TRACK_LOUDNESS_RANGE" */
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_TRUE_PEAK; /* = "R128_TRACK_TRUE_PEAK" */
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_LOUDNESS; /* = "R128_ALBUM_LOUDNESS" */
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_RANGE; /* = "R128_ALBUM_LOUDNESS_RANGE" */
+extern const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_TRUE_PEAK; /* = "R128_ALBUM_TRUE_PEAK" */
+
+typedef struct {
+	double integrated; /* in LUFS */
+	double range; /* in LU */
+	double true_peak; /* in dBTP */
+} grabbag__Loudness;
+
+/* Anything quieter than this, e.g. digital silence, is reported at this
+ * level (the absolute gate of BS.1770).
+ */
+#define GRABBAG__LOUDNESS_FLOOR (-70.0)
+
+FLAC__bool grabbag__loudness_is_valid_format(unsigned sample_frequency, unsigned channels);
+
+/* As with grabbag__ReplayGainContext, a context is used by one thread at a
+ * time and holds the title being analyzed and the album it is added to.
+ */
+typedef struct grabbag__LoudnessContext grabbag__LoudnessContext;
+
+/* Returns NULL if out of memory */
+grabbag__LoudnessContext *grabbag__loudness_new(void);
+void grabbag__loudness_delete(grabbag__LoudnessContext *context);
+
+/* The channels are in FLAC's order; the LFE channel of 5.1 and up does not
+ * count and the surround channels are weighted by +1.5 dB.
+ */
+FLAC__bool grabbag__loudness_init(grabbag__LoudnessContext *context, unsigned sample_frequency, unsigned channels);
+
+/* 'bps' must be valid for FLAC, i.e. >=4 and <= 32 */
+void grabbag__loudness_analyze(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned bps, unsigned samples);
+
+void grabbag__loudness_get_album(grabbag__LoudnessContext *context, grabbag__Loudness *album);
+void grabbag__loudness_get_title(grabbag__LoudnessContext *context, grabbag__Loudness *title);
+
+/* Adds the titles that have been finished in 'title' with
+ * grabbag__loudness_get_title() to the album of 'album', which may be a new
+ * context that was never initialized.
+ */
+void grabbag__loudness_merge_album(grabbag__LoudnessContext *album, const grabbag__LoudnessContext *title);
+
+/* These return an error string on error, or NULL if successful */
+const char *grabbag__loudness_store_to_vorbiscomment_album(FLAC__StreamMetadata *block, const grabbag__Loudness *album);
+const char *grabbag__loudness_store_to_vorbiscomment_title(FLAC__StreamMetadata *block, const grabbag__Loudness *title);
+const char *grabbag__loudness_store_to_file_album(const char *filename, const grabbag__Loudness *album, FLAC__bool preserve_modtime);
+const char *grabbag__loudness_store_to_file_title(const char *filename, const grabbag__Loudness *title, FLAC__bool preserve_modtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
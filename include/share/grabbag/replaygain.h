@@ -44,16 +44,34 @@ extern const FLAC__byte * const GRABBAG__REPLAYGAIN_TAG_ALBUM_PEAK; /* = "REPLAY
 
 FLAC__bool grabbag__replaygain_is_valid_sample_frequency(unsigned sample_frequency);
 
-FLAC__bool grabbag__replaygain_init(unsigned sample_frequency);
+/* All the state of an analysis is kept in a context, so that several
+ * analyses can go on at once in different threads.  A context is used by
+ * one thread at a time.
+ */
+typedef struct grabbag__ReplayGainContext grabbag__ReplayGainContext;
+
+/* Returns NULL if out of memory */
+grabbag__ReplayGainContext *grabbag__replaygain_new(void);
+void grabbag__replaygain_delete(grabbag__ReplayGainContext *context);
+
+FLAC__bool grabbag__replaygain_init(grabbag__ReplayGainContext *context, unsigned sample_frequency);
 
 /* 'bps' must be valid for FLAC, i.e. >=4 and <= 32 */
-FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples);
+FLAC__bool grabbag__replaygain_analyze(grabbag__ReplayGainContext *context, const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples);
 
-void grabbag__replaygain_get_album(float *gain, float *peak);
-void grabbag__replaygain_get_title(float *gain, float *peak);
+void grabbag__replaygain_get_album(grabbag__ReplayGainContext *context, float *gain, float *peak);
+void grabbag__replaygain_get_title(grabbag__ReplayGainContext *context, float *gain, float *peak);
+
+/* Adds the titles that have been finished in 'title' with
+ * grabbag__replaygain_get_title() to the album of 'album'.  'album' may
+ * be a new context that was never initialized.  Merging the titles of an
+ * album analyzed in separate contexts gives the same album gain and peak
+ * as analyzing them one after the other in a single context.
+ */
+void grabbag__replaygain_merge_album(grabbag__ReplayGainContext *album, const grabbag__ReplayGainContext *title);
 
 /* These three functions return an error string on error, or NULL if successful */
-const char *grabbag__replaygain_analyze_file(const char *filename, float *title_gain, float *title_peak);
+const char *grabbag__replaygain_analyze_file(grabbag__ReplayGainContext *context, const char *filename, float *title_gain, float *title_peak);
 const char *grabbag__replaygain_store_to_vorbiscomment(FLAC__StreamMetadata *block, float album_gain, float album_peak, float title_gain, float title_peak);
 const char *grabbag__replaygain_store_to_vorbiscomment_reference(FLAC__StreamMetadata *block);
 const char *grabbag__replaygain_store_to_vorbiscomment_album(FLAC__StreamMetadata *block, float album_gain, float album_peak);
@@ -0,0 +1,58 @@
+/* grabbag - Convenience lib for various routines common to several tools
+ * Copyright (C) 2002-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Convenience routines for cutting and joining FLAC files without re-encoding */
+
+/* This .h cannot be included by itself; #include "share/grabbag.h" instead. */
+
+#ifndef GRABBAG__SPLICE_H
+#define GRABBAG__SPLICE_H
+
+#include "FLAC/format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	const char *filename;
+	FLAC__uint64 skip; /* the first sample to copy */
+	FLAC__uint64 until; /* the sample after the last one to copy, or 0 for the end of the stream */
+} grabbag__SpliceSegment;
+
+/* Writes the segments, one after the other, to outfilename ("-" for stdout)
+ * as a single FLAC stream.  Whole frames are copied without being decoded;
+ * only their frame numbers and CRCs are rewritten.  The frames split by a
+ * cut point are decoded and the part that is kept is encoded again with the
+ * given compression level.  All the segments must have the same sample rate,
+ * number of channels and bits per sample.
+ *
+ * The metadata of the first segment's file is copied, except that a
+ * SEEKTABLE is rebuilt (only when writing to a file) and a CUESHEET is
+ * dropped.  The MD5 signature in the STREAMINFO block is left unset.
+ *
+ * Returns an error string on error, or NULL if successful.
+ */
+const char *grabbag__splice(const grabbag__SpliceSegment segments[], unsigned num_segments, const char *outfilename, unsigned compression_level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -46,11 +46,16 @@ typedef float   flac_float_t;         /* Type used for filtering */
 
 extern flac_float_t ReplayGainReferenceLoudness; /* in dB SPL, currently == 89.0 */
 
-int     InitGainAnalysis ( long samplefreq );
+typedef struct ReplayGainContext ReplayGainContext; /* the state of one analysis; see replaygain_analysis.c */
+
+ReplayGainContext* CreateGainAnalysis ( void );
+void    DeleteGainAnalysis ( ReplayGainContext* ctx );
+int     InitGainAnalysis ( ReplayGainContext* ctx, long samplefreq );
 int     ValidGainFrequency ( long samplefreq );
-int     AnalyzeSamples   ( const flac_float_t* left_samples, const flac_float_t* right_samples, size_t num_samples, int num_channels );
-flac_float_t GetTitleGain     ( void );
-flac_float_t GetAlbumGain     ( void );
+int     AnalyzeSamples   ( ReplayGainContext* ctx, const flac_float_t* left_samples, const flac_float_t* right_samples, size_t num_samples, int num_channels );
+flac_float_t GetTitleGain     ( ReplayGainContext* ctx );
+flac_float_t GetAlbumGain     ( const ReplayGainContext* ctx );
+void    MergeAlbumGain   ( ReplayGainContext* album, const ReplayGainContext* title );
 
 #ifdef __cplusplus
 }
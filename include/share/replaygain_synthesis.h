@@ -32,21 +32,31 @@ typedef enum {
 	NOISE_SHAPING_HIGH = 3
 } NoiseShaping;
 
-typedef struct {
+#define FLAC_SHARE__RANDOM_GENERATORS 8
+
+typedef struct DitherContext DitherContext;
+
+struct DitherContext {
 	const float*  FilterCoeff;
 	FLAC__uint64  Mask;
 	double        Add;
 	float         Dither;
-	float         ErrorHistory     [FLAC_SHARE__MAX_SUPPORTED_CHANNELS] [16];  /* 16th order Noise shaping */
+	float         ErrorHistory     [FLAC_SHARE__MAX_SUPPORTED_CHANNELS] [16];  /* 16th order Noise shaping, newest first */
 	float         DitherHistory    [FLAC_SHARE__MAX_SUPPORTED_CHANNELS] [16];
 	int           LastRandomNumber [FLAC_SHARE__MAX_SUPPORTED_CHANNELS];
-	unsigned      LastHistoryIndex;
 	NoiseShaping  ShapingType;
-} DitherContext;
+	FLAC__uint32  RandomState      [2] [FLAC_SHARE__RANDOM_GENERATORS];  /* independent generators, taken in turn */
+	/* the fastest versions for this CPU, set by FLAC__replaygain_synthesis__init_dither_context() */
+	void        (*RandomFill)      (FLAC__uint32 state[2][FLAC_SHARE__RANDOM_GENERATORS], FLAC__int32 out[], unsigned count);
+	void        (*NoiseShape)      (DitherContext *d, unsigned channel, unsigned channels, const double * const in[], const FLAC__int32 * const random[], FLAC__int64 * const out[], unsigned samples);
+};
 
 void FLAC__replaygain_synthesis__init_dither_context(DitherContext *dither, int bits, int shapingtype);
 
-/* scale = (float) pow(10., (double)replaygain * 0.05); */
+/* scale = (float) pow(10., (double)replaygain * 0.05);
+ * When scale is exactly 1.0, without hard_limit and with target_bps >= source_bps,
+ * the samples are passed through as they are, without dithering.
+ */
 size_t FLAC__replaygain_synthesis__apply_gain(FLAC__byte *data_out, FLAC__bool little_endian_data_out, FLAC__bool unsigned_data_out, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, const unsigned source_bps, const unsigned target_bps, const double scale, const FLAC__bool hard_limit, FLAC__bool do_dithering, DitherContext *dither_context);
 
 #endif
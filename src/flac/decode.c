@@ -24,12 +24,24 @@
 #include <errno.h>
 #include <math.h> /* for floor() */
 #include <stdio.h> /* for FILE etc. */
+#include <stdlib.h> /* for malloc() */
 #include <string.h> /* for strcmp(), strerror() */
 #include "FLAC/all.h"
 #include "share/grabbag.h"
 #include "share/replaygain_synthesis.h"
 #include "share/compat.h"
 #include "decode.h"
+#include "pcm.h"
+
+typedef union
+{	/* The arrays defined within this union are all the same size. */
+	FLAC__int8	 s8buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)]; /* WATCHOUT: can be up to 2 megs */
+	FLAC__uint8  u8buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)];
+	FLAC__int16  s16buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int16)];
+	FLAC__uint16 u16buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int16)];
+	FLAC__int32  s32buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS];
+	FLAC__uint32 u32buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS];
+} OutputBuffer;
 
 typedef struct {
 #if FLAC__HAS_OGG
@@ -41,6 +53,7 @@ typedef struct {
 	FileFormat format;
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool continue_through_decode_errors;
+	unsigned num_threads;
 	FLAC__bool channel_map_none;
 
 	struct {
@@ -86,6 +99,9 @@ typedef struct {
 	FLAC__StreamDecoder *decoder;
 
 	FILE *fout;
+	OutputBuffer *ubuf; /* the samples of a frame as they are written; per session so that several files can be decoded at once */
+	flac__PCMPackFunc pack; /* a SIMD routine for write_callback() to use, or NULL */
+	unsigned pack_bps; /* the output bits-per-sample that pack was picked for, or 0 if not picked yet */
 
 	foreign_metadata_t *foreign_metadata; /* NULL unless --keep-foreign-metadata requested */
 	FLAC__off_t fm_offset1, fm_offset2, fm_offset3;
@@ -98,13 +114,12 @@ static FLAC__bool is_big_endian_host_;
 /*
  * local routines
  */
-static FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename);
+static FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, unsigned num_threads, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename);
 static void DecoderSession_destroy(DecoderSession *d, FLAC__bool error_occurred);
 static FLAC__bool DecoderSession_init_decoder(DecoderSession *d, const char *infilename);
 static FLAC__bool DecoderSession_process(DecoderSession *d);
 static int DecoderSession_finish_ok(DecoderSession *d);
 static int DecoderSession_finish_error(DecoderSession *d);
-static FLAC__bool canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input);
 static FLAC__bool write_iff_headers(FILE *f, DecoderSession *decoder_session, FLAC__uint64 samples);
 static FLAC__bool write_riff_wave_fmt_chunk_body(FILE *f, FLAC__bool is_waveformatextensible, unsigned bps, unsigned channels, unsigned sample_rate, FLAC__uint32 channel_mask);
 static FLAC__bool write_aiff_form_comm_chunk(FILE *f, FLAC__uint64 samples, unsigned bps, unsigned channels, unsigned sample_rate);
@@ -159,6 +174,7 @@ int flac__decode_file(const char *infilename, const char *outfilename, FLAC__boo
 			options.format,
 			options.treat_warnings_as_errors,
 			options.continue_through_decode_errors,
+			options.num_threads,
 			options.channel_map_none,
 			options.replaygain_synthesis_spec,
 			analysis_mode,
@@ -183,7 +199,7 @@ int flac__decode_file(const char *infilename, const char *outfilename, FLAC__boo
 	return DecoderSession_finish_ok(&decoder_session);
 }
 
-FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename)
+FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__bool use_first_serial_number, long serial_number, FileFormat format, FLAC__bool treat_warnings_as_errors, FLAC__bool continue_through_decode_errors, unsigned num_threads, FLAC__bool channel_map_none, replaygain_synthesis_spec_t replaygain_synthesis_spec, FLAC__bool analysis_mode, analysis_options aopts, utils__SkipUntilSpecification *skip_specification, utils__SkipUntilSpecification *until_specification, utils__CueSpecification *cue_specification, foreign_metadata_t *foreign_metadata, const char *infilename, const char *outfilename)
 {
 #if FLAC__HAS_OGG
 	d->is_ogg = is_ogg;
@@ -198,6 +214,7 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 	d->format = format;
 	d->treat_warnings_as_errors = treat_warnings_as_errors;
 	d->continue_through_decode_errors = continue_through_decode_errors;
+	d->num_threads = num_threads;
 	d->channel_map_none = channel_map_none;
 	d->replaygain.spec = replaygain_synthesis_spec;
 	d->replaygain.apply = false;
@@ -236,6 +253,9 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 	d->decoder = 0;
 
 	d->fout = 0; /* initialized with an open file later if necessary */
+	d->ubuf = 0;
+	d->pack = 0;
+	d->pack_bps = 0;
 
 	d->foreign_metadata = foreign_metadata;
 
@@ -252,6 +272,11 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 				return false;
 			}
 		}
+		if(!analysis_mode && 0 == (d->ubuf = malloc(sizeof(OutputBuffer)))) {
+			flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for the output buffer\n", d->inbasefilename);
+			DecoderSession_destroy(d, /*error_occurred=*/true);
+			return false;
+		}
 	}
 
 	if(analysis_mode)
@@ -262,6 +287,10 @@ FLAC__bool DecoderSession_construct(DecoderSession *d, FLAC__bool is_ogg, FLAC__
 
 void DecoderSession_destroy(DecoderSession *d, FLAC__bool error_occurred)
 {
+	if(0 != d->ubuf) {
+		free(d->ubuf);
+		d->ubuf = 0;
+	}
 	if(0 != d->fout && d->fout != stdout) {
 #ifdef _WIN32
 		if(!error_occurred) {
@@ -309,6 +338,11 @@ FLAC__bool DecoderSession_init_decoder(DecoderSession *decoder_session, const ch
 	}
 
 	FLAC__stream_decoder_set_md5_checking(decoder_session->decoder, true);
+	/* analysis mode needs the residuals and decode position of each frame */
+	if(!decoder_session->analysis_mode) {
+		FLAC__stream_decoder_set_num_threads(decoder_session->decoder, decoder_session->num_threads);
+		FLAC__stream_decoder_set_threaded_md5(decoder_session->decoder, decoder_session->num_threads > 1);
+	}
 	if (0 != decoder_session->cue_specification)
 		FLAC__stream_decoder_set_metadata_respond(decoder_session->decoder, FLAC__METADATA_TYPE_CUESHEET);
 	if (decoder_session->replaygain.spec.apply || !decoder_session->channel_map_none)
@@ -525,51 +559,6 @@ int DecoderSession_finish_error(DecoderSession *d)
 	return 1;
 }
 
-FLAC__bool canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input)
-{
-	/* convert from mm:ss.sss to sample number if necessary */
-	flac__utils_canonicalize_skip_until_specification(spec, sample_rate);
-
-	/* special case: if "--until=-0", use the special value '0' to mean "end-of-stream" */
-	if(spec->is_relative && spec->value.samples == 0) {
-		spec->is_relative = false;
-		return true;
-	}
-
-	/* in any other case the total samples in the input must be known */
-	if(total_samples_in_input == 0) {
-		flac__utils_printf(stderr, 1, "%s: ERROR, cannot use --until when FLAC metadata has total sample count of 0\n", inbasefilename);
-		return false;
-	}
-
-	FLAC__ASSERT(spec->value_is_samples);
-
-	/* convert relative specifications to absolute */
-	if(spec->is_relative) {
-		if(spec->value.samples <= 0)
-			spec->value.samples += (FLAC__int64)total_samples_in_input;
-		else
-			spec->value.samples += skip;
-		spec->is_relative = false;
-	}
-
-	/* error check */
-	if(spec->value.samples < 0) {
-		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is before beginning of input\n", inbasefilename);
-		return false;
-	}
-	if((FLAC__uint64)spec->value.samples <= skip) {
-		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is before --skip point\n", inbasefilename);
-		return false;
-	}
-	if((FLAC__uint64)spec->value.samples > total_samples_in_input) {
-		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is after end of input\n", inbasefilename);
-		return false;
-	}
-
-	return true;
-}
-
 FLAC__bool write_iff_headers(FILE *f, DecoderSession *decoder_session, FLAC__uint64 samples)
 {
 	const FileFormat format = decoder_session->format;
@@ -1010,15 +999,7 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 	unsigned wide_samples = frame->header.blocksize, wide_sample, sample, channel;
 	unsigned frame_bytes = 0;
 
-	static union
-	{	/* The arrays defined within this union are all the same size. */
-		FLAC__int8	 s8buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)]; /* WATCHOUT: can be up to 2 megs */
-		FLAC__uint8  u8buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int32)];
-		FLAC__int16  s16buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int16)];
-		FLAC__uint16 u16buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS * sizeof(FLAC__int16)];
-		FLAC__int32  s32buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS];
-		FLAC__uint32 u32buffer	[FLAC__MAX_BLOCK_SIZE * FLAC__MAX_CHANNELS];
-	} ubuf;
+	OutputBuffer *ubuf = decoder_session->ubuf;
 
 	size_t bytes_to_write = 0;
 
@@ -1138,9 +1119,13 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 					for(channel = 0; channel < channels; channel++)
 						((FLAC__int32**)buffer)[channel][wide_sample] <<= shift;/*@@@@@@un-const'ing the buffer is hacky but safe*/
 			}
+			if(decoder_session->pack_bps != bps+shift) {
+				decoder_session->pack = flac__pcm_get_pack_func(bps+shift, is_unsigned_samples);
+				decoder_session->pack_bps = bps+shift;
+			}
 			if(decoder_session->replaygain.apply) {
 				bytes_to_write = FLAC__replaygain_synthesis__apply_gain(
-					ubuf.u8buffer,
+					ubuf->u8buffer,
 					!is_big_endian,
 					is_unsigned_samples,
 					buffer,
@@ -1154,19 +1139,24 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 					&decoder_session->replaygain.dither_context
 				);
 			}
+			/* the SIMD routines handle every channel count and byte order */
+			else if(0 != decoder_session->pack) {
+				decoder_session->pack(ubuf->u8buffer, buffer, wide_samples, channels, is_big_endian);
+				bytes_to_write = (size_t)wide_samples * channels * ((bps+shift) / 8);
+			}
 			/* first some special code for common cases */
 			else if(is_big_endian == is_big_endian_host_ && !is_unsigned_samples && channels == 2 && bps+shift == 16) {
-				FLAC__int16 *buf1_ = ubuf.s16buffer + 1;
+				FLAC__int16 *buf1_ = ubuf->s16buffer + 1;
 				if(is_big_endian)
-					memcpy(ubuf.s16buffer, ((FLAC__byte*)(buffer[0]))+2, sizeof(FLAC__int32) * wide_samples - 2);
+					memcpy(ubuf->s16buffer, ((FLAC__byte*)(buffer[0]))+2, sizeof(FLAC__int32) * wide_samples - 2);
 				else
-					memcpy(ubuf.s16buffer, buffer[0], sizeof(FLAC__int32) * wide_samples);
+					memcpy(ubuf->s16buffer, buffer[0], sizeof(FLAC__int32) * wide_samples);
 				for(sample = 0; sample < wide_samples; sample++, buf1_+=2)
 					*buf1_ = (FLAC__int16)buffer[1][sample];
 				bytes_to_write = 4 * sample;
 			}
 			else if(is_big_endian == is_big_endian_host_ && !is_unsigned_samples && channels == 1 && bps+shift == 16) {
-				FLAC__int16 *buf1_ = ubuf.s16buffer;
+				FLAC__int16 *buf1_ = ubuf->s16buffer;
 				for(sample = 0; sample < wide_samples; sample++)
 					*buf1_++ = (FLAC__int16)buffer[0][sample];
 				bytes_to_write = 2 * sample;
@@ -1176,35 +1166,35 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 				if(is_unsigned_samples) {
 					if(channels == 2) {
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
-							ubuf.u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
-							ubuf.u16buffer[sample++] = (FLAC__uint16)(buffer[1][wide_sample] + 0x8000);
+							ubuf->u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
+							ubuf->u16buffer[sample++] = (FLAC__uint16)(buffer[1][wide_sample] + 0x8000);
 						}
 					}
 					else if(channels == 1) {
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							ubuf.u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
+							ubuf->u16buffer[sample++] = (FLAC__uint16)(buffer[0][wide_sample] + 0x8000);
 					}
 					else { /* works for any 'channels' but above flavors are faster for 1 and 2 */
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 							for(channel = 0; channel < channels; channel++, sample++)
-								ubuf.u16buffer[sample] = (FLAC__uint16)(buffer[channel][wide_sample] + 0x8000);
+								ubuf->u16buffer[sample] = (FLAC__uint16)(buffer[channel][wide_sample] + 0x8000);
 					}
 				}
 				else {
 					if(channels == 2) {
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
-							ubuf.s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
-							ubuf.s16buffer[sample++] = (FLAC__int16)(buffer[1][wide_sample]);
+							ubuf->s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
+							ubuf->s16buffer[sample++] = (FLAC__int16)(buffer[1][wide_sample]);
 						}
 					}
 					else if(channels == 1) {
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
-							ubuf.s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
+							ubuf->s16buffer[sample++] = (FLAC__int16)(buffer[0][wide_sample]);
 					}
 					else { /* works for any 'channels' but above flavors are faster for 1 and 2 */
 						for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 							for(channel = 0; channel < channels; channel++, sample++)
-								ubuf.s16buffer[sample] = (FLAC__int16)(buffer[channel][wide_sample]);
+								ubuf->s16buffer[sample] = (FLAC__int16)(buffer[channel][wide_sample]);
 					}
 				}
 				if(is_big_endian != is_big_endian_host_) {
@@ -1212,9 +1202,9 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 					const unsigned bytes = sample * 2;
 					unsigned b;
 					for(b = 0; b < bytes; b += 2) {
-						tmp = ubuf.u8buffer[b];
-						ubuf.u8buffer[b] = ubuf.u8buffer[b+1];
-						ubuf.u8buffer[b+1] = tmp;
+						tmp = ubuf->u8buffer[b];
+						ubuf->u8buffer[b] = ubuf->u8buffer[b+1];
+						ubuf->u8buffer[b+1] = tmp;
 					}
 				}
 				bytes_to_write = 2 * sample;
@@ -1223,24 +1213,24 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 				if(is_unsigned_samples) {
 					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 						for(channel = 0; channel < channels; channel++, sample++)
-							ubuf.u32buffer[sample] = buffer[channel][wide_sample] + 0x800000;
+							ubuf->u32buffer[sample] = buffer[channel][wide_sample] + 0x800000;
 				}
 				else {
 					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 						for(channel = 0; channel < channels; channel++, sample++)
-							ubuf.s32buffer[sample] = buffer[channel][wide_sample];
+							ubuf->s32buffer[sample] = buffer[channel][wide_sample];
 				}
 				if(is_big_endian != is_big_endian_host_) {
 					unsigned char tmp;
 					const unsigned bytes = sample * 4;
 					unsigned b;
 					for(b = 0; b < bytes; b += 4) {
-						tmp = ubuf.u8buffer[b];
-						ubuf.u8buffer[b] = ubuf.u8buffer[b+3];
-						ubuf.u8buffer[b+3] = tmp;
-						tmp = ubuf.u8buffer[b+1];
-						ubuf.u8buffer[b+1] = ubuf.u8buffer[b+2];
-						ubuf.u8buffer[b+2] = tmp;
+						tmp = ubuf->u8buffer[b];
+						ubuf->u8buffer[b] = ubuf->u8buffer[b+3];
+						ubuf->u8buffer[b+3] = tmp;
+						tmp = ubuf->u8buffer[b+1];
+						ubuf->u8buffer[b+1] = ubuf->u8buffer[b+2];
+						ubuf->u8buffer[b+2] = tmp;
 					}
 				}
 				if(is_big_endian) {
@@ -1248,18 +1238,18 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 					const unsigned bytes = sample * 4;
 					for(lbyte = b = 0; b < bytes; ) {
 						b++;
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
 					}
 				}
 				else {
 					unsigned b, lbyte;
 					const unsigned bytes = sample * 4;
 					for(lbyte = b = 0; b < bytes; ) {
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
-						ubuf.u8buffer[lbyte++] = ubuf.u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
+						ubuf->u8buffer[lbyte++] = ubuf->u8buffer[b++];
 						b++;
 					}
 				}
@@ -1269,12 +1259,12 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 				if(is_unsigned_samples) {
 					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 						for(channel = 0; channel < channels; channel++, sample++)
-							ubuf.u8buffer[sample] = (FLAC__uint8)(buffer[channel][wide_sample] + 0x80);
+							ubuf->u8buffer[sample] = (FLAC__uint8)(buffer[channel][wide_sample] + 0x80);
 				}
 				else {
 					for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 						for(channel = 0; channel < channels; channel++, sample++)
-							ubuf.s8buffer[sample] = (FLAC__int8)(buffer[channel][wide_sample]);
+							ubuf->s8buffer[sample] = (FLAC__int8)(buffer[channel][wide_sample]);
 				}
 				bytes_to_write = sample;
 			}
@@ -1287,7 +1277,7 @@ FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder
 		}
 	}
 	if(bytes_to_write > 0) {
-		if(flac__utils_fwrite(ubuf.u8buffer, 1, bytes_to_write, fout) != bytes_to_write) {
+		if(flac__utils_fwrite(ubuf->u8buffer, 1, bytes_to_write, fout) != bytes_to_write) {
 			/* if a pipe closed when writing to stdout, we let it go without an error message */
 			if(errno == EPIPE && decoder_session->fout == stdout)
 				decoder_session->aborting_due_to_until = true;
@@ -1332,7 +1322,7 @@ void metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMet
 		decoder_session->total_samples = metadata->data.stream_info.total_samples - skip;
 
 		/* note that we use metadata->data.stream_info.total_samples instead of decoder_session->total_samples */
-		if(!canonicalize_until_specification(decoder_session->until_specification, decoder_session->inbasefilename, decoder_session->sample_rate, skip, metadata->data.stream_info.total_samples)) {
+		if(!flac__utils_canonicalize_until_specification(decoder_session->until_specification, decoder_session->inbasefilename, decoder_session->sample_rate, skip, metadata->data.stream_info.total_samples)) {
 			decoder_session->abort_flag = true;
 			return;
 		}
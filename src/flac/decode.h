@@ -41,6 +41,7 @@ typedef struct {
 typedef struct {
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool continue_through_decode_errors;
+	unsigned num_threads;
 	replaygain_synthesis_spec_t replaygain_synthesis_spec;
 #if FLAC__HAS_OGG
 	FLAC__bool is_ogg;
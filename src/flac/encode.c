@@ -28,6 +28,12 @@
 #include <stdlib.h> /* for malloc */
 #include <string.h> /* for strcmp(), strerror() */
 #include <sys/stat.h>
+#ifdef HAVE_POSIX_FADVISE
+#include <fcntl.h> /* for posix_fadvise() */
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "FLAC/all.h"
 #include "share/alloc.h"
 #include "share/grabbag.h"
@@ -35,6 +41,7 @@
 #include "share/private.h"
 #include "share/safe_str.h"
 #include "encode.h"
+#include "pcm.h"
 
 #ifdef min
 #undef min
@@ -48,6 +55,7 @@
 /* this MUST be >= 588 so that sector aligning can take place with one read */
 /* this MUST be < 2^sizeof(size_t) / ( FLAC__MAX_CHANNELS * (FLAC__MAX_BITS_PER_SAMPLE/8) ) */
 #define CHUNK_OF_SAMPLES 2048
+#define CHUNK_OF_BYTES (CHUNK_OF_SAMPLES*FLAC__MAX_CHANNELS*((FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE+7)/8))
 
 typedef struct {
 	unsigned sample_rate;
@@ -71,6 +79,36 @@ typedef struct {
 	FLAC__bool fatal_error;
 } FLACDecoderData;
 
+/* one chunk of raw input samples as read from the file */
+typedef union {
+	FLAC__int8 s8[CHUNK_OF_BYTES];
+	FLAC__uint8 u8[CHUNK_OF_BYTES];
+	FLAC__int16 s16[CHUNK_OF_BYTES/2];
+	FLAC__uint16 u16[CHUNK_OF_BYTES/2];
+} InputBuffer;
+
+/* reads the raw PCM input ahead of the encoder, in a thread of its own when
+ * possible, so that reading the next chunk overlaps encoding the current one */
+typedef struct {
+	FILE *f;
+	void *storage; /* unaligned allocation holding the buffers */
+	InputBuffer *buffer[2];
+	size_t length[2];
+	size_t chunk_length; /* bytes per chunk, a multiple of the bytes per wide sample */
+	FLAC__uint64 bytes_left; /* the reader stops here, even if the file goes on */
+	const FLAC__byte *prefix; /* bytes already read from the file that come first */
+	unsigned prefix_length;
+	unsigned next; /* the buffer to be handed out next */
+	FLAC__bool eof, error;
+#ifdef HAVE_PTHREAD
+	FLAC__bool is_threaded, is_full[2], stop;
+	unsigned in_use; /* the buffer held by the caller, or 2 for none */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+} InputReader;
+
 typedef struct {
 #if FLAC__HAS_OGG
 	FLAC__bool use_ogg;
@@ -85,6 +123,9 @@ typedef struct {
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool continue_through_decode_errors;
 	FLAC__bool replay_gain;
+	grabbag__ReplayGainContext *replay_gain_context;
+	FLAC__bool loudness;
+	grabbag__LoudnessContext *loudness_context;
 	FLAC__uint64 total_samples_to_encode; /* (i.e. "wide samples" aka "sample frames") WATCHOUT: may be 0 to mean 'unknown' */
 	FLAC__uint64 unencoded_size; /* an estimate of the input size, only used in the progress indicator */
 	FLAC__uint64 bytes_written;
@@ -110,25 +151,18 @@ typedef struct {
 	FILE *fin;
 	FLAC__StreamMetadata *seek_table_template;
 	double progress, compression_ratio;
+
+	/* kept per session rather than static so that several files can be encoded at once */
+	InputReader reader;
+	flac__PCMUnpackFunc unpack; /* a SIMD routine for format_input() to use, or NULL */
+	FLAC__int32 in[FLAC__MAX_CHANNELS][CHUNK_OF_SAMPLES];
+	FLAC__int32 *input[FLAC__MAX_CHANNELS];
 } EncoderSession;
 
 const int FLAC_ENCODE__DEFAULT_PADDING = 8192;
 
 static FLAC__bool is_big_endian_host_;
 
-static FLAC__int8 static_buffer[CHUNK_OF_SAMPLES*FLAC__MAX_CHANNELS*((FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE+7)/8)];
-
-static union {
-	FLAC__int8 *s8;
-	FLAC__uint8 *u8;
-	FLAC__int16 *s16;
-	FLAC__uint16 *u16;
-} ubuffer = { static_buffer };
-
-
-static FLAC__int32 in_[FLAC__MAX_CHANNELS][CHUNK_OF_SAMPLES];
-static FLAC__int32 *input_[FLAC__MAX_CHANNELS];
-
 
 /*
  * local routines
@@ -143,7 +177,10 @@ static FLAC__bool EncoderSession_format_is_iff(const EncoderSession *e);
 static FLAC__bool convert_to_seek_table_template(const char *requested_seek_points, int num_requested_seek_points, FLAC__StreamMetadata *cuesheet, EncoderSession *e);
 static FLAC__bool canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input);
 static FLAC__bool verify_metadata(const EncoderSession *e, FLAC__StreamMetadata **metadata, unsigned num_metadata);
-static FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map);
+static FLAC__bool InputReader_start(InputReader *r, FILE *f, size_t chunk_length, FLAC__uint64 max_bytes, const FLAC__byte *prefix, unsigned prefix_length);
+static size_t InputReader_read(InputReader *r, InputBuffer **buffer);
+static void InputReader_finish(InputReader *r);
+static FLAC__bool format_input(InputBuffer *ubuffer, flac__PCMUnpackFunc unpack, FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map);
 static void encoder_progress_callback(const FLAC__StreamEncoder *encoder, FLAC__uint64 bytes_written, FLAC__uint64 samples_written, unsigned frames_written, unsigned total_frames_estimate, void *client_data);
 static FLAC__StreamDecoderReadStatus flac_decoder_read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 static FLAC__StreamDecoderSeekStatus flac_decoder_seek_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -1280,79 +1317,57 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 		/*
 		 * now do samples from the file
 		 */
+		encoder_session.unpack = flac__pcm_get_unpack_func(encoder_session.info.bits_per_sample, encoder_session.info.is_unsigned_samples);
 		switch(options.format) {
 			case FORMAT_RAW:
 				if(infilesize < 0) {
 					size_t bytes_read;
-					while(!feof(infile)) {
-						if(lookahead_length > 0) {
-							FLAC__ASSERT(lookahead_length < CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample);
-							memcpy(ubuffer.u8, lookahead, lookahead_length);
-							bytes_read = fread(ubuffer.u8+lookahead_length, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample - lookahead_length, infile) + lookahead_length;
-							if(ferror(infile)) {
-								flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
-								return EncoderSession_finish_error(&encoder_session);
-							}
-							lookahead_length = 0;
-						}
-						else
-							bytes_read = fread(ubuffer.u8, sizeof(unsigned char), CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, infile);
-
-						if(bytes_read == 0) {
-							if(ferror(infile)) {
-								flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
-								return EncoderSession_finish_error(&encoder_session);
-							}
-						}
-						else if(bytes_read % encoder_session.info.bytes_per_wide_sample != 0) {
+					InputBuffer *ubuffer;
+					FLAC__ASSERT(lookahead_length < CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample);
+					if(!InputReader_start(&encoder_session.reader, infile, CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, (FLAC__uint64)(-1), lookahead, lookahead_length)) {
+						flac__utils_printf(stderr, 1, "%s: ERROR starting the input reader\n", encoder_session.inbasefilename);
+						return EncoderSession_finish_error(&encoder_session);
+					}
+					while((bytes_read = InputReader_read(&encoder_session.reader, &ubuffer)) > 0) {
+						if(bytes_read % encoder_session.info.bytes_per_wide_sample != 0) {
 							flac__utils_printf(stderr, 1, "%s: ERROR: got partial sample\n", encoder_session.inbasefilename);
 							return EncoderSession_finish_error(&encoder_session);
 						}
 						else {
 							unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-							if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+							if(!format_input(ubuffer, encoder_session.unpack, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 								return EncoderSession_finish_error(&encoder_session);
 
-							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 								print_error_with_state(&encoder_session, "ERROR during encoding");
 								return EncoderSession_finish_error(&encoder_session);
 							}
 						}
 					}
+					if(encoder_session.reader.error) {
+						flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
+						return EncoderSession_finish_error(&encoder_session);
+					}
 				}
 				else {
 					size_t bytes_read;
+					InputBuffer *ubuffer;
 					const FLAC__uint64 max_input_bytes = infilesize;
 					FLAC__uint64 total_input_bytes_read = 0;
+					FLAC__ASSERT(lookahead_length <= max_input_bytes);
+					if(!InputReader_start(&encoder_session.reader, infile, CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, max_input_bytes, lookahead, lookahead_length)) {
+						flac__utils_printf(stderr, 1, "%s: ERROR starting the input reader\n", encoder_session.inbasefilename);
+						return EncoderSession_finish_error(&encoder_session);
+					}
 					while(total_input_bytes_read < max_input_bytes) {
-						{
-							size_t wanted = (CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample);
-							wanted = (size_t) min((FLAC__uint64)wanted, max_input_bytes - total_input_bytes_read);
-
-							if(lookahead_length > 0) {
-								FLAC__ASSERT(lookahead_length <= wanted);
-								memcpy(ubuffer.u8, lookahead, lookahead_length);
-								wanted -= lookahead_length;
-								bytes_read = lookahead_length;
-								if(wanted > 0) {
-									bytes_read += fread(ubuffer.u8+lookahead_length, sizeof(unsigned char), wanted, infile);
-									if(ferror(infile)) {
-										flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
-										return EncoderSession_finish_error(&encoder_session);
-									}
-								}
-								lookahead_length = 0;
-							}
-							else
-								bytes_read = fread(ubuffer.u8, sizeof(unsigned char), wanted, infile);
-						}
+						bytes_read = InputReader_read(&encoder_session.reader, &ubuffer);
 
 						if(bytes_read == 0) {
-							if(ferror(infile)) {
+							if(encoder_session.reader.error) {
 								flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 								return EncoderSession_finish_error(&encoder_session);
 							}
-							else if(feof(infile)) {
+							else if(encoder_session.reader.eof) {
 								flac__utils_printf(stderr, 1, "%s: WARNING: unexpected EOF; expected %" PRIu64 " samples, got %" PRIu64 " samples\n", encoder_session.inbasefilename, encoder_session.total_samples_to_encode, encoder_session.samples_written);
 								if(encoder_session.treat_warnings_as_errors)
 									return EncoderSession_finish_error(&encoder_session);
@@ -1366,10 +1381,10 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 							}
 							else {
 								unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-								if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+								if(!format_input(ubuffer, encoder_session.unpack, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 									return EncoderSession_finish_error(&encoder_session);
 
-								if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+								if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 									print_error_with_state(&encoder_session, "ERROR during encoding");
 									return EncoderSession_finish_error(&encoder_session);
 								}
@@ -1384,18 +1399,19 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 			case FORMAT_RF64:
 			case FORMAT_AIFF:
 			case FORMAT_AIFF_C:
+				if(!InputReader_start(&encoder_session.reader, infile, CHUNK_OF_SAMPLES * encoder_session.info.bytes_per_wide_sample, encoder_session.fmt.iff.data_bytes, 0, 0)) {
+					flac__utils_printf(stderr, 1, "%s: ERROR starting the input reader\n", encoder_session.inbasefilename);
+					return EncoderSession_finish_error(&encoder_session);
+				}
 				while(encoder_session.fmt.iff.data_bytes > 0) {
-					const size_t bytes_to_read = (size_t)min(
-						encoder_session.fmt.iff.data_bytes,
-						(FLAC__uint64)CHUNK_OF_SAMPLES * (FLAC__uint64)encoder_session.info.bytes_per_wide_sample
-					);
-					size_t bytes_read = fread(ubuffer.u8, sizeof(unsigned char), bytes_to_read, infile);
+					InputBuffer *ubuffer;
+					size_t bytes_read = InputReader_read(&encoder_session.reader, &ubuffer);
 					if(bytes_read == 0) {
-						if(ferror(infile)) {
+						if(encoder_session.reader.error) {
 							flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 							return EncoderSession_finish_error(&encoder_session);
 						}
-						else if(feof(infile)) {
+						else if(encoder_session.reader.eof) {
 							if(options.ignore_chunk_sizes) {
 								flac__utils_printf(stderr, 1, "%s: INFO: hit EOF with --ignore-chunk-sizes, got %" PRIu64 " samples\n", encoder_session.inbasefilename, encoder_session.samples_written);
 							}
@@ -1414,10 +1430,10 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 						}
 						else {
 							unsigned wide_samples = bytes_read / encoder_session.info.bytes_per_wide_sample;
-							if(!format_input(input_, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+							if(!format_input(ubuffer, encoder_session.unpack, encoder_session.input, wide_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 								return EncoderSession_finish_error(&encoder_session);
 
-							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+							if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 								print_error_with_state(&encoder_session, "ERROR during encoding");
 								return EncoderSession_finish_error(&encoder_session);
 							}
@@ -1451,6 +1467,8 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 				return EncoderSession_finish_error(&encoder_session);
 		}
 
+		InputReader_finish(&encoder_session.reader);
+
 		/*
 		 * now read unaligned samples into reservoir or pad with zeroes if necessary
 		 */
@@ -1462,9 +1480,9 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 
 					info_align_zero = wide_samples;
 					for(channel = 0; channel < encoder_session.info.channels; channel++)
-						memset(input_[channel], 0, sizeof(input_[0][0]) * wide_samples);
+						memset(encoder_session.input[channel], 0, sizeof(encoder_session.input[0][0]) * wide_samples);
 
-					if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)input_, wide_samples)) {
+					if(!EncoderSession_process(&encoder_session, (const FLAC__int32 * const *)encoder_session.input, wide_samples)) {
 						print_error_with_state(&encoder_session, "ERROR during encoding");
 						return EncoderSession_finish_error(&encoder_session);
 					}
@@ -1474,7 +1492,7 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 				if(*options.align_reservoir_samples > 0) {
 					size_t bytes_read;
 					FLAC__ASSERT(CHUNK_OF_SAMPLES >= 588);
-					bytes_read = fread(ubuffer.u8, sizeof(unsigned char), (*options.align_reservoir_samples) * encoder_session.info.bytes_per_wide_sample, infile);
+					bytes_read = fread(encoder_session.reader.buffer[0]->u8, sizeof(unsigned char), (*options.align_reservoir_samples) * encoder_session.info.bytes_per_wide_sample, infile);
 					if(bytes_read == 0 && ferror(infile)) {
 						flac__utils_printf(stderr, 1, "%s: ERROR during read\n", encoder_session.inbasefilename);
 						return EncoderSession_finish_error(&encoder_session);
@@ -1486,7 +1504,7 @@ int flac__encode_file(FILE *infile, FLAC__off_t infilesize, const char *infilena
 					}
 					else {
 						info_align_carry = *options.align_reservoir_samples;
-						if(!format_input(options.align_reservoir, *options.align_reservoir_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
+						if(!format_input(encoder_session.reader.buffer[0], encoder_session.unpack, options.align_reservoir, *options.align_reservoir_samples, encoder_session.info.is_big_endian, encoder_session.info.is_unsigned_samples, encoder_session.info.channels, encoder_session.info.bits_per_sample, encoder_session.info.shift, channel_map))
 							return EncoderSession_finish_error(&encoder_session);
 					}
 				}
@@ -1514,14 +1532,13 @@ FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options,
 
 	is_big_endian_host_ = (*((FLAC__byte*)(&test)))? false : true;
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
-		input_[i] = &(in_[i][0]);
-
 
 	/*
 	 * initialize instance
 	 */
 
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
+		e->input[i] = &(e->in[i][0]);
 #if FLAC__HAS_OGG
 	e->use_ogg = options.use_ogg;
 #endif
@@ -1577,6 +1594,10 @@ FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options,
 
 	e->fin = infile;
 	e->seek_table_template = 0;
+	e->reader.storage = 0;
+#ifdef HAVE_PTHREAD
+	e->reader.is_threaded = false;
+#endif
 
 	if(0 == (e->seek_table_template = FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE))) {
 		flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for seek table\n", e->inbasefilename);
@@ -1590,6 +1611,15 @@ FLAC__bool EncoderSession_construct(EncoderSession *e, encode_options_t options,
 		return false;
 	}
 
+	/* two buffers so that one can be filled while the other is encoded; 32-byte aligned for SIMD loads */
+	if(0 == (e->reader.storage = malloc(2 * sizeof(InputBuffer) + 31))) {
+		flac__utils_printf(stderr, 1, "%s: ERROR allocating memory for input buffers\n", e->inbasefilename);
+		EncoderSession_destroy(e);
+		return false;
+	}
+	e->reader.buffer[0] = (InputBuffer*)(((size_t)e->reader.storage + 31) & ~(size_t)31);
+	e->reader.buffer[1] = e->reader.buffer[0] + 1;
+
 	return true;
 }
 
@@ -1605,6 +1635,12 @@ void EncoderSession_destroy(EncoderSession *e)
 		e->fmt.flac.client_data.num_metadata_blocks = 0;
 	}
 
+	InputReader_finish(&e->reader);
+	if(0 != e->reader.storage) {
+		free(e->reader.storage);
+		e->reader.storage = 0;
+	}
+
 	if(e->fin != stdin)
 		fclose(e->fin);
 
@@ -1762,6 +1798,9 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 	static_metadata_init(&static_metadata);
 
 	e->replay_gain = options.replay_gain;
+	e->replay_gain_context = options.replay_gain_context;
+	e->loudness = options.loudness;
+	e->loudness_context = options.loudness_context;
 
 	apodizations[0] = '\0';
 
@@ -1774,11 +1813,20 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 			flac__utils_printf(stderr, 1, "%s: ERROR, invalid sample rate (%u) for --replay-gain\n", e->inbasefilename, sample_rate);
 			return false;
 		}
-		if(options.is_first_file) {
-			if(!grabbag__replaygain_init(sample_rate)) {
-				flac__utils_printf(stderr, 1, "%s: ERROR initializing ReplayGain stage\n", e->inbasefilename);
-				return false;
-			}
+		if(!grabbag__replaygain_init(e->replay_gain_context, sample_rate)) {
+			flac__utils_printf(stderr, 1, "%s: ERROR initializing ReplayGain stage\n", e->inbasefilename);
+			return false;
+		}
+	}
+
+	if(e->loudness) {
+		if(!grabbag__loudness_is_valid_format(sample_rate, channels)) {
+			flac__utils_printf(stderr, 1, "%s: ERROR, invalid sample rate (%u) or number of channels (%u) for --loudness\n", e->inbasefilename, sample_rate, channels);
+			return false;
+		}
+		if(!grabbag__loudness_init(e->loudness_context, sample_rate, channels)) {
+			flac__utils_printf(stderr, 1, "%s: ERROR initializing loudness stage\n", e->inbasefilename);
+			return false;
 		}
 	}
 
@@ -1999,6 +2047,8 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 				p = e->total_samples_to_encode / sample_rate < 20*60? FLAC_ENCODE__DEFAULT_PADDING : FLAC_ENCODE__DEFAULT_PADDING*8;
 			if(p > 0)
 				p += (e->replay_gain ? GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED : 0);
+			if(p > 0)
+				p += (e->loudness ? GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED : 0);
 			if(options.padding != 0) {
 				if(p > 0 && flac_decoder_data->num_metadata_blocks < sizeof(flac_decoder_data->metadata_blocks)/sizeof(flac_decoder_data->metadata_blocks[0])) {
 					flac_decoder_data->metadata_blocks[flac_decoder_data->num_metadata_blocks] = FLAC__metadata_object_new(FLAC__METADATA_TYPE_PADDING);
@@ -2055,7 +2105,7 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 		if(options.padding != 0) {
 			padding.is_last = false; /* the encoder will set this for us */
 			padding.type = FLAC__METADATA_TYPE_PADDING;
-			padding.length = (unsigned)(options.padding>0? options.padding : (e->total_samples_to_encode / sample_rate < 20*60? FLAC_ENCODE__DEFAULT_PADDING : FLAC_ENCODE__DEFAULT_PADDING*8)) + (e->replay_gain ? GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED : 0);
+			padding.length = (unsigned)(options.padding>0? options.padding : (e->total_samples_to_encode / sample_rate < 20*60? FLAC_ENCODE__DEFAULT_PADDING : FLAC_ENCODE__DEFAULT_PADDING*8)) + (e->replay_gain ? GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED : 0) + (e->loudness ? GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED : 0);
 			static_metadata_append(&static_metadata, &padding, /*needs_delete=*/false);
 		}
 		metadata = static_metadata.metadata;
@@ -2133,6 +2183,10 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 		FLAC__stream_encoder_set_apodization(e->encoder, apodizations);
 	FLAC__stream_encoder_set_total_samples_estimate(e->encoder, e->total_samples_to_encode);
 	FLAC__stream_encoder_set_metadata(e->encoder, (num_metadata > 0)? metadata : 0, num_metadata);
+	FLAC__stream_encoder_set_num_threads(e->encoder, options.num_threads);
+	FLAC__stream_encoder_set_threaded_verify(e->encoder, options.num_threads > 1);
+	FLAC__stream_encoder_set_threaded_md5(e->encoder, options.num_threads > 1);
+	FLAC__stream_encoder_set_do_variable_blocksize(e->encoder, options.variable_blocksize);
 
 	FLAC__stream_encoder_disable_constant_subframes(e->encoder, options.debug.disable_constant_subframes);
 	FLAC__stream_encoder_disable_fixed_subframes(e->encoder, options.debug.disable_fixed_subframes);
@@ -2181,13 +2235,16 @@ FLAC__bool EncoderSession_init_encoder(EncoderSession *e, encode_options_t optio
 FLAC__bool EncoderSession_process(EncoderSession *e, const FLAC__int32 * const buffer[], unsigned samples)
 {
 	if(e->replay_gain) {
-		if(!grabbag__replaygain_analyze(buffer, e->info.channels==2, e->info.bits_per_sample, samples)) {
+		if(!grabbag__replaygain_analyze(e->replay_gain_context, buffer, e->info.channels==2, e->info.bits_per_sample, samples)) {
 			flac__utils_printf(stderr, 1, "%s: WARNING, error while calculating ReplayGain\n", e->inbasefilename);
 			if(e->treat_warnings_as_errors)
 				return false;
 		}
 	}
 
+	if(e->loudness)
+		grabbag__loudness_analyze(e->loudness_context, buffer, e->info.bits_per_sample, samples);
+
 	return FLAC__stream_encoder_process(e->encoder, buffer, samples);
 }
 
@@ -2344,7 +2401,7 @@ FLAC__bool verify_metadata(const EncoderSession *e, FLAC__StreamMetadata **metad
 	return true;
 }
 
-FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map)
+FLAC__bool format_input(InputBuffer *ubuffer, flac__PCMUnpackFunc unpack, FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples, unsigned channels, unsigned bps, unsigned shift, size_t *channel_map)
 {
 	unsigned wide_sample, sample, channel;
 	FLAC__int32 *out[FLAC__MAX_CHANNELS];
@@ -2358,16 +2415,19 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			out[channel] = dest[channel_map[channel]];
 	}
 
-	if(bps == 8) {
+	if(0 != unpack) {
+		unpack(out, ubuffer->u8, wide_samples, channels, is_big_endian);
+	}
+	else if(bps == 8) {
 		if(is_unsigned_samples) {
 			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)ubuffer.u8[sample] - 0x80;
+					out[channel][wide_sample] = (FLAC__int32)ubuffer->u8[sample] - 0x80;
 		}
 		else {
 			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = (FLAC__int32)ubuffer.s8[sample];
+					out[channel][wide_sample] = (FLAC__int32)ubuffer->s8[sample];
 		}
 	}
 	else if(bps == 16) {
@@ -2376,20 +2436,20 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			const unsigned bytes = wide_samples * channels * (bps >> 3);
 			unsigned b;
 			for(b = 0; b < bytes; b += 2) {
-				tmp = ubuffer.u8[b];
-				ubuffer.u8[b] = ubuffer.u8[b+1];
-				ubuffer.u8[b+1] = tmp;
+				tmp = ubuffer->u8[b];
+				ubuffer->u8[b] = ubuffer->u8[b+1];
+				ubuffer->u8[b+1] = tmp;
 			}
 		}
 		if(is_unsigned_samples) {
 			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = ubuffer.u16[sample] - 0x8000;
+					out[channel][wide_sample] = ubuffer->u16[sample] - 0x8000;
 		}
 		else {
 			for(sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++)
-					out[channel][wide_sample] = ubuffer.s16[sample];
+					out[channel][wide_sample] = ubuffer->s16[sample];
 		}
 	}
 	else if(bps == 24) {
@@ -2398,9 +2458,9 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			const unsigned bytes = wide_samples * channels * (bps >> 3);
 			unsigned b;
 			for(b = 0; b < bytes; b += 3) {
-				tmp = ubuffer.u8[b];
-				ubuffer.u8[b] = ubuffer.u8[b+2];
-				ubuffer.u8[b+2] = tmp;
+				tmp = ubuffer->u8[b];
+				ubuffer->u8[b] = ubuffer->u8[b+2];
+				ubuffer->u8[b+2] = tmp;
 			}
 		}
 		if(is_unsigned_samples) {
@@ -2408,9 +2468,9 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			for(b = sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++) {
 					FLAC__int32 t;
-					t  = ubuffer.u8[b++]; t <<= 8;
-					t |= ubuffer.u8[b++]; t <<= 8;
-					t |= ubuffer.u8[b++];
+					t  = ubuffer->u8[b++]; t <<= 8;
+					t |= ubuffer->u8[b++]; t <<= 8;
+					t |= ubuffer->u8[b++];
 					t -= 0x800000;
 					out[channel][wide_sample] = t;
 				}
@@ -2420,9 +2480,9 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 			for(b = sample = wide_sample = 0; wide_sample < wide_samples; wide_sample++)
 				for(channel = 0; channel < channels; channel++, sample++) {
 					FLAC__int32 t;
-					t  = ubuffer.s8[b++]; t <<= 8;
-					t |= ubuffer.u8[b++]; t <<= 8;
-					t |= ubuffer.u8[b++];
+					t  = ubuffer->s8[b++]; t <<= 8;
+					t |= ubuffer->u8[b++]; t <<= 8;
+					t |= ubuffer->u8[b++];
 					out[channel][wide_sample] = t;
 				}
 		}
@@ -2444,6 +2504,155 @@ FLAC__bool format_input(FLAC__int32 *dest[], unsigned wide_samples, FLAC__bool i
 	return true;
 }
 
+/* reads the next chunk into r->buffer[i]; returns 0 at the end of the input */
+static size_t InputReader_fill_(InputReader *r, unsigned i)
+{
+	size_t wanted, length = 0;
+
+	if(r->eof || r->error || r->bytes_left == 0)
+		return 0;
+
+	wanted = (size_t)min((FLAC__uint64)r->chunk_length, r->bytes_left);
+	if(r->prefix_length > 0) {
+		length = min(r->prefix_length, wanted);
+		memcpy(r->buffer[i]->u8, r->prefix, length);
+		r->prefix += length;
+		r->prefix_length -= length;
+	}
+	if(length < wanted) {
+		length += fread(r->buffer[i]->u8 + length, sizeof(unsigned char), wanted - length, r->f);
+		if(length < wanted) {
+			if(ferror(r->f))
+				r->error = true;
+			else
+				r->eof = true;
+		}
+	}
+	r->bytes_left -= length;
+	return length;
+}
+
+#ifdef HAVE_PTHREAD
+static void *InputReader_thread_(void *arg)
+{
+	InputReader *r = (InputReader*)arg;
+	unsigned i = 0;
+	size_t length;
+
+	do {
+		pthread_mutex_lock(&r->mutex);
+		while(r->is_full[i] && !r->stop)
+			pthread_cond_wait(&r->cond, &r->mutex);
+		if(r->stop) {
+			pthread_mutex_unlock(&r->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&r->mutex);
+
+		length = InputReader_fill_(r, i);
+
+		pthread_mutex_lock(&r->mutex);
+		r->length[i] = length;
+		r->is_full[i] = true;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+		i ^= 1;
+	} while(length > 0);
+
+	return 0;
+}
+#endif
+
+/* starts reading up to max_bytes from f, beginning with the prefix bytes */
+FLAC__bool InputReader_start(InputReader *r, FILE *f, size_t chunk_length, FLAC__uint64 max_bytes, const FLAC__byte *prefix, unsigned prefix_length)
+{
+	FLAC__ASSERT(chunk_length > 0 && chunk_length <= sizeof(InputBuffer));
+
+	r->f = f;
+	r->chunk_length = chunk_length;
+	r->bytes_left = max_bytes;
+	r->prefix = prefix;
+	r->prefix_length = prefix_length;
+	r->next = 0;
+	r->eof = r->error = false;
+
+#ifdef HAVE_POSIX_FADVISE
+	/* only a hint; it fails harmlessly on pipes */
+	(void)posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#ifdef HAVE_PTHREAD
+	r->is_full[0] = r->is_full[1] = false;
+	r->stop = false;
+	r->in_use = 2;
+	if(0 != pthread_mutex_init(&r->mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&r->cond, 0)) {
+		pthread_mutex_destroy(&r->mutex);
+		return false;
+	}
+	/* if no thread can be started, InputReader_read() reads in the caller's thread */
+	r->is_threaded = (0 == pthread_create(&r->thread, 0, InputReader_thread_, r));
+	if(!r->is_threaded) {
+		pthread_cond_destroy(&r->cond);
+		pthread_mutex_destroy(&r->mutex);
+	}
+#endif
+	return true;
+}
+
+/* hands out the next chunk, which stays valid until the next call; returns
+ * 0 at the end of the input, when r->eof or r->error tells why it ended
+ * before max_bytes */
+size_t InputReader_read(InputReader *r, InputBuffer **buffer)
+{
+	size_t length;
+
+#ifdef HAVE_PTHREAD
+	if(r->is_threaded) {
+		pthread_mutex_lock(&r->mutex);
+		if(r->in_use < 2) {
+			r->is_full[r->in_use] = false;
+			r->in_use = 2;
+			pthread_cond_broadcast(&r->cond);
+		}
+		while(!r->is_full[r->next])
+			pthread_cond_wait(&r->cond, &r->mutex);
+		length = r->length[r->next];
+		/* a zero length chunk is the last one; keep returning it */
+		if(length > 0) {
+			r->in_use = r->next;
+			*buffer = r->buffer[r->next];
+			r->next ^= 1;
+		}
+		pthread_mutex_unlock(&r->mutex);
+		return length;
+	}
+#endif
+	length = InputReader_fill_(r, 0);
+	*buffer = r->buffer[0];
+	return length;
+}
+
+/* stops the reader thread; the file can be used again after this */
+void InputReader_finish(InputReader *r)
+{
+#ifdef HAVE_PTHREAD
+	if(r->is_threaded) {
+		pthread_mutex_lock(&r->mutex);
+		r->stop = true;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+		pthread_join(r->thread, 0);
+		pthread_cond_destroy(&r->cond);
+		pthread_mutex_destroy(&r->mutex);
+		r->is_threaded = false;
+	}
+#else
+	(void)r;
+#endif
+}
+
 void encoder_progress_callback(const FLAC__StreamEncoder *encoder, FLAC__uint64 bytes_written, FLAC__uint64 samples_written, unsigned frames_written, unsigned total_frames_estimate, void *client_data)
 {
 	EncoderSession *e = (EncoderSession*)client_data;
@@ -2839,7 +3048,7 @@ FLAC__bool read_sane_extended(FILE *f, FLAC__uint32 *val, const char *fn)
 
 FLAC__bool fskip_ahead(FILE *f, FLAC__uint64 offset)
 {
-	static unsigned char dump[8192];
+	unsigned char dump[8192];
 	struct flac_stat_s stb;
 
 	if(flac_fstat(fileno(f), &stb) == 0 && (stb.st_mode & S_IFMT) == S_IFREG)
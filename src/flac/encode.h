@@ -28,6 +28,7 @@
 #include "foreign_metadata.h"
 #include "utils.h"
 #include "share/compat.h"
+#include "share/grabbag.h"
 
 extern const int FLAC_ENCODE__DEFAULT_PADDING;
 
@@ -76,15 +77,20 @@ typedef struct {
 	FLAC__bool cued_seekpoints;
 	FLAC__bool channel_map_none; /* --channel-map=none specified, eventually will expand to take actual channel map */
 
-	/* options related to --replay-gain and --sector-align */
+	/* options related to --replay-gain, --loudness and --sector-align */
 	FLAC__bool is_first_file;
 	FLAC__bool is_last_file;
 	FLAC__int32 **align_reservoir;
 	unsigned *align_reservoir_samples;
 	FLAC__bool replay_gain;
+	grabbag__ReplayGainContext *replay_gain_context; /* this file's own analysis, if replay_gain */
+	FLAC__bool loudness;
+	grabbag__LoudnessContext *loudness_context; /* this file's own analysis, if loudness */
 	FLAC__bool ignore_chunk_sizes;
 	FLAC__bool sector_align;
 	FLAC__bool error_on_compression_fail;
+	unsigned num_threads;
+	FLAC__bool variable_blocksize;
 
 	FLAC__StreamMetadata *vorbis_comment;
 	FLAC__StreamMetadata *pictures[64];
@@ -34,6 +34,9 @@
 /* unlink is in stdio.h in VC++ */
 #include <unistd.h> /* for unlink() */
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "FLAC/all.h"
 #include "share/alloc.h"
 #include "share/grabbag.h"
@@ -71,12 +74,21 @@ static void show_help(void);
 static void show_explain(void);
 static void format_mistake(const char *infilename, FileFormat wrong, FileFormat right);
 
-static int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file);
+static int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file, unsigned file_number);
 static int decode_file(const char *infilename);
+#ifdef HAVE_PTHREAD
+static int run_jobs(void);
+#endif
+static int cut_file(const char *infilename);
+static int split_file(const char *infilename);
+static int join_files(void);
+static int splice_file(const char *infilename, const grabbag__SpliceSegment segments[], unsigned num_segments, const char *outfilename);
+static unsigned get_compression_level(void);
 
-static const char *get_encoded_outfilename(const char *infilename);
-static const char *get_decoded_outfilename(const char *infilename);
-static const char *get_outfilename(const char *infilename, const char *suffix);
+#define OUTFILENAME_BUFFER_SIZE 4096 /* @@@ bad MAGIC NUMBER */
+static const char *get_encoded_outfilename(const char *infilename, char *buffer, size_t buffer_size);
+static const char *get_decoded_outfilename(const char *infilename, char *buffer, size_t buffer_size);
+static const char *get_outfilename(const char *infilename, const char *suffix, char *buffer, size_t buffer_size);
 
 static void die(const char *message);
 static int conditional_fclose(FILE *f);
@@ -96,6 +108,9 @@ static struct share__option long_options_[] = {
 	{ "decode"                , share__no_argument, 0, 'd' },
 	{ "analyze"               , share__no_argument, 0, 'a' },
 	{ "test"                  , share__no_argument, 0, 't' },
+	{ "cut"                   , share__no_argument, 0, 0 },
+	{ "split"                 , share__no_argument, 0, 0 },
+	{ "join"                  , share__no_argument, 0, 0 },
 	{ "stdout"                , share__no_argument, 0, 'c' },
 	{ "silent"                , share__no_argument, 0, 's' },
 	{ "totally-silent"        , share__no_argument, 0, 0 },
@@ -144,6 +159,7 @@ static struct share__option long_options_[] = {
 	{ "force-wave64-format"       , share__no_argument, 0, 0 },
 	{ "lax"                       , share__no_argument, 0, 0 },
 	{ "replay-gain"               , share__no_argument, 0, 0 },
+	{ "loudness"                  , share__no_argument, 0, 0 },
 	{ "ignore-chunk-sizes"        , share__no_argument, 0, 0 },
 	{ "sector-align"              , share__no_argument, 0, 0 }, /* DEPRECATED */
 	{ "seekpoint"                 , share__required_argument, 0, 'S' },
@@ -168,6 +184,9 @@ static struct share__option long_options_[] = {
 	{ "sign"                      , share__required_argument, 0, 0 },
 	{ "input-size"                , share__required_argument, 0, 0 },
 	{ "error-on-compression-fail" , share__no_argument, 0, 0 },
+	{ "threads"                   , share__required_argument, 0, 0 },
+	{ "jobs"                      , share__required_argument, 0, 0 },
+	{ "variable-blocksize"        , share__no_argument, 0, 0 },
 
 	/*
 	 * analysis options
@@ -186,6 +205,7 @@ static struct share__option long_options_[] = {
 	{ "no-delete-input-file"      , share__no_argument, 0, 0 },
 	{ "no-keep-foreign-metadata"  , share__no_argument, 0, 0 },
 	{ "no-replay-gain"            , share__no_argument, 0, 0 },
+	{ "no-loudness"               , share__no_argument, 0, 0 },
 	{ "no-ignore-chunk-sizes"     , share__no_argument, 0, 0 },
 	{ "no-sector-align"           , share__no_argument, 0, 0 }, /* DEPRECATED */
 	{ "no-utf8-convert"           , share__no_argument, 0, 0 },
@@ -224,6 +244,9 @@ static struct {
 	FLAC__bool show_explain;
 	FLAC__bool show_version;
 	FLAC__bool mode_decode;
+	FLAC__bool mode_cut;
+	FLAC__bool mode_split;
+	FLAC__bool mode_join;
 	FLAC__bool verify;
 	FLAC__bool treat_warnings_as_errors;
 	FLAC__bool force_file_overwrite;
@@ -244,6 +267,7 @@ static struct {
 	FLAC__bool preserve_modtime;
 	FLAC__bool keep_foreign_metadata;
 	FLAC__bool replay_gain;
+	FLAC__bool loudness;
 	FLAC__bool ignore_chunk_sizes;
 	FLAC__bool sector_align;
 	FLAC__bool utf8_convert; /* true by default, to convert tag strings from locale to utf-8, false if --no-utf8-convert used */
@@ -268,6 +292,9 @@ static struct {
 	FLAC__bool cued_seekpoints;
 	FLAC__bool channel_map_none; /* --channel-map=none specified, eventually will expand to take actual channel map */
 	FLAC__bool error_on_compression_fail;
+	unsigned num_threads;
+	unsigned num_jobs;
+	FLAC__bool variable_blocksize;
 
 	unsigned num_files;
 	char **filenames;
@@ -293,6 +320,18 @@ static FLAC__int32 align_reservoir_0[588], align_reservoir_1[588]; /* for carryi
 static FLAC__int32 *align_reservoir[2] = { align_reservoir_0, align_reservoir_1 };
 static unsigned align_reservoir_samples = 0; /* 0 .. 587 */
 
+/* for --replay-gain with more than one file: each file is analyzed on its own and added to this when it is done */
+static grabbag__ReplayGainContext *replay_gain_album = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t replay_gain_album_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* the same for --loudness */
+static grabbag__LoudnessContext *loudness_album = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t loudness_album_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 
 int main(int argc, char *argv[])
 {
@@ -364,7 +403,29 @@ int do_it(void)
 		/*
 		 * tweak options; validate the values
 		 */
-		if(!option_values.mode_decode) {
+		if((option_values.mode_decode?1:0) + (option_values.mode_cut?1:0) + (option_values.mode_split?1:0) + (option_values.mode_join?1:0) > 1)
+			return usage_error("ERROR: only one of -d/-t/-a/--cut/--split/--join allowed\n");
+		if(option_values.mode_split || option_values.mode_join) {
+			if(0 != option_values.skip_specification)
+				return usage_error("ERROR: --skip is not allowed with --split or --join\n");
+			if(0 != option_values.until_specification)
+				return usage_error("ERROR: --until is not allowed with --split or --join\n");
+			if(0 != option_values.cue_specification)
+				return usage_error("ERROR: --cue is not allowed with --split or --join\n");
+		}
+		if((option_values.mode_cut || option_values.mode_split || option_values.mode_join) && option_values.num_files == 0)
+			return usage_error("ERROR: --cut, --split and --join need FLAC files to read, not stdin\n");
+#if FLAC__HAS_OGG
+		if((option_values.mode_cut || option_values.mode_split || option_values.mode_join) && option_values.use_ogg)
+			return usage_error("ERROR: --ogg is not allowed with --cut, --split or --join\n");
+#endif
+		if(option_values.mode_split && option_values.cmdline_forced_outfilename)
+			return usage_error("ERROR: -o/--output-name cannot be used with --split\n");
+		if(option_values.mode_split && option_values.force_to_stdout)
+			return usage_error("ERROR: -c/--stdout cannot be used with --split\n");
+		if(option_values.mode_join && 0 == option_values.cmdline_forced_outfilename && !option_values.force_to_stdout)
+			return usage_error("ERROR: --join needs -o/--output-name or -c/--stdout\n");
+		if(!option_values.mode_decode && !option_values.mode_cut) {
 			if(0 != option_values.cue_specification)
 				return usage_error("ERROR: --cue is not allowed in test mode\n");
 		}
@@ -457,7 +518,34 @@ int do_it(void)
 				flac__utils_printf(stderr, 1, "NOTE: --replay-gain may leave a small PADDING block even with --no-padding\n");
 			}
 		}
-		if(option_values.num_files > 1 && option_values.cmdline_forced_outfilename) {
+		if(option_values.loudness) {
+			if(option_values.force_to_stdout)
+				return usage_error("ERROR: --loudness not allowed with -c/--stdout\n");
+			if(option_values.mode_decode)
+				return usage_error("ERROR: --loudness only allowed for encoding\n");
+			if(option_values.format_sample_rate >= 0 && !grabbag__loudness_is_valid_format(option_values.format_sample_rate, 1))
+				return usage_error("ERROR: invalid sample rate used with --loudness\n");
+			if(
+				(option_values.padding >= 0 && option_values.padding < (int)GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED) ||
+				(option_values.padding < 0 && FLAC_ENCODE__DEFAULT_PADDING < (int)GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED)
+			) {
+				flac__utils_printf(stderr, 1, "NOTE: --loudness may leave a small PADDING block even with --no-padding\n");
+			}
+		}
+		if(option_values.num_jobs > 1 && option_values.num_files > 1 && !option_values.mode_cut && !option_values.mode_split && !option_values.mode_join) {
+			unsigned i;
+			if(option_values.force_to_stdout)
+				return usage_error("ERROR: --jobs cannot be used with -c/--stdout\n");
+			if(option_values.analyze)
+				return usage_error("ERROR: --jobs cannot be used with -a/--analyze\n");
+			if(option_values.sector_align)
+				return usage_error("ERROR: --jobs cannot be used with --sector-align\n");
+			for(i = 0; i < option_values.num_files; i++) {
+				if(0 == strcmp(option_values.filenames[i], "-"))
+					return usage_error("ERROR: --jobs cannot be used with stdin\n");
+			}
+		}
+		if(option_values.num_files > 1 && option_values.cmdline_forced_outfilename && !option_values.mode_join) {
 			return usage_error("ERROR: -o/--output-name cannot be used with multiple files\n");
 		}
 		if(option_values.cmdline_forced_outfilename && option_values.output_prefix) {
@@ -483,7 +571,15 @@ int do_it(void)
 	flac__utils_printf(stderr, 2, "flac comes with ABSOLUTELY NO WARRANTY.  This is free software, and you are\n");
 	flac__utils_printf(stderr, 2, "welcome to redistribute it under certain conditions.  Type `flac' for details.\n\n");
 
-	if(option_values.mode_decode) {
+	if(option_values.mode_join) {
+		retval = join_files();
+	}
+	else if(option_values.mode_cut || option_values.mode_split) {
+		unsigned i;
+		for(i = 0, retval = 0; i < option_values.num_files; i++)
+			retval |= option_values.mode_cut? cut_file(option_values.filenames[i]) : split_file(option_values.filenames[i]);
+	}
+	else if(option_values.mode_decode) {
 		FLAC__bool first = true;
 
 		if(option_values.num_files == 0) {
@@ -493,6 +589,10 @@ int do_it(void)
 			unsigned i;
 			if(option_values.num_files > 1)
 				option_values.cmdline_forced_outfilename = 0;
+#ifdef HAVE_PTHREAD
+			if(option_values.num_jobs > 1 && option_values.num_files > 1)
+				return run_jobs();
+#endif
 			for(i = 0, retval = 0; i < option_values.num_files; i++) {
 				if(0 == strcmp(option_values.filenames[i], "-") && !first)
 					continue;
@@ -507,24 +607,42 @@ int do_it(void)
 		if(option_values.ignore_chunk_sizes)
 			flac__utils_printf(stderr, 1, "INFO: Make sure you know what you're doing when using --ignore-chunk-sizes.\n      Improper use can cause flac to encode non-audio data as audio.\n");
 
+#if FLAC__HAS_OGG
+		/* set a random serial number if one has not yet been specified; each file gets the next one */
+		if(!option_values.has_serial_number) {
+			option_values.serial_number = rand();
+			option_values.has_serial_number = true;
+		}
+#endif
+
 		if(option_values.num_files == 0) {
-			retval = encode_file("-", first, true);
+			retval = encode_file("-", first, true, 0);
 		}
 		else {
-			unsigned i;
+			unsigned i, n;
 			if(option_values.num_files > 1)
 				option_values.cmdline_forced_outfilename = 0;
-			for(i = 0, retval = 0; i < option_values.num_files; i++) {
+			if(option_values.replay_gain && 0 == (replay_gain_album = grabbag__replaygain_new()))
+				die("out of memory allocating ReplayGain analysis");
+			if(option_values.loudness && 0 == (loudness_album = grabbag__loudness_new()))
+				die("out of memory allocating loudness analysis");
+#ifdef HAVE_PTHREAD
+			if(option_values.num_jobs > 1 && option_values.num_files > 1)
+				retval = run_jobs();
+			else
+#endif
+			for(i = 0, n = 0, retval = 0; i < option_values.num_files; i++) {
 				if(0 == strcmp(option_values.filenames[i], "-") && !first)
 					continue;
-				retval |= encode_file(option_values.filenames[i], first, i == (option_values.num_files-1));
+				retval |= encode_file(option_values.filenames[i], first, i == (option_values.num_files-1), n++);
 				first = false;
 			}
 			if(option_values.replay_gain && retval == 0) {
 				float album_gain, album_peak;
-				grabbag__replaygain_get_album(&album_gain, &album_peak);
+				grabbag__replaygain_get_album(replay_gain_album, &album_gain, &album_peak);
 				for(i = 0; i < option_values.num_files; i++) {
-					const char *error, *outfilename = get_encoded_outfilename(option_values.filenames[i]);
+					char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+					const char *error, *outfilename = get_encoded_outfilename(option_values.filenames[i], outfilename_buffer, sizeof(outfilename_buffer));
 					if(0 == outfilename) {
 						flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", option_values.filenames[i]);
 						return 1;
@@ -535,6 +653,26 @@ int do_it(void)
 					}
 				}
 			}
+			if(option_values.loudness && retval == 0) {
+				grabbag__Loudness album;
+				grabbag__loudness_get_album(loudness_album, &album);
+				for(i = 0; i < option_values.num_files; i++) {
+					char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+					const char *error, *outfilename = get_encoded_outfilename(option_values.filenames[i], outfilename_buffer, sizeof(outfilename_buffer));
+					if(0 == outfilename) {
+						flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", option_values.filenames[i]);
+						return 1;
+					}
+					if(0 != (error = grabbag__loudness_store_to_file_album(outfilename, &album, option_values.preserve_modtime))) {
+						flac__utils_printf(stderr, 1, "%s: ERROR writing loudness album tags (%s)\n", outfilename, error);
+						retval = 1;
+					}
+				}
+			}
+			grabbag__replaygain_delete(replay_gain_album);
+			replay_gain_album = 0;
+			grabbag__loudness_delete(loudness_album);
+			loudness_album = 0;
 		}
 	}
 
@@ -546,6 +684,9 @@ FLAC__bool init_options(void)
 	option_values.show_help = false;
 	option_values.show_explain = false;
 	option_values.mode_decode = false;
+	option_values.mode_cut = false;
+	option_values.mode_split = false;
+	option_values.mode_join = false;
 	option_values.verify = false;
 	option_values.treat_warnings_as_errors = false;
 	option_values.force_file_overwrite = false;
@@ -570,6 +711,7 @@ FLAC__bool init_options(void)
 	option_values.preserve_modtime = true;
 	option_values.keep_foreign_metadata = false;
 	option_values.replay_gain = false;
+	option_values.loudness = false;
 	option_values.ignore_chunk_sizes = false;
 	option_values.sector_align = false;
 	option_values.utf8_convert = true;
@@ -596,6 +738,9 @@ FLAC__bool init_options(void)
 	option_values.cued_seekpoints = true;
 	option_values.channel_map_none = false;
 	option_values.error_on_compression_fail = false;
+	option_values.num_threads = 1;
+	option_values.num_jobs = 1;
+	option_values.variable_blocksize = false;
 
 	option_values.num_files = 0;
 	option_values.filenames = 0;
@@ -662,6 +807,15 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 		if(0 == strcmp(long_option, "totally-silent")) {
 			flac__utils_verbosity_ = 0;
 		}
+		else if(0 == strcmp(long_option, "cut")) {
+			option_values.mode_cut = true;
+		}
+		else if(0 == strcmp(long_option, "split")) {
+			option_values.mode_split = true;
+		}
+		else if(0 == strcmp(long_option, "join")) {
+			option_values.mode_join = true;
+		}
 		else if(0 == strcmp(long_option, "delete-input-file")) {
 			option_values.delete_input = true;
 		}
@@ -698,6 +852,29 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 					return usage_error("ERROR: --%s must be > 0\n", long_option);
 			}
 		}
+		else if(0 == strcmp(long_option, "threads")) {
+			FLAC__ASSERT(0 != option_argument);
+			{
+				char *end;
+				long n = strtol(option_argument, &end, 10);
+				if(0 == strlen(option_argument) || *end || n < 1)
+					return usage_error("ERROR: --%s must be a number > 0\n", long_option);
+				option_values.num_threads = (unsigned)n;
+			}
+		}
+		else if(0 == strcmp(long_option, "jobs")) {
+			FLAC__ASSERT(0 != option_argument);
+			{
+				char *end;
+				long n = strtol(option_argument, &end, 10);
+				if(0 == strlen(option_argument) || *end || n < 1)
+					return usage_error("ERROR: --%s must be a number > 0\n", long_option);
+				option_values.num_jobs = (unsigned)n;
+			}
+		}
+		else if(0 == strcmp(long_option, "variable-blocksize")) {
+			option_values.variable_blocksize = true;
+		}
 		else if(0 == strcmp(long_option, "cue")) {
 			FLAC__ASSERT(0 != option_argument);
 			option_values.cue_specification = option_argument;
@@ -771,6 +948,9 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 		else if(0 == strcmp(long_option, "replay-gain")) {
 			option_values.replay_gain = true;
 		}
+		else if(0 == strcmp(long_option, "loudness")) {
+			option_values.loudness = true;
+		}
 		else if(0 == strcmp(long_option, "ignore-chunk-sizes")) {
 			option_values.ignore_chunk_sizes = true;
 		}
@@ -852,6 +1032,9 @@ int parse_option(int short_option, const char *long_option, const char *option_a
 		else if(0 == strcmp(long_option, "no-replay-gain")) {
 			option_values.replay_gain = false;
 		}
+		else if(0 == strcmp(long_option, "no-loudness")) {
+			option_values.loudness = false;
+		}
 		else if(0 == strcmp(long_option, "no-ignore-chunk-sizes")) {
 			option_values.ignore_chunk_sizes = false;
 		}
@@ -1193,6 +1376,8 @@ static void usage_summary(void)
 	printf(" Decoding: flac -d [<general-options>] [<format-options>] [FLACFILE [...]]\n");
 	printf("  Testing: flac -t [<general-options>] [FLACFILE [...]]\n");
 	printf("Analyzing: flac -a [<general-options>] [<analysis-options>] [FLACFILE [...]]\n");
+	printf("  Cutting: flac --cut|--split [<general-options>] [FLACFILE [...]]\n");
+	printf("  Joining: flac --join -o OUTFILE [<general-options>] FLACFILE [...]\n");
 	printf("\n");
 	printf("Be sure to read the list of known bugs at:\n");
 	printf("http://xiph.org/flac/documentation_bugs.html\n");
@@ -1232,6 +1417,9 @@ void show_help(void)
 	printf("  -d, --decode                 Decode (the default behavior is to encode)\n");
 	printf("  -t, --test                   Same as -d except no decoded file is written\n");
 	printf("  -a, --analyze                Same as -d except an analysis file is written\n");
+	printf("      --cut                    Copy --skip/--until or --cue range to a FLAC file\n");
+	printf("      --split                  Split each FLAC file into one file per track\n");
+	printf("      --join                   Join the FLAC files into one (needs -o or -c)\n");
 	printf("  -c, --stdout                 Write output to stdout\n");
 	printf("  -s, --silent                 Do not write runtime encode/decode statistics\n");
 	printf("      --totally-silent         Do not print anything, including errors\n");
@@ -1245,6 +1433,7 @@ void show_help(void)
 	printf("      --keep-foreign-metadata  Save/restore WAVE or AIFF non-audio chunks\n");
 	printf("      --skip={#|mm:ss.ss}      Skip the given initial samples for each input\n");
 	printf("      --until={#|[+|-]mm:ss.ss}  Stop at the given sample for each input file\n");
+	printf("      --jobs=#                 Encode or decode # files at a time\n");
 #if FLAC__HAS_OGG
 	printf("      --ogg                    Use Ogg as transport layer\n");
 	printf("      --serial-number          Serial number to use for the FLAC stream\n");
@@ -1261,6 +1450,7 @@ void show_help(void)
 	printf("      --ignore-chunk-sizes     Ignore data chunk sizes in WAVE/AIFF files\n");
 	printf("      --sector-align (DEPRECATED) Align multiple files on sector boundaries\n");
 	printf("      --replay-gain            Calculate ReplayGain & store in FLAC tags\n");
+	printf("      --loudness               Measure EBU R128 loudness & store in FLAC tags\n");
 	printf("      --cuesheet=FILENAME      Import cuesheet and store in CUESHEET block\n");
 	printf("      --picture=SPECIFICATION  Import picture and store in PICTURE block\n");
 	printf("  -T, --tag=FIELD=VALUE        Add a FLAC tag; may appear multiple times\n");
@@ -1280,6 +1470,7 @@ void show_help(void)
 	printf("  -8, --compression-level-8, --best  Synonymous with -l 12 -b 4096 -m -r 6\n");
 	printf("                    -A tukey(0.5) -A partial_tukey(2) -A punchout_tukey(3)\n");
 	printf("  -b, --blocksize=#                  Specify blocksize in samples\n");
+	printf("      --variable-blocksize           Merge or split blocks where it helps\n");
 	printf("  -m, --mid-side                     Try mid-side coding for each frame\n");
 	printf("  -M, --adaptive-mid-side            Adaptive mid-side coding for all frames\n");
 	printf("  -e, --exhaustive-model-search      Do exhaustive model search (expensive!)\n");
@@ -1288,6 +1479,7 @@ void show_help(void)
 	printf("  -p, --qlp-coeff-precision-search   Exhaustively search LP coeff quantization\n");
 	printf("  -q, --qlp-coeff-precision=#        Specify precision in bits\n");
 	printf("  -r, --rice-partition-order=[#,]#   Set [min,]max residual partition order\n");
+	printf("      --threads=#                    Number of threads to encode/decode with\n");
 	printf("format options:\n");
 	printf("      --force-raw-format       Treat input or output as raw samples\n");
 	printf("      --force-aiff-format      Force decoding to AIFF format\n");
@@ -1317,6 +1509,7 @@ void show_help(void)
 	printf("      --no-padding\n");
 	printf("      --no-qlp-coeff-prec-search\n");
 	printf("      --no-replay-gain\n");
+	printf("      --no-loudness\n");
 	printf("      --no-residual-gnuplot\n");
 	printf("      --no-residual-text\n");
 	printf("      --no-ignore-chunk-sizes\n");
@@ -1359,6 +1552,22 @@ void show_explain(void)
 	printf("  -d, --decode                 Decode (the default behavior is to encode)\n");
 	printf("  -t, --test                   Same as -d except no decoded file is written\n");
 	printf("  -a, --analyze                Same as -d except an analysis file is written\n");
+	printf("      --cut                    Write the part of a FLAC file selected with\n");
+	printf("                               --skip/--until or --cue to a new FLAC file\n");
+	printf("                               without re-encoding it.  Only the two frames\n");
+	printf("                               at the cut points are decoded and encoded\n");
+	printf("                               again.  The MD5 signature of the output is\n");
+	printf("                               left unset; use metaflac --rebuild-md5sum to\n");
+	printf("                               fill it in.\n");
+	printf("      --split                  Like --cut, but writes every track of the\n");
+	printf("                               file's CUESHEET (or the one given with\n");
+	printf("                               --cuesheet) to its own file, named after the\n");
+	printf("                               input with the track number inserted before\n");
+	printf("                               the extension, e.g. album.01.flac.\n");
+	printf("      --join                   Join all the input FLAC files into the one\n");
+	printf("                               given with -o (or stdout with -c) without\n");
+	printf("                               re-encoding.  The inputs must have the same\n");
+	printf("                               sample rate, channels and bits per sample.\n");
 	printf("  -c, --stdout                 Write output to stdout\n");
 	printf("  -s, --silent                 Do not write runtime encode/decode statistics\n");
 	printf("      --totally-silent         Do not print anything of any kind, including\n");
@@ -1408,6 +1617,12 @@ void show_explain(void)
 	printf("                               relative to the --skip point.  If a `-' sign is\n");
 	printf("                               at the beginning, the --until point is relative\n");
 	printf("                               to end of the audio.\n");
+	printf("      --jobs=#                 Encode or decode up to # of the input files at\n");
+	printf("                               the same time, each in a thread of its own.\n");
+	printf("                               The messages for each file are printed in one\n");
+	printf("                               piece when it is done.  Cannot be used with -c,\n");
+	printf("                               -a, --sector-align or stdin as input.  The\n");
+	printf("                               default is 1.\n");
 #if FLAC__HAS_OGG
 	printf("      --ogg                    When encoding, generate Ogg FLAC output instead\n");
 	printf("                               of native FLAC.  Ogg FLAC streams are FLAC\n");
@@ -1474,6 +1689,13 @@ void show_explain(void)
 	printf("                               one of 8, 11.025, 12, 16, 22.05, 24, 32, 44.1,\n");
 	printf("                               or 48 kHz.  NOTE: this option may also leave a\n");
 	printf("                               few extra bytes in the PADDING block.\n");
+	printf("      --loudness               Measure the loudness after EBU R128 and store\n");
+	printf("                               it as FLAC tags.  The integrated loudness,\n");
+	printf("                               loudness range and maximum true peak will be\n");
+	printf("                               computed for each file, and for all files\n");
+	printf("                               together as an album.  The sample rate must be\n");
+	printf("                               at least 8 kHz.  NOTE: this option may also\n");
+	printf("                               leave a few extra bytes in the PADDING block.\n");
 	printf("      --cuesheet=FILENAME      Import the given cuesheet file and store it in\n");
 	printf("                               a CUESHEET metadata block.  This option may only\n");
 	printf("                               be used when encoding a single file.  A\n");
@@ -1572,6 +1794,11 @@ void show_explain(void)
 	printf("                               576, 1152, 2304, 4608, 256, 512, 1024, 2048,\n");
 	printf("                               4096 (and 8192 or 16384 if the sample rate is\n");
 	printf("                               >48kHz) for Subset streams.\n");
+	printf("      --variable-blocksize     Let the encoder merge pairs of blocks, and\n");
+	printf("                               split them in halves or quarters where the\n");
+	printf("                               audio changes suddenly, if that makes the\n");
+	printf("                               file smaller; the default blocksize is then\n");
+	printf("                               2304 for Subset streams up to 48kHz\n");
 	printf("  -0, --compression-level-0, --fast  Synonymous with -l 0 -b 1152 -r 3\n");
 	printf("  -1, --compression-level-1          Synonymous with -l 0 -b 1152 -M -r 3\n");
 	printf("  -2, --compression-level-2          Synonymous with -l 0 -b 1152 -m -r 3\n");
@@ -1615,6 +1842,14 @@ void show_explain(void)
 	printf("                                     (# is 0..16; min defaults to 0; the\n");
 	printf("                                     default is -r 0; above 4 doesn't usually\n");
 	printf("                                     help much)\n");
+	printf("      --threads=#                    Encode frames in parallel using # threads\n");
+	printf("                                     (the default is 1; the output is identical\n");
+	printf("                                     regardless of the number of threads; has no\n");
+	printf("                                     effect with -M or if flac was built without\n");
+	printf("                                     thread support; with more than 1 thread, -V\n");
+	printf("                                     and the MD5 signature also run in threads\n");
+	printf("                                     of their own; when decoding or testing,\n");
+	printf("                                     frames are decoded in parallel too)\n");
 	printf("format options:\n");
 	printf("      --force-raw-format       Force input (when encoding) or output (when\n");
 	printf("                               decoding) to be treated as raw samples\n");
@@ -1681,7 +1916,7 @@ void format_mistake(const char *infilename, FileFormat wrong, FileFormat right)
 	flac__utils_printf(stderr, 1, "WARNING: %s is not a%s file; treating as a%s file\n", infilename, ff[wrong], ff[right]);
 }
 
-int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file)
+int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_last_file, unsigned file_number)
 {
 	FILE *encode_infile;
 	FLAC__byte lookahead[12];
@@ -1690,7 +1925,8 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	int retval;
 	FLAC__off_t infilesize;
 	encode_options_t encode_options;
-	const char *outfilename = get_encoded_outfilename(infilename); /* the final name of the encoded file */
+	char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+	const char *outfilename = get_encoded_outfilename(infilename, outfilename_buffer, sizeof(outfilename_buffer)); /* the final name of the encoded file */
 	/* internal_outfilename is the file we will actually write to; it will be a temporary name if infilename==outfilename */
 	char *internal_outfilename = 0; /* NULL implies 'use outfilename' */
 
@@ -1863,11 +2099,19 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 			conditional_fclose(encode_infile);
 			return usage_error("ERROR: --replay-gain cannot be used when encoding to stdout\n");
 		}
+		if(option_values.loudness) {
+			conditional_fclose(encode_infile);
+			return usage_error("ERROR: --loudness cannot be used when encoding to stdout\n");
+		}
 	}
 	if(option_values.replay_gain && option_values.use_ogg) {
 		conditional_fclose(encode_infile);
 		return usage_error("ERROR: --replay-gain cannot be used when encoding to Ogg FLAC yet\n");
 	}
+	if(option_values.loudness && option_values.use_ogg) {
+		conditional_fclose(encode_infile);
+		return usage_error("ERROR: --loudness cannot be used when encoding to Ogg FLAC yet\n");
+	}
 
 	if(!flac__utils_parse_skip_until_specification(option_values.skip_specification, &encode_options.skip_specification) || encode_options.skip_specification.is_relative) {
 		conditional_fclose(encode_infile);
@@ -1886,12 +2130,9 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	encode_options.treat_warnings_as_errors = option_values.treat_warnings_as_errors;
 #if FLAC__HAS_OGG
 	encode_options.use_ogg = option_values.use_ogg;
-	/* set a random serial number if one has not yet been specified */
-	if(!option_values.has_serial_number) {
-		option_values.serial_number = rand();
-		option_values.has_serial_number = true;
-	}
-	encode_options.serial_number = option_values.serial_number++;
+	encode_options.serial_number = option_values.serial_number + file_number;
+#else
+	(void)file_number;
 #endif
 	encode_options.lax = option_values.lax;
 	encode_options.padding = option_values.padding;
@@ -1909,6 +2150,9 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	encode_options.align_reservoir = align_reservoir;
 	encode_options.align_reservoir_samples = &align_reservoir_samples;
 	encode_options.replay_gain = option_values.replay_gain;
+	encode_options.replay_gain_context = 0;
+	encode_options.loudness = option_values.loudness;
+	encode_options.loudness_context = 0;
 	encode_options.ignore_chunk_sizes = option_values.ignore_chunk_sizes;
 	encode_options.sector_align = option_values.sector_align;
 	encode_options.vorbis_comment = option_values.vorbis_comment;
@@ -1921,6 +2165,8 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	encode_options.debug.disable_verbatim_subframes = option_values.debug.disable_verbatim_subframes;
 	encode_options.debug.do_md5 = option_values.debug.do_md5;
 	encode_options.error_on_compression_fail = option_values.error_on_compression_fail;
+	encode_options.num_threads = option_values.num_threads;
+	encode_options.variable_blocksize = option_values.variable_blocksize;
 
 	/* if infilename and outfilename point to the same file, we need to write to a temporary file */
 	if(encode_infile != stdin && grabbag__file_are_same(infilename, outfilename)) {
@@ -1936,6 +2182,23 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 		safe_strncat(internal_outfilename, tmp_suffix, dest_len);
 	}
 
+	if(option_values.replay_gain && 0 == (encode_options.replay_gain_context = grabbag__replaygain_new())) {
+		flac__utils_printf(stderr, 1, "ERROR allocating memory for ReplayGain analysis\n");
+		conditional_fclose(encode_infile);
+		if(internal_outfilename != 0)
+			free(internal_outfilename);
+		return 1;
+	}
+
+	if(option_values.loudness && 0 == (encode_options.loudness_context = grabbag__loudness_new())) {
+		flac__utils_printf(stderr, 1, "ERROR allocating memory for loudness analysis\n");
+		conditional_fclose(encode_infile);
+		grabbag__replaygain_delete(encode_options.replay_gain_context);
+		if(internal_outfilename != 0)
+			free(internal_outfilename);
+		return 1;
+	}
+
 	if(input_format == FORMAT_RAW) {
 		encode_options.format_options.raw.is_big_endian = option_values.format_is_big_endian;
 		encode_options.format_options.raw.is_unsigned_samples = option_values.format_is_unsigned_samples;
@@ -1964,6 +2227,8 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 			if(0 == encode_options.format_options.iff.foreign_metadata) {
 				flac__utils_printf(stderr, 1, "ERROR: creating foreign metadata object\n");
 				conditional_fclose(encode_infile);
+				grabbag__replaygain_delete(encode_options.replay_gain_context);
+				grabbag__loudness_delete(encode_options.loudness_context);
 				if(internal_outfilename != 0)
 					free(internal_outfilename);
 				return 1;
@@ -1985,7 +2250,16 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 			if(option_values.replay_gain) {
 				float title_gain, title_peak;
 				const char *error;
-				grabbag__replaygain_get_title(&title_gain, &title_peak);
+				grabbag__replaygain_get_title(encode_options.replay_gain_context, &title_gain, &title_peak);
+				if(0 != replay_gain_album) {
+#ifdef HAVE_PTHREAD
+					pthread_mutex_lock(&replay_gain_album_mutex);
+#endif
+					grabbag__replaygain_merge_album(replay_gain_album, encode_options.replay_gain_context);
+#ifdef HAVE_PTHREAD
+					pthread_mutex_unlock(&replay_gain_album_mutex);
+#endif
+				}
 				if(
 					0 != (error = grabbag__replaygain_store_to_file_reference(internal_outfilename? internal_outfilename : outfilename, option_values.preserve_modtime)) ||
 					0 != (error = grabbag__replaygain_store_to_file_title(internal_outfilename? internal_outfilename : outfilename, title_gain, title_peak, option_values.preserve_modtime))
@@ -1994,6 +2268,24 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 					retval = 1;
 				}
 			}
+			if(option_values.loudness) {
+				grabbag__Loudness title;
+				const char *error;
+				grabbag__loudness_get_title(encode_options.loudness_context, &title);
+				if(0 != loudness_album) {
+#ifdef HAVE_PTHREAD
+					pthread_mutex_lock(&loudness_album_mutex);
+#endif
+					grabbag__loudness_merge_album(loudness_album, encode_options.loudness_context);
+#ifdef HAVE_PTHREAD
+					pthread_mutex_unlock(&loudness_album_mutex);
+#endif
+				}
+				if(0 != (error = grabbag__loudness_store_to_file_title(internal_outfilename? internal_outfilename : outfilename, &title, option_values.preserve_modtime))) {
+					flac__utils_printf(stderr, 1, "%s: ERROR writing loudness title tags (%s)\n", outfilename, error);
+					retval = 1;
+				}
+			}
 			if(option_values.preserve_modtime && strcmp(infilename, "-"))
 				grabbag__file_copy_metadata(infilename, internal_outfilename? internal_outfilename : outfilename);
 		}
@@ -2023,6 +2315,9 @@ int encode_file(const char *infilename, FLAC__bool is_first_file, FLAC__bool is_
 	if(retval == 0 && option_values.delete_input && strcmp(infilename, "-") && internal_outfilename == 0)
 		flac_unlink(infilename);
 
+	grabbag__replaygain_delete(encode_options.replay_gain_context);
+	grabbag__loudness_delete(encode_options.loudness_context);
+
 	if(internal_outfilename != 0)
 		free(internal_outfilename);
 
@@ -2035,7 +2330,8 @@ int decode_file(const char *infilename)
 	FLAC__bool treat_as_ogg = false;
 	FileFormat output_format = FORMAT_WAVE;
 	decode_options_t decode_options;
-	const char *outfilename = get_decoded_outfilename(infilename);
+	char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+	const char *outfilename = get_decoded_outfilename(infilename, outfilename_buffer, sizeof(outfilename_buffer));
 
 	if(0 == outfilename) {
 		flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", infilename);
@@ -2119,6 +2415,7 @@ int decode_file(const char *infilename)
 
 	decode_options.treat_warnings_as_errors = option_values.treat_warnings_as_errors;
 	decode_options.continue_through_decode_errors = option_values.continue_through_decode_errors;
+	decode_options.num_threads = option_values.num_threads;
 	decode_options.replaygain_synthesis_spec = option_values.replaygain_synthesis_spec;
 #if FLAC__HAS_OGG
 	decode_options.is_ogg = treat_as_ogg;
@@ -2169,13 +2466,323 @@ int decode_file(const char *infilename)
 	return retval;
 }
 
-const char *get_encoded_outfilename(const char *infilename)
+int splice_file(const char *infilename, const grabbag__SpliceSegment segments[], unsigned num_segments, const char *outfilename)
+{
+	/* internal_outfilename is the file we will actually write to; it will be a temporary name if an input is also the output */
+	char *internal_outfilename = 0; /* NULL implies 'use outfilename' */
+	const char *error;
+	unsigned i;
+	int retval = 0;
+
+	/*
+	 * Error if output file already exists (and -f not used).
+	 * Use grabbag__file_get_filesize() as a cheap way to check.
+	 */
+	if(!option_values.force_file_overwrite && strcmp(outfilename, "-") && grabbag__file_get_filesize(outfilename) != (FLAC__off_t)(-1)) {
+		flac__utils_printf(stderr, 1, "ERROR: output file %s already exists, use -f to override\n", outfilename);
+		return 1;
+	}
+
+	for(i = 0; i < num_segments && 0 == internal_outfilename; i++) {
+		if(strcmp(outfilename, "-") && grabbag__file_are_same(segments[i].filename, outfilename)) {
+			static const char *tmp_suffix = ".tmp,fl-ac+en'c";
+			size_t dest_len = strlen(outfilename) + strlen(tmp_suffix) + 1;
+			if(0 == (internal_outfilename = safe_malloc_(dest_len))) {
+				flac__utils_printf(stderr, 1, "ERROR allocating memory for tempfile name\n");
+				return 1;
+			}
+			safe_strncpy(internal_outfilename, outfilename, dest_len);
+			safe_strncat(internal_outfilename, tmp_suffix, dest_len);
+		}
+	}
+
+	if(0 != (error = grabbag__splice(segments, num_segments, internal_outfilename? internal_outfilename : outfilename, get_compression_level()))) {
+		flac__utils_printf(stderr, 1, "%s: ERROR: %s\n", infilename, error);
+		retval = 1;
+	}
+	else if(option_values.preserve_modtime && strcmp(outfilename, "-"))
+		grabbag__file_copy_metadata(infilename, internal_outfilename? internal_outfilename : outfilename);
+
+	/* rename temporary file if necessary */
+	if(retval == 0 && internal_outfilename != 0) {
+		if(flac_rename(internal_outfilename, outfilename) < 0) {
+#if defined _MSC_VER || defined __MINGW32__ || defined __EMX__
+			/* on some flavors of windows, flac_rename() will fail if the destination already exists, so we unlink and try again */
+			if(flac_unlink(outfilename) < 0) {
+				flac__utils_printf(stderr, 1, "ERROR: moving new FLAC file %s back on top of original FLAC file %s, keeping both\n", internal_outfilename, outfilename);
+				retval = 1;
+			}
+			else if(flac_rename(internal_outfilename, outfilename) < 0) {
+				flac__utils_printf(stderr, 1, "ERROR: moving new FLAC file %s back on top of original FLAC file %s, you must do it\n", internal_outfilename, outfilename);
+				retval = 1;
+			}
+#else
+			flac__utils_printf(stderr, 1, "ERROR: moving new FLAC file %s back on top of original FLAC file %s, keeping both\n", internal_outfilename, outfilename);
+			retval = 1;
+#endif
+		}
+	}
+
+	if(retval == 0)
+		flac__utils_printf(stderr, 2, "%s: wrote %s\n", infilename, outfilename);
+
+	if(internal_outfilename != 0)
+		free(internal_outfilename);
+
+	return retval;
+}
+
+int cut_file(const char *infilename)
+{
+	FLAC__StreamMetadata streaminfo;
+	utils__SkipUntilSpecification skip_specification, until_specification;
+	grabbag__SpliceSegment segment;
+	char outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+	const char *outfilename = get_encoded_outfilename(infilename, outfilename_buffer, sizeof(outfilename_buffer));
+
+	if(0 == outfilename) {
+		flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", infilename);
+		return 1;
+	}
+	if(0 == strcmp(infilename, "-"))
+		return usage_error("ERROR: --cut cannot read from stdin\n");
+
+	if(!FLAC__metadata_get_streaminfo(infilename, &streaminfo)) {
+		flac__utils_printf(stderr, 1, "%s: ERROR reading STREAMINFO\n", infilename);
+		return 1;
+	}
+
+	if(option_values.cue_specification) {
+		utils__CueSpecification cue_specification;
+		FLAC__StreamMetadata *cuesheet;
+		if(!flac__utils_parse_cue_specification(option_values.cue_specification, &cue_specification))
+			return usage_error("ERROR: invalid value for --cue\n");
+		if(streaminfo.data.stream_info.total_samples == 0) {
+			flac__utils_printf(stderr, 1, "%s: ERROR can't use --cue when FLAC metadata has total sample count of 0\n", infilename);
+			return 1;
+		}
+		if(!FLAC__metadata_get_cuesheet(infilename, &cuesheet)) {
+			flac__utils_printf(stderr, 1, "%s: ERROR, no CUESHEET to use with --cue\n", infilename);
+			return 1;
+		}
+		flac__utils_canonicalize_cue_specification(&cue_specification, &cuesheet->data.cue_sheet, streaminfo.data.stream_info.total_samples, &skip_specification, &until_specification);
+		FLAC__metadata_object_delete(cuesheet);
+	}
+	else {
+		if(!flac__utils_parse_skip_until_specification(option_values.skip_specification, &skip_specification) || skip_specification.is_relative)
+			return usage_error("ERROR: invalid value for --skip\n");
+		if(!flac__utils_parse_skip_until_specification(option_values.until_specification, &until_specification))
+			return usage_error("ERROR: invalid value for --until\n");
+		/* if there is no "--until" we want to default to "--until=-0" */
+		if(0 == option_values.until_specification)
+			until_specification.is_relative = true;
+
+		flac__utils_canonicalize_skip_until_specification(&skip_specification, streaminfo.data.stream_info.sample_rate);
+		if(!flac__utils_canonicalize_until_specification(&until_specification, infilename, streaminfo.data.stream_info.sample_rate, (FLAC__uint64)skip_specification.value.samples, streaminfo.data.stream_info.total_samples))
+			return 1;
+	}
+
+	segment.filename = infilename;
+	segment.skip = (FLAC__uint64)skip_specification.value.samples;
+	segment.until = (FLAC__uint64)until_specification.value.samples;
+
+	return splice_file(infilename, &segment, 1, outfilename);
+}
+
+int split_file(const char *infilename)
+{
+	FLAC__StreamMetadata streaminfo, *cuesheet;
+	const FLAC__StreamMetadata_CueSheet *cs;
+	FLAC__uint64 total_samples;
+	unsigned i;
+	int retval = 0;
+
+	if(0 == strcmp(infilename, "-"))
+		return usage_error("ERROR: --split cannot read from stdin\n");
+
+	if(!FLAC__metadata_get_streaminfo(infilename, &streaminfo)) {
+		flac__utils_printf(stderr, 1, "%s: ERROR reading STREAMINFO\n", infilename);
+		return 1;
+	}
+	total_samples = streaminfo.data.stream_info.total_samples;
+	if(total_samples == 0) {
+		flac__utils_printf(stderr, 1, "%s: ERROR can't use --split when FLAC metadata has total sample count of 0\n", infilename);
+		return 1;
+	}
+
+	if(option_values.cuesheet_filename) {
+		const FLAC__StreamMetadata_StreamInfo *si = &streaminfo.data.stream_info;
+		const FLAC__bool is_cdda = (si->channels == 1 || si->channels == 2) && (si->bits_per_sample == 16) && (si->sample_rate == 44100);
+		const char *error_message;
+		unsigned last_line_read;
+		FILE *f;
+		if(0 == (f = flac_fopen(option_values.cuesheet_filename, "r"))) {
+			flac__utils_printf(stderr, 1, "%s: ERROR opening cuesheet \"%s\" for reading: %s\n", infilename, option_values.cuesheet_filename, strerror(errno));
+			return 1;
+		}
+		cuesheet = grabbag__cuesheet_parse(f, &error_message, &last_line_read, si->sample_rate, is_cdda, total_samples);
+		fclose(f);
+		if(0 == cuesheet) {
+			flac__utils_printf(stderr, 1, "%s: ERROR parsing cuesheet \"%s\" on line %u: %s\n", infilename, option_values.cuesheet_filename, last_line_read, error_message);
+			return 1;
+		}
+	}
+	else if(!FLAC__metadata_get_cuesheet(infilename, &cuesheet)) {
+		flac__utils_printf(stderr, 1, "%s: ERROR, no CUESHEET to split by; use --cuesheet\n", infilename);
+		return 1;
+	}
+	cs = &cuesheet->data.cue_sheet;
+
+	/* each track runs from its index 1 to the next track's index 1; the last one is the lead-out */
+	for(i = 0; i + 1 < cs->num_tracks && retval == 0; i++) {
+		utils__CueSpecification cue_specification;
+		utils__SkipUntilSpecification skip_specification, until_specification;
+		grabbag__SpliceSegment segment;
+		char suffix[16], outfilename_buffer[OUTFILENAME_BUFFER_SIZE];
+		const char *outfilename;
+
+		cue_specification.has_start_point = true;
+		cue_specification.start_track = cs->tracks[i].number;
+		cue_specification.start_index = 1;
+		cue_specification.has_end_point = (i + 2 < cs->num_tracks);
+		cue_specification.end_track = cs->tracks[i+1].number;
+		cue_specification.end_index = 1;
+		flac__utils_canonicalize_cue_specification(&cue_specification, cs, total_samples, &skip_specification, &until_specification);
+		if(until_specification.value.samples <= skip_specification.value.samples)
+			continue;
+
+		flac_snprintf(suffix, sizeof(suffix), ".%02u.flac", cs->tracks[i].number);
+		if(0 == (outfilename = get_outfilename(infilename, suffix, outfilename_buffer, sizeof(outfilename_buffer)))) {
+			flac__utils_printf(stderr, 1, "ERROR: filename too long: %s", infilename);
+			retval = 1;
+			break;
+		}
+
+		segment.filename = infilename;
+		segment.skip = (FLAC__uint64)skip_specification.value.samples;
+		segment.until = (FLAC__uint64)until_specification.value.samples;
+		retval = splice_file(infilename, &segment, 1, outfilename);
+	}
+
+	FLAC__metadata_object_delete(cuesheet);
+
+	return retval;
+}
+
+int join_files(void)
+{
+	grabbag__SpliceSegment *segments;
+	const char *outfilename = option_values.force_to_stdout? "-" : option_values.cmdline_forced_outfilename;
+	unsigned i;
+	int retval;
+
+	FLAC__ASSERT(0 != outfilename);
+
+	if(0 == (segments = safe_malloc_mul_2op_(option_values.num_files, sizeof(grabbag__SpliceSegment))))
+		die("out of memory allocating space for segment list");
+
+	for(i = 0; i < option_values.num_files; i++) {
+		if(0 == strcmp(option_values.filenames[i], "-")) {
+			free(segments);
+			return usage_error("ERROR: --join cannot read from stdin\n");
+		}
+		segments[i].filename = option_values.filenames[i];
+		segments[i].skip = 0;
+		segments[i].until = 0;
+	}
+
+	retval = splice_file(option_values.filenames[0], segments, option_values.num_files, outfilename);
+
+	free(segments);
+
+	return retval;
+}
+
+unsigned get_compression_level(void)
+{
+	unsigned level = 5, i;
+	for(i = 0; i < option_values.num_compression_settings; i++) {
+		if(option_values.compression_settings[i].type == CST_COMPRESSION_LEVEL)
+			level = option_values.compression_settings[i].value.t_unsigned;
+	}
+	return level;
+}
+
+#ifdef HAVE_PTHREAD
+/* the files given on the command line are handed out in order to the --jobs threads */
+static struct {
+	pthread_mutex_t mutex;
+	unsigned next_file;
+	int retval;
+} jobs_;
+
+static void *job_thread_(void *arg)
+{
+	(void)arg;
+
+	for(;;) {
+		unsigned i;
+		int retval;
+
+		pthread_mutex_lock(&jobs_.mutex);
+		i = jobs_.next_file++;
+		pthread_mutex_unlock(&jobs_.mutex);
+		if(i >= option_values.num_files)
+			break;
+
+		flac__utils_begin_buffered_output();
+		if(option_values.mode_decode)
+			retval = decode_file(option_values.filenames[i]);
+		else
+			retval = encode_file(option_values.filenames[i], i == 0, i == option_values.num_files - 1, i);
+		flac__utils_end_buffered_output();
+
+		pthread_mutex_lock(&jobs_.mutex);
+		jobs_.retval |= retval;
+		pthread_mutex_unlock(&jobs_.mutex);
+	}
+
+	return 0;
+}
+
+int run_jobs(void)
+{
+	pthread_t *threads;
+	unsigned num_threads = option_values.num_jobs < option_values.num_files? option_values.num_jobs : option_values.num_files, i, n;
+
+	FLAC__ASSERT(num_threads > 1);
+
+	if(0 == (threads = safe_malloc_mul_2op_(num_threads, sizeof(pthread_t))))
+		die("out of memory allocating space for threads");
+	if(0 != pthread_mutex_init(&jobs_.mutex, 0))
+		die("initializing mutex");
+	jobs_.next_file = 0;
+	jobs_.retval = 0;
+
+	/* if not all the threads can be started, the ones that were do all the files */
+	for(n = 0; n < num_threads; n++) {
+		if(0 != pthread_create(&threads[n], 0, job_thread_, 0))
+			break;
+	}
+	if(n == 0)
+		job_thread_(0);
+	for(i = 0; i < n; i++)
+		pthread_join(threads[i], 0);
+
+	pthread_mutex_destroy(&jobs_.mutex);
+	free(threads);
+
+	return jobs_.retval;
+}
+#endif
+
+const char *get_encoded_outfilename(const char *infilename, char *buffer, size_t buffer_size)
 {
 	const char *suffix = (option_values.use_ogg? ".oga" : ".flac");
-	return get_outfilename(infilename, suffix);
+	return get_outfilename(infilename, suffix, buffer, buffer_size);
 }
 
-const char *get_decoded_outfilename(const char *infilename)
+const char *get_decoded_outfilename(const char *infilename, char *buffer, size_t buffer_size)
 {
 	const char *suffix;
 	if(option_values.analyze) {
@@ -2196,31 +2803,30 @@ const char *get_decoded_outfilename(const char *infilename)
 	else {
 		suffix = ".wav";
 	}
-	return get_outfilename(infilename, suffix);
+	return get_outfilename(infilename, suffix, buffer, buffer_size);
 }
 
-const char *get_outfilename(const char *infilename, const char *suffix)
+/* the name is made in the caller's buffer so that files can be done in parallel with --jobs */
+const char *get_outfilename(const char *infilename, const char *suffix, char *buffer, size_t buffer_size)
 {
 	if(0 == option_values.cmdline_forced_outfilename) {
-		static char buffer[4096]; /* @@@ bad MAGIC NUMBER */
-
 		if(0 == strcmp(infilename, "-") || option_values.force_to_stdout) {
-			safe_strncpy(buffer, "-", sizeof(buffer));
+			safe_strncpy(buffer, "-", buffer_size);
 		}
 		else {
 			char *p;
-			if (flac__strlcpy(buffer, option_values.output_prefix? option_values.output_prefix : "", sizeof buffer) >= sizeof buffer)
+			if (flac__strlcpy(buffer, option_values.output_prefix? option_values.output_prefix : "", buffer_size) >= buffer_size)
 				return 0;
-			if (flac__strlcat(buffer, infilename, sizeof buffer) >= sizeof buffer)
+			if (flac__strlcat(buffer, infilename, buffer_size) >= buffer_size)
 				return 0;
 			/* the . must come after any / to avoid problems with, e.g. "some.directory/extensionless-filename" */
 			if(0 == (p = strrchr(buffer, '.')) || strchr(p, '/')) {
-				if (flac__strlcat(buffer, suffix, sizeof buffer) >= sizeof buffer)
+				if (flac__strlcat(buffer, suffix, buffer_size) >= buffer_size)
 					return 0;
 			}
 			else {
 				*p = '\0';
-				if (flac__strlcat(buffer, suffix, sizeof buffer) >= sizeof buffer)
+				if (flac__strlcat(buffer, suffix, buffer_size) >= buffer_size)
 					return 0;
 			}
 		}
@@ -0,0 +1,749 @@
+/* flac - Command-line FLAC encoder/decoder
+ * Copyright (C) 2014  Xiph.Org Foundation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stddef.h> /* for size_t */
+#include "share/cpu.h"
+#include "pcm.h"
+
+#ifdef SHARE__X86_SIMD
+
+#include <immintrin.h>
+
+/* the number of samples that the routines for more than 2 channels convert
+ * at a time, going through an interleaved FLAC__int32 buffer of this size */
+#define BLOCK_SAMPLES 1024
+
+static inline FLAC__int32 sample16_(const FLAC__byte b[], FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	const FLAC__int32 x = is_big_endian? (b[0] << 8) | b[1] : (b[1] << 8) | b[0];
+	return is_unsigned_samples? x - 0x8000 : (x ^ 0x8000) - 0x8000;
+}
+
+static inline FLAC__int32 sample24_(const FLAC__byte b[], FLAC__bool is_big_endian)
+{
+	const FLAC__int32 x = is_big_endian? (b[0] << 16) | (b[1] << 8) | b[2] : (b[2] << 16) | (b[1] << 8) | b[0];
+	return (x ^ 0x800000) - 0x800000;
+}
+
+/* copies frames wide samples of interleaved int32 samples from tmp[] to
+ * out[0..channels-1], starting at wide_sample */
+static inline void deinterleave_(FLAC__int32 * const out[], unsigned channels, const FLAC__int32 tmp[], unsigned frames, unsigned wide_sample)
+{
+	unsigned channel, i;
+	for(channel = 0; channel < channels; channel++) {
+		FLAC__int32 *o = out[channel] + wide_sample;
+		const FLAC__int32 *t = tmp + channel;
+		for(i = 0; i < frames; i++)
+			o[i] = t[(size_t)i * channels];
+	}
+}
+
+/*
+ * 16 bits: the samples are byte-swapped if need be and, if unsigned, have
+ * their top bit flipped, which leaves them as signed 16-bit values to be
+ * sign-extended.  is_unsigned_samples is a constant in each caller and the
+ * tests on it are folded away.
+ */
+
+SHARE__SIMD_TARGET("sse2")
+static inline __m128i load16_sse2_(const FLAC__byte in[], FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	__m128i x = _mm_loadu_si128((const __m128i*)in);
+	if(is_big_endian)
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	if(is_unsigned_samples)
+		x = _mm_xor_si128(x, _mm_set1_epi16((short)0x8000));
+	return x;
+}
+
+/* converts n samples without deinterleaving them */
+SHARE__SIMD_TARGET("sse2")
+static inline void convert16_sse2_(FLAC__int32 out[], const FLAC__byte in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 8 <= n; i += 8) {
+		const __m128i x = load16_sse2_(in + 2 * (size_t)i, is_big_endian, is_unsigned_samples);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		_mm_storeu_si128((__m128i*)(out + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+	}
+	for( ; i < n; i++)
+		out[i] = sample16_(in + 2 * (size_t)i, is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void unpack16_sse2_(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert16_sse2_(out[0], in, wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		FLAC__int32 *left = out[0], *right = out[1];
+		unsigned i;
+		for(i = 0; i + 4 <= wide_samples; i += 4) {
+			/* each 32-bit lane holds one wide sample, left channel in the low half */
+			const __m128i x = load16_sse2_(in + 4 * (size_t)i, is_big_endian, is_unsigned_samples);
+			_mm_storeu_si128((__m128i*)(left + i), _mm_srai_epi32(_mm_slli_epi32(x, 16), 16));
+			_mm_storeu_si128((__m128i*)(right + i), _mm_srai_epi32(x, 16));
+		}
+		for( ; i < wide_samples; i++) {
+			left[i] = sample16_(in + 4 * (size_t)i, is_big_endian, is_unsigned_samples);
+			right[i] = sample16_(in + 4 * (size_t)i + 2, is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			convert16_sse2_(tmp, in + 2 * (size_t)i * channels, frames * channels, is_big_endian, is_unsigned_samples);
+			deinterleave_(out, channels, tmp, frames, i);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void unpack_s16_sse2(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	unpack16_sse2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void unpack_u16_sse2(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	unpack16_sse2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m256i load16_avx2_(const FLAC__byte in[], FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	__m256i x = _mm256_loadu_si256((const __m256i*)in);
+	if(is_big_endian)
+		x = _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+	if(is_unsigned_samples)
+		x = _mm256_xor_si256(x, _mm256_set1_epi16((short)0x8000));
+	return x;
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline void convert16_avx2_(FLAC__int32 out[], const FLAC__byte in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 16 <= n; i += 16) {
+		const __m256i x = load16_avx2_(in + 2 * (size_t)i, is_big_endian, is_unsigned_samples);
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x)));
+		_mm256_storeu_si256((__m256i*)(out + i + 8), _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1)));
+	}
+	for( ; i < n; i++)
+		out[i] = sample16_(in + 2 * (size_t)i, is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void unpack16_avx2_(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert16_avx2_(out[0], in, wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		FLAC__int32 *left = out[0], *right = out[1];
+		unsigned i;
+		for(i = 0; i + 8 <= wide_samples; i += 8) {
+			const __m256i x = load16_avx2_(in + 4 * (size_t)i, is_big_endian, is_unsigned_samples);
+			_mm256_storeu_si256((__m256i*)(left + i), _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16));
+			_mm256_storeu_si256((__m256i*)(right + i), _mm256_srai_epi32(x, 16));
+		}
+		for( ; i < wide_samples; i++) {
+			left[i] = sample16_(in + 4 * (size_t)i, is_big_endian, is_unsigned_samples);
+			right[i] = sample16_(in + 4 * (size_t)i + 2, is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			convert16_avx2_(tmp, in + 2 * (size_t)i * channels, frames * channels, is_big_endian, is_unsigned_samples);
+			deinterleave_(out, channels, tmp, frames, i);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void unpack_s16_avx2(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	unpack16_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void unpack_u16_avx2(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	unpack16_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+/*
+ * 24 bits: a byte shuffle puts each 3-byte sample in the top of a 32-bit
+ * lane, and an arithmetic shift brings it down with its sign.  The loads
+ * are 16 bytes for every 12 used, so the vector loops stop early enough
+ * not to read past the last sample.
+ */
+
+SHARE__SIMD_TARGET("ssse3")
+static inline __m128i shuffle24_ssse3_(FLAC__bool is_big_endian)
+{
+	return is_big_endian?
+		_mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9) :
+		_mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static inline __m128i load24_ssse3_(const FLAC__byte in[], __m128i shuffle)
+{
+	return _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), shuffle), 8);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static inline void convert24_ssse3_(FLAC__int32 out[], const FLAC__byte in[], unsigned n, FLAC__bool is_big_endian)
+{
+	const __m128i shuffle = shuffle24_ssse3_(is_big_endian);
+	unsigned i;
+	for(i = 0; i + 6 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)(out + i), load24_ssse3_(in + 3 * (size_t)i, shuffle));
+	for( ; i < n; i++)
+		out[i] = sample24_(in + 3 * (size_t)i, is_big_endian);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static void unpack_s24_ssse3(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	if(channels == 1) {
+		convert24_ssse3_(out[0], in, wide_samples, is_big_endian);
+	}
+	else if(channels == 2) {
+		const __m128i shuffle = shuffle24_ssse3_(is_big_endian);
+		FLAC__int32 *left = out[0], *right = out[1];
+		unsigned i;
+		for(i = 0; i + 5 <= wide_samples; i += 4) {
+			/* L0 R0 L1 R1 and L2 R2 L3 R3, reordered to L0 L1 R0 R1 and L2 L3 R2 R3 */
+			const __m128i x = _mm_shuffle_epi32(load24_ssse3_(in + 6 * (size_t)i, shuffle), _MM_SHUFFLE(3, 1, 2, 0));
+			const __m128i y = _mm_shuffle_epi32(load24_ssse3_(in + 6 * (size_t)i + 12, shuffle), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(left + i), _mm_unpacklo_epi64(x, y));
+			_mm_storeu_si128((__m128i*)(right + i), _mm_unpackhi_epi64(x, y));
+		}
+		for( ; i < wide_samples; i++) {
+			left[i] = sample24_(in + 6 * (size_t)i, is_big_endian);
+			right[i] = sample24_(in + 6 * (size_t)i + 3, is_big_endian);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			convert24_ssse3_(tmp, in + 3 * (size_t)i * channels, frames * channels, is_big_endian);
+			deinterleave_(out, channels, tmp, frames, i);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m256i load24_avx2_(const FLAC__byte in[], __m256i shuffle)
+{
+	const __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)), _mm_loadu_si128((const __m128i*)(in + 12)), 1);
+	return _mm256_srai_epi32(_mm256_shuffle_epi8(x, shuffle), 8);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline void convert24_avx2_(FLAC__int32 out[], const FLAC__byte in[], unsigned n, FLAC__bool is_big_endian)
+{
+	const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle24_ssse3_(is_big_endian));
+	unsigned i;
+	for(i = 0; i + 10 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + i), load24_avx2_(in + 3 * (size_t)i, shuffle));
+	for( ; i < n; i++)
+		out[i] = sample24_(in + 3 * (size_t)i, is_big_endian);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void unpack_s24_avx2(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	if(channels == 1) {
+		convert24_avx2_(out[0], in, wide_samples, is_big_endian);
+	}
+	else if(channels == 2) {
+		/* L0 R0 L1 R1 L2 R2 L3 R3 to L0 L1 L2 L3 R0 R1 R2 R3 */
+		const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle24_ssse3_(is_big_endian));
+		const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		FLAC__int32 *left = out[0], *right = out[1];
+		unsigned i;
+		for(i = 0; i + 5 <= wide_samples; i += 4) {
+			const __m256i x = _mm256_permutevar8x32_epi32(load24_avx2_(in + 6 * (size_t)i, shuffle), deinterleave);
+			_mm_storeu_si128((__m128i*)(left + i), _mm256_castsi256_si128(x));
+			_mm_storeu_si128((__m128i*)(right + i), _mm256_extracti128_si256(x, 1));
+		}
+		for( ; i < wide_samples; i++) {
+			left[i] = sample24_(in + 6 * (size_t)i, is_big_endian);
+			right[i] = sample24_(in + 6 * (size_t)i + 3, is_big_endian);
+		}
+	}
+	else {
+		/* the deinterleave dominates here and is slower when built for AVX2 */
+		unpack_s24_ssse3(out, in, wide_samples, channels, is_big_endian);
+	}
+}
+
+/*
+ * Packing, the other way round for the decoder: one array of FLAC__int32
+ * per channel to interleaved bytes.  The samples are truncated to the
+ * output size, as the casts in the scalar code do, and the stores are kept
+ * inside the n samples being written, so out[] needs no slack at the end.
+ */
+
+static inline void store8_(FLAC__byte b[], FLAC__int32 x, FLAC__bool is_unsigned_samples)
+{
+	b[0] = (FLAC__byte)(is_unsigned_samples? x + 0x80 : x);
+}
+
+static inline void store16_(FLAC__byte b[], FLAC__int32 x, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	if(is_unsigned_samples)
+		x += 0x8000;
+	b[is_big_endian? 1 : 0] = (FLAC__byte)x;
+	b[is_big_endian? 0 : 1] = (FLAC__byte)(x >> 8);
+}
+
+static inline void store24_(FLAC__byte b[], FLAC__int32 x, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	if(is_unsigned_samples)
+		x += 0x800000;
+	b[is_big_endian? 2 : 0] = (FLAC__byte)x;
+	b[1] = (FLAC__byte)(x >> 8);
+	b[is_big_endian? 0 : 2] = (FLAC__byte)(x >> 16);
+}
+
+/* copies frames wide samples, starting at wide_sample, from
+ * in[0..channels-1] to tmp[] as interleaved int32 samples */
+static inline void interleave_(FLAC__int32 tmp[], const FLAC__int32 * const in[], unsigned channels, unsigned frames, unsigned wide_sample)
+{
+	unsigned channel, i;
+	for(channel = 0; channel < channels; channel++) {
+		const FLAC__int32 *s = in[channel] + wide_sample;
+		FLAC__int32 *t = tmp + channel;
+		for(i = 0; i < frames; i++)
+			t[(size_t)i * channels] = s[i];
+	}
+}
+
+/*
+ * 8 bits: only SSE2, there being little 8-bit audio about.
+ */
+
+SHARE__SIMD_TARGET("sse2")
+static inline void convert8_sse2_(FLAC__byte out[], const FLAC__int32 in[], unsigned n, FLAC__bool is_unsigned_samples)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	unsigned i;
+	for(i = 0; i + 16 <= n; i += 16) {
+		/* masking first keeps the saturating packs from changing anything */
+		const __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i)), mask);
+		const __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i + 4)), mask);
+		const __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i + 8)), mask);
+		const __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i + 12)), mask);
+		__m128i x = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		if(is_unsigned_samples)
+			x = _mm_xor_si128(x, _mm_set1_epi8((char)0x80));
+		_mm_storeu_si128((__m128i*)(out + i), x);
+	}
+	for( ; i < n; i++)
+		store8_(out + i, in[i], is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack8_sse2_(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert8_sse2_(out, in[0], wide_samples, is_unsigned_samples);
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			interleave_(tmp, in, channels, frames, i);
+			convert8_sse2_(out + (size_t)i * channels, tmp, frames * channels, is_unsigned_samples);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack_s8_sse2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	(void)is_big_endian;
+	pack8_sse2_(out, in, wide_samples, channels, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack_u8_sse2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	(void)is_big_endian;
+	pack8_sse2_(out, in, wide_samples, channels, /*is_unsigned_samples=*/true);
+}
+
+/*
+ * 16 bits: the samples are sign-extended from their low 16 bits so that
+ * the saturating pack truncates them, then have their top bit flipped if
+ * unsigned and are byte-swapped if need be.
+ */
+
+SHARE__SIMD_TARGET("sse2")
+static inline __m128i narrow16_sse2_(__m128i a, __m128i b, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	__m128i x = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+	if(is_unsigned_samples)
+		x = _mm_xor_si128(x, _mm_set1_epi16((short)0x8000));
+	if(is_big_endian)
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	return x;
+}
+
+/* converts n samples that are already interleaved */
+SHARE__SIMD_TARGET("sse2")
+static inline void convert16_to_sse2_(FLAC__byte out[], const FLAC__int32 in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 8 <= n; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i*)(in + i));
+		const __m128i b = _mm_loadu_si128((const __m128i*)(in + i + 4));
+		_mm_storeu_si128((__m128i*)(out + 2 * (size_t)i), narrow16_sse2_(a, b, is_big_endian, is_unsigned_samples));
+	}
+	for( ; i < n; i++)
+		store16_(out + 2 * (size_t)i, in[i], is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack16_sse2_(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert16_to_sse2_(out, in[0], wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		const FLAC__int32 *left = in[0], *right = in[1];
+		unsigned i;
+		for(i = 0; i + 4 <= wide_samples; i += 4) {
+			const __m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+			const __m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+			_mm_storeu_si128((__m128i*)(out + 4 * (size_t)i), narrow16_sse2_(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r), is_big_endian, is_unsigned_samples));
+		}
+		for( ; i < wide_samples; i++) {
+			store16_(out + 4 * (size_t)i, left[i], is_big_endian, is_unsigned_samples);
+			store16_(out + 4 * (size_t)i + 2, right[i], is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			interleave_(tmp, in, channels, frames, i);
+			convert16_to_sse2_(out + 2 * (size_t)i * channels, tmp, frames * channels, is_big_endian, is_unsigned_samples);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack_s16_sse2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack16_sse2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void pack_u16_sse2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack16_sse2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m256i narrow16_avx2_(__m256i a, __m256i b, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	/* the pack works within each 128-bit lane, so the quarters come out as a0 b0 a1 b1 */
+	__m256i x = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+	x = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 1, 2, 0));
+	if(is_unsigned_samples)
+		x = _mm256_xor_si256(x, _mm256_set1_epi16((short)0x8000));
+	if(is_big_endian)
+		x = _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+	return x;
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline void convert16_to_avx2_(FLAC__byte out[], const FLAC__int32 in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 16 <= n; i += 16) {
+		const __m256i a = _mm256_loadu_si256((const __m256i*)(in + i));
+		const __m256i b = _mm256_loadu_si256((const __m256i*)(in + i + 8));
+		_mm256_storeu_si256((__m256i*)(out + 2 * (size_t)i), narrow16_avx2_(a, b, is_big_endian, is_unsigned_samples));
+	}
+	for( ; i < n; i++)
+		store16_(out + 2 * (size_t)i, in[i], is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack16_avx2_(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert16_to_avx2_(out, in[0], wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		const FLAC__int32 *left = in[0], *right = in[1];
+		unsigned i;
+		for(i = 0; i + 8 <= wide_samples; i += 8) {
+			const __m256i l = _mm256_loadu_si256((const __m256i*)(left + i));
+			const __m256i r = _mm256_loadu_si256((const __m256i*)(right + i));
+			/* L0 R0 L1 R1 L4 R4 L5 R5 and L2 R2 L3 R3 L6 R6 L7 R7, put back in order */
+			const __m256i lo = _mm256_unpacklo_epi32(l, r), hi = _mm256_unpackhi_epi32(l, r);
+			_mm256_storeu_si256((__m256i*)(out + 4 * (size_t)i), narrow16_avx2_(_mm256_permute2x128_si256(lo, hi, 0x20), _mm256_permute2x128_si256(lo, hi, 0x31), is_big_endian, is_unsigned_samples));
+		}
+		for( ; i < wide_samples; i++) {
+			store16_(out + 4 * (size_t)i, left[i], is_big_endian, is_unsigned_samples);
+			store16_(out + 4 * (size_t)i + 2, right[i], is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			interleave_(tmp, in, channels, frames, i);
+			convert16_to_avx2_(out + 2 * (size_t)i * channels, tmp, frames * channels, is_big_endian, is_unsigned_samples);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack_s16_avx2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack16_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack_u16_avx2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack16_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+/*
+ * 24 bits: a byte shuffle drops the top byte of each 32-bit lane.  The
+ * stores are 16 bytes for every 12 used, the rest being overwritten by the
+ * next store, so the vector loops stop early enough not to write past the
+ * last sample.
+ */
+
+SHARE__SIMD_TARGET("ssse3")
+static inline __m128i narrow24_ssse3_(__m128i x, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	const __m128i shuffle = is_big_endian?
+		_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+		_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	if(is_unsigned_samples)
+		x = _mm_add_epi32(x, _mm_set1_epi32(0x800000));
+	return _mm_shuffle_epi8(x, shuffle);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static inline void convert24_to_ssse3_(FLAC__byte out[], const FLAC__int32 in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 6 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)(out + 3 * (size_t)i), narrow24_ssse3_(_mm_loadu_si128((const __m128i*)(in + i)), is_big_endian, is_unsigned_samples));
+	for( ; i < n; i++)
+		store24_(out + 3 * (size_t)i, in[i], is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static void pack24_ssse3_(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert24_to_ssse3_(out, in[0], wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		const FLAC__int32 *left = in[0], *right = in[1];
+		unsigned i;
+		for(i = 0; i + 5 <= wide_samples; i += 4) {
+			const __m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+			const __m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+			_mm_storeu_si128((__m128i*)(out + 6 * (size_t)i), narrow24_ssse3_(_mm_unpacklo_epi32(l, r), is_big_endian, is_unsigned_samples));
+			_mm_storeu_si128((__m128i*)(out + 6 * (size_t)i + 12), narrow24_ssse3_(_mm_unpackhi_epi32(l, r), is_big_endian, is_unsigned_samples));
+		}
+		for( ; i < wide_samples; i++) {
+			store24_(out + 6 * (size_t)i, left[i], is_big_endian, is_unsigned_samples);
+			store24_(out + 6 * (size_t)i + 3, right[i], is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			interleave_(tmp, in, channels, frames, i);
+			convert24_to_ssse3_(out + 3 * (size_t)i * channels, tmp, frames * channels, is_big_endian, is_unsigned_samples);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static void pack_s24_ssse3(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack24_ssse3_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("ssse3")
+static void pack_u24_ssse3(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack24_ssse3_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m256i narrow24_avx2_(__m256i x, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	const __m256i shuffle = is_big_endian?
+		_mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+		_mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	if(is_unsigned_samples)
+		x = _mm256_add_epi32(x, _mm256_set1_epi32(0x800000));
+	/* 12 bytes at the bottom of each lane, moved together */
+	return _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, shuffle), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline void convert24_to_avx2_(FLAC__byte out[], const FLAC__int32 in[], unsigned n, FLAC__bool is_big_endian, FLAC__bool is_unsigned_samples)
+{
+	unsigned i;
+	for(i = 0; i + 11 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + 3 * (size_t)i), narrow24_avx2_(_mm256_loadu_si256((const __m256i*)(in + i)), is_big_endian, is_unsigned_samples));
+	for( ; i < n; i++)
+		store24_(out + 3 * (size_t)i, in[i], is_big_endian, is_unsigned_samples);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack24_avx2_(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian, const FLAC__bool is_unsigned_samples)
+{
+	if(channels == 1) {
+		convert24_to_avx2_(out, in[0], wide_samples, is_big_endian, is_unsigned_samples);
+	}
+	else if(channels == 2) {
+		const FLAC__int32 *left = in[0], *right = in[1];
+		unsigned i;
+		for(i = 0; i + 10 <= wide_samples; i += 8) {
+			const __m256i l = _mm256_loadu_si256((const __m256i*)(left + i));
+			const __m256i r = _mm256_loadu_si256((const __m256i*)(right + i));
+			const __m256i lo = _mm256_unpacklo_epi32(l, r), hi = _mm256_unpackhi_epi32(l, r);
+			_mm256_storeu_si256((__m256i*)(out + 6 * (size_t)i), narrow24_avx2_(_mm256_permute2x128_si256(lo, hi, 0x20), is_big_endian, is_unsigned_samples));
+			_mm256_storeu_si256((__m256i*)(out + 6 * (size_t)i + 24), narrow24_avx2_(_mm256_permute2x128_si256(lo, hi, 0x31), is_big_endian, is_unsigned_samples));
+		}
+		for( ; i < wide_samples; i++) {
+			store24_(out + 6 * (size_t)i, left[i], is_big_endian, is_unsigned_samples);
+			store24_(out + 6 * (size_t)i + 3, right[i], is_big_endian, is_unsigned_samples);
+		}
+	}
+	else {
+		FLAC__int32 tmp[BLOCK_SAMPLES];
+		const unsigned block = BLOCK_SAMPLES / channels;
+		unsigned i, frames;
+		for(i = 0; i < wide_samples; i += frames) {
+			frames = wide_samples - i < block? wide_samples - i : block;
+			interleave_(tmp, in, channels, frames, i);
+			convert24_to_avx2_(out + 3 * (size_t)i * channels, tmp, frames * channels, is_big_endian, is_unsigned_samples);
+		}
+	}
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack_s24_avx2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack24_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/false);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void pack_u24_avx2(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian)
+{
+	pack24_avx2_(out, in, wide_samples, channels, is_big_endian, /*is_unsigned_samples=*/true);
+}
+
+#endif /* SHARE__X86_SIMD */
+
+flac__PCMUnpackFunc flac__pcm_get_unpack_func(unsigned bps, FLAC__bool is_unsigned_samples)
+{
+#ifdef SHARE__X86_SIMD
+	share__CPUInfo cpu;
+
+	share__cpu_info(&cpu);
+	if(bps == 16) {
+		if(cpu.avx2)
+			return is_unsigned_samples? unpack_u16_avx2 : unpack_s16_avx2;
+		if(cpu.sse2)
+			return is_unsigned_samples? unpack_u16_sse2 : unpack_s16_sse2;
+	}
+	else if(bps == 24 && !is_unsigned_samples) {
+		if(cpu.avx2)
+			return unpack_s24_avx2;
+		if(cpu.ssse3)
+			return unpack_s24_ssse3;
+	}
+#else
+	(void)bps, (void)is_unsigned_samples;
+#endif
+	return 0;
+}
+
+flac__PCMPackFunc flac__pcm_get_pack_func(unsigned bps, FLAC__bool is_unsigned_samples)
+{
+#ifdef SHARE__X86_SIMD
+	share__CPUInfo cpu;
+
+	share__cpu_info(&cpu);
+	if(bps == 8) {
+		if(cpu.sse2)
+			return is_unsigned_samples? pack_u8_sse2 : pack_s8_sse2;
+	}
+	else if(bps == 16) {
+		if(cpu.avx2)
+			return is_unsigned_samples? pack_u16_avx2 : pack_s16_avx2;
+		if(cpu.sse2)
+			return is_unsigned_samples? pack_u16_sse2 : pack_s16_sse2;
+	}
+	else if(bps == 24) {
+		if(cpu.avx2)
+			return is_unsigned_samples? pack_u24_avx2 : pack_s24_avx2;
+		if(cpu.ssse3)
+			return is_unsigned_samples? pack_u24_ssse3 : pack_s24_ssse3;
+	}
+#else
+	(void)bps, (void)is_unsigned_samples;
+#endif
+	return 0;
+}
@@ -0,0 +1,64 @@
+/* flac - Command-line FLAC encoder/decoder
+ * Copyright (C) 2014  Xiph.Org Foundation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef flac__pcm_h
+#define flac__pcm_h
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+/* Converts wide_samples of one array of FLAC__int32 per channel,
+ * in[0..channels-1], to interleaved PCM in out[], truncating each sample
+ * to the output size.  Nothing is written past the last output sample.
+ */
+typedef void (*flac__PCMPackFunc)(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian);
+
+/* Like flac__pcm_get_unpack_func(), for the decoder's output.  There are
+ * routines for signed and unsigned 8-, 16- and 24-bit samples.
+ */
+flac__PCMPackFunc flac__pcm_get_pack_func(unsigned bps, FLAC__bool is_unsigned_samples);
+
+#endif
+
+#include "FLAC/ordinals.h"
+
+/* Converts wide_samples of interleaved PCM in in[] to one array of
+ * FLAC__int32 per channel, out[0..channels-1].  Which sample sizes and
+ * signedness a routine handles is fixed when it is picked; the byte order
+ * is given on each call.
+ */
+typedef void (*flac__PCMUnpackFunc)(FLAC__int32 * const out[], const FLAC__byte in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian);
+
+/* Returns a SIMD routine for the given format that this CPU can run, or
+ * NULL if there is none and the samples must be converted the usual way.
+ * There are routines for signed and unsigned 16-bit and signed 24-bit
+ * samples, either byte order, any number of channels.
+ */
+flac__PCMUnpackFunc flac__pcm_get_unpack_func(unsigned bps, FLAC__bool is_unsigned_samples);
+
+/* Converts wide_samples of one array of FLAC__int32 per channel,
+ * in[0..channels-1], to interleaved PCM in out[], truncating each sample
+ * to the output size.  Nothing is written past the last output sample.
+ */
+typedef void (*flac__PCMPackFunc)(FLAC__byte out[], const FLAC__int32 * const in[], unsigned wide_samples, unsigned channels, FLAC__bool is_big_endian);
+
+/* Like flac__pcm_get_unpack_func(), for the decoder's output.  There are
+ * routines for signed and unsigned 8-, 16- and 24-bit samples.
+ */
+flac__PCMPackFunc flac__pcm_get_pack_func(unsigned bps, FLAC__bool is_unsigned_samples);
+
+#endif
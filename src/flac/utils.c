@@ -30,6 +30,9 @@
 #include "FLAC/assert.h"
 #include "FLAC/metadata.h"
 #include "share/compat.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #ifndef _WIN32
 #include <wchar.h>
 #ifdef HAVE_TERMIOS_H
@@ -44,6 +47,104 @@ const char *CHANNEL_MASK_TAG = "WAVEFORMATEXTENSIBLE_CHANNEL_MASK";
 
 int flac__utils_verbosity_ = 2;
 
+#ifdef HAVE_PTHREAD
+/* console output collected by a thread between flac__utils_begin_buffered_output()
+ * and flac__utils_end_buffered_output() */
+typedef struct {
+	char *text;
+	size_t length, capacity;
+	size_t info_start; /* everything after this is status info that the next update replaces */
+	FLAC__bool is_name_printed;
+} OutputBuffer;
+
+static pthread_once_t output_key_once_ = PTHREAD_ONCE_INIT;
+static pthread_key_t output_key_;
+
+static void create_output_key_(void)
+{
+	(void)pthread_key_create(&output_key_, 0);
+}
+
+static OutputBuffer *get_output_buffer_(const FILE *stream)
+{
+	if(stream != stderr)
+		return 0;
+	(void)pthread_once(&output_key_once_, create_output_key_);
+	return (OutputBuffer*)pthread_getspecific(output_key_);
+}
+
+/* returns false if the buffer had to grow and the text must be formatted again */
+static FLAC__bool output_buffer_append_(OutputBuffer *b, const char *format, va_list args)
+{
+	const size_t avail = b->capacity - b->length;
+	const int len = avail > 1? flac_vsnprintf(b->text + b->length, avail, format, args) : -1;
+	size_t capacity;
+	char *text;
+
+	/* some vsnprintf()s return size-1 or -1 instead of the needed length when truncating */
+	if(len >= 0 && (size_t)len + 1 < avail) {
+		b->length += len;
+		return true;
+	}
+	capacity = b->capacity * 2;
+	if(len >= 0 && capacity < b->length + len + 2)
+		capacity = b->length + len + 2;
+	if(0 == (text = realloc(b->text, capacity))) {
+		b->text[b->length] = '\0';
+		return true; /* drop the text */
+	}
+	b->text = text;
+	b->capacity = capacity;
+	return false;
+}
+
+static void output_buffer_printf_(OutputBuffer *b, const char *format, ...)
+{
+	va_list args;
+	FLAC__bool done;
+
+	do {
+		va_start(args, format);
+		done = output_buffer_append_(b, format, args);
+		va_end(args);
+	} while(!done);
+}
+
+void flac__utils_begin_buffered_output(void)
+{
+	OutputBuffer *b;
+
+	(void)pthread_once(&output_key_once_, create_output_key_);
+	if(0 == (b = calloc(1, sizeof(OutputBuffer))))
+		return;
+	b->capacity = 256;
+	if(0 == (b->text = malloc(b->capacity))) {
+		free(b);
+		return;
+	}
+	b->text[0] = '\0';
+	(void)pthread_setspecific(output_key_, b);
+}
+
+void flac__utils_end_buffered_output(void)
+{
+	OutputBuffer *b = get_output_buffer_(stderr);
+
+	if(0 == b)
+		return;
+	(void)pthread_setspecific(output_key_, 0);
+	if(b->length > 0) {
+		/* the last status line is kept, but needs to be ended */
+		if(b->text[b->length-1] != '\n')
+			flac_fprintf(stderr, "%s\n", b->text);
+		else
+			flac_fprintf(stderr, "%s", b->text);
+	}
+	free(b->text);
+	free(b);
+}
+#endif
+
 static FLAC__bool local__parse_uint64_(const char *s, FLAC__uint64 *value)
 {
 	FLAC__uint64 ret = 0;
@@ -152,9 +253,25 @@ void flac__utils_printf(FILE *stream, int level, const char *format, ...)
 {
 	if(flac__utils_verbosity_ >= level) {
 		va_list args;
+#ifdef HAVE_PTHREAD
+		OutputBuffer *b = get_output_buffer_(stream);
+#endif
 
 		FLAC__ASSERT(0 != format);
 
+#ifdef HAVE_PTHREAD
+		if(0 != b) {
+			FLAC__bool done;
+			do {
+				va_start(args, format);
+				done = output_buffer_append_(b, format, args);
+				va_end(args);
+			} while(!done);
+			b->info_start = b->length;
+			return;
+		}
+#endif
+
 		va_start(args, format);
 
 		(void) flac_vfprintf(stream, format, args);
@@ -214,11 +331,26 @@ size_t strlen_console(const char *text)
 
 void stats_new_file(void)
 {
+#ifdef HAVE_PTHREAD
+	OutputBuffer *b = get_output_buffer_(stderr);
+	if(0 != b) {
+		b->is_name_printed = false;
+		return;
+	}
+#endif
 	is_name_printed = false;
 }
 
 void stats_clear(void)
 {
+#ifdef HAVE_PTHREAD
+	OutputBuffer *b = get_output_buffer_(stderr);
+	if(0 != b) {
+		b->length = b->info_start;
+		b->text[b->length] = '\0';
+		return;
+	}
+#endif
 	while (stats_char_count > 0 && stats_char_count--)
 		fprintf(stderr, "\b");
 }
@@ -228,6 +360,17 @@ void stats_print_name(int level, const char *name)
 	int len;
 
 	if (flac__utils_verbosity_ >= level) {
+#ifdef HAVE_PTHREAD
+		OutputBuffer *b = get_output_buffer_(stderr);
+		if(0 != b) {
+			stats_clear();
+			if(b->is_name_printed) return;
+			output_buffer_printf_(b, "%s: ", name);
+			b->info_start = b->length;
+			b->is_name_printed = true;
+			return;
+		}
+#endif
 		stats_clear();
 		if(is_name_printed) return;
 
@@ -250,6 +393,16 @@ void stats_print_info(int level, const char *format, ...)
 		len = flac_vsnprintf(tmp, sizeof(tmp), format, args);
 		va_end(args);
 		stats_clear();
+#ifdef HAVE_PTHREAD
+		{
+			/* the info replaces the previous one; there is no console line to fit it in */
+			OutputBuffer *b = get_output_buffer_(stderr);
+			if(0 != b) {
+				output_buffer_printf_(b, "%s", tmp);
+				return;
+			}
+		}
+#endif
 		if (len >= console_chars_left) {
 			clear_len = console_chars_left;
 			while (clear_len > 0 && clear_len--) fprintf(stderr, " ");
@@ -322,6 +475,51 @@ void flac__utils_canonicalize_skip_until_specification(utils__SkipUntilSpecifica
 	}
 }
 
+FLAC__bool flac__utils_canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input)
+{
+	/* convert from mm:ss.sss to sample number if necessary */
+	flac__utils_canonicalize_skip_until_specification(spec, sample_rate);
+
+	/* special case: if "--until=-0", use the special value '0' to mean "end-of-stream" */
+	if(spec->is_relative && spec->value.samples == 0) {
+		spec->is_relative = false;
+		return true;
+	}
+
+	/* in any other case the total samples in the input must be known */
+	if(total_samples_in_input == 0) {
+		flac__utils_printf(stderr, 1, "%s: ERROR, cannot use --until when FLAC metadata has total sample count of 0\n", inbasefilename);
+		return false;
+	}
+
+	FLAC__ASSERT(spec->value_is_samples);
+
+	/* convert relative specifications to absolute */
+	if(spec->is_relative) {
+		if(spec->value.samples <= 0)
+			spec->value.samples += (FLAC__int64)total_samples_in_input;
+		else
+			spec->value.samples += skip;
+		spec->is_relative = false;
+	}
+
+	/* error check */
+	if(spec->value.samples < 0) {
+		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is before beginning of input\n", inbasefilename);
+		return false;
+	}
+	if((FLAC__uint64)spec->value.samples <= skip) {
+		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is before --skip point\n", inbasefilename);
+		return false;
+	}
+	if((FLAC__uint64)spec->value.samples > total_samples_in_input) {
+		flac__utils_printf(stderr, 1, "%s: ERROR, --until value is after end of input\n", inbasefilename);
+		return false;
+	}
+
+	return true;
+}
+
 FLAC__bool flac__utils_parse_cue_specification(const char *s, utils__CueSpecification *spec)
 {
 	const char *start = s, *end = 0;
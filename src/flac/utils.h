@@ -60,9 +60,17 @@ void stats_new_file(void);
 void stats_clear(void);
 void stats_print_name(int level, const char *name);
 void stats_print_info(int level, const char *format, ...);
+#ifdef HAVE_PTHREAD
+/* While buffered, everything the calling thread prints to stderr is kept and
+ * written out in one piece at the end, so that files processed at the same
+ * time (--jobs) do not mix up their messages and progress. */
+void flac__utils_begin_buffered_output(void);
+void flac__utils_end_buffered_output(void);
+#endif
 
 FLAC__bool flac__utils_parse_skip_until_specification(const char *s, utils__SkipUntilSpecification *spec);
 void flac__utils_canonicalize_skip_until_specification(utils__SkipUntilSpecification *spec, unsigned sample_rate);
+FLAC__bool flac__utils_canonicalize_until_specification(utils__SkipUntilSpecification *spec, const char *inbasefilename, unsigned sample_rate, FLAC__uint64 skip, FLAC__uint64 total_samples_in_input);
 
 FLAC__bool flac__utils_parse_cue_specification(const char *s, utils__CueSpecification *spec);
 void flac__utils_canonicalize_cue_specification(const utils__CueSpecification *cue_spec, const FLAC__StreamMetadata_CueSheet *cuesheet, FLAC__uint64 total_samples, utils__SkipUntilSpecification *skip_spec, utils__SkipUntilSpecification *until_spec);
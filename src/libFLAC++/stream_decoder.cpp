@@ -80,6 +80,30 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_set_md5_checking(decoder_, value);
 		}
 
+		bool Stream::set_threaded_md5(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_threaded_md5(decoder_, value);
+		}
+
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_num_threads(decoder_, value);
+		}
+
+		bool Stream::set_pcm_format(::FLAC__StreamDecoderPCMFormat format)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_pcm_format(decoder_, format);
+		}
+
+		bool Stream::set_frame_index(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_set_frame_index(decoder_, value);
+		}
+
 		bool Stream::set_metadata_respond(::FLAC__MetadataType type)
 		{
 			FLAC__ASSERT(is_valid());
@@ -128,6 +152,42 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_get_md5_checking(decoder_);
 		}
 
+		bool Stream::get_threaded_md5() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_get_threaded_md5(decoder_);
+		}
+
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_num_threads(decoder_);
+		}
+
+		::FLAC__StreamDecoderPCMFormat Stream::get_pcm_format() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_pcm_format(decoder_);
+		}
+
+		const void *Stream::get_pcm(size_t *bytes) const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_pcm(decoder_, bytes);
+		}
+
+		bool Stream::get_frame_index() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_get_frame_index(decoder_);
+		}
+
+		const ::FLAC__StreamMetadata_SeekPoint *Stream::get_frame_index_points(unsigned *num_points) const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_decoder_get_frame_index_points(decoder_, num_points);
+		}
+
 		FLAC__uint64 Stream::get_total_samples() const
 		{
 			FLAC__ASSERT(is_valid());
@@ -224,12 +284,42 @@ namespace FLAC {
 			return (bool)::FLAC__stream_decoder_skip_single_frame(decoder_);
 		}
 
+		bool Stream::scan_until_end_of_stream(FLAC__uint64 *total_samples)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_scan_until_end_of_stream(decoder_, scan_callback_, total_samples);
+		}
+
 		bool Stream::seek_absolute(FLAC__uint64 sample)
 		{
 			FLAC__ASSERT(is_valid());
 			return (bool)::FLAC__stream_decoder_seek_absolute(decoder_, sample);
 		}
 
+		bool Stream::find_total_samples(FLAC__uint64 *total_samples)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_find_total_samples(decoder_, total_samples);
+		}
+
+		bool Stream::compute_md5_signature(FLAC__byte md5sum[16])
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_compute_md5_signature(decoder_, md5sum);
+		}
+
+		bool Stream::save_frame_index(const char *filename)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_save_frame_index(decoder_, filename);
+		}
+
+		bool Stream::load_frame_index(const char *filename)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_decoder_load_frame_index(decoder_, filename);
+		}
+
 		::FLAC__StreamDecoderSeekStatus Stream::seek_callback(FLAC__uint64 absolute_byte_offset)
 		{
 			(void)absolute_byte_offset;
@@ -258,6 +348,12 @@ namespace FLAC {
 			(void)metadata;
 		}
 
+		bool Stream::scan_callback(const ::FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes)
+		{
+			(void)header, (void)frame_offset, (void)frame_bytes;
+			return true;
+		}
+
 		::FLAC__StreamDecoderReadStatus Stream::read_callback_(const ::FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
 		{
 			(void)decoder;
@@ -330,6 +426,15 @@ namespace FLAC {
 			instance->error_callback(status);
 		}
 
+		FLAC__bool Stream::scan_callback_(const ::FLAC__StreamDecoder *decoder, const ::FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data)
+		{
+			(void)decoder;
+			FLAC__ASSERT(0 != client_data);
+			Stream *instance = reinterpret_cast<Stream *>(client_data);
+			FLAC__ASSERT(0 != instance);
+			return instance->scan_callback(header, frame_offset, frame_bytes);
+		}
+
 		// ------------------------------------------------------------
 		//
 		// File
@@ -378,6 +483,40 @@ namespace FLAC {
 			return init_ogg(filename.c_str());
 		}
 
+		::FLAC__StreamDecoderInitStatus File::init_memory(const FLAC__byte *data, size_t bytes)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_memory(decoder_, data, bytes, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_ogg_memory(const FLAC__byte *data, size_t bytes)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_ogg_memory(decoder_, data, bytes, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_mapped(const char *filename)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_mapped_file(decoder_, filename, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_mapped(const std::string &filename)
+		{
+			return init_mapped(filename.c_str());
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_ogg_mapped(const char *filename)
+		{
+			FLAC__ASSERT(0 != decoder_);
+			return ::FLAC__stream_decoder_init_ogg_mapped_file(decoder_, filename, write_callback_, metadata_callback_, error_callback_, /*client_data=*/(void*)this);
+		}
+
+		::FLAC__StreamDecoderInitStatus File::init_ogg_mapped(const std::string &filename)
+		{
+			return init_ogg_mapped(filename.c_str());
+		}
+
 		// This is a dummy to satisfy the pure virtual from Stream; the
 		// read callback will never be called since we are initializing
 		// with FLAC__stream_decoder_init_FILE() or
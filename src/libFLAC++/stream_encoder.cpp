@@ -220,6 +220,36 @@ namespace FLAC {
 #endif
 		}
 
+		bool Stream::set_num_threads(unsigned value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_num_threads(encoder_, value);
+		}
+
+		bool Stream::set_do_parallel_subframes(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_do_parallel_subframes(encoder_, value);
+		}
+
+		bool Stream::set_do_variable_blocksize(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_do_variable_blocksize(encoder_, value);
+		}
+
+		bool Stream::set_threaded_verify(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_threaded_verify(encoder_, value);
+		}
+
+		bool Stream::set_threaded_md5(bool value)
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_set_threaded_md5(encoder_, value);
+		}
+
 		Stream::State Stream::get_state() const
 		{
 			FLAC__ASSERT(is_valid());
@@ -340,6 +370,36 @@ namespace FLAC {
 			return ::FLAC__stream_encoder_get_total_samples_estimate(encoder_);
 		}
 
+		unsigned Stream::get_num_threads() const
+		{
+			FLAC__ASSERT(is_valid());
+			return ::FLAC__stream_encoder_get_num_threads(encoder_);
+		}
+
+		bool Stream::get_do_parallel_subframes() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_do_parallel_subframes(encoder_);
+		}
+
+		bool Stream::get_do_variable_blocksize() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_do_variable_blocksize(encoder_);
+		}
+
+		bool Stream::get_threaded_verify() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_threaded_verify(encoder_);
+		}
+
+		bool Stream::get_threaded_md5() const
+		{
+			FLAC__ASSERT(is_valid());
+			return (bool)::FLAC__stream_encoder_get_threaded_md5(encoder_);
+		}
+
 		::FLAC__StreamEncoderInitStatus Stream::init()
 		{
 			FLAC__ASSERT(is_valid());
@@ -156,6 +156,15 @@ FLAC__bool FLAC__bitwriter_init(FLAC__BitWriter *bw)
 	return true;
 }
 
+FLAC__bool FLAC__bitwriter_reserve(FLAC__BitWriter *bw, unsigned bits)
+{
+	FLAC__ASSERT(0 != bw);
+	FLAC__ASSERT(0 != bw->buffer);
+
+	/* one spare word so that FLAC__bitwriter_write_rice_signed_block() never drops to its slow path at the very end */
+	return bitwriter_grow_(bw, bits + FLAC__BITS_PER_WORD);
+}
+
 void FLAC__bitwriter_free(FLAC__BitWriter *bw)
 {
 	FLAC__ASSERT(0 != bw);
@@ -507,90 +516,66 @@ FLAC__bool FLAC__bitwriter_write_rice_signed_block(FLAC__BitWriter *bw, const FL
 {
 	const FLAC__uint32 mask1 = FLAC__WORD_ALL_ONES << parameter; /* we val|=mask1 to set the stop bit above it... */
 	const FLAC__uint32 mask2 = FLAC__WORD_ALL_ONES >> (31-parameter); /* ...then mask off the bits above the stop bit with val&=mask2*/
-	FLAC__uint32 uval;
-	unsigned left;
 	const unsigned lsbits = 1 + parameter;
-	unsigned msbits;
+	FLAC__uint32 uval;
+	unsigned msbits, total_bits;
+	/*
+	 * The codes are packed into a local 64-bit accumulator.  Since fewer
+	 * than 32 bits are ever left pending between codes, any code of up to
+	 * 32 bits can be appended without checking for room first, and at
+	 * most one word has to be flushed per code.
+	 */
+	FLAC__uint64 accum;
+	unsigned bits, words, capacity;
+	uint32_t *buffer;
 
 	FLAC__ASSERT(0 != bw);
 	FLAC__ASSERT(0 != bw->buffer);
 	FLAC__ASSERT(parameter < 8*sizeof(uint32_t)-1);
 	/* WATCHOUT: code does not work with <32bit words; we can make things much faster with this assertion */
-	FLAC__ASSERT(FLAC__BITS_PER_WORD >= 32);
+	FLAC__ASSERT(FLAC__BITS_PER_WORD == 32);
+
+	accum = bw->accum;
+	bits = bw->bits;
+	words = bw->words;
+	buffer = bw->buffer;
+	capacity = bw->capacity;
 
 	while(nvals) {
 		/* fold signed to unsigned; actual formula is: negative(v)? -2v-1 : 2v */
 		uval = (*vals<<1) ^ (*vals>>31);
 
 		msbits = uval >> parameter;
-
-		if(bw->bits && bw->bits + msbits + lsbits < FLAC__BITS_PER_WORD) { /* i.e. if the whole thing fits in the current uint32_t */
-			/* ^^^ if bw->bits is 0 then we may have filled the buffer and have no free uint32_t to work in */
-			bw->bits = bw->bits + msbits + lsbits;
-			uval |= mask1; /* set stop bit */
-			uval &= mask2; /* mask off unused top bits */
-			bw->accum <<= msbits + lsbits;
-			bw->accum |= uval;
+		total_bits = msbits + lsbits;
+
+		if(total_bits <= FLAC__BITS_PER_WORD && words < capacity) { /* i.e. if the whole code fits in one uint32_t and there is a free uint32_t to flush to */
+			accum <<= total_bits;
+			accum |= (uval | mask1) & mask2; /* set stop bit, mask off unused top bits */
+			bits += total_bits;
+			if(bits >= FLAC__BITS_PER_WORD) {
+				bits -= FLAC__BITS_PER_WORD;
+				buffer[words++] = SWAP_BE_WORD_TO_HOST((uint32_t)(accum >> bits));
+			}
 		}
 		else {
-			/* slightly pessimistic size check but faster than "<= bw->words + (bw->bits+msbits+lsbits+FLAC__BITS_PER_WORD-1)/FLAC__BITS_PER_WORD" */
-			/* OPT: pessimism may cause flurry of false calls to grow_ which eat up all savings before it */
-			if(bw->capacity <= bw->words + bw->bits + msbits + 1/*lsbits always fit in 1 uint32_t*/ && !bitwriter_grow_(bw, msbits+lsbits))
+			/* long code or full buffer: hand the state back and let the generic writers grow the buffer as needed */
+			bw->accum = (uint32_t)accum;
+			bw->bits = bits;
+			bw->words = words;
+			if(!FLAC__bitwriter_write_zeroes(bw, msbits) || !FLAC__bitwriter_write_raw_uint32(bw, (uval | mask1) & mask2, lsbits))
 				return false;
-
-			if(msbits) {
-				/* first part gets to word alignment */
-				if(bw->bits) {
-					left = FLAC__BITS_PER_WORD - bw->bits;
-					if(msbits < left) {
-						bw->accum <<= msbits;
-						bw->bits += msbits;
-						goto break1;
-					}
-					else {
-						bw->accum <<= left;
-						msbits -= left;
-						bw->buffer[bw->words++] = SWAP_BE_WORD_TO_HOST(bw->accum);
-						bw->bits = 0;
-					}
-				}
-				/* do whole words */
-				while(msbits >= FLAC__BITS_PER_WORD) {
-					bw->buffer[bw->words++] = 0;
-					msbits -= FLAC__BITS_PER_WORD;
-				}
-				/* do any leftovers */
-				if(msbits > 0) {
-					bw->accum = 0;
-					bw->bits = msbits;
-				}
-			}
-break1:
-			uval |= mask1; /* set stop bit */
-			uval &= mask2; /* mask off unused top bits */
-
-			left = FLAC__BITS_PER_WORD - bw->bits;
-			if(lsbits < left) {
-				bw->accum <<= lsbits;
-				bw->accum |= uval;
-				bw->bits += lsbits;
-			}
-			else {
-				/* if bw->bits == 0, left==FLAC__BITS_PER_WORD which will always
-				 * be > lsbits (because of previous assertions) so it would have
-				 * triggered the (lsbits<left) case above.
-				 */
-				FLAC__ASSERT(bw->bits);
-				FLAC__ASSERT(left < FLAC__BITS_PER_WORD);
-				bw->accum <<= left;
-				bw->accum |= uval >> (bw->bits = lsbits - left);
-				bw->buffer[bw->words++] = SWAP_BE_WORD_TO_HOST(bw->accum);
-				bw->accum = uval;
-			}
+			accum = bw->accum;
+			bits = bw->bits;
+			words = bw->words;
+			buffer = bw->buffer;
+			capacity = bw->capacity;
 		}
 		vals++;
 		nvals--;
 	}
+	bw->accum = (uint32_t)accum;
+	bw->bits = bits;
+	bw->words = words;
 	return true;
 }
 
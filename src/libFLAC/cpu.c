@@ -59,6 +59,7 @@ static void disable_avx(FLAC__CPUInfo *info)
 	info->ia32.avx     = false;
 	info->ia32.avx2    = false;
 	info->ia32.fma     = false;
+	info->ia32.avx512f = false;
 }
 
 #elif defined FLAC__CPU_X86_64
@@ -68,6 +69,7 @@ static void disable_avx(FLAC__CPUInfo *info)
 	info->x86.avx     = false;
 	info->x86.avx2    = false;
 	info->x86.fma     = false;
+	info->x86.avx512f = false;
 }
 #endif
 
@@ -108,6 +110,14 @@ static const unsigned FLAC__CPUINFO_IA32_CPUID_AVX = 0x10000000;
 static const unsigned FLAC__CPUINFO_IA32_CPUID_FMA = 0x00001000;
 /* these are flags in EBX of CPUID AX=00000007 */
 static const unsigned FLAC__CPUINFO_IA32_CPUID_AVX2 = 0x00000020;
+static const unsigned FLAC__CPUINFO_IA32_CPUID_AVX512F = 0x00010000;
+#endif
+
+#if defined FLAC__CPU_X86_64 && defined FLAC__AVX2_SUPPORTED
+/* these are flags in EBX of CPUID AX=00000007 */
+static const unsigned FLAC__CPUINFO_IA32_CPUID_BMI2 = 0x00000100;
+/* these are flags in ECX of CPUID AX=80000001 */
+static const unsigned FLAC__CPUINFO_IA32_CPUID_EXTENDED_LZCNT = 0x00000020;
 #endif
 
 /*
@@ -184,6 +194,9 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 		info->ia32.fma   = (flags_ecx & FLAC__CPUINFO_IA32_CPUID_FMA    )? true : false;
 		FLAC__cpu_info_x86(7, &flags_eax, &flags_ebx, &flags_ecx, &flags_edx);
 		info->ia32.avx2  = (flags_ebx & FLAC__CPUINFO_IA32_CPUID_AVX2   )? true : false;
+#if defined FLAC__AVX512_SUPPORTED
+		info->ia32.avx512f = (flags_ebx & FLAC__CPUINFO_IA32_CPUID_AVX512F)? true : false;
+#endif
 #endif
 	}
 
@@ -202,6 +215,9 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 	fprintf(stderr, "  FMA ........ %c\n", info->ia32.fma     ? 'Y' : 'n');
 	fprintf(stderr, "  AVX2 ....... %c\n", info->ia32.avx2    ? 'Y' : 'n');
 # endif
+# if defined FLAC__HAS_X86INTRIN && defined FLAC__AVX512_SUPPORTED
+	fprintf(stderr, "  AVX512F .... %c\n", info->ia32.avx512f ? 'Y' : 'n');
+# endif
 #endif
 
 	/*
@@ -324,6 +340,8 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 		FLAC__uint32 ecr = FLAC__cpu_xgetbv_x86();
 		if ((ecr & 0x6) != 0x6)
 			disable_avx(info);
+		else if ((ecr & 0xe0) != 0xe0) /* opmask and upper ZMM state */
+			info->ia32.avx512f = false;
 #ifdef DEBUG
 		fprintf(stderr, "  AVX OS sup . %c\n", info->ia32.avx ? 'Y' : 'n');
 #endif
@@ -358,6 +376,15 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 		info->x86.fma   = (flags_ecx & FLAC__CPUINFO_IA32_CPUID_FMA    )? true : false;
 		FLAC__cpu_info_x86(7, &flags_eax, &flags_ebx, &flags_ecx, &flags_edx);
 		info->x86.avx2  = (flags_ebx & FLAC__CPUINFO_IA32_CPUID_AVX2   )? true : false;
+#if defined FLAC__AVX512_SUPPORTED
+		info->x86.avx512f = (flags_ebx & FLAC__CPUINFO_IA32_CPUID_AVX512F)? true : false;
+#endif
+#if defined FLAC__AVX2_SUPPORTED
+		/* general purpose register instructions, so no OS support is needed */
+		info->x86.bmi2  = (flags_ebx & FLAC__CPUINFO_IA32_CPUID_BMI2   )? true : false;
+		FLAC__cpu_info_x86(0x80000001, &flags_eax, &flags_ebx, &flags_ecx, &flags_edx);
+		info->x86.lzcnt = (flags_ecx & FLAC__CPUINFO_IA32_CPUID_EXTENDED_LZCNT)? true : false;
+#endif
 #endif
 	}
 #ifdef DEBUG
@@ -371,6 +398,13 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 	fprintf(stderr, "  FMA ........ %c\n", info->x86.fma   ? 'Y' : 'n');
 	fprintf(stderr, "  AVX2 ....... %c\n", info->x86.avx2  ? 'Y' : 'n');
 # endif
+# if defined FLAC__AVX512_SUPPORTED
+	fprintf(stderr, "  AVX512F .... %c\n", info->x86.avx512f ? 'Y' : 'n');
+# endif
+# if defined FLAC__AVX2_SUPPORTED
+	fprintf(stderr, "  LZCNT ...... %c\n", info->x86.lzcnt ? 'Y' : 'n');
+	fprintf(stderr, "  BMI2 ....... %c\n", info->x86.bmi2  ? 'Y' : 'n');
+# endif
 #endif
 
 	/*
@@ -380,6 +414,8 @@ void FLAC__cpu_info(FLAC__CPUInfo *info)
 		FLAC__uint32 ecr = FLAC__cpu_xgetbv_x86();
 		if ((ecr & 0x6) != 0x6)
 			disable_avx(info);
+		else if ((ecr & 0xe0) != 0xe0) /* opmask and upper ZMM state */
+			info->x86.avx512f = false;
 #ifdef DEBUG
 		fprintf(stderr, "  AVX OS sup . %c\n", info->x86.avx ? 'Y' : 'n');
 #endif
@@ -0,0 +1,234 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2001-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdlib.h> /* for realloc() */
+#include <string.h> /* for memcmp(), memmove() */
+#include "private/frame_index.h"
+#include "FLAC/assert.h"
+#include "share/alloc.h"
+
+/*
+ * The file is all big-endian:
+ *
+ *   4 bytes   "fLiX"
+ *   1 byte    version, 1
+ *   3 bytes   reserved, 0
+ *  16 bytes   MD5 signature from STREAMINFO
+ *   8 bytes   total samples from STREAMINFO
+ *   8 bytes   length of the audio data, from the first frame to the end
+ *   4 bytes   number of points
+ *  18 bytes   per point, laid out as in a SEEKTABLE
+ */
+static const FLAC__byte FLAC__FRAME_INDEX_MAGIC[4] = { 'f', 'L', 'i', 'X' };
+static const unsigned FLAC__FRAME_INDEX_VERSION = 1;
+#define FLAC__FRAME_INDEX_HEADER_LEN 44u /* bytes */
+
+static void pack_uint64_(FLAC__uint64 val, FLAC__byte *b, unsigned bytes)
+{
+	unsigned i;
+
+	b += bytes;
+
+	for(i = 0; i < bytes; i++) {
+		*(--b) = (FLAC__byte)(val & 0xff);
+		val >>= 8;
+	}
+}
+
+static FLAC__uint64 unpack_uint64_(const FLAC__byte *b, unsigned bytes)
+{
+	FLAC__uint64 ret = 0;
+	unsigned i;
+
+	for(i = 0; i < bytes; i++)
+		ret = (ret << 8) | (FLAC__uint64)(*b++);
+
+	return ret;
+}
+
+void FLAC__frame_index_init(FLAC__FrameIndex *index)
+{
+	FLAC__ASSERT(0 != index);
+
+	index->points = 0;
+	index->num_points = index->capacity = 0;
+}
+
+void FLAC__frame_index_free(FLAC__FrameIndex *index)
+{
+	FLAC__ASSERT(0 != index);
+
+	free(index->points);
+	FLAC__frame_index_init(index);
+}
+
+FLAC__bool FLAC__frame_index_add(FLAC__FrameIndex *index, FLAC__uint64 sample_number, FLAC__uint64 stream_offset, unsigned frame_samples)
+{
+	unsigned lo = 0, hi;
+
+	FLAC__ASSERT(0 != index);
+
+	/* frames usually come in order, so check the end first */
+	hi = index->num_points;
+	if(hi > 0 && index->points[hi-1].sample_number >= sample_number) {
+		/* find the first point with a sample number >= sample_number */
+		while(lo < hi) {
+			const unsigned mid = lo + (hi - lo) / 2;
+			if(index->points[mid].sample_number < sample_number)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if(index->points[lo].sample_number == sample_number)
+			return true;
+	}
+	else
+		lo = hi;
+
+	if(index->num_points == index->capacity) {
+		const unsigned capacity = index->capacity? index->capacity * 2 : 1024;
+		FLAC__StreamMetadata_SeekPoint *points;
+		if(capacity < index->capacity || 0 == (points = safe_realloc_mul_2op_(index->points, sizeof(FLAC__StreamMetadata_SeekPoint), capacity)))
+			return false;
+		index->points = points;
+		index->capacity = capacity;
+	}
+
+	memmove(index->points+lo+1, index->points+lo, sizeof(FLAC__StreamMetadata_SeekPoint) * (index->num_points - lo));
+	index->points[lo].sample_number = sample_number;
+	index->points[lo].stream_offset = stream_offset;
+	index->points[lo].frame_samples = frame_samples;
+	index->num_points++;
+	return true;
+}
+
+const FLAC__StreamMetadata_SeekPoint *FLAC__frame_index_find(const FLAC__FrameIndex *index, FLAC__uint64 sample_number)
+{
+	unsigned lo = 0, hi = index->num_points;
+
+	FLAC__ASSERT(0 != index);
+
+	/* find the first point with a sample number > sample_number */
+	while(lo < hi) {
+		const unsigned mid = lo + (hi - lo) / 2;
+		if(index->points[mid].sample_number <= sample_number)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0? &index->points[lo-1] : 0;
+}
+
+FLAC__bool FLAC__frame_index_save(const FLAC__FrameIndex *index, FILE *file, const FLAC__byte md5sum[16], FLAC__uint64 total_samples, FLAC__uint64 audio_bytes)
+{
+	FLAC__byte buffer[FLAC__FRAME_INDEX_HEADER_LEN];
+	unsigned i;
+
+	FLAC__ASSERT(0 != index);
+	FLAC__ASSERT(0 != file);
+
+	memcpy(buffer, FLAC__FRAME_INDEX_MAGIC, 4);
+	pack_uint64_(FLAC__FRAME_INDEX_VERSION, buffer+4, 1);
+	pack_uint64_(0, buffer+5, 3);
+	memcpy(buffer+8, md5sum, 16);
+	pack_uint64_(total_samples, buffer+24, 8);
+	pack_uint64_(audio_bytes, buffer+32, 8);
+	pack_uint64_(index->num_points, buffer+40, 4);
+	if(fwrite(buffer, 1, FLAC__FRAME_INDEX_HEADER_LEN, file) != FLAC__FRAME_INDEX_HEADER_LEN)
+		return false;
+
+	for(i = 0; i < index->num_points; i++) {
+		pack_uint64_(index->points[i].sample_number, buffer, FLAC__STREAM_METADATA_SEEKPOINT_SAMPLE_NUMBER_LEN/8);
+		pack_uint64_(index->points[i].stream_offset, buffer+8, FLAC__STREAM_METADATA_SEEKPOINT_STREAM_OFFSET_LEN/8);
+		pack_uint64_(index->points[i].frame_samples, buffer+16, FLAC__STREAM_METADATA_SEEKPOINT_FRAME_SAMPLES_LEN/8);
+		if(fwrite(buffer, 1, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH, file) != FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)
+			return false;
+	}
+	return true;
+}
+
+FLAC__bool FLAC__frame_index_load(FLAC__FrameIndex *index, FILE *file, const FLAC__byte md5sum[16], FLAC__uint64 total_samples, FLAC__uint64 audio_bytes)
+{
+	FLAC__byte buffer[FLAC__FRAME_INDEX_HEADER_LEN];
+	FLAC__FrameIndex loaded;
+	FLAC__uint64 saved_audio_bytes;
+	unsigned i, num_points;
+	FLAC__bool ok = true;
+
+	FLAC__ASSERT(0 != index);
+	FLAC__ASSERT(0 != file);
+
+	if(fread(buffer, 1, FLAC__FRAME_INDEX_HEADER_LEN, file) != FLAC__FRAME_INDEX_HEADER_LEN)
+		return false;
+	if(memcmp(buffer, FLAC__FRAME_INDEX_MAGIC, 4) || unpack_uint64_(buffer+4, 1) != FLAC__FRAME_INDEX_VERSION)
+		return false;
+	/* make sure it is the index of this stream */
+	saved_audio_bytes = unpack_uint64_(buffer+32, 8);
+	if(memcmp(buffer+8, md5sum, 16) || unpack_uint64_(buffer+24, 8) != total_samples || (audio_bytes && saved_audio_bytes && saved_audio_bytes != audio_bytes))
+		return false;
+	num_points = (unsigned)unpack_uint64_(buffer+40, 4);
+
+	/* read it all before touching the index so a damaged file leaves it as it was */
+	FLAC__frame_index_init(&loaded);
+	for(i = 0; ok && i < num_points; i++) {
+		FLAC__uint64 sample_number, stream_offset;
+		unsigned frame_samples;
+		if(fread(buffer, 1, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH, file) != FLAC__STREAM_METADATA_SEEKPOINT_LENGTH) {
+			ok = false;
+			break;
+		}
+		sample_number = unpack_uint64_(buffer, FLAC__STREAM_METADATA_SEEKPOINT_SAMPLE_NUMBER_LEN/8);
+		stream_offset = unpack_uint64_(buffer+8, FLAC__STREAM_METADATA_SEEKPOINT_STREAM_OFFSET_LEN/8);
+		frame_samples = (unsigned)unpack_uint64_(buffer+16, FLAC__STREAM_METADATA_SEEKPOINT_FRAME_SAMPLES_LEN/8);
+		/* defense against a damaged file */
+		if(frame_samples == 0 || (total_samples && sample_number >= total_samples) || (audio_bytes && stream_offset >= audio_bytes))
+			ok = false;
+		else
+			ok = FLAC__frame_index_add(&loaded, sample_number, stream_offset, frame_samples);
+	}
+
+	if(ok) {
+		if(index->num_points == 0) {
+			FLAC__frame_index_free(index);
+			*index = loaded;
+			return true;
+		}
+		for(i = 0; ok && i < loaded.num_points; i++)
+			ok = FLAC__frame_index_add(index, loaded.points[i].sample_number, loaded.points[i].stream_offset, loaded.points[i].frame_samples);
+	}
+	FLAC__frame_index_free(&loaded);
+	return ok;
+}
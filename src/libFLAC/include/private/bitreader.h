@@ -37,6 +37,11 @@
 #include "FLAC/ordinals.h"
 #include "cpu.h"
 
+/* the rice block decoder has an LZCNT/BMI2 version where the compiler can target those per function */
+#if !defined FLAC__NO_ASM && defined FLAC__CPU_X86_64 && defined FLAC__HAS_X86INTRIN && defined FLAC__AVX2_SUPPORTED
+#define FLAC__BITREADER_HAS_BMI2 1
+#endif
+
 /*
  * opaque structure definition
  */
@@ -51,6 +56,7 @@ typedef FLAC__bool (*FLAC__BitReaderReadCallback)(FLAC__byte buffer[], size_t *b
 FLAC__BitReader *FLAC__bitreader_new(void);
 void FLAC__bitreader_delete(FLAC__BitReader *br);
 FLAC__bool FLAC__bitreader_init(FLAC__BitReader *br, FLAC__BitReaderReadCallback rcb, void *cd);
+void FLAC__bitreader_set_source(FLAC__BitReader *br, const FLAC__byte *source, size_t bytes, size_t *position); /* source[*position..bytes-1] is read before calling the read callback; 0 to unset */
 void FLAC__bitreader_free(FLAC__BitReader *br); /* does not 'free(br)' */
 FLAC__bool FLAC__bitreader_clear(FLAC__BitReader *br);
 void FLAC__bitreader_dump(const FLAC__BitReader *br, FILE *out);
@@ -82,6 +88,9 @@ FLAC__bool FLAC__bitreader_read_byte_block_aligned_no_crc(FLAC__BitReader *br, F
 FLAC__bool FLAC__bitreader_read_unary_unsigned(FLAC__BitReader *br, unsigned *val);
 FLAC__bool FLAC__bitreader_read_rice_signed(FLAC__BitReader *br, int *val, unsigned parameter);
 FLAC__bool FLAC__bitreader_read_rice_signed_block(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter);
+#ifdef FLAC__BITREADER_HAS_BMI2
+FLAC__bool FLAC__bitreader_read_rice_signed_block_bmi2(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter); /* only call if the CPU has LZCNT and BMI2 */
+#endif
 #if 0 /* UNUSED */
 FLAC__bool FLAC__bitreader_read_golomb_signed(FLAC__BitReader *br, int *val, unsigned parameter);
 FLAC__bool FLAC__bitreader_read_golomb_unsigned(FLAC__BitReader *br, unsigned *val, unsigned parameter);
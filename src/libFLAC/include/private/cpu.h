@@ -56,6 +56,9 @@
     #define FLAC__AVX2_SUPPORTED 1
     #define FLAC__FMA_SUPPORTED 1
   #endif
+  #if (__INTEL_COMPILER >= 1500) /* Intel C++ Compiler 15.0 */
+    #define FLAC__AVX512_SUPPORTED 1
+  #endif
 #elif defined _MSC_VER
   #define FLAC__SSE_TARGET(x)
   #define FLAC__SSE_SUPPORTED 1
@@ -71,6 +74,9 @@
     #define FLAC__AVX2_SUPPORTED 1
     #define FLAC__FMA_SUPPORTED 1
   #endif
+  #if (_MSC_VER >= 1910) /* MS Visual Studio 2017 */
+    #define FLAC__AVX512_SUPPORTED 1
+  #endif
 #elif defined __GNUC__
   #if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) /* since GCC 4.9 -msse.. compiler options aren't necessary */
     #define FLAC__SSE_TARGET(x) __attribute__ ((__target__ (x)))
@@ -81,6 +87,7 @@
     #define FLAC__AVX_SUPPORTED 1
     #define FLAC__AVX2_SUPPORTED 1
     #define FLAC__FMA_SUPPORTED 1
+    #define FLAC__AVX512_SUPPORTED 1
   #else /* for GCC older than 4.9 */
     #define FLAC__SSE_TARGET(x)
     #ifdef __SSE__
@@ -104,6 +111,9 @@
     #ifdef __FMA__
       #define FLAC__FMA_SUPPORTED 1
     #endif
+    #ifdef __AVX512F__
+      #define FLAC__AVX512_SUPPORTED 1
+    #endif
   #endif /* GCC version */
 #endif /* compiler version */
 #endif /* intrinsics support */
@@ -128,6 +138,7 @@ typedef struct {
 	FLAC__bool avx;
 	FLAC__bool avx2;
 	FLAC__bool fma;
+	FLAC__bool avx512f;
 } FLAC__CPUInfo_IA32;
 #elif defined FLAC__CPU_X86_64
 typedef struct {
@@ -138,6 +149,9 @@ typedef struct {
 	FLAC__bool avx;
 	FLAC__bool avx2;
 	FLAC__bool fma;
+	FLAC__bool avx512f;
+	FLAC__bool lzcnt;
+	FLAC__bool bmi2;
 } FLAC__CPUInfo_x86;
 #endif
 
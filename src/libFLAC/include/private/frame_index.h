@@ -0,0 +1,71 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2001-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAC__PRIVATE__FRAME_INDEX_H
+#define FLAC__PRIVATE__FRAME_INDEX_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h> /* for FILE */
+#include "FLAC/format.h"
+
+/*
+ * An index of where every frame of a stream starts, collected by the
+ * decoder as frames go by.  The points are kept by ascending sample
+ * number; as in a SEEKTABLE, stream_offset counts from the first byte of
+ * the first frame, so the index stays valid when the metadata changes
+ * size.  Points can be added in any order.
+ */
+typedef struct {
+	FLAC__StreamMetadata_SeekPoint *points;
+	unsigned num_points, capacity;
+} FLAC__FrameIndex;
+
+void FLAC__frame_index_init(FLAC__FrameIndex *index);
+void FLAC__frame_index_free(FLAC__FrameIndex *index);
+FLAC__bool FLAC__frame_index_add(FLAC__FrameIndex *index, FLAC__uint64 sample_number, FLAC__uint64 stream_offset, unsigned frame_samples);
+
+/* returns the last point with a sample number <= sample_number, or NULL */
+const FLAC__StreamMetadata_SeekPoint *FLAC__frame_index_find(const FLAC__FrameIndex *index, FLAC__uint64 sample_number);
+
+/*
+ * The index is saved with the STREAMINFO MD5 signature, total samples
+ * and the length of the audio data (0 if not known), and is only loaded
+ * back for a stream where they are the same.  Loaded points are added to
+ * the ones already in the index.
+ */
+FLAC__bool FLAC__frame_index_save(const FLAC__FrameIndex *index, FILE *file, const FLAC__byte md5sum[16], FLAC__uint64 total_samples, FLAC__uint64 audio_bytes);
+FLAC__bool FLAC__frame_index_load(FLAC__FrameIndex *index, FILE *file, const FLAC__byte md5sum[16], FLAC__uint64 total_samples, FLAC__uint64 audio_bytes);
+
+#endif
@@ -47,4 +47,45 @@ void FLAC__MD5Final(FLAC__byte digest[16], FLAC__MD5Context *context);
 
 FLAC__bool FLAC__MD5Accumulate(FLAC__MD5Context *ctx, const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bytes_per_sample);
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+/*
+ * An FLAC__MD5Pipeline runs FLAC__MD5Accumulate() on a thread of its own.
+ * FLAC__MD5PipelineAccumulate() copies the samples into a ring of blocks
+ * and returns; the thread hashes the blocks in order, so the signature
+ * is the same as when accumulating directly.  The context must not be
+ * touched until FLAC__MD5PipelineSync() or FLAC__MD5PipelineStop() has
+ * returned.
+ */
+#define FLAC__MD5_PIPELINE_BLOCKS 4
+
+typedef struct {
+	FLAC__int32 *data; /* the samples of each channel in turn */
+	size_t capacity; /* of data, in samples */
+	unsigned channels;
+	unsigned samples;
+	unsigned bytes_per_sample;
+} FLAC__MD5PipelineBlock;
+
+typedef struct {
+	FLAC__MD5Context *ctx;
+	FLAC__MD5PipelineBlock block[FLAC__MD5_PIPELINE_BLOCKS];
+	unsigned head; /* the block being hashed, or the next one to be */
+	unsigned count; /* # of blocks queued, including the one being hashed */
+	FLAC__bool ok; /* false once FLAC__MD5Accumulate() has failed */
+	FLAC__bool quit;
+	FLAC__bool started;
+	pthread_t thread;
+	pthread_mutex_t mutex; /* protects head, count, ok and quit */
+	pthread_cond_t cond_queued;
+	pthread_cond_t cond_done;
+} FLAC__MD5Pipeline;
+
+FLAC__bool FLAC__MD5PipelineStart(FLAC__MD5Pipeline *pipeline, FLAC__MD5Context *ctx);
+FLAC__bool FLAC__MD5PipelineAccumulate(FLAC__MD5Pipeline *pipeline, const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bytes_per_sample);
+FLAC__bool FLAC__MD5PipelineSync(FLAC__MD5Pipeline *pipeline); /* waits until all queued blocks are hashed */
+FLAC__bool FLAC__MD5PipelineStop(FLAC__MD5Pipeline *pipeline); /* syncs, then ends the thread and frees the blocks */
+#endif
+
 #endif
@@ -0,0 +1,110 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAC__PRIVATE__PCM_H
+#define FLAC__PRIVATE__PCM_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h> /* for size_t */
+#include "private/cpu.h"
+#include "FLAC/format.h"
+
+/*
+ *	FLAC__pcm_pack_*()
+ *	--------------------------------------------------------------------
+ *	Interleaves the channels of signal[] into out[] as packed PCM.  The
+ *	samples have bps bits and are shifted to the width of the output:
+ *	left if they are narrower, right (i.e. truncated) if they are wider.
+ *	Float output is the sample divided by 2^(bps-1), in host byte order.
+ *	The routines are all of the type FLAC__PCMPackFunc, so the decoder
+ *	can pick one when it is initialized.
+ *
+ *	IN signal[0,channels-1][0,samples-1]
+ *	IN channels > 0
+ *	IN samples
+ *	IN 0 < bps <= 32
+ *	OUT out[0,channels*samples*bytes per sample-1]
+ */
+typedef void (*FLAC__PCMPackFunc)(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+
+void FLAC__pcm_pack_s16le(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s16be(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s24le(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s24be(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+void FLAC__pcm_pack_float(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#endif
+
+/*
+ * The intrinsics routines handle mono and stereo and call the ones above
+ * for other channel counts, and for the samples after the last whole
+ * vector through FLAC__pcm_pack_tail().
+ */
+static inline void FLAC__pcm_pack_tail(FLAC__PCMPackFunc pack, FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps, unsigned done, unsigned bytes_per_sample)
+{
+	const FLAC__int32 *tail[FLAC__MAX_CHANNELS];
+	unsigned channel;
+
+	if(done == samples)
+		return;
+	for(channel = 0; channel < channels; channel++)
+		tail[channel] = signal[channel] + done;
+	pack(out + (size_t)done * channels * bytes_per_sample, tail, channels, samples - done, bps);
+}
+
+#ifndef FLAC__NO_ASM
+#  if (defined FLAC__CPU_IA32 || defined FLAC__CPU_X86_64) && defined FLAC__HAS_X86INTRIN
+#    ifdef FLAC__SSE2_SUPPORTED
+void FLAC__pcm_pack_s16le_intrin_sse2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s16be_intrin_sse2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#      ifndef FLAC__INTEGER_ONLY_LIBRARY
+void FLAC__pcm_pack_float_intrin_sse2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#      endif
+#    endif
+#    ifdef FLAC__SSSE3_SUPPORTED
+void FLAC__pcm_pack_s24le_intrin_ssse3(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s24be_intrin_ssse3(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+void FLAC__pcm_pack_s16le_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+void FLAC__pcm_pack_s16be_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#      ifndef FLAC__INTEGER_ONLY_LIBRARY
+void FLAC__pcm_pack_float_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps);
+#      endif
+#    endif
+#  endif
+#endif
+
+#endif
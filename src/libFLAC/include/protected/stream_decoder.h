@@ -38,6 +38,8 @@
 #include "private/ogg_decoder_aspect.h"
 #endif
 
+#define FLAC__STREAM_DECODER_MAX_THREADS 64
+
 typedef struct FLAC__StreamDecoderProtected {
 	FLAC__StreamDecoderState state;
 	FLAC__StreamDecoderInitStatus initstate;
@@ -47,6 +49,10 @@ typedef struct FLAC__StreamDecoderProtected {
 	unsigned sample_rate; /* in Hz */
 	unsigned blocksize; /* in samples (per channel) */
 	FLAC__bool md5_checking; /* if true, generate MD5 signature of decoded data and compare against signature in the STREAMINFO metadata block */
+	FLAC__bool threaded_md5; /* if true, the MD5 signature is computed on a thread of its own */
+	unsigned num_threads; /* if more than 1, frames are decoded in parallel by FLAC__stream_decoder_process_until_end_of_stream() */
+	FLAC__StreamDecoderPCMFormat pcm_format;
+	FLAC__bool frame_index; /* if true, remember where each frame starts and use it when seeking */
 #if FLAC__HAS_OGG
 	FLAC__OggDecoderAspect ogg_decoder_aspect;
 #endif
@@ -83,6 +83,8 @@ typedef struct {
 
 #endif // #ifndef FLAC__INTEGER_ONLY_LIBRARY
 
+#define FLAC__STREAM_ENCODER_MAX_THREADS 64
+
 typedef struct FLAC__StreamEncoderProtected {
 	FLAC__StreamEncoderState state;
 	FLAC__bool verify;
@@ -106,6 +108,11 @@ typedef struct FLAC__StreamEncoderProtected {
 	unsigned min_residual_partition_order;
 	unsigned max_residual_partition_order;
 	unsigned rice_parameter_search_dist;
+	unsigned num_threads;
+	FLAC__bool do_parallel_subframes;
+	FLAC__bool do_variable_blocksize;
+	FLAC__bool threaded_verify;
+	FLAC__bool threaded_md5;
 	FLAC__uint64 total_samples_estimate;
 	FLAC__StreamMetadata **metadata;
 	unsigned num_metadata_blocks;
@@ -42,9 +42,142 @@
 
 #include "FLAC/assert.h"
 #include "FLAC/format.h"
+#include "share/compat.h"
 
 #include <immintrin.h> /* AVX2 */
 
+/*
+ * Computes autoc[0,8*num_sums-1], keeping the order of the additions of
+ * FLAC__lpc_compute_autocorrelation() so the result is the same.  Near
+ * the end of data[] the samples are read from a zero-padded copy, so no
+ * load goes past data_len.  num_sums is a constant in each caller and
+ * the tests on it are folded away.
+ */
+FLAC__SSE_TARGET("avx2")
+static FLAC__ALWAYS_INLINE void compute_autocorrelation_avx2_(const FLAC__real data[], unsigned data_len, const unsigned num_sums, __m256 sum[5])
+{
+	const int width = 8 * num_sums;
+	int i, limit = (int)data_len - width, tail;
+	FLAC__real padded[2*40];
+
+#define ACCUMULATE_(p) { \
+		const __m256 d = _mm256_broadcast_ss(p); \
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(d, _mm256_loadu_ps((p)))); \
+		if(num_sums > 1) sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(d, _mm256_loadu_ps((p)+8))); \
+		if(num_sums > 2) sum2 = _mm256_add_ps(sum2, _mm256_mul_ps(d, _mm256_loadu_ps((p)+16))); \
+		if(num_sums > 3) sum3 = _mm256_add_ps(sum3, _mm256_mul_ps(d, _mm256_loadu_ps((p)+24))); \
+		if(num_sums > 4) sum4 = _mm256_add_ps(sum4, _mm256_mul_ps(d, _mm256_loadu_ps((p)+32))); \
+	}
+
+	__m256 sum0 = _mm256_setzero_ps(), sum1 = sum0, sum2 = sum0, sum3 = sum0, sum4 = sum0;
+
+	FLAC__ASSERT(num_sums > 0 && num_sums <= 5);
+
+	for(i = 0; i <= limit; i++)
+		ACCUMULATE_(data+i)
+
+	if(limit < -1)
+		limit = -1;
+	tail = (int)data_len - (limit+1);
+	for(i = 0; i < tail; i++)
+		padded[i] = data[limit+1+i];
+	for(; i < tail + width; i++)
+		padded[i] = 0.0f;
+	for(i = 0; i < tail; i++)
+		ACCUMULATE_(padded+i)
+
+#undef ACCUMULATE_
+
+	sum[0] = sum0; sum[1] = sum1; sum[2] = sum2; sum[3] = sum3; sum[4] = sum4;
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_8(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m256 sum[5];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 8);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx2_(data, data_len, 1, sum);
+
+	_mm256_storeu_ps(autoc,    sum[0]);
+	_mm256_zeroupper();
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m256 sum[5];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 16);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx2_(data, data_len, 2, sum);
+
+	_mm256_storeu_ps(autoc,    sum[0]);
+	_mm256_storeu_ps(autoc+8,  sum[1]);
+	_mm256_zeroupper();
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_24(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m256 sum[5];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 24);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx2_(data, data_len, 3, sum);
+
+	_mm256_storeu_ps(autoc,    sum[0]);
+	_mm256_storeu_ps(autoc+8,  sum[1]);
+	_mm256_storeu_ps(autoc+16, sum[2]);
+	_mm256_zeroupper();
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_32(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m256 sum[5];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 32);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx2_(data, data_len, 4, sum);
+
+	_mm256_storeu_ps(autoc,    sum[0]);
+	_mm256_storeu_ps(autoc+8,  sum[1]);
+	_mm256_storeu_ps(autoc+16, sum[2]);
+	_mm256_storeu_ps(autoc+24, sum[3]);
+	_mm256_zeroupper();
+}
+
+/* autoc[] only has room for FLAC__MAX_LPC_ORDER+1 == 33 values, so only
+ * the first lane of the last sum is stored */
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_33(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m256 sum[5];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 33);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx2_(data, data_len, 5, sum);
+
+	_mm256_storeu_ps(autoc,    sum[0]);
+	_mm256_storeu_ps(autoc+8,  sum[1]);
+	_mm256_storeu_ps(autoc+16, sum[2]);
+	_mm256_storeu_ps(autoc+24, sum[3]);
+	_mm_store_ss(autoc+32, _mm256_castps256_ps128(sum[4]));
+	_mm256_zeroupper();
+}
+
 FLAC__SSE_TARGET("avx2")
 void FLAC__lpc_compute_residual_from_qlp_coefficients_16_intrin_avx2(const FLAC__int32 *data, unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 residual[])
 {
@@ -1114,6 +1247,66 @@ void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2(const FLA
 	_mm256_zeroupper();
 }
 
+/* same scheme as FLAC__lpc_restore_signal_wide_intrin_sse41(), with the four 64-bit sums in one register */
+FLAC__SSE_TARGET("avx2")
+void FLAC__lpc_restore_signal_wide_intrin_avx2(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	int i, m;
+	FLAC__int64 q0, q1, q2, q3, q4, q5, q6, h0, h1, h2, h3;
+	FLAC__int64 p[4];
+	__m256i q[32+4];
+	__m128i b0, b1;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order < 10 || data_len < 8) {
+		FLAC__lpc_restore_signal_wide(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	for(i = 0; i < (int)order; i++)
+		q[i] = _mm256_set1_epi32(qlp_coeff[i]);
+	for(; i < 32+4; i++)
+		q[i] = _mm256_setzero_si256();
+	q0 = qlp_coeff[0]; q1 = qlp_coeff[1]; q2 = qlp_coeff[2]; q3 = qlp_coeff[3];
+	q4 = qlp_coeff[4]; q5 = qlp_coeff[5]; q6 = qlp_coeff[6];
+
+	/* the first block is done in C so that no load reaches below data[-order] */
+	FLAC__lpc_restore_signal_wide(residual, 4, qlp_coeff, order, lp_quantization, data);
+	h0 = data[0]; h1 = data[1]; h2 = data[2]; h3 = data[3];
+
+	for(i = 4; i < (int)data_len-3; i += 4) {
+		FLAC__int32 o0, o1, o2, o3;
+		__m256i summ;
+		/* _mm256_mul_epi32() only looks at the low half of each lane, so zero extension is enough */
+		b1 = _mm_loadu_si128((const __m128i*)(data+i-8));
+		summ =                        _mm256_mul_epi32(q[4], _mm256_cvtepu32_epi64(_mm_srli_si128(b1, 12)));
+		summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[5], _mm256_cvtepu32_epi64(_mm_srli_si128(b1, 8))));
+		summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[6], _mm256_cvtepu32_epi64(_mm_srli_si128(b1, 4))));
+		for(m = 1; 4*m+3 < (int)order; m++) {
+			b0 = b1;
+			b1 = _mm_loadu_si128((const __m128i*)(data+i-4*m-8));
+			summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[4*m+3], _mm256_cvtepu32_epi64(b0)));
+			summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[4*m+4], _mm256_cvtepu32_epi64(_mm_alignr_epi8(b0, b1, 12))));
+			summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[4*m+5], _mm256_cvtepu32_epi64(_mm_alignr_epi8(b0, b1, 8))));
+			summ = _mm256_add_epi64(summ, _mm256_mul_epi32(q[4*m+6], _mm256_cvtepu32_epi64(_mm_alignr_epi8(b0, b1, 4))));
+		}
+		_mm256_storeu_si256((__m256i*)p, summ);
+		/* newest samples last to keep the dependency chain short */
+		o0 = residual[i  ] + (FLAC__int32)((p[0] + q3*h0 + q2*h1 + q1*h2 + q0*h3) >> lp_quantization);
+		o1 = residual[i+1] + (FLAC__int32)((p[1] + q4*h0 + q3*h1 + q2*h2 + q1*h3 + q0*o0) >> lp_quantization);
+		o2 = residual[i+2] + (FLAC__int32)((p[2] + q5*h0 + q4*h1 + q3*h2 + q2*h3 + q1*o0 + q0*o1) >> lp_quantization);
+		o3 = residual[i+3] + (FLAC__int32)((p[3] + q6*h0 + q5*h1 + q4*h2 + q3*h3 + q2*o0 + q1*o1 + q0*o2) >> lp_quantization);
+		_mm_storeu_si128((__m128i*)(data+i), _mm_setr_epi32(o0, o1, o2, o3));
+		h0 = o0; h1 = o1; h2 = o2; h3 = o3;
+	}
+	_mm256_zeroupper();
+
+	if(i < (int)data_len)
+		FLAC__lpc_restore_signal_wide(residual+i, data_len-i, qlp_coeff, order, lp_quantization, data+i);
+}
+
 #endif /* FLAC__AVX2_SUPPORTED */
 #endif /* (FLAC__CPU_IA32 || FLAC__CPU_X86_64) && FLAC__HAS_X86INTRIN */
 #endif /* FLAC__NO_ASM */
@@ -0,0 +1,149 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+#ifndef FLAC__NO_ASM
+#if (defined FLAC__CPU_IA32 || defined FLAC__CPU_X86_64) && defined FLAC__HAS_X86INTRIN
+#include "private/lpc.h"
+#ifdef FLAC__AVX512_SUPPORTED
+
+#include "FLAC/assert.h"
+#include "FLAC/format.h"
+#include "share/compat.h"
+
+#include <immintrin.h> /* AVX-512 */
+
+/*
+ * Computes autoc[0,16*num_sums-1] like compute_autocorrelation_avx2_()
+ * in lpc_intrin_avx2.c, but with twice the width and fused multiply-adds.
+ * The latency of those would be the bottleneck, so even and odd samples
+ * are summed separately and the two halves are added at the end; this
+ * and the FMAs mean the result can differ from the C routine in the last
+ * bits, as with the SSE routines.  The samples are taken 16 at a time
+ * with constant offsets, so the compiler can reuse the vector loaded for
+ * one sum as the one for the next sum 16 samples later.
+ */
+FLAC__SSE_TARGET("avx512f")
+static FLAC__ALWAYS_INLINE void compute_autocorrelation_avx512_(const FLAC__real data[], unsigned data_len, const unsigned num_sums, __m512 sum[3])
+{
+	const int width = 16 * num_sums;
+	int i, limit = (int)data_len - width - 16, tail;
+	FLAC__real padded[2*(48+16)];
+
+#define ACCUMULATE_(p, s, acc) { \
+		const __m512 d = _mm512_set1_ps((p)[s]); \
+		acc##0 = _mm512_fmadd_ps(d, _mm512_loadu_ps((p)+(s)), acc##0); \
+		if(num_sums > 1) acc##1 = _mm512_fmadd_ps(d, _mm512_loadu_ps((p)+(s)+16), acc##1); \
+		if(num_sums > 2) acc##2 = _mm512_fmadd_ps(d, _mm512_loadu_ps((p)+(s)+32), acc##2); \
+	}
+#define ACCUMULATE_16_(p) { \
+		ACCUMULATE_(p,  0, sum) ACCUMULATE_(p,  1, odd) \
+		ACCUMULATE_(p,  2, sum) ACCUMULATE_(p,  3, odd) \
+		ACCUMULATE_(p,  4, sum) ACCUMULATE_(p,  5, odd) \
+		ACCUMULATE_(p,  6, sum) ACCUMULATE_(p,  7, odd) \
+		ACCUMULATE_(p,  8, sum) ACCUMULATE_(p,  9, odd) \
+		ACCUMULATE_(p, 10, sum) ACCUMULATE_(p, 11, odd) \
+		ACCUMULATE_(p, 12, sum) ACCUMULATE_(p, 13, odd) \
+		ACCUMULATE_(p, 14, sum) ACCUMULATE_(p, 15, odd) \
+	}
+
+	__m512 sum0 = _mm512_setzero_ps(), sum1 = sum0, sum2 = sum0;
+	__m512 odd0 = sum0, odd1 = sum0, odd2 = sum0;
+
+	FLAC__ASSERT(num_sums > 0 && num_sums <= 3);
+
+	for(i = 0; i <= limit; i += 16)
+		ACCUMULATE_16_(data+i)
+
+	/* the rest is padded with zeros up to a multiple of 16 samples */
+	tail = (int)data_len - i;
+	{
+		const int start = i;
+		for(i = 0; i < tail; i++)
+			padded[i] = data[start+i];
+		for(; i < (int)(sizeof(padded)/sizeof(padded[0])); i++)
+			padded[i] = 0.0f;
+	}
+	for(i = 0; i < tail; i += 16)
+		ACCUMULATE_16_(padded+i)
+
+#undef ACCUMULATE_16_
+#undef ACCUMULATE_
+
+	sum[0] = _mm512_add_ps(sum0, odd0);
+	sum[1] = _mm512_add_ps(sum1, odd1);
+	sum[2] = _mm512_add_ps(sum2, odd2);
+}
+
+FLAC__SSE_TARGET("avx512f")
+void FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_32(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m512 sum[3];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 32);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx512_(data, data_len, 2, sum);
+
+	_mm512_storeu_ps(autoc,    sum[0]);
+	_mm512_storeu_ps(autoc+16, sum[1]);
+	_mm256_zeroupper();
+}
+
+/* autoc[] only has room for FLAC__MAX_LPC_ORDER+1 == 33 values, so only
+ * the first lane of the last sum is stored */
+FLAC__SSE_TARGET("avx512f")
+void FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_33(const FLAC__real data[], unsigned data_len, unsigned lag, FLAC__real autoc[])
+{
+	__m512 sum[3];
+
+	(void) lag;
+	FLAC__ASSERT(lag <= 33);
+	FLAC__ASSERT(lag <= data_len);
+
+	compute_autocorrelation_avx512_(data, data_len, 3, sum);
+
+	_mm512_storeu_ps(autoc,    sum[0]);
+	_mm512_storeu_ps(autoc+16, sum[1]);
+	_mm_store_ss(autoc+32, _mm512_castps512_ps128(sum[2]));
+	_mm256_zeroupper();
+}
+
+#endif /* FLAC__AVX512_SUPPORTED */
+#endif /* (FLAC__CPU_IA32 || FLAC__CPU_X86_64) && FLAC__HAS_X86INTRIN */
+#endif /* FLAC__NO_ASM */
+#endif /* FLAC__INTEGER_ONLY_LIBRARY */
@@ -1306,6 +1306,130 @@ void FLAC__lpc_compute_residual_from_qlp_coefficients_intrin_sse41(const FLAC__i
 	}
 }
 
+/*
+ * The restore loops below work on blocks of 4 samples.  Each lane k of a
+ * block gets the terms qlp_coeff[j]*data[i+k-1-j] for j >= k+4 in vector
+ * registers; those only involve samples from before the previous block, so
+ * this work overlaps with the serial part of the previous block.  The
+ * remaining (at most 7) terms per sample are summed in scalar code.
+ * Every block is written back with a single vector store and the vector part
+ * only loads whole blocks, so loads are always forwarded from those stores.
+ * For low orders the plain C routines are faster.
+ */
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_restore_signal_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	int i, m;
+	FLAC__int32 q0, q1, q2, q3, q4, q5, q6, h0, h1, h2, h3;
+	__m128i q[32+4], b0, b1;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order < 10 || data_len < 8) {
+		FLAC__lpc_restore_signal(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	for(i = 0; i < (int)order; i++)
+		q[i] = _mm_set1_epi32(qlp_coeff[i]);
+	for(; i < 32+4; i++)
+		q[i] = _mm_setzero_si128();
+	q0 = qlp_coeff[0]; q1 = qlp_coeff[1]; q2 = qlp_coeff[2]; q3 = qlp_coeff[3];
+	q4 = qlp_coeff[4]; q5 = qlp_coeff[5]; q6 = qlp_coeff[6];
+
+	/* the first block is done in C so that no load reaches below data[-order] */
+	FLAC__lpc_restore_signal(residual, 4, qlp_coeff, order, lp_quantization, data);
+	h0 = data[0]; h1 = data[1]; h2 = data[2]; h3 = data[3];
+
+	for(i = 4; i < (int)data_len-3; i += 4) {
+		FLAC__int32 o0, o1, o2, o3;
+		__m128i summ;
+		b1 = _mm_loadu_si128((const __m128i*)(data+i-8));
+		summ =                     _mm_mullo_epi32(q[4], _mm_srli_si128(b1, 12));
+		summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[5], _mm_srli_si128(b1, 8)));
+		summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[6], _mm_srli_si128(b1, 4)));
+		for(m = 1; 4*m+3 < (int)order; m++) {
+			b0 = b1;
+			b1 = _mm_loadu_si128((const __m128i*)(data+i-4*m-8));
+			summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[4*m+3], b0));
+			summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[4*m+4], _mm_alignr_epi8(b0, b1, 12)));
+			summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[4*m+5], _mm_alignr_epi8(b0, b1, 8)));
+			summ = _mm_add_epi32(summ, _mm_mullo_epi32(q[4*m+6], _mm_alignr_epi8(b0, b1, 4)));
+		}
+		/* newest samples last to keep the dependency chain short */
+		o0 = residual[i  ] + ((_mm_cvtsi128_si32(summ)   + q3*h0 + q2*h1 + q1*h2 + q0*h3) >> lp_quantization);
+		o1 = residual[i+1] + ((_mm_extract_epi32(summ, 1) + q4*h0 + q3*h1 + q2*h2 + q1*h3 + q0*o0) >> lp_quantization);
+		o2 = residual[i+2] + ((_mm_extract_epi32(summ, 2) + q5*h0 + q4*h1 + q3*h2 + q2*h3 + q1*o0 + q0*o1) >> lp_quantization);
+		o3 = residual[i+3] + ((_mm_extract_epi32(summ, 3) + q6*h0 + q5*h1 + q4*h2 + q3*h3 + q2*o0 + q1*o1 + q0*o2) >> lp_quantization);
+		_mm_storeu_si128((__m128i*)(data+i), _mm_setr_epi32(o0, o1, o2, o3));
+		h0 = o0; h1 = o1; h2 = o2; h3 = o3;
+	}
+
+	if(i < (int)data_len)
+		FLAC__lpc_restore_signal(residual+i, data_len-i, qlp_coeff, order, lp_quantization, data+i);
+}
+
+#if defined FLAC__CPU_X86_64 /* the IA32 version is above */
+
+FLAC__SSE_TARGET("sse4.1")
+void FLAC__lpc_restore_signal_wide_intrin_sse41(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[])
+{
+	int i, m;
+	FLAC__int64 q0, q1, q2, q3, q4, q5, q6, h0, h1, h2, h3;
+	__m128i q[32+4], b0, b1;
+
+	FLAC__ASSERT(order > 0);
+	FLAC__ASSERT(order <= 32);
+
+	if(order < 10 || data_len < 8) {
+		FLAC__lpc_restore_signal_wide(residual, data_len, qlp_coeff, order, lp_quantization, data);
+		return;
+	}
+
+	for(i = 0; i < (int)order; i++)
+		q[i] = _mm_set1_epi32(qlp_coeff[i]);
+	for(; i < 32+4; i++)
+		q[i] = _mm_setzero_si128();
+	q0 = qlp_coeff[0]; q1 = qlp_coeff[1]; q2 = qlp_coeff[2]; q3 = qlp_coeff[3];
+	q4 = qlp_coeff[4]; q5 = qlp_coeff[5]; q6 = qlp_coeff[6];
+
+	FLAC__lpc_restore_signal_wide(residual, 4, qlp_coeff, order, lp_quantization, data);
+	h0 = data[0]; h1 = data[1]; h2 = data[2]; h3 = data[3];
+
+	for(i = 4; i < (int)data_len-3; i += 4) {
+		FLAC__int32 o0, o1, o2, o3;
+		FLAC__int64 p0, p1, p2, p3;
+		__m128i even, odd, x; /* 64-bit sums of lanes 0,2 and 1,3 */
+		b1 = _mm_loadu_si128((const __m128i*)(data+i-8));
+		x = _mm_srli_si128(b1, 12); even =                     _mm_mul_epi32(q[4], x);
+		x = _mm_srli_si128(b1, 8);  even = _mm_add_epi64(even, _mm_mul_epi32(q[5], x)); odd =                    _mm_mul_epi32(q[5], _mm_srli_epi64(x, 32));
+		x = _mm_srli_si128(b1, 4);  even = _mm_add_epi64(even, _mm_mul_epi32(q[6], x)); odd = _mm_add_epi64(odd, _mm_mul_epi32(q[6], _mm_srli_epi64(x, 32)));
+		for(m = 1; 4*m+3 < (int)order; m++) {
+			b0 = b1;
+			b1 = _mm_loadu_si128((const __m128i*)(data+i-4*m-8));
+			x = b0;                          even = _mm_add_epi64(even, _mm_mul_epi32(q[4*m+3], x)); odd = _mm_add_epi64(odd, _mm_mul_epi32(q[4*m+3], _mm_srli_epi64(x, 32)));
+			x = _mm_alignr_epi8(b0, b1, 12); even = _mm_add_epi64(even, _mm_mul_epi32(q[4*m+4], x)); odd = _mm_add_epi64(odd, _mm_mul_epi32(q[4*m+4], _mm_srli_epi64(x, 32)));
+			x = _mm_alignr_epi8(b0, b1, 8);  even = _mm_add_epi64(even, _mm_mul_epi32(q[4*m+5], x)); odd = _mm_add_epi64(odd, _mm_mul_epi32(q[4*m+5], _mm_srli_epi64(x, 32)));
+			x = _mm_alignr_epi8(b0, b1, 4);  even = _mm_add_epi64(even, _mm_mul_epi32(q[4*m+6], x)); odd = _mm_add_epi64(odd, _mm_mul_epi32(q[4*m+6], _mm_srli_epi64(x, 32)));
+		}
+		p0 = _mm_cvtsi128_si64(even); p2 = _mm_extract_epi64(even, 1);
+		p1 = _mm_cvtsi128_si64(odd);  p3 = _mm_extract_epi64(odd, 1);
+		o0 = residual[i  ] + (FLAC__int32)((p0 + q3*h0 + q2*h1 + q1*h2 + q0*h3) >> lp_quantization);
+		o1 = residual[i+1] + (FLAC__int32)((p1 + q4*h0 + q3*h1 + q2*h2 + q1*h3 + q0*o0) >> lp_quantization);
+		o2 = residual[i+2] + (FLAC__int32)((p2 + q5*h0 + q4*h1 + q3*h2 + q2*h3 + q1*o0 + q0*o1) >> lp_quantization);
+		o3 = residual[i+3] + (FLAC__int32)((p3 + q6*h0 + q5*h1 + q4*h2 + q3*h3 + q2*o0 + q1*o1 + q0*o2) >> lp_quantization);
+		_mm_storeu_si128((__m128i*)(data+i), _mm_setr_epi32(o0, o1, o2, o3));
+		h0 = o0; h1 = o1; h2 = o2; h3 = o3;
+	}
+
+	if(i < (int)data_len)
+		FLAC__lpc_restore_signal_wide(residual+i, data_len-i, qlp_coeff, order, lp_quantization, data+i);
+}
+
+#endif /* defined FLAC__CPU_X86_64 */
+
 #endif /* FLAC__SSE4_1_SUPPORTED */
 #endif /* (FLAC__CPU_IA32 || FLAC__CPU_X86_64) && FLAC__HAS_X86INTRIN */
 #endif /* FLAC__NO_ASM */
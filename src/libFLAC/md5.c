@@ -5,6 +5,8 @@
 #include <stdlib.h>		/* for malloc() */
 #include <string.h>		/* for memcpy() */
 
+#include "FLAC/assert.h"
+#include "FLAC/format.h"
 #include "private/md5.h"
 #include "share/alloc.h"
 #include "share/endswap.h"
@@ -516,3 +518,155 @@ FLAC__bool FLAC__MD5Accumulate(FLAC__MD5Context *ctx, const FLAC__int32 * const
 
 	return true;
 }
+
+#ifdef HAVE_PTHREAD
+static void *md5_pipeline_main_(void *arg)
+{
+	FLAC__MD5Pipeline *pipeline = (FLAC__MD5Pipeline*)arg;
+
+	pthread_mutex_lock(&pipeline->mutex);
+	for(;;) {
+		const FLAC__MD5PipelineBlock *block;
+		const FLAC__int32 *signal[FLAC__MAX_CHANNELS];
+		unsigned channel;
+		FLAC__bool ok;
+
+		while(pipeline->count == 0 && !pipeline->quit)
+			pthread_cond_wait(&pipeline->cond_queued, &pipeline->mutex);
+		if(pipeline->count == 0)
+			break;
+
+		/* the block stays queued while it is hashed, so it is not overwritten */
+		block = &pipeline->block[pipeline->head];
+		pthread_mutex_unlock(&pipeline->mutex);
+
+		for(channel = 0; channel < block->channels; channel++)
+			signal[channel] = block->data + (size_t)channel * block->samples;
+		ok = FLAC__MD5Accumulate(pipeline->ctx, signal, block->channels, block->samples, block->bytes_per_sample);
+
+		pthread_mutex_lock(&pipeline->mutex);
+		if(!ok)
+			pipeline->ok = false;
+		pipeline->head = (pipeline->head + 1) % FLAC__MD5_PIPELINE_BLOCKS;
+		pipeline->count--;
+		pthread_cond_signal(&pipeline->cond_done);
+	}
+	pthread_mutex_unlock(&pipeline->mutex);
+
+	return 0;
+}
+
+FLAC__bool FLAC__MD5PipelineStart(FLAC__MD5Pipeline *pipeline, FLAC__MD5Context *ctx)
+{
+	unsigned i;
+
+	pipeline->ctx = ctx;
+	for(i = 0; i < FLAC__MD5_PIPELINE_BLOCKS; i++) {
+		pipeline->block[i].data = 0;
+		pipeline->block[i].capacity = 0;
+	}
+	pipeline->head = pipeline->count = 0;
+	pipeline->ok = true;
+	pipeline->quit = false;
+
+	if(0 != pthread_mutex_init(&pipeline->mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&pipeline->cond_queued, 0)) {
+		pthread_mutex_destroy(&pipeline->mutex);
+		return false;
+	}
+	if(0 != pthread_cond_init(&pipeline->cond_done, 0)) {
+		pthread_cond_destroy(&pipeline->cond_queued);
+		pthread_mutex_destroy(&pipeline->mutex);
+		return false;
+	}
+	if(0 != pthread_create(&pipeline->thread, 0, md5_pipeline_main_, pipeline)) {
+		pthread_cond_destroy(&pipeline->cond_done);
+		pthread_cond_destroy(&pipeline->cond_queued);
+		pthread_mutex_destroy(&pipeline->mutex);
+		return false;
+	}
+	pipeline->started = true;
+	return true;
+}
+
+FLAC__bool FLAC__MD5PipelineAccumulate(FLAC__MD5Pipeline *pipeline, const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bytes_per_sample)
+{
+	FLAC__MD5PipelineBlock *block;
+	unsigned channel;
+	FLAC__bool ok;
+
+	FLAC__ASSERT(pipeline->started);
+
+	pthread_mutex_lock(&pipeline->mutex);
+	while(pipeline->count == FLAC__MD5_PIPELINE_BLOCKS)
+		pthread_cond_wait(&pipeline->cond_done, &pipeline->mutex);
+	block = &pipeline->block[(pipeline->head + pipeline->count) % FLAC__MD5_PIPELINE_BLOCKS];
+	ok = pipeline->ok;
+	pthread_mutex_unlock(&pipeline->mutex);
+
+	if(!ok)
+		return false;
+
+	/* the block is not queued, so the thread will not look at it until we queue it below */
+	if(block->capacity < (size_t)channels * samples) {
+		FLAC__int32 *tmp = safe_realloc_mul_2op_(block->data, sizeof(FLAC__int32), /*times*/(size_t)channels * samples);
+		if(0 == tmp)
+			return false;
+		block->data = tmp;
+		block->capacity = (size_t)channels * samples;
+	}
+	for(channel = 0; channel < channels; channel++)
+		memcpy(block->data + (size_t)channel * samples, signal[channel], sizeof(FLAC__int32) * samples);
+	block->channels = channels;
+	block->samples = samples;
+	block->bytes_per_sample = bytes_per_sample;
+
+	pthread_mutex_lock(&pipeline->mutex);
+	pipeline->count++;
+	pthread_cond_signal(&pipeline->cond_queued);
+	pthread_mutex_unlock(&pipeline->mutex);
+
+	return true;
+}
+
+FLAC__bool FLAC__MD5PipelineSync(FLAC__MD5Pipeline *pipeline)
+{
+	FLAC__bool ok;
+
+	FLAC__ASSERT(pipeline->started);
+
+	pthread_mutex_lock(&pipeline->mutex);
+	while(pipeline->count > 0)
+		pthread_cond_wait(&pipeline->cond_done, &pipeline->mutex);
+	ok = pipeline->ok;
+	pthread_mutex_unlock(&pipeline->mutex);
+
+	return ok;
+}
+
+FLAC__bool FLAC__MD5PipelineStop(FLAC__MD5Pipeline *pipeline)
+{
+	const FLAC__bool ok = FLAC__MD5PipelineSync(pipeline);
+	unsigned i;
+
+	pthread_mutex_lock(&pipeline->mutex);
+	pipeline->quit = true;
+	pthread_cond_signal(&pipeline->cond_queued);
+	pthread_mutex_unlock(&pipeline->mutex);
+
+	pthread_join(pipeline->thread, 0);
+	pthread_cond_destroy(&pipeline->cond_done);
+	pthread_cond_destroy(&pipeline->cond_queued);
+	pthread_mutex_destroy(&pipeline->mutex);
+
+	for(i = 0; i < FLAC__MD5_PIPELINE_BLOCKS; i++) {
+		free(pipeline->block[i].data);
+		pipeline->block[i].data = 0;
+		pipeline->block[i].capacity = 0;
+	}
+	pipeline->started = false;
+
+	return ok;
+}
+#endif
@@ -0,0 +1,134 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "FLAC/assert.h"
+#include "private/pcm.h"
+
+/* shifts a sample of bps bits to the given width */
+static inline FLAC__int32 shift_to_width_(FLAC__int32 x, unsigned bps, unsigned width)
+{
+	return bps <= width? x << (width - bps) : x >> (bps - width);
+}
+
+void FLAC__pcm_pack_s16le(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	unsigned i, channel;
+	FLAC__int32 x;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	for(i = 0; i < samples; i++) {
+		for(channel = 0; channel < channels; channel++) {
+			x = shift_to_width_(signal[channel][i], bps, 16);
+			*out++ = (FLAC__byte)x;
+			*out++ = (FLAC__byte)(x >> 8);
+		}
+	}
+}
+
+void FLAC__pcm_pack_s16be(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	unsigned i, channel;
+	FLAC__int32 x;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	for(i = 0; i < samples; i++) {
+		for(channel = 0; channel < channels; channel++) {
+			x = shift_to_width_(signal[channel][i], bps, 16);
+			*out++ = (FLAC__byte)(x >> 8);
+			*out++ = (FLAC__byte)x;
+		}
+	}
+}
+
+void FLAC__pcm_pack_s24le(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	unsigned i, channel;
+	FLAC__int32 x;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	for(i = 0; i < samples; i++) {
+		for(channel = 0; channel < channels; channel++) {
+			x = shift_to_width_(signal[channel][i], bps, 24);
+			*out++ = (FLAC__byte)x;
+			*out++ = (FLAC__byte)(x >> 8);
+			*out++ = (FLAC__byte)(x >> 16);
+		}
+	}
+}
+
+void FLAC__pcm_pack_s24be(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	unsigned i, channel;
+	FLAC__int32 x;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	for(i = 0; i < samples; i++) {
+		for(channel = 0; channel < channels; channel++) {
+			x = shift_to_width_(signal[channel][i], bps, 24);
+			*out++ = (FLAC__byte)(x >> 16);
+			*out++ = (FLAC__byte)(x >> 8);
+			*out++ = (FLAC__byte)x;
+		}
+	}
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+void FLAC__pcm_pack_float(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	/* exact for bps up to 25, since a float has a 24-bit mantissa plus sign */
+	const float scale = 1.0f / (float)(1u << (bps - 1));
+	float *fout = (float*)out;
+	unsigned i, channel;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	for(i = 0; i < samples; i++) {
+		for(channel = 0; channel < channels; channel++)
+			*fout++ = (float)signal[channel][i] * scale;
+	}
+}
+
+#endif
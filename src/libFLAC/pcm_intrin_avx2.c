@@ -0,0 +1,135 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifndef FLAC__NO_ASM
+#if (defined FLAC__CPU_IA32 || defined FLAC__CPU_X86_64) && defined FLAC__HAS_X86INTRIN
+#include "private/pcm.h"
+#ifdef FLAC__AVX2_SUPPORTED
+
+#include <immintrin.h> /* AVX2 */
+#include "FLAC/assert.h"
+
+/* big_endian is a constant in each caller and the tests on it are folded away */
+FLAC__SSE_TARGET("avx2")
+static inline void pack_s16_avx2_(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps, const FLAC__bool big_endian)
+{
+	/* one of the shifts is always 0; see FLAC__pcm_pack_s16le() */
+	const __m128i left = _mm_cvtsi32_si128(bps <= 16? 16 - bps : 0);
+	const __m128i right = _mm_cvtsi32_si128(bps > 16? bps - 16 : 0);
+	__m256i a, b, p;
+	unsigned i = 0;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	if(channels == 2) {
+		const FLAC__int32 *l = signal[0], *r = signal[1];
+		for( ; i + 8 <= samples; i += 8) {
+			a = _mm256_sra_epi32(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(l+i)), left), right);
+			b = _mm256_sra_epi32(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(r+i)), left), right);
+			/* the unpacks and the pack work within 128-bit lanes, which keeps the samples in order */
+			p = _mm256_packs_epi32(_mm256_unpacklo_epi32(a, b), _mm256_unpackhi_epi32(a, b));
+			if(big_endian)
+				p = _mm256_or_si256(_mm256_slli_epi16(p, 8), _mm256_srli_epi16(p, 8));
+			_mm256_storeu_si256((__m256i*)(out+4*i), p);
+		}
+	}
+	else if(channels == 1) {
+		const FLAC__int32 *s = signal[0];
+		for( ; i + 16 <= samples; i += 16) {
+			a = _mm256_sra_epi32(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(s+i)), left), right);
+			b = _mm256_sra_epi32(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*)(s+i+8)), left), right);
+			/* the pack leaves the middle two quarters swapped */
+			p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+			if(big_endian)
+				p = _mm256_or_si256(_mm256_slli_epi16(p, 8), _mm256_srli_epi16(p, 8));
+			_mm256_storeu_si256((__m256i*)(out+2*i), p);
+		}
+	}
+
+	FLAC__pcm_pack_tail(big_endian? FLAC__pcm_pack_s16be : FLAC__pcm_pack_s16le, out, signal, channels, samples, bps, i, 2);
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__pcm_pack_s16le_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	pack_s16_avx2_(out, signal, channels, samples, bps, /*big_endian=*/false);
+}
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__pcm_pack_s16be_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	pack_s16_avx2_(out, signal, channels, samples, bps, /*big_endian=*/true);
+}
+
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+
+FLAC__SSE_TARGET("avx2")
+void FLAC__pcm_pack_float_intrin_avx2(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / (float)(1u << (bps - 1)));
+	float *fout = (float*)out;
+	__m256 a, b, lo, hi;
+	unsigned i = 0;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	if(channels == 2) {
+		const FLAC__int32 *l = signal[0], *r = signal[1];
+		for( ; i + 8 <= samples; i += 8) {
+			a = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(l+i))), scale);
+			b = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(r+i))), scale);
+			lo = _mm256_unpacklo_ps(a, b);
+			hi = _mm256_unpackhi_ps(a, b);
+			_mm256_storeu_ps(fout+2*i, _mm256_permute2f128_ps(lo, hi, 0x20));
+			_mm256_storeu_ps(fout+2*i+8, _mm256_permute2f128_ps(lo, hi, 0x31));
+		}
+	}
+	else if(channels == 1) {
+		const FLAC__int32 *s = signal[0];
+		for( ; i + 8 <= samples; i += 8)
+			_mm256_storeu_ps(fout+i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(s+i))), scale));
+	}
+
+	FLAC__pcm_pack_tail(FLAC__pcm_pack_float, out, signal, channels, samples, bps, i, 4);
+}
+
+#endif /* FLAC__INTEGER_ONLY_LIBRARY */
+
+#endif /* FLAC__AVX2_SUPPORTED */
+#endif /* (FLAC__CPU_IA32 || FLAC__CPU_X86_64) && FLAC__HAS_X86INTRIN */
+#endif /* FLAC__NO_ASM */
@@ -0,0 +1,114 @@
+/* libFLAC - Free Lossless Audio Codec library
+ * Copyright (C) 2000-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * - Neither the name of the Xiph.org Foundation nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifndef FLAC__NO_ASM
+#if (defined FLAC__CPU_IA32 || defined FLAC__CPU_X86_64) && defined FLAC__HAS_X86INTRIN
+#include "private/pcm.h"
+#ifdef FLAC__SSSE3_SUPPORTED
+
+#include <tmmintrin.h> /* SSSE3 */
+#include "FLAC/assert.h"
+#include "share/compat.h"
+
+/*
+ * Each group of 16 interleaved samples is shifted to 24 bits in v[0..3],
+ * the low three bytes of each are gathered with a shuffle, and the four
+ * 12-byte results are merged into three full 16-byte stores.
+ * big_endian is a constant in each caller and the tests on it are folded
+ * away.
+ */
+FLAC__SSE_TARGET("ssse3")
+static FLAC__ALWAYS_INLINE void pack_s24_ssse3_(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps, const FLAC__bool big_endian)
+{
+	/* one of the shifts is always 0; see FLAC__pcm_pack_s24le() */
+	const __m128i left = _mm_cvtsi32_si128(bps <= 24? 24 - bps : 0);
+	const __m128i right = _mm_cvtsi32_si128(bps > 24? bps - 24 : 0);
+	const __m128i gather = big_endian?
+		_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+		_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m128i a, b, v[4];
+	unsigned i = 0, k;
+
+	FLAC__ASSERT(channels > 0);
+	FLAC__ASSERT(bps > 0 && bps <= 32);
+
+	if(channels <= 2) {
+		const unsigned step = 16 / channels;
+		for( ; i + step <= samples; i += step) {
+			if(channels == 2) {
+				const FLAC__int32 *l = signal[0], *r = signal[1];
+				a = _mm_loadu_si128((const __m128i*)(l+i));
+				b = _mm_loadu_si128((const __m128i*)(r+i));
+				v[0] = _mm_unpacklo_epi32(a, b);
+				v[1] = _mm_unpackhi_epi32(a, b);
+				a = _mm_loadu_si128((const __m128i*)(l+i+4));
+				b = _mm_loadu_si128((const __m128i*)(r+i+4));
+				v[2] = _mm_unpacklo_epi32(a, b);
+				v[3] = _mm_unpackhi_epi32(a, b);
+			}
+			else {
+				const FLAC__int32 *s = signal[0];
+				v[0] = _mm_loadu_si128((const __m128i*)(s+i));
+				v[1] = _mm_loadu_si128((const __m128i*)(s+i+4));
+				v[2] = _mm_loadu_si128((const __m128i*)(s+i+8));
+				v[3] = _mm_loadu_si128((const __m128i*)(s+i+12));
+			}
+			for(k = 0; k < 4; k++)
+				v[k] = _mm_shuffle_epi8(_mm_sra_epi32(_mm_sll_epi32(v[k], left), right), gather);
+			_mm_storeu_si128((__m128i*)(out+3*channels*i), _mm_or_si128(v[0], _mm_slli_si128(v[1], 12)));
+			_mm_storeu_si128((__m128i*)(out+3*channels*i+16), _mm_or_si128(_mm_srli_si128(v[1], 4), _mm_slli_si128(v[2], 8)));
+			_mm_storeu_si128((__m128i*)(out+3*channels*i+32), _mm_or_si128(_mm_srli_si128(v[2], 8), _mm_slli_si128(v[3], 4)));
+		}
+	}
+
+	FLAC__pcm_pack_tail(big_endian? FLAC__pcm_pack_s24be : FLAC__pcm_pack_s24le, out, signal, channels, samples, bps, i, 3);
+}
+
+FLAC__SSE_TARGET("ssse3")
+void FLAC__pcm_pack_s24le_intrin_ssse3(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	pack_s24_ssse3_(out, signal, channels, samples, bps, /*big_endian=*/false);
+}
+
+FLAC__SSE_TARGET("ssse3")
+void FLAC__pcm_pack_s24be_intrin_ssse3(FLAC__byte out[], const FLAC__int32 * const signal[], unsigned channels, unsigned samples, unsigned bps)
+{
+	pack_s24_ssse3_(out, signal, channels, samples, bps, /*big_endian=*/true);
+}
+
+#endif /* FLAC__SSSE3_SUPPORTED */
+#endif /* (FLAC__CPU_IA32 || FLAC__CPU_X86_64) && FLAC__HAS_X86INTRIN */
+#endif /* FLAC__NO_ASM */
@@ -39,6 +39,14 @@
 #include <string.h> /* for memset/memcpy() */
 #include <sys/stat.h> /* for stat() */
 #include <sys/types.h> /* for off_t */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h> /* for open() */
+#include <sys/mman.h> /* for mmap() */
+#include <unistd.h> /* for close() */
+#endif
 #include "share/compat.h"
 #include "FLAC/assert.h"
 #include "share/alloc.h"
@@ -49,8 +57,10 @@
 #include "private/crc.h"
 #include "private/fixed.h"
 #include "private/format.h"
+#include "private/frame_index.h"
 #include "private/lpc.h"
 #include "private/md5.h"
+#include "private/pcm.h"
 #include "private/memory.h"
 #include "private/macros.h"
 
@@ -73,6 +83,55 @@ FLAC_API int FLAC_API_SUPPORTS_OGG_FLAC =
 
 static const FLAC__byte ID3V2_TAG_[3] = { 'I', 'D', '3' };
 
+#ifdef HAVE_PTHREAD
+/* With multithreaded decoding, the size of the stretch of input given to
+ * each thread at a time.  It is raised for streams with very large frames
+ * so that a task always holds a few of them.
+ */
+static const size_t THREADTASK_BYTES_ = 128u * 1024u;
+
+typedef enum {
+	THREADTASK_FREE = 0,   /* idle, or being filled with input by the client's thread */
+	THREADTASK_QUEUED = 1, /* holds input waiting to be decoded */
+	THREADTASK_BUSY = 2,   /* being decoded */
+	THREADTASK_DONE = 3    /* decoded, waiting to be delivered in order */
+} ThreadTaskStatus;
+
+typedef struct {
+	FLAC__StreamDecoderErrorStatus status;
+	unsigned frame; /* the number of frames decoded before the error */
+} FLAC__StreamDecoderThreadTaskError;
+
+/* A stretch of the stream and everything decoded from it.  Each task has
+ * a decoder of its own which reads from data[] and keeps the frames and
+ * errors through the threadtask_*_callback_() routines, so they can be
+ * passed on to the client in order later.
+ */
+typedef struct {
+	ThreadTaskStatus status;
+	FLAC__StreamDecoder *decoder;
+	FLAC__byte *data;
+	size_t bytes, capacity;                  /* of data[] */
+	size_t limit;                            /* frames that start at or after data[limit] are left to the next task */
+	size_t read_pos;                         /* how much of data[] the decoder has read */
+	FLAC__uint64 offset;                     /* of data[0], counted from where multithreaded decoding started */
+	FLAC__bool is_last;                      /* data[] runs to the end of the stream */
+	/* results: */
+	size_t end;                              /* where in data[] the next frame starts */
+	FLAC__bool overrun;                      /* a frame ran past the end of data[]; it is left to the next task */
+	FLAC__bool end_of_stream;
+	FLAC__bool failed;                       /* read_frame_() gave up on the stream; decoding stops after the frames before */
+	FLAC__bool out_of_memory;
+	FLAC__Frame *frame;
+	size_t *frame_samples;                   /* where each frame's samples start in samples[]; the channels follow each other */
+	unsigned num_frames, frames_capacity;
+	FLAC__int32 *samples;
+	size_t num_samples, samples_capacity;
+	FLAC__StreamDecoderThreadTaskError *error;
+	unsigned num_errors, errors_capacity;
+} FLAC__StreamDecoderThreadTask;
+#endif
+
 /***********************************************************************
  *
  * Private class method prototypes
@@ -101,12 +160,17 @@ static FLAC__bool read_subframe_lpc_(FLAC__StreamDecoder *decoder, unsigned chan
 static FLAC__bool read_subframe_verbatim_(FLAC__StreamDecoder *decoder, unsigned channel, unsigned bps, FLAC__bool do_full_decode);
 static FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, unsigned predictor_order, unsigned partition_order, FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents, FLAC__int32 *residual, FLAC__bool is_extended);
 static FLAC__bool read_zero_padding_(FLAC__StreamDecoder *decoder);
+static unsigned scan_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte *raw, size_t bytes, unsigned fixed_block_size, FLAC__FrameHeader *header);
+static FLAC__bool scan_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderScanCallback scan_callback, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, FLAC__uint64 frame_end);
+static FLAC__bool find_last_frame_(const FLAC__StreamDecoder *decoder, const FLAC__byte *buffer, size_t bytes, FLAC__uint64 *total_samples);
 static FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data);
 #if FLAC__HAS_OGG
 static FLAC__StreamDecoderReadStatus read_callback_ogg_aspect_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes);
 static FLAC__OggDecoderAspectReadStatus read_callback_proxy_(const void *void_decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 #endif
 static FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
+static FLAC__StreamDecoderWriteStatus call_write_callback_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[]);
+static FLAC__StreamDecoderWriteStatus discard_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status);
 static FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample);
 #if FLAC__HAS_OGG
@@ -117,6 +181,35 @@ static FLAC__StreamDecoderSeekStatus file_seek_callback_(const FLAC__StreamDecod
 static FLAC__StreamDecoderTellStatus file_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data);
 static FLAC__StreamDecoderLengthStatus file_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data);
 static FLAC__bool file_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data);
+static FLAC__StreamDecoderReadStatus memory_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+static FLAC__StreamDecoderSeekStatus memory_seek_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data);
+static FLAC__StreamDecoderTellStatus memory_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data);
+static FLAC__StreamDecoderLengthStatus memory_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data);
+static FLAC__bool memory_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data);
+static void set_memory_source_(FLAC__StreamDecoder *decoder);
+static FLAC__bool frame_index_stream_params_(FLAC__StreamDecoder *decoder, FLAC__uint64 *audio_bytes);
+static void release_memory_(FLAC__StreamDecoder *decoder);
+#ifdef HAVE_PTHREAD
+/* multithreading-related routines: */
+static FLAC__StreamDecoderThreadTask *threadtask_new_(void);
+static void threadtask_delete_(FLAC__StreamDecoderThreadTask *task);
+static FLAC__bool start_threads_(FLAC__StreamDecoder *decoder, unsigned num_threads);
+static void stop_threads_(FLAC__StreamDecoder *decoder);
+static void *thread_main_(void *arg);
+static FLAC__bool decode_next_queued_threadtask_(FLAC__StreamDecoder *decoder);
+static void decode_threadtask_(FLAC__StreamDecoderThreadTask *task, size_t start);
+static FLAC__StreamDecoderReadStatus threadtask_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+static FLAC__StreamDecoderWriteStatus threadtask_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
+static void threadtask_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static FLAC__bool is_frame_header_(const FLAC__byte *data, size_t bytes);
+static size_t find_frame_boundary_(FLAC__StreamDecoder *decoder, size_t from, size_t to);
+static FLAC__bool read_threadinput_(FLAC__StreamDecoder *decoder, size_t bytes);
+static FLAC__bool fill_threadtask_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *task);
+static FLAC__bool deliver_threadtask_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *task);
+static FLAC__bool begin_threaded_decoding_(FLAC__StreamDecoder *decoder);
+static void end_threaded_decoding_(FLAC__StreamDecoder *decoder);
+static FLAC__bool process_until_end_of_stream_threaded_(FLAC__StreamDecoder *decoder);
+#endif
 
 /***********************************************************************
  *
@@ -142,8 +235,13 @@ typedef struct FLAC__StreamDecoderPrivate {
 	void (*local_lpc_restore_signal_64bit)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
 	/* for use when the signal is <= 16 bits-per-sample, or <= 15 bits-per-sample on a side channel (which requires 1 extra bit): */
 	void (*local_lpc_restore_signal_16bit)(const FLAC__int32 residual[], unsigned data_len, const FLAC__int32 qlp_coeff[], unsigned order, int lp_quantization, FLAC__int32 data[]);
+	FLAC__bool (*local_bitreader_read_rice_signed_block)(FLAC__BitReader *br, int vals[], unsigned nvals, unsigned parameter);
+	FLAC__PCMPackFunc local_pcm_pack; /* NULL unless a PCM format is set */
 	void *client_data;
 	FILE *file; /* only used if FLAC__stream_decoder_init_file()/FLAC__stream_decoder_init_file() called, else NULL */
+	const FLAC__byte *memory; /* only used if FLAC__stream_decoder_init_memory()/FLAC__stream_decoder_init_mapped_file() called, else NULL */
+	size_t memory_bytes, memory_position;
+	FLAC__bool memory_is_mapped; /* true if memory has to be munmap()ed */
 	FLAC__BitReader *input;
 	FLAC__int32 *output[FLAC__MAX_CHANNELS];
 	FLAC__int32 *residual[FLAC__MAX_CHANNELS]; /* WATCHOUT: these are the aligned pointers; the real pointers that should be free()'d are residual_unaligned[] below */
@@ -168,15 +266,48 @@ typedef struct FLAC__StreamDecoderPrivate {
 	FLAC__bool internal_reset_hack; /* used only during init() so we can call reset to set up the decoder without rewinding the input */
 	FLAC__bool is_seeking;
 	FLAC__MD5Context md5context;
+	FLAC__byte *pcm; /* the frame being written in the format set with FLAC__stream_decoder_set_pcm_format() */
+	size_t pcm_bytes, pcm_capacity;
+#ifdef HAVE_PTHREAD
+	FLAC__MD5Pipeline md5pipeline; /* used instead of accumulating md5context directly with threaded MD5 */
+#endif
 	FLAC__byte computed_md5sum[16]; /* this is the sum we computed from the decoded data */
 	/* (the rest of these are only used for seeking) */
 	FLAC__Frame last_frame; /* holds the info of the last frame we seeked to */
 	FLAC__uint64 first_frame_offset; /* hint to the seek routine of where in the stream the first audio frame starts */
 	FLAC__uint64 target_sample;
+	FLAC__FrameIndex frame_index; /* where the frames seen so far start, if protected_->frame_index is set */
+	FLAC__uint64 frame_start_offset; /* where the frame being read starts, or (FLAC__uint64)(-1) if not known */
 	unsigned unparseable_frame_count; /* used to tell whether we're decoding a future version of FLAC or just got a bad sync */
 #if FLAC__HAS_OGG
 	FLAC__bool got_a_frame; /* hack needed in Ogg FLAC seek routine to check when process_single() actually writes a frame */
 #endif
+#ifdef HAVE_PTHREAD
+	/* (the rest of these are only used for multithreaded decoding) */
+	FLAC__StreamDecoderThreadTask *threadtask[2*FLAC__STREAM_DECODER_MAX_THREADS]; /* used as a ring, in stream order */
+	unsigned num_threadtasks; /* 0 until multithreaded decoding is first used */
+	pthread_t thread[FLAC__STREAM_DECODER_MAX_THREADS];
+	unsigned num_running_threads; /* worker threads; the client's thread also decodes while it waits on them */
+	pthread_mutex_t mutex_threadtasks; /* protects the status of all tasks and next_threadtask_to_decode */
+	pthread_cond_t cond_threadtask_queued;
+	pthread_cond_t cond_threadtask_done;
+	unsigned next_threadtask_to_decode;
+	FLAC__bool threads_started;
+	FLAC__bool quit_threads;
+	struct {
+		FLAC__byte *data; /* input read ahead but not yet given to a task */
+		size_t bytes, capacity;
+		FLAC__uint64 offset; /* of data[0], counted from where multithreaded decoding started */
+		FLAC__bool eof;
+		FLAC__byte *carry; /* the part of a task that ran out of input, to be decoded again with the next one */
+		size_t carry_bytes, carry_capacity;
+		FLAC__uint64 next_frame_offset; /* where the task after the last delivered one has to start */
+		size_t task_bytes, overlap; /* each task gets about task_bytes, plus overlap bytes for its last frame */
+		FLAC__bool use_seek_table; /* true if offset 0 is the first frame, so seek points can be used */
+		unsigned next_seek_point;
+		FLAC__bool failed; /* decoding stopped because a task failed; see FLAC__StreamDecoderThreadTask */
+	} threadinput;
+#endif
 } FLAC__StreamDecoderPrivate;
 
 /***********************************************************************
@@ -243,6 +374,15 @@ FLAC_API const char * const FLAC__StreamDecoderErrorStatusString[] = {
 	"FLAC__STREAM_DECODER_ERROR_STATUS_UNPARSEABLE_STREAM"
 };
 
+FLAC_API const char * const FLAC__StreamDecoderPCMFormatString[] = {
+	"FLAC__STREAM_DECODER_PCM_FORMAT_NONE",
+	"FLAC__STREAM_DECODER_PCM_FORMAT_S16LE",
+	"FLAC__STREAM_DECODER_PCM_FORMAT_S16BE",
+	"FLAC__STREAM_DECODER_PCM_FORMAT_S24LE",
+	"FLAC__STREAM_DECODER_PCM_FORMAT_S24BE",
+	"FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT"
+};
+
 /***********************************************************************
  *
  * Class constructor/destructor
@@ -304,6 +444,16 @@ FLAC_API FLAC__StreamDecoder *FLAC__stream_decoder_new(void)
 
 	decoder->private_->file = 0;
 
+	decoder->private_->memory = 0;
+	decoder->private_->memory_bytes = decoder->private_->memory_position = 0;
+	decoder->private_->memory_is_mapped = false;
+
+	decoder->private_->pcm = 0;
+	decoder->private_->pcm_bytes = decoder->private_->pcm_capacity = 0;
+
+	FLAC__frame_index_init(&decoder->private_->frame_index);
+	decoder->private_->frame_start_offset = (FLAC__uint64)(-1);
+
 	set_defaults_(decoder);
 
 	decoder->protected_->state = FLAC__STREAM_DECODER_UNINITIALIZED;
@@ -389,6 +539,29 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 	decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal;
 	decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide;
 	decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal;
+	decoder->private_->local_bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block;
+	switch(decoder->protected_->pcm_format) {
+		case FLAC__STREAM_DECODER_PCM_FORMAT_S16LE:
+			decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16le;
+			break;
+		case FLAC__STREAM_DECODER_PCM_FORMAT_S16BE:
+			decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16be;
+			break;
+		case FLAC__STREAM_DECODER_PCM_FORMAT_S24LE:
+			decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24le;
+			break;
+		case FLAC__STREAM_DECODER_PCM_FORMAT_S24BE:
+			decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24be;
+			break;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+		case FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT:
+			decoder->private_->local_pcm_pack = FLAC__pcm_pack_float;
+			break;
+#endif
+		default:
+			decoder->private_->local_pcm_pack = 0;
+			break;
+	}
 	/* now override with asm where appropriate */
 #ifndef FLAC__NO_ASM
 	if(decoder->private_->cpuinfo.use_asm) {
@@ -416,10 +589,93 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 			decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide_intrin_sse41;
 		}
 # endif
+# if defined FLAC__SSE2_SUPPORTED
+		if(decoder->private_->cpuinfo.ia32.sse2) {
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16le_intrin_sse2;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16be_intrin_sse2;
+#  ifndef FLAC__INTEGER_ONLY_LIBRARY
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_float_intrin_sse2;
+#  endif
+		}
+# endif
+# if defined FLAC__SSSE3_SUPPORTED
+		if(decoder->private_->cpuinfo.ia32.ssse3) {
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S24LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24le_intrin_ssse3;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S24BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24be_intrin_ssse3;
+		}
+# endif
+# if defined FLAC__AVX2_SUPPORTED
+		if(decoder->private_->cpuinfo.ia32.avx2) {
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16le_intrin_avx2;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16be_intrin_avx2;
+#  ifndef FLAC__INTEGER_ONLY_LIBRARY
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_float_intrin_avx2;
+#  endif
+		}
+# endif
 #endif
 #elif defined FLAC__CPU_X86_64
 		FLAC__ASSERT(decoder->private_->cpuinfo.type == FLAC__CPUINFO_TYPE_X86_64);
-		/* No useful SSE optimizations yet */
+#ifdef FLAC__HAS_X86INTRIN
+# if defined FLAC__SSE4_1_SUPPORTED
+		if(decoder->private_->cpuinfo.x86.sse41) {
+			decoder->private_->local_lpc_restore_signal = FLAC__lpc_restore_signal_intrin_sse41;
+			decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide_intrin_sse41;
+			decoder->private_->local_lpc_restore_signal_16bit = FLAC__lpc_restore_signal_intrin_sse41;
+		}
+# endif
+# if defined FLAC__AVX2_SUPPORTED
+		if(decoder->private_->cpuinfo.x86.avx2) {
+			/* OPT_AVX: there is no 32-bit AVX2 version; 8-sample blocks need twice the serial work */
+			decoder->private_->local_lpc_restore_signal_64bit = FLAC__lpc_restore_signal_wide_intrin_avx2;
+		}
+# endif
+# if defined FLAC__SSE2_SUPPORTED
+		{ /* every x86-64 CPU has SSE2 */
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16le_intrin_sse2;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16be_intrin_sse2;
+#  ifndef FLAC__INTEGER_ONLY_LIBRARY
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_float_intrin_sse2;
+#  endif
+		}
+# endif
+# if defined FLAC__SSSE3_SUPPORTED
+		if(decoder->private_->cpuinfo.x86.ssse3) {
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S24LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24le_intrin_ssse3;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S24BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s24be_intrin_ssse3;
+		}
+# endif
+# if defined FLAC__AVX2_SUPPORTED
+		if(decoder->private_->cpuinfo.x86.avx2) {
+			if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16LE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16le_intrin_avx2;
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_S16BE)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_s16be_intrin_avx2;
+#  ifndef FLAC__INTEGER_ONLY_LIBRARY
+			else if(decoder->protected_->pcm_format == FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+				decoder->private_->local_pcm_pack = FLAC__pcm_pack_float_intrin_avx2;
+#  endif
+		}
+# endif
+#endif
+#ifdef FLAC__BITREADER_HAS_BMI2
+		if(decoder->private_->cpuinfo.x86.lzcnt && decoder->private_->cpuinfo.x86.bmi2) {
+			decoder->private_->local_bitreader_read_rice_signed_block = FLAC__bitreader_read_rice_signed_block_bmi2;
+		}
+#endif
 #endif
 	}
 #endif
@@ -454,6 +710,13 @@ static FLAC__StreamDecoderInitStatus init_stream_internal_(
 		return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
 	}
 
+#ifdef HAVE_PTHREAD
+	if(decoder->protected_->md5_checking && decoder->protected_->threaded_md5 && !FLAC__MD5PipelineStart(&decoder->private_->md5pipeline, &decoder->private_->md5context)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return FLAC__STREAM_DECODER_INIT_STATUS_MEMORY_ALLOCATION_ERROR;
+	}
+#endif
+
 	return FLAC__STREAM_DECODER_INIT_STATUS_OK;
 }
 
@@ -638,6 +901,148 @@ FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_file(
 	return init_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/true);
 }
 
+static FLAC__StreamDecoderInitStatus init_memory_internal_(
+	FLAC__StreamDecoder *decoder,
+	const FLAC__byte *data,
+	size_t bytes,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data,
+	FLAC__bool is_ogg
+)
+{
+	FLAC__StreamDecoderInitStatus init_status;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != data || bytes == 0);
+
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return decoder->protected_->initstate = FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+
+	if(0 == write_callback || 0 == error_callback)
+		return decoder->protected_->initstate = FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
+
+	/* a valid pointer even for an empty stream so FLAC__stream_decoder_finish() knows to clean up */
+	decoder->private_->memory = data? data : (const FLAC__byte*)"";
+	decoder->private_->memory_bytes = bytes;
+	decoder->private_->memory_position = 0;
+
+	init_status = init_stream_internal_(
+		decoder,
+		memory_read_callback_,
+		memory_seek_callback_,
+		memory_tell_callback_,
+		memory_length_callback_,
+		memory_eof_callback_,
+		write_callback,
+		metadata_callback,
+		error_callback,
+		client_data,
+		is_ogg
+	);
+	if(init_status == FLAC__STREAM_DECODER_INIT_STATUS_OK)
+		set_memory_source_(decoder);
+	else if(decoder->protected_->state == FLAC__STREAM_DECODER_UNINITIALIZED)
+		release_memory_(decoder); /* FLAC__stream_decoder_finish() won't */
+	return init_status;
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_memory(
+	FLAC__StreamDecoder *decoder,
+	const FLAC__byte *data,
+	size_t bytes,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_memory_internal_(decoder, data, bytes, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/false);
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_memory(
+	FLAC__StreamDecoder *decoder,
+	const FLAC__byte *data,
+	size_t bytes,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_memory_internal_(decoder, data, bytes, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/true);
+}
+
+static FLAC__StreamDecoderInitStatus init_mapped_file_internal_(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data,
+	FLAC__bool is_ogg
+)
+{
+#ifdef HAVE_SYS_MMAN_H
+	FLAC__ASSERT(0 != decoder);
+
+	/*
+	 * As in init_file_internal_(), do the entrance checks here so that
+	 * once the file is mapped, FLAC__stream_decoder_finish() will always
+	 * unmap it.
+	 */
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return decoder->protected_->initstate = FLAC__STREAM_DECODER_INIT_STATUS_ALREADY_INITIALIZED;
+
+	if(0 == write_callback || 0 == error_callback)
+		return decoder->protected_->initstate = FLAC__STREAM_DECODER_INIT_STATUS_INVALID_CALLBACKS;
+
+	if(0 != filename) {
+		struct flac_stat_s filestats;
+		void *mapping = MAP_FAILED;
+		int fd = open(filename, O_RDONLY);
+
+		if(fd < 0)
+			return FLAC__STREAM_DECODER_INIT_STATUS_ERROR_OPENING_FILE;
+		/* only regular files can be mapped, and an empty one cannot; those are read as usual */
+		if(flac_fstat(fd, &filestats) == 0 && S_ISREG(filestats.st_mode) && filestats.st_size > 0 && (FLAC__uint64)filestats.st_size <= (FLAC__uint64)SIZE_MAX)
+			mapping = mmap(0, (size_t)filestats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if(mapping != MAP_FAILED) {
+			decoder->private_->memory_is_mapped = true;
+			return init_memory_internal_(decoder, (const FLAC__byte*)mapping, (size_t)filestats.st_size, write_callback, metadata_callback, error_callback, client_data, is_ogg);
+		}
+	}
+#endif
+	return init_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, is_ogg);
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_mapped_file(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_mapped_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/false);
+}
+
+FLAC_API FLAC__StreamDecoderInitStatus FLAC__stream_decoder_init_ogg_mapped_file(
+	FLAC__StreamDecoder *decoder,
+	const char *filename,
+	FLAC__StreamDecoderWriteCallback write_callback,
+	FLAC__StreamDecoderMetadataCallback metadata_callback,
+	FLAC__StreamDecoderErrorCallback error_callback,
+	void *client_data
+)
+{
+	return init_mapped_file_internal_(decoder, filename, write_callback, metadata_callback, error_callback, client_data, /*is_ogg=*/true);
+}
+
 FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 {
 	FLAC__bool md5_failed = false;
@@ -650,6 +1055,14 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 	if(decoder->protected_->state == FLAC__STREAM_DECODER_UNINITIALIZED)
 		return true;
 
+#ifdef HAVE_PTHREAD
+	end_threaded_decoding_(decoder);
+
+	/* the MD5 thread must have hashed every frame before the sum is final */
+	if(decoder->private_->md5pipeline.started && !FLAC__MD5PipelineStop(&decoder->private_->md5pipeline) && decoder->private_->do_md5_checking)
+		md5_failed = true;
+#endif
+
 	/* see the comment in FLAC__stream_decoder_reset() as to why we
 	 * always call FLAC__MD5Final()
 	 */
@@ -679,6 +1092,10 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 	}
 	decoder->private_->output_capacity = 0;
 	decoder->private_->output_channels = 0;
+	free(decoder->private_->pcm);
+	decoder->private_->pcm = 0;
+	decoder->private_->pcm_bytes = decoder->private_->pcm_capacity = 0;
+	FLAC__frame_index_free(&decoder->private_->frame_index);
 
 #if FLAC__HAS_OGG
 	if(decoder->private_->is_ogg)
@@ -691,6 +1108,8 @@ FLAC_API FLAC__bool FLAC__stream_decoder_finish(FLAC__StreamDecoder *decoder)
 		decoder->private_->file = 0;
 	}
 
+	release_memory_(decoder);
+
 	if(decoder->private_->do_md5_checking) {
 		if(memcmp(decoder->private_->stream_info.data.stream_info.md5sum, decoder->private_->computed_md5sum, 16))
 			md5_failed = true;
@@ -731,6 +1150,52 @@ FLAC_API FLAC__bool FLAC__stream_decoder_set_md5_checking(FLAC__StreamDecoder *d
 	return true;
 }
 
+FLAC_API FLAC__bool FLAC__stream_decoder_set_threaded_md5(FLAC__StreamDecoder *decoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+	decoder->protected_->threaded_md5 = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_num_threads(FLAC__StreamDecoder *decoder, unsigned value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+	decoder->protected_->num_threads = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_pcm_format(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderPCMFormat format)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+#ifdef FLAC__INTEGER_ONLY_LIBRARY
+	if(format == FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+		return false;
+#endif
+	if((unsigned)format > FLAC__STREAM_DECODER_PCM_FORMAT_FLOAT)
+		return false;
+	decoder->protected_->pcm_format = format;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_set_frame_index(FLAC__StreamDecoder *decoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	if(decoder->protected_->state != FLAC__STREAM_DECODER_UNINITIALIZED)
+		return false;
+	decoder->protected_->frame_index = value;
+	return true;
+}
+
 FLAC_API FLAC__bool FLAC__stream_decoder_set_metadata_respond(FLAC__StreamDecoder *decoder, FLAC__MetadataType type)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -866,6 +1331,52 @@ FLAC_API FLAC__bool FLAC__stream_decoder_get_md5_checking(const FLAC__StreamDeco
 	return decoder->protected_->md5_checking;
 }
 
+FLAC_API FLAC__bool FLAC__stream_decoder_get_threaded_md5(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->threaded_md5;
+}
+
+FLAC_API unsigned FLAC__stream_decoder_get_num_threads(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->num_threads;
+}
+
+FLAC_API FLAC__StreamDecoderPCMFormat FLAC__stream_decoder_get_pcm_format(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->pcm_format;
+}
+
+FLAC_API const void *FLAC__stream_decoder_get_pcm(const FLAC__StreamDecoder *decoder, size_t *bytes)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->private_);
+	if(0 != bytes)
+		*bytes = decoder->private_->pcm_bytes;
+	return decoder->private_->pcm_bytes > 0? decoder->private_->pcm : 0;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_get_frame_index(const FLAC__StreamDecoder *decoder)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	return decoder->protected_->frame_index;
+}
+
+FLAC_API const FLAC__StreamMetadata_SeekPoint *FLAC__stream_decoder_get_frame_index_points(const FLAC__StreamDecoder *decoder, unsigned *num_points)
+{
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->private_);
+	FLAC__ASSERT(0 != num_points);
+	*num_points = decoder->private_->frame_index.num_points;
+	return decoder->private_->frame_index.num_points > 0? decoder->private_->frame_index.points : 0;
+}
+
 FLAC_API FLAC__uint64 FLAC__stream_decoder_get_total_samples(const FLAC__StreamDecoder *decoder)
 {
 	FLAC__ASSERT(0 != decoder);
@@ -1005,6 +1516,11 @@ FLAC_API FLAC__bool FLAC__stream_decoder_reset(FLAC__StreamDecoder *decoder)
 	 * FLAC__stream_decoder_finish() to make sure things are always cleaned up
 	 * properly.
 	 */
+#ifdef HAVE_PTHREAD
+	/* frames from before the reset may still be queued for the MD5 thread */
+	if(decoder->private_->md5pipeline.started)
+		(void)FLAC__MD5PipelineSync(&decoder->private_->md5pipeline);
+#endif
 	FLAC__MD5Init(&decoder->private_->md5context);
 
 	decoder->private_->first_frame_offset = 0;
@@ -1094,6 +1610,16 @@ FLAC_API FLAC__bool FLAC__stream_decoder_process_until_end_of_stream(FLAC__Strea
 					return false; /* above function sets the status for us */
 				break;
 			case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+#ifdef HAVE_PTHREAD
+				if(
+					decoder->protected_->num_threads > 1 &&
+#if FLAC__HAS_OGG
+					!decoder->private_->is_ogg &&
+#endif
+					decoder->private_->has_stream_info
+				)
+					return process_until_end_of_stream_threaded_(decoder); /* above function sets the status for us */
+#endif
 				if(!frame_sync_(decoder))
 					return true; /* above function sets the status for us */
 				break;
@@ -1142,46 +1668,200 @@ FLAC_API FLAC__bool FLAC__stream_decoder_skip_single_frame(FLAC__StreamDecoder *
 	}
 }
 
-FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *decoder, FLAC__uint64 sample)
+FLAC_API FLAC__bool FLAC__stream_decoder_scan_until_end_of_stream(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderScanCallback scan_callback, FLAC__uint64 *total_samples)
 {
-	FLAC__uint64 length;
+	/* the most we need to see past a sync code to parse a frame header */
+	static const size_t lookahead = 16;
+	const size_t chunk = 65536;
+	FLAC__byte *buffer;
+	size_t capacity, bytes = 0, pos = 0, unconsumed;
+	FLAC__uint64 offset; /* of buffer[0] in the stream */
+	FLAC__uint64 frame_offset = 0, crc_zero_offset = 0;
+	FLAC__FrameHeader frame, next;
+	unsigned crc = 0, header_len, frame_header_len = 0, fixed_block_size = 0;
+	FLAC__bool in_frame = false, eof = false, ok = true;
 
 	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
 
-	if(
-		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_METADATA &&
-		decoder->protected_->state != FLAC__STREAM_DECODER_READ_METADATA &&
-		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
-		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
-		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
-	)
-		return false;
+	if(0 != total_samples)
+		*total_samples = 0;
 
-	if(0 == decoder->private_->seek_callback)
+#if FLAC__HAS_OGG
+	if(decoder->private_->is_ogg)
 		return false;
+#endif
 
-	FLAC__ASSERT(decoder->private_->seek_callback);
-	FLAC__ASSERT(decoder->private_->tell_callback);
-	FLAC__ASSERT(decoder->private_->length_callback);
-	FLAC__ASSERT(decoder->private_->eof_callback);
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above function sets the status for us */
+	}
+	switch(decoder->protected_->state) {
+		case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+		case FLAC__STREAM_DECODER_READ_FRAME:
+			break;
+		case FLAC__STREAM_DECODER_END_OF_STREAM:
+			if(0 != total_samples)
+				*total_samples = decoder->private_->samples_decoded;
+			return true;
+		default:
+			return false;
+	}
 
-	if(FLAC__stream_decoder_get_total_samples(decoder) > 0 && sample >= FLAC__stream_decoder_get_total_samples(decoder))
+	if(!FLAC__stream_decoder_get_decode_position(decoder, &offset))
 		return false;
 
-	decoder->private_->is_seeking = true;
-
-	/* turn off md5 checking if a seek is attempted */
+	/* no audio is decoded, so the MD5 signature can't be checked */
 	decoder->private_->do_md5_checking = false;
 
-	/* get the file length (currently our algorithm needs to know the length so it's also an error to get FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED) */
-	if(decoder->private_->length_callback(decoder, &length, decoder->private_->client_data) != FLAC__STREAM_DECODER_LENGTH_STATUS_OK) {
-		decoder->private_->is_seeking = false;
+	unconsumed = FLAC__stream_decoder_get_input_bytes_unconsumed(decoder);
+	capacity = unconsumed + 2 + chunk;
+	if(0 == (buffer = safe_malloc_(capacity))) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
 		return false;
 	}
 
-	/* if we haven't finished processing the metadata yet, do that so we have the STREAMINFO, SEEK_TABLE, and first_frame_offset */
-	if(
-		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+	/* start with whatever the decoder has already read but not consumed */
+	if(decoder->protected_->state == FLAC__STREAM_DECODER_READ_FRAME) {
+		buffer[bytes++] = decoder->private_->header_warmup[0];
+		buffer[bytes++] = decoder->private_->header_warmup[1];
+	}
+	else if(decoder->private_->cached)
+		buffer[bytes++] = decoder->private_->lookahead;
+	decoder->private_->cached = false;
+	offset -= bytes;
+	if(unconsumed > 0 && !FLAC__bitreader_read_byte_block_aligned_no_crc(decoder->private_->input, buffer + bytes, unconsumed)) {
+		free(buffer);
+		return false; /* read_callback_ sets the state for us */
+	}
+	bytes += unconsumed;
+	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+
+	/*
+	 * A frame ends where the next one starts, which we can tell by a sync
+	 * code, a valid header, and the CRC-16 of the frame so far coming out
+	 * to 0 (i.e. the last 2 bytes were the footer).  A frame with a bad
+	 * CRC-16 ends where the frame that should come next starts.
+	 */
+	while(ok) {
+		size_t limit;
+		if(!eof && bytes - pos <= lookahead) {
+			size_t n;
+			memmove(buffer, buffer + pos, bytes - pos);
+			offset += pos;
+			bytes -= pos;
+			pos = 0;
+			n = capacity - bytes;
+			if(!read_callback_(buffer + bytes, &n, decoder)) {
+				if(decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM) {
+					ok = false;
+					break;
+				}
+				eof = true;
+			}
+			bytes += n;
+			continue;
+		}
+		if(pos == bytes)
+			break;
+		limit = eof? bytes : bytes - lookahead;
+		for( ; pos < limit; pos++) {
+			const FLAC__byte b = buffer[pos];
+			if(
+				b == 0xff &&
+				(!in_frame || offset + pos > frame_offset + frame_header_len + 2) &&
+				0 != (header_len = scan_frame_header_(decoder, buffer + pos, bytes - pos, fixed_block_size, &next))
+			) {
+				FLAC__bool starts_frame = true;
+				if(!in_frame) {
+					in_frame = true;
+					fixed_block_size = next.blocksize;
+				}
+				else if(crc == 0 || next.number.sample_number == frame.number.sample_number + frame.blocksize) {
+					if(crc != 0)
+						send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+					if(!scan_frame_(decoder, scan_callback, &frame, frame_offset, offset + pos)) {
+						ok = false;
+						break;
+					}
+				}
+				else
+					starts_frame = false; /* just audio data that looks like a header */
+				if(starts_frame) {
+					frame = next;
+					frame_offset = offset + pos;
+					frame_header_len = header_len;
+					crc_zero_offset = 0;
+					crc = FLAC__crc16(buffer + pos, header_len);
+					pos += header_len - 1;
+					continue;
+				}
+			}
+			crc = FLAC__CRC16_UPDATE(b, crc);
+			if(crc == 0)
+				crc_zero_offset = offset + pos + 1;
+		}
+	}
+
+	if(ok && in_frame) {
+		if(crc == 0)
+			ok = scan_frame_(decoder, scan_callback, &frame, frame_offset, offset + bytes);
+		/* anything after the last place the CRC-16 came out right, like an ID3v1 tag, is not part of the frame */
+		else if(crc_zero_offset > frame_offset + frame_header_len + 2)
+			ok = scan_frame_(decoder, scan_callback, &frame, frame_offset, crc_zero_offset);
+		else /* probably a truncated stream */
+			send_error_to_client_(decoder, FLAC__STREAM_DECODER_ERROR_STATUS_FRAME_CRC_MISMATCH);
+	}
+
+	free(buffer);
+	if(ok && 0 != total_samples)
+		*total_samples = decoder->private_->samples_decoded;
+	return ok;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *decoder, FLAC__uint64 sample)
+{
+	FLAC__uint64 length;
+
+	FLAC__ASSERT(0 != decoder);
+
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
+	)
+		return false;
+
+	if(0 == decoder->private_->seek_callback)
+		return false;
+
+	FLAC__ASSERT(decoder->private_->seek_callback);
+	FLAC__ASSERT(decoder->private_->tell_callback);
+	FLAC__ASSERT(decoder->private_->length_callback);
+	FLAC__ASSERT(decoder->private_->eof_callback);
+
+	if(FLAC__stream_decoder_get_total_samples(decoder) > 0 && sample >= FLAC__stream_decoder_get_total_samples(decoder))
+		return false;
+
+	decoder->private_->is_seeking = true;
+
+	/* turn off md5 checking if a seek is attempted */
+	decoder->private_->do_md5_checking = false;
+
+	/* get the file length (currently our algorithm needs to know the length so it's also an error to get FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED) */
+	if(decoder->private_->length_callback(decoder, &length, decoder->private_->client_data) != FLAC__STREAM_DECODER_LENGTH_STATUS_OK) {
+		decoder->private_->is_seeking = false;
+		return false;
+	}
+
+	/* if we haven't finished processing the metadata yet, do that so we have the STREAMINFO, SEEK_TABLE, and first_frame_offset */
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
 		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
 	) {
 		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder)) {
@@ -1197,18 +1877,254 @@ FLAC_API FLAC__bool FLAC__stream_decoder_seek_absolute(FLAC__StreamDecoder *deco
 	}
 
 	{
-		const FLAC__bool ok =
+		FLAC__bool ok;
+		/* the seek routines count on read_callback_() to give up on a run of unparseable frames, so don't bypass it */
+		FLAC__bitreader_set_source(decoder->private_->input, 0, 0, 0);
+		ok =
 #if FLAC__HAS_OGG
 			decoder->private_->is_ogg?
 			seek_to_absolute_sample_ogg_(decoder, length, sample) :
 #endif
 			seek_to_absolute_sample_(decoder, length, sample)
 		;
+		set_memory_source_(decoder);
 		decoder->private_->is_seeking = false;
 		return ok;
 	}
 }
 
+FLAC_API FLAC__bool FLAC__stream_decoder_find_total_samples(FLAC__StreamDecoder *decoder, FLAC__uint64 *total_samples)
+{
+	FLAC__uint64 length, resume, window, samples_decoded;
+	FLAC__StreamDecoderState state;
+	FLAC__byte *buffer = 0;
+	FLAC__bool do_md5_checking, found = false, ok = true;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != total_samples);
+
+	*total_samples = 0;
+
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_METADATA &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
+	)
+		return false;
+
+	if(0 == decoder->private_->seek_callback || 0 == decoder->private_->tell_callback)
+		return false;
+
+#if FLAC__HAS_OGG
+	if(decoder->private_->is_ogg)
+		return false;
+#endif
+
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above function sets the status for us */
+	}
+
+	if(FLAC__stream_decoder_get_total_samples(decoder) > 0) {
+		*total_samples = FLAC__stream_decoder_get_total_samples(decoder);
+		return true;
+	}
+
+	if(decoder->private_->length_callback(decoder, &length, decoder->private_->client_data) != FLAC__STREAM_DECODER_LENGTH_STATUS_OK)
+		return false;
+
+	/* remember where to come back to, counting what frame_sync_() has already read */
+	if(!FLAC__stream_decoder_get_decode_position(decoder, &resume))
+		return false;
+	state = decoder->protected_->state;
+	if(state == FLAC__STREAM_DECODER_READ_FRAME)
+		resume -= 2;
+	else if(decoder->private_->cached)
+		resume -= 1;
+	samples_decoded = decoder->private_->samples_decoded;
+	do_md5_checking = decoder->private_->do_md5_checking;
+
+	/*
+	 * Start with enough of the end of the stream to be sure of holding
+	 * the whole last frame: the largest frame STREAMINFO knows of, or
+	 * else the size of a verbatim frame, with room for the frame before
+	 * and an ID3v1 tag after.
+	 */
+	if(decoder->private_->has_stream_info) {
+		const FLAC__StreamMetadata_StreamInfo *stream_info = &decoder->private_->stream_info.data.stream_info;
+		window = stream_info->max_framesize > 0?
+			stream_info->max_framesize :
+			(FLAC__uint64)stream_info->max_blocksize * stream_info->channels * stream_info->bits_per_sample / 8 + 32
+		;
+	}
+	else
+		window = 65536;
+	window = 2 * window + 128;
+
+	/* the reads have to go through read_callback_() to see the end of the stream */
+	FLAC__bitreader_set_source(decoder->private_->input, 0, 0, 0);
+	while(1) {
+		FLAC__uint64 start = decoder->private_->first_frame_offset;
+		size_t capacity, bytes = 0;
+		FLAC__byte *tmp;
+
+		if(length > start + window)
+			start = length - window;
+		capacity = (size_t)(length - start);
+		if((FLAC__uint64)capacity != length - start || 0 == (tmp = safe_realloc_add_2op_(buffer, capacity, 1))) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			ok = false;
+			break;
+		}
+		buffer = tmp;
+
+		if(decoder->private_->seek_callback(decoder, start, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+			ok = false;
+			break;
+		}
+		while(bytes < capacity) {
+			size_t n = capacity - bytes;
+			if(!read_callback_(buffer + bytes, &n, decoder)) {
+				ok = (decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM);
+				break;
+			}
+			bytes += n;
+		}
+		if(!ok)
+			break;
+
+		if(find_last_frame_(decoder, buffer, bytes, total_samples)) {
+			found = true;
+			break;
+		}
+		/* a stream with no frames at all has no samples */
+		if(start == decoder->private_->first_frame_offset)
+			break;
+		window *= 2;
+	}
+	free(buffer);
+
+	if(ok) {
+		if(decoder->private_->seek_callback(decoder, resume, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
+			ok = false;
+		}
+		else if(!FLAC__stream_decoder_flush(decoder))
+			ok = false; /* above function sets the status for us */
+		else {
+			decoder->private_->cached = false;
+			decoder->private_->samples_decoded = samples_decoded;
+			decoder->private_->do_md5_checking = do_md5_checking;
+			if(state == FLAC__STREAM_DECODER_END_OF_STREAM)
+				decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+		}
+	}
+	set_memory_source_(decoder);
+
+	if(ok && found)
+		decoder->private_->stream_info.data.stream_info.total_samples = *total_samples;
+	return ok;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_compute_md5_signature(FLAC__StreamDecoder *decoder, FLAC__byte md5sum[16])
+{
+	FLAC__StreamDecoderWriteCallback write_callback;
+	FLAC__PCMPackFunc local_pcm_pack;
+	FLAC__bool ok;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != decoder->protected_);
+	FLAC__ASSERT(0 != md5sum);
+
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false; /* above function sets the status for us */
+	}
+
+	/* the signature covers the whole stream, so nothing can have been decoded yet */
+	if(
+		(
+			decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+			decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME
+		) ||
+		decoder->private_->samples_decoded > 0 ||
+		!decoder->private_->has_stream_info /* write_audio_frame_to_client_() won't hash without it */
+	)
+		return false;
+
+	/* hash the audio even if STREAMINFO has no signature to check it against */
+	decoder->private_->do_md5_checking = true;
+	write_callback = decoder->private_->write_callback;
+	local_pcm_pack = decoder->private_->local_pcm_pack;
+	decoder->private_->write_callback = discard_write_callback_;
+	decoder->private_->local_pcm_pack = 0;
+
+	ok =
+		FLAC__stream_decoder_process_until_end_of_stream(decoder) &&
+		decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM
+	;
+
+	decoder->private_->write_callback = write_callback;
+	decoder->private_->local_pcm_pack = local_pcm_pack;
+#ifdef HAVE_PTHREAD
+	if(decoder->private_->md5pipeline.started && !FLAC__MD5PipelineSync(&decoder->private_->md5pipeline))
+		ok = false;
+#endif
+	if(ok)
+		FLAC__MD5Final(md5sum, &decoder->private_->md5context);
+	/* the sum is used up, so don't let FLAC__stream_decoder_finish() check it */
+	decoder->private_->do_md5_checking = false;
+	return ok;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_save_frame_index(FLAC__StreamDecoder *decoder, const char *filename)
+{
+	FLAC__uint64 audio_bytes;
+	FILE *file;
+	FLAC__bool ok;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != filename);
+
+	if(!frame_index_stream_params_(decoder, &audio_bytes))
+		return false;
+
+	if(0 == (file = flac_fopen(filename, "wb")))
+		return false;
+	ok = FLAC__frame_index_save(&decoder->private_->frame_index, file, decoder->private_->stream_info.data.stream_info.md5sum, decoder->private_->stream_info.data.stream_info.total_samples, audio_bytes);
+	if(fclose(file) != 0)
+		ok = false;
+	return ok;
+}
+
+FLAC_API FLAC__bool FLAC__stream_decoder_load_frame_index(FLAC__StreamDecoder *decoder, const char *filename)
+{
+	FLAC__uint64 audio_bytes;
+	FILE *file;
+	FLAC__bool ok;
+
+	FLAC__ASSERT(0 != decoder);
+	FLAC__ASSERT(0 != filename);
+
+	if(!frame_index_stream_params_(decoder, &audio_bytes))
+		return false;
+
+	if(0 == (file = flac_fopen(filename, "rb")))
+		return false;
+	ok = FLAC__frame_index_load(&decoder->private_->frame_index, file, decoder->private_->stream_info.data.stream_info.md5sum, decoder->private_->stream_info.data.stream_info.total_samples, audio_bytes);
+	fclose(file);
+	return ok;
+}
+
 /***********************************************************************
  *
  * Protected class methods
@@ -1249,6 +2165,10 @@ void set_defaults_(FLAC__StreamDecoder *decoder)
 	decoder->private_->metadata_filter_ids_count = 0;
 
 	decoder->protected_->md5_checking = false;
+	decoder->protected_->threaded_md5 = false;
+	decoder->protected_->num_threads = 1;
+	decoder->protected_->pcm_format = FLAC__STREAM_DECODER_PCM_FORMAT_NONE;
+	decoder->protected_->frame_index = false;
 
 #if FLAC__HAS_OGG
 	FLAC__ogg_decoder_aspect_set_defaults(&decoder->protected_->ogg_decoder_aspect);
@@ -2021,6 +2941,18 @@ FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FL
 
 	*got_a_frame = false;
 
+	/* the sync code in header_warmup has already been read, so the frame starts 2 bytes back */
+	decoder->private_->frame_start_offset = (FLAC__uint64)(-1);
+	if(decoder->protected_->frame_index
+#if FLAC__HAS_OGG
+		&& !decoder->private_->is_ogg
+#endif
+	) {
+		FLAC__uint64 pos;
+		if(FLAC__stream_decoder_get_decode_position(decoder, &pos) && pos >= decoder->private_->first_frame_offset + 2)
+			decoder->private_->frame_start_offset = pos - 2;
+	}
+
 	/* init the CRC */
 	frame_crc = 0;
 	frame_crc = FLAC__CRC16_UPDATE(decoder->private_->header_warmup[0], frame_crc);
@@ -2080,6 +3012,13 @@ FLAC__bool read_frame_(FLAC__StreamDecoder *decoder, FLAC__bool *got_a_frame, FL
 	if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &x, FLAC__FRAME_FOOTER_CRC_LEN))
 		return false; /* read_callback_ sets the state for us */
 	if(frame_crc == x) {
+		if(decoder->private_->frame_start_offset != (FLAC__uint64)(-1)) {
+			FLAC__ASSERT(decoder->private_->frame.header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+			if(!FLAC__frame_index_add(&decoder->private_->frame_index, decoder->private_->frame.header.number.sample_number, decoder->private_->frame_start_offset - decoder->private_->first_frame_offset, decoder->private_->frame.header.blocksize)) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return false;
+			}
+		}
 		if(do_full_decode) {
 			/* Undo any special channel coding */
 			switch(decoder->private_->frame.header.channel_assignment) {
@@ -2767,7 +3706,7 @@ FLAC__bool read_residual_partitioned_rice_(FLAC__StreamDecoder *decoder, unsigne
 		if(rice_parameter < pesc) {
 			partitioned_rice_contents->raw_bits[partition] = 0;
 			u = (partition_order == 0 || partition > 0)? partition_samples : partition_samples - predictor_order;
-			if(!FLAC__bitreader_read_rice_signed_block(decoder->private_->input, residual + sample, u, rice_parameter))
+			if(!decoder->private_->local_bitreader_read_rice_signed_block(decoder->private_->input, residual + sample, u, rice_parameter))
 				return false; /* read_callback_ sets the state for us */
 			sample += u;
 		}
@@ -2800,59 +3739,270 @@ FLAC__bool read_zero_padding_(FLAC__StreamDecoder *decoder)
 	return true;
 }
 
-FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data)
+/*
+ * Parses a frame header from raw bytes for
+ * FLAC__stream_decoder_scan_until_end_of_stream(), the same way
+ * read_frame_header_() does from the bitreader.  Returns the length of the
+ * header including the CRC-8, or 0 if raw[] does not start with a valid
+ * header we can parse.  fixed_block_size is used to turn a frame number
+ * into a sample number when there is no STREAMINFO.
+ */
+unsigned scan_frame_header_(const FLAC__StreamDecoder *decoder, const FLAC__byte *raw, size_t bytes, unsigned fixed_block_size, FLAC__FrameHeader *header)
 {
-	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder *)client_data;
+	static const unsigned sample_rate_table[12] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+	static const unsigned bits_per_sample_table[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+	const FLAC__StreamMetadata_StreamInfo *stream_info = decoder->private_->has_stream_info? &decoder->private_->stream_info.data.stream_info : 0;
+	unsigned x, i, len, blocksize_hint = 0, sample_rate_hint = 0;
+	FLAC__uint64 number;
+	FLAC__bool is_variable;
+
+	/* sync code and reserved bit; the sync code cannot appear in the rest of the header */
+	if(bytes < 6 || raw[0] != 0xff || (raw[1] & 0xfe) != 0xf8 || raw[2] == 0xff || raw[3] == 0xff)
+		return 0;
 
-	if(
-#if FLAC__HAS_OGG
-		/* see [1] HACK NOTE below for why we don't call the eof_callback when decoding Ogg FLAC */
-		!decoder->private_->is_ogg &&
-#endif
-		decoder->private_->eof_callback && decoder->private_->eof_callback(decoder, decoder->private_->client_data)
-	) {
-		*bytes = 0;
-		decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
-		return false;
+	x = raw[2] >> 4;
+	if(x == 0)
+		return 0;
+	else if(x == 1)
+		header->blocksize = 192;
+	else if(x <= 5)
+		header->blocksize = 576 << (x-2);
+	else if(x <= 7)
+		blocksize_hint = x;
+	else
+		header->blocksize = 256 << (x-8);
+
+	x = raw[2] & 0x0f;
+	if(x == 0) {
+		if(0 == stream_info)
+			return 0;
+		header->sample_rate = stream_info->sample_rate;
 	}
-	else if(*bytes > 0) {
-		/* While seeking, it is possible for our seek to land in the
-		 * middle of audio data that looks exactly like a frame header
-		 * from a future version of an encoder.  When that happens, our
-		 * error callback will get an
-		 * FLAC__STREAM_DECODER_UNPARSEABLE_STREAM and increment its
-		 * unparseable_frame_count.  But there is a remote possibility
-		 * that it is properly synced at such a "future-codec frame",
-		 * so to make sure, we wait to see many "unparseable" errors in
-		 * a row before bailing out.
-		 */
-		if(decoder->private_->is_seeking && decoder->private_->unparseable_frame_count > 20) {
-			decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
-			return false;
+	else if(x < 12)
+		header->sample_rate = sample_rate_table[x];
+	else if(x < 15)
+		sample_rate_hint = x;
+	else
+		return 0;
+
+	x = raw[3] >> 4;
+	if(x & 8) {
+		header->channels = 2;
+		switch(x & 7) {
+			case 0:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE;
+				break;
+			case 1:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE;
+				break;
+			case 2:
+				header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_MID_SIDE;
+				break;
+			default:
+				return 0;
 		}
-		else {
-			const FLAC__StreamDecoderReadStatus status =
-#if FLAC__HAS_OGG
-				decoder->private_->is_ogg?
-				read_callback_ogg_aspect_(decoder, buffer, bytes) :
-#endif
-				decoder->private_->read_callback(decoder, buffer, bytes, decoder->private_->client_data)
-			;
-			if(status == FLAC__STREAM_DECODER_READ_STATUS_ABORT) {
-				decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
-				return false;
-			}
-			else if(*bytes == 0) {
-				if(
-					status == FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM ||
-					(
-#if FLAC__HAS_OGG
-						/* see [1] HACK NOTE below for why we don't call the eof_callback when decoding Ogg FLAC */
-						!decoder->private_->is_ogg &&
-#endif
-						decoder->private_->eof_callback && decoder->private_->eof_callback(decoder, decoder->private_->client_data)
-					)
-				) {
+	}
+	else {
+		header->channels = x + 1;
+		header->channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
+	}
+
+	x = (raw[3] & 0x0e) >> 1;
+	if(x == 0) {
+		if(0 == stream_info)
+			return 0;
+		header->bits_per_sample = stream_info->bits_per_sample;
+	}
+	else if(0 == (header->bits_per_sample = bits_per_sample_table[x]))
+		return 0;
+	if(raw[3] & 0x01)
+		return 0;
+
+	/* the frame or sample number, UTF-8 coded; see FLAC__bitreader_read_utf8_uint64() */
+	is_variable = (raw[1] & 0x01) || (0 != stream_info && stream_info->min_blocksize != stream_info->max_blocksize);
+	x = raw[4];
+	if(!(x & 0x80)) {
+		number = x;
+		i = 0;
+	}
+	else if((x & 0xe0) == 0xc0) {
+		number = x & 0x1f;
+		i = 1;
+	}
+	else if((x & 0xf0) == 0xe0) {
+		number = x & 0x0f;
+		i = 2;
+	}
+	else if((x & 0xf8) == 0xf0) {
+		number = x & 0x07;
+		i = 3;
+	}
+	else if((x & 0xfc) == 0xf8) {
+		number = x & 0x03;
+		i = 4;
+	}
+	else if((x & 0xfe) == 0xfc) {
+		number = x & 0x01;
+		i = 5;
+	}
+	else if(x == 0xfe && is_variable) {
+		number = 0;
+		i = 6;
+	}
+	else
+		return 0;
+	len = 5;
+	if(bytes < len + i + (blocksize_hint? blocksize_hint - 5 : 0) + (sample_rate_hint? (sample_rate_hint == 12? 1 : 2) : 0) + 1)
+		return 0;
+	for( ; i > 0; i--) {
+		x = raw[len++];
+		if((x & 0xc0) != 0x80)
+			return 0;
+		number = (number << 6) | (x & 0x3f);
+	}
+
+	if(blocksize_hint) {
+		x = raw[len++];
+		if(blocksize_hint == 7)
+			x = (x << 8) | raw[len++];
+		header->blocksize = x + 1;
+	}
+
+	if(sample_rate_hint) {
+		x = raw[len++];
+		if(sample_rate_hint != 12)
+			x = (x << 8) | raw[len++];
+		if(sample_rate_hint == 12)
+			header->sample_rate = x*1000;
+		else if(sample_rate_hint == 13)
+			header->sample_rate = x;
+		else
+			header->sample_rate = x*10;
+	}
+
+	if(FLAC__crc8(raw, len) != raw[len])
+		return 0;
+	header->crc = raw[len++];
+
+	header->number_type = FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER;
+	if(is_variable)
+		header->number.sample_number = number;
+	else if(0 != stream_info)
+		header->number.sample_number = (FLAC__uint64)stream_info->min_blocksize * number;
+	else
+		header->number.sample_number = (FLAC__uint64)(fixed_block_size? fixed_block_size : header->blocksize) * number;
+
+	return len;
+}
+
+/*
+ * Passes a frame found by FLAC__stream_decoder_scan_until_end_of_stream()
+ * on to the client, and does the bookkeeping read_frame_() would have.
+ */
+FLAC__bool scan_frame_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderScanCallback scan_callback, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, FLAC__uint64 frame_end)
+{
+	if(decoder->protected_->frame_index && frame_offset >= decoder->private_->first_frame_offset) {
+		if(!FLAC__frame_index_add(&decoder->private_->frame_index, header->number.sample_number, frame_offset - decoder->private_->first_frame_offset, header->blocksize)) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+	}
+
+	decoder->protected_->channels = header->channels;
+	decoder->protected_->channel_assignment = header->channel_assignment;
+	decoder->protected_->bits_per_sample = header->bits_per_sample;
+	decoder->protected_->sample_rate = header->sample_rate;
+	decoder->protected_->blocksize = header->blocksize;
+	decoder->private_->samples_decoded = header->number.sample_number + header->blocksize;
+
+	if(0 != scan_callback && !scan_callback(decoder, header, frame_offset, (unsigned)(frame_end - frame_offset), decoder->private_->client_data)) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Looks for the last frame in buffer[] for
+ * FLAC__stream_decoder_find_total_samples().  Working back from the end,
+ * the first header whose frame checks out by its CRC-16 is the last
+ * frame; anything after its footer, like an ID3v1 tag, is ignored.
+ */
+FLAC__bool find_last_frame_(const FLAC__StreamDecoder *decoder, const FLAC__byte *buffer, size_t bytes, FLAC__uint64 *total_samples)
+{
+	FLAC__FrameHeader header;
+	unsigned header_len, crc;
+	size_t i, j;
+
+	for(i = bytes; i-- > 0; ) {
+		if(buffer[i] != 0xff || 0 == (header_len = scan_frame_header_(decoder, buffer + i, bytes - i, 0, &header)))
+			continue;
+		crc = FLAC__crc16(buffer + i, header_len);
+		for(j = i + header_len; j < bytes; j++) {
+			crc = FLAC__CRC16_UPDATE(buffer[j], crc);
+			/* a frame has at least a subframe header and the footer after its header */
+			if(crc == 0 && j >= i + header_len + 2) {
+				*total_samples = header.number.sample_number + header.blocksize;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+FLAC__bool read_callback_(FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder *)client_data;
+
+	if(
+#if FLAC__HAS_OGG
+		/* see [1] HACK NOTE below for why we don't call the eof_callback when decoding Ogg FLAC */
+		!decoder->private_->is_ogg &&
+#endif
+		decoder->private_->eof_callback && decoder->private_->eof_callback(decoder, decoder->private_->client_data)
+	) {
+		*bytes = 0;
+		decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+		return false;
+	}
+	else if(*bytes > 0) {
+		/* While seeking, it is possible for our seek to land in the
+		 * middle of audio data that looks exactly like a frame header
+		 * from a future version of an encoder.  When that happens, our
+		 * error callback will get an
+		 * FLAC__STREAM_DECODER_UNPARSEABLE_STREAM and increment its
+		 * unparseable_frame_count.  But there is a remote possibility
+		 * that it is properly synced at such a "future-codec frame",
+		 * so to make sure, we wait to see many "unparseable" errors in
+		 * a row before bailing out.
+		 */
+		if(decoder->private_->is_seeking && decoder->private_->unparseable_frame_count > 20) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
+			return false;
+		}
+		else {
+			const FLAC__StreamDecoderReadStatus status =
+#if FLAC__HAS_OGG
+				decoder->private_->is_ogg?
+				read_callback_ogg_aspect_(decoder, buffer, bytes) :
+#endif
+				decoder->private_->read_callback(decoder, buffer, bytes, decoder->private_->client_data)
+			;
+			if(status == FLAC__STREAM_DECODER_READ_STATUS_ABORT) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_ABORTED;
+				return false;
+			}
+			else if(*bytes == 0) {
+				if(
+					status == FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM ||
+					(
+#if FLAC__HAS_OGG
+						/* see [1] HACK NOTE below for why we don't call the eof_callback when decoding Ogg FLAC */
+						!decoder->private_->is_ogg &&
+#endif
+						decoder->private_->eof_callback && decoder->private_->eof_callback(decoder, decoder->private_->client_data)
+					)
+				) {
 					decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
 					return false;
 				}
@@ -2952,11 +4102,11 @@ FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder
 				decoder->private_->last_frame.header.blocksize -= delta;
 				decoder->private_->last_frame.header.number.sample_number += (FLAC__uint64)delta;
 				/* write the relevant samples */
-				return decoder->private_->write_callback(decoder, &decoder->private_->last_frame, newbuffer, decoder->private_->client_data);
+				return call_write_callback_(decoder, &decoder->private_->last_frame, newbuffer);
 			}
 			else {
 				/* write the relevant samples */
-				return decoder->private_->write_callback(decoder, frame, buffer, decoder->private_->client_data);
+				return call_write_callback_(decoder, frame, buffer);
 			}
 		}
 		else {
@@ -2971,13 +4121,52 @@ FLAC__StreamDecoderWriteStatus write_audio_frame_to_client_(FLAC__StreamDecoder
 		if(!decoder->private_->has_stream_info)
 			decoder->private_->do_md5_checking = false;
 		if(decoder->private_->do_md5_checking) {
+#ifdef HAVE_PTHREAD
+			if(decoder->private_->md5pipeline.started) {
+				if(!FLAC__MD5PipelineAccumulate(&decoder->private_->md5pipeline, buffer, frame->header.channels, frame->header.blocksize, (frame->header.bits_per_sample+7) / 8))
+					return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+			}
+			else
+#endif
 			if(!FLAC__MD5Accumulate(&decoder->private_->md5context, buffer, frame->header.channels, frame->header.blocksize, (frame->header.bits_per_sample+7) / 8))
 				return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
-		return decoder->private_->write_callback(decoder, frame, buffer, decoder->private_->client_data);
+		return call_write_callback_(decoder, frame, buffer);
 	}
 }
 
+FLAC__StreamDecoderWriteStatus call_write_callback_(FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[])
+{
+	FLAC__StreamDecoderWriteStatus status;
+
+	if(0 != decoder->private_->local_pcm_pack) {
+		static const unsigned bytes_per_sample[] = { 0, 2, 2, 3, 3, 4 }; /* indexed by FLAC__StreamDecoderPCMFormat */
+		const size_t bytes = (size_t)frame->header.blocksize * frame->header.channels * bytes_per_sample[decoder->protected_->pcm_format];
+		if(bytes > decoder->private_->pcm_capacity) {
+			FLAC__byte *pcm = realloc(decoder->private_->pcm, bytes);
+			if(0 == pcm) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+			}
+			decoder->private_->pcm = pcm;
+			decoder->private_->pcm_capacity = bytes;
+		}
+		decoder->private_->local_pcm_pack(decoder->private_->pcm, buffer, frame->header.channels, frame->header.blocksize, frame->header.bits_per_sample);
+		decoder->private_->pcm_bytes = bytes;
+	}
+
+	status = decoder->private_->write_callback(decoder, frame, buffer, decoder->private_->client_data);
+	decoder->private_->pcm_bytes = 0;
+	return status;
+}
+
+/* stands in for the client's write callback in FLAC__stream_decoder_compute_md5_signature() */
+FLAC__StreamDecoderWriteStatus discard_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	(void)decoder, (void)frame, (void)buffer, (void)client_data;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
 void send_error_to_client_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status)
 {
 	if(!decoder->private_->is_seeking)
@@ -2992,7 +4181,7 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 	FLAC__int64 pos = -1;
 	int i;
 	unsigned approx_bytes_per_frame;
-	FLAC__bool first_seek = true;
+	FLAC__bool first_seek = true, exact = false;
 	const FLAC__uint64 total_samples = FLAC__stream_decoder_get_total_samples(decoder);
 	const unsigned min_blocksize = decoder->private_->stream_info.data.stream_info.min_blocksize;
 	const unsigned max_blocksize = decoder->private_->stream_info.data.stream_info.max_blocksize;
@@ -3088,6 +4277,53 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 		}
 	}
 
+	/*
+	 * The frame index knows exactly where the frames it has seen start,
+	 * so it can narrow the bounds further.  If it has the frame that
+	 * contains target_sample, we can go straight there.
+	 *
+	 * As with the seektable, points that fall outside the bounds we
+	 * already have are ignored.
+	 */
+	if(decoder->private_->frame_index.num_points > 0) {
+		const FLAC__FrameIndex *frame_index = &decoder->private_->frame_index;
+		const FLAC__StreamMetadata_SeekPoint *point = FLAC__frame_index_find(frame_index, target_sample);
+		FLAC__uint64 new_lower_bound = lower_bound;
+		FLAC__uint64 new_upper_bound = upper_bound;
+		FLAC__uint64 new_lower_bound_sample = lower_bound_sample;
+		FLAC__uint64 new_upper_bound_sample = upper_bound_sample;
+		FLAC__bool new_exact = false;
+
+		if(
+			0 != point &&
+			point->sample_number >= lower_bound_sample &&
+			first_frame_offset + point->stream_offset >= lower_bound &&
+			first_frame_offset + point->stream_offset < upper_bound
+		) {
+			new_lower_bound = first_frame_offset + point->stream_offset;
+			new_lower_bound_sample = point->sample_number;
+			new_exact = target_sample < point->sample_number + point->frame_samples;
+		}
+
+		point = 0 != point? point + 1 : frame_index->points;
+		if(
+			point < frame_index->points + frame_index->num_points &&
+			(total_samples <= 0 || point->sample_number < total_samples) &&
+			first_frame_offset + point->stream_offset > new_lower_bound &&
+			first_frame_offset + point->stream_offset <= upper_bound
+		) {
+			new_upper_bound = first_frame_offset + point->stream_offset;
+			new_upper_bound_sample = point->sample_number;
+		}
+		if(new_upper_bound >= new_lower_bound && new_upper_bound_sample >= new_lower_bound_sample) {
+			lower_bound = new_lower_bound;
+			upper_bound = new_upper_bound;
+			lower_bound_sample = new_lower_bound_sample;
+			upper_bound_sample = new_upper_bound_sample;
+			exact = new_exact;
+		}
+	}
+
 	FLAC__ASSERT(upper_bound_sample >= lower_bound_sample);
 	/* there are 2 insidious ways that the following equality occurs, which
 	 * we need to fix:
@@ -3121,6 +4357,11 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 			pos = (FLAC__int64)upper_bound - 1;
 		if(pos < (FLAC__int64)lower_bound)
 			pos = (FLAC__int64)lower_bound;
+		if(exact) {
+			/* the frame index says the target frame starts right at lower_bound */
+			pos = (FLAC__int64)lower_bound;
+			exact = false;
+		}
 		if(decoder->private_->seek_callback(decoder, (FLAC__uint64)pos, decoder->private_->client_data) != FLAC__STREAM_DECODER_SEEK_STATUS_OK) {
 			decoder->protected_->state = FLAC__STREAM_DECODER_SEEK_ERROR;
 			return false;
@@ -3195,6 +4436,46 @@ FLAC__bool seek_to_absolute_sample_(FLAC__StreamDecoder *decoder, FLAC__uint64 s
 	return true;
 }
 
+/*
+ * Gets what FLAC__frame_index_save()/FLAC__frame_index_load() need to know
+ * about the stream, processing the metadata first if that hasn't been done.
+ */
+FLAC__bool frame_index_stream_params_(FLAC__StreamDecoder *decoder, FLAC__uint64 *audio_bytes)
+{
+	FLAC__uint64 length;
+
+#if FLAC__HAS_OGG
+	if(decoder->private_->is_ogg)
+		return false;
+#endif
+	if(
+		decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_METADATA ||
+		decoder->protected_->state == FLAC__STREAM_DECODER_READ_METADATA
+	) {
+		if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
+			return false;
+	}
+	if(
+		decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_READ_FRAME &&
+		decoder->protected_->state != FLAC__STREAM_DECODER_END_OF_STREAM
+	)
+		return false;
+	/* without a STREAMINFO there is nothing to tie the index to the stream */
+	if(!decoder->private_->has_stream_info)
+		return false;
+
+	if(
+		0 != decoder->private_->length_callback &&
+		decoder->private_->length_callback(decoder, &length, decoder->private_->client_data) == FLAC__STREAM_DECODER_LENGTH_STATUS_OK &&
+		length > decoder->private_->first_frame_offset
+	)
+		*audio_bytes = length - decoder->private_->first_frame_offset;
+	else
+		*audio_bytes = 0;
+	return true;
+}
+
 #if FLAC__HAS_OGG
 FLAC__bool seek_to_absolute_sample_ogg_(FLAC__StreamDecoder *decoder, FLAC__uint64 stream_length, FLAC__uint64 target_sample)
 {
@@ -3392,3 +4673,852 @@ FLAC__bool file_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_d
 
 	return feof(decoder->private_->file)? true : false;
 }
+
+FLAC__StreamDecoderReadStatus memory_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	const size_t left = decoder->private_->memory_bytes - decoder->private_->memory_position;
+	(void)client_data;
+
+	if(*bytes > 0) {
+		if(*bytes > left)
+			*bytes = left;
+		memcpy(buffer, decoder->private_->memory + decoder->private_->memory_position, *bytes);
+		decoder->private_->memory_position += *bytes;
+		return *bytes == 0? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+	}
+	else
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT; /* abort to avoid a deadlock */
+}
+
+FLAC__StreamDecoderSeekStatus memory_seek_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data)
+{
+	(void)client_data;
+
+	if(absolute_byte_offset > decoder->private_->memory_bytes)
+		return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+	decoder->private_->memory_position = (size_t)absolute_byte_offset;
+	return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+FLAC__StreamDecoderTellStatus memory_tell_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data)
+{
+	(void)client_data;
+
+	*absolute_byte_offset = decoder->private_->memory_position;
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+FLAC__StreamDecoderLengthStatus memory_length_callback_(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data)
+{
+	(void)client_data;
+
+	*stream_length = decoder->private_->memory_bytes;
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+FLAC__bool memory_eof_callback_(const FLAC__StreamDecoder *decoder, void *client_data)
+{
+	(void)client_data;
+
+	return decoder->private_->memory_position >= decoder->private_->memory_bytes;
+}
+
+/* let the bitreader take the stream straight from memory instead of
+ * through read_callback_(); seeking and telling still go through the
+ * memory callbacks above, which share memory_position with it */
+void set_memory_source_(FLAC__StreamDecoder *decoder)
+{
+	if(
+#if FLAC__HAS_OGG
+		/* Ogg FLAC has to go through the Ogg decoder aspect */
+		!decoder->private_->is_ogg &&
+#endif
+		0 != decoder->private_->memory
+	)
+		FLAC__bitreader_set_source(decoder->private_->input, decoder->private_->memory, decoder->private_->memory_bytes, &decoder->private_->memory_position);
+}
+
+void release_memory_(FLAC__StreamDecoder *decoder)
+{
+	if(0 != decoder->private_->memory) {
+#ifdef HAVE_SYS_MMAN_H
+		if(decoder->private_->memory_is_mapped)
+			munmap((void*)decoder->private_->memory, decoder->private_->memory_bytes);
+#endif
+		decoder->private_->memory = 0;
+		decoder->private_->memory_bytes = decoder->private_->memory_position = 0;
+		decoder->private_->memory_is_mapped = false;
+	}
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * How the multithreaded decoder works:
+ *
+ * FLAC__stream_decoder_process_until_end_of_stream() reads the input
+ * ahead and cuts it into tasks of about THREADTASK_BYTES_ each, at places
+ * that look like a frame header; seek points are tried first since they
+ * are known to be frame boundaries.  Each task also gets enough of the
+ * following input to finish a frame that starts before its limit.  The
+ * worker threads decode queued tasks in ring order, each with the task's
+ * own decoder, and keep the frames and errors.  The client's thread
+ * passes them on strictly in ring order, which is stream order, and
+ * decodes queued tasks itself while it has to wait.
+ *
+ * A cut can land on something that only looks like a frame header.  That
+ * is caught when a task is delivered: every task records where the frame
+ * after its last one starts, and if the next task did not start there it
+ * is decoded again from that point by the client's thread.  So the frames
+ * and errors the client gets are the same as when decoding in a single
+ * thread.
+ *
+ * The status of every task and next_threadtask_to_decode are protected
+ * by mutex_threadtasks; everything else is only touched by the client's
+ * thread, or by the one thread that has a task in THREADTASK_BUSY.
+ */
+FLAC__StreamDecoderThreadTask *threadtask_new_(void)
+{
+	FLAC__StreamDecoderThreadTask *task = calloc(1, sizeof(FLAC__StreamDecoderThreadTask));
+
+	if(0 == task)
+		return 0;
+	if(
+		0 == (task->decoder = FLAC__stream_decoder_new()) ||
+		FLAC__stream_decoder_init_stream(task->decoder, threadtask_read_callback_, 0, 0, 0, 0, threadtask_write_callback_, 0, threadtask_error_callback_, /*client_data=*/task) != FLAC__STREAM_DECODER_INIT_STATUS_OK
+	) {
+		threadtask_delete_(task);
+		return 0;
+	}
+	task->status = THREADTASK_FREE;
+
+	return task;
+}
+
+void threadtask_delete_(FLAC__StreamDecoderThreadTask *task)
+{
+	if(0 == task)
+		return;
+
+	FLAC__stream_decoder_delete(task->decoder);
+	free(task->data);
+	free(task->frame);
+	free(task->frame_samples);
+	free(task->samples);
+	free(task->error);
+	free(task);
+}
+
+FLAC__bool start_threads_(FLAC__StreamDecoder *decoder, unsigned num_threads)
+{
+	unsigned i;
+
+	FLAC__ASSERT(num_threads < FLAC__STREAM_DECODER_MAX_THREADS);
+	FLAC__ASSERT(!decoder->private_->threads_started);
+
+	if(0 != pthread_mutex_init(&decoder->private_->mutex_threadtasks, 0))
+		return false;
+	if(0 != pthread_cond_init(&decoder->private_->cond_threadtask_queued, 0)) {
+		pthread_mutex_destroy(&decoder->private_->mutex_threadtasks);
+		return false;
+	}
+	if(0 != pthread_cond_init(&decoder->private_->cond_threadtask_done, 0)) {
+		pthread_cond_destroy(&decoder->private_->cond_threadtask_queued);
+		pthread_mutex_destroy(&decoder->private_->mutex_threadtasks);
+		return false;
+	}
+
+	decoder->private_->next_threadtask_to_decode = 0;
+	decoder->private_->quit_threads = false;
+	decoder->private_->threads_started = true;
+
+	/* The client's thread counts as one of the threads, so num_threads
+	 * is the number of others.  If not all of them can be created we
+	 * just carry on with what we have.
+	 */
+	decoder->private_->num_running_threads = 0;
+	for(i = 0; i < num_threads; i++) {
+		if(0 != pthread_create(&decoder->private_->thread[i], 0, thread_main_, decoder))
+			break;
+		decoder->private_->num_running_threads++;
+	}
+
+	return true;
+}
+
+void stop_threads_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	if(!decoder->private_->threads_started)
+		return;
+
+	pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+	decoder->private_->quit_threads = true;
+	pthread_cond_broadcast(&decoder->private_->cond_threadtask_queued);
+	pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+
+	for(i = 0; i < decoder->private_->num_running_threads; i++)
+		pthread_join(decoder->private_->thread[i], 0);
+	decoder->private_->num_running_threads = 0;
+
+	pthread_cond_destroy(&decoder->private_->cond_threadtask_done);
+	pthread_cond_destroy(&decoder->private_->cond_threadtask_queued);
+	pthread_mutex_destroy(&decoder->private_->mutex_threadtasks);
+
+	decoder->private_->threads_started = false;
+}
+
+void *thread_main_(void *arg)
+{
+	FLAC__StreamDecoder *decoder = (FLAC__StreamDecoder*)arg;
+
+	pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+	while(!decoder->private_->quit_threads) {
+		if(!decode_next_queued_threadtask_(decoder))
+			pthread_cond_wait(&decoder->private_->cond_threadtask_queued, &decoder->private_->mutex_threadtasks);
+	}
+	pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+
+	return 0;
+}
+
+/* Must be called with mutex_threadtasks locked; it is unlocked while the
+ * task is being decoded.  Returns false if there was nothing queued.
+ */
+FLAC__bool decode_next_queued_threadtask_(FLAC__StreamDecoder *decoder)
+{
+	FLAC__StreamDecoderThreadTask *task = decoder->private_->threadtask[decoder->private_->next_threadtask_to_decode];
+
+	if(task->status != THREADTASK_QUEUED)
+		return false;
+
+	task->status = THREADTASK_BUSY;
+	decoder->private_->next_threadtask_to_decode = (decoder->private_->next_threadtask_to_decode + 1) % decoder->private_->num_threadtasks;
+	pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+
+	decode_threadtask_(task, 0);
+
+	pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+	task->status = THREADTASK_DONE;
+	pthread_cond_signal(&decoder->private_->cond_threadtask_done);
+
+	return true;
+}
+
+/* Decodes the frames that start in data[start..limit-1] of a task. */
+void decode_threadtask_(FLAC__StreamDecoderThreadTask *task, size_t start)
+{
+	FLAC__StreamDecoder *decoder = task->decoder;
+	size_t pos, sync_pos = start;
+	unsigned num_errors_before_sync = 0;
+	FLAC__bool got_a_frame;
+
+	task->read_pos = start;
+	task->end = start;
+	task->overrun = false;
+	task->end_of_stream = false;
+	task->failed = false;
+	task->out_of_memory = false;
+	task->num_frames = 0;
+	task->num_samples = 0;
+	task->num_errors = 0;
+
+	decoder->private_->samples_decoded = 0;
+	decoder->private_->cached = false;
+	if(!FLAC__bitreader_clear(decoder->private_->input)) {
+		task->out_of_memory = true;
+		return;
+	}
+	decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+
+	while(!task->out_of_memory) {
+		/* where the decoder is in data[]; a partly read byte counts as read */
+		pos = task->read_pos - FLAC__bitreader_get_input_bits_unconsumed(decoder->private_->input) / 8 - (decoder->private_->cached? 1 : 0);
+
+		switch(decoder->protected_->state) {
+			case FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC:
+				if(pos >= task->limit) {
+					task->end = pos;
+					return;
+				}
+				sync_pos = pos;
+				num_errors_before_sync = task->num_errors;
+				(void)frame_sync_(decoder); /* sets the state for us */
+				break;
+			case FLAC__STREAM_DECODER_READ_FRAME:
+				/* the frame sync code has just been read */
+				if(pos - 2 >= task->limit) {
+					task->end = pos - 2;
+					return;
+				}
+				if(!read_frame_(decoder, &got_a_frame, /*do_full_decode=*/true)) {
+					/* as FLAC__stream_decoder_process_until_end_of_stream() would, stop
+					 * on a frame that is cut short or too corrupt to skip over
+					 */
+					if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) {
+						task->end = task->read_pos;
+						task->failed = true;
+						return;
+					}
+					if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM)
+						task->failed = true;
+				}
+				break;
+			case FLAC__STREAM_DECODER_END_OF_STREAM:
+				task->end = pos;
+				task->end_of_stream = true;
+				return;
+			case FLAC__STREAM_DECODER_ABORTED:
+				/* only threadtask_read_callback_() aborts without setting out_of_memory */
+				FLAC__ASSERT(task->overrun);
+				/* forget everything since the last frame; the next task gets to decode it */
+				task->end = sync_pos;
+				task->num_errors = num_errors_before_sync;
+				return;
+			default:
+				task->out_of_memory = true;
+				return;
+		}
+	}
+}
+
+FLAC__StreamDecoderReadStatus threadtask_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+	FLAC__StreamDecoderThreadTask *task = (FLAC__StreamDecoderThreadTask*)client_data;
+	const size_t left = task->bytes - task->read_pos;
+
+	(void)decoder;
+
+	if(left == 0) {
+		*bytes = 0;
+		if(task->is_last)
+			return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+		/* the rest of the frame is only in the next task's input */
+		task->overrun = true;
+		return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	}
+	if(*bytes > left)
+		*bytes = left;
+	memcpy(buffer, task->data + task->read_pos, *bytes);
+	task->read_pos += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus threadtask_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	FLAC__StreamDecoderThreadTask *task = (FLAC__StreamDecoderThreadTask*)client_data;
+	const unsigned blocksize = frame->header.blocksize;
+	FLAC__Frame *copy;
+	unsigned channel;
+
+	(void)decoder;
+
+	if(task->num_frames == task->frames_capacity) {
+		const unsigned capacity = task->frames_capacity? 2 * task->frames_capacity : 16;
+		FLAC__Frame *new_frame;
+		size_t *new_frame_samples;
+		if(0 == (new_frame = safe_realloc_mul_2op_(task->frame, capacity, sizeof(FLAC__Frame)))) {
+			task->out_of_memory = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		task->frame = new_frame;
+		if(0 == (new_frame_samples = safe_realloc_mul_2op_(task->frame_samples, capacity, sizeof(size_t)))) {
+			task->out_of_memory = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		task->frame_samples = new_frame_samples;
+		task->frames_capacity = capacity;
+	}
+	if(task->samples_capacity - task->num_samples < (size_t)frame->header.channels * blocksize) {
+		const size_t capacity = flac_max(2 * task->samples_capacity, task->num_samples + (size_t)frame->header.channels * blocksize);
+		FLAC__int32 *new_samples;
+		if(0 == (new_samples = safe_realloc_mul_2op_(task->samples, capacity, sizeof(FLAC__int32)))) {
+			task->out_of_memory = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		task->samples = new_samples;
+		task->samples_capacity = capacity;
+	}
+
+	copy = &task->frame[task->num_frames];
+	*copy = *frame;
+	task->frame_samples[task->num_frames] = task->num_samples;
+	for(channel = 0; channel < frame->header.channels; channel++) {
+		memcpy(task->samples + task->num_samples, buffer[channel], sizeof(FLAC__int32) * blocksize);
+		task->num_samples += blocksize;
+		/* these point into the task's decoder, which moves on to the next frame */
+		switch(copy->subframes[channel].type) {
+			case FLAC__SUBFRAME_TYPE_FIXED:
+				copy->subframes[channel].data.fixed.residual = 0;
+				break;
+			case FLAC__SUBFRAME_TYPE_LPC:
+				copy->subframes[channel].data.lpc.residual = 0;
+				break;
+			case FLAC__SUBFRAME_TYPE_VERBATIM:
+				copy->subframes[channel].data.verbatim.data = 0;
+				break;
+			default:
+				break;
+		}
+	}
+	task->num_frames++;
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void threadtask_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	FLAC__StreamDecoderThreadTask *task = (FLAC__StreamDecoderThreadTask*)client_data;
+
+	(void)decoder;
+
+	if(task->num_errors == task->errors_capacity) {
+		const unsigned capacity = task->errors_capacity? 2 * task->errors_capacity : 16;
+		FLAC__StreamDecoderThreadTaskError *new_error;
+		if(0 == (new_error = safe_realloc_mul_2op_(task->error, capacity, sizeof(FLAC__StreamDecoderThreadTaskError)))) {
+			task->out_of_memory = true;
+			return;
+		}
+		task->error = new_error;
+		task->errors_capacity = capacity;
+	}
+	task->error[task->num_errors].status = status;
+	task->error[task->num_errors].frame = task->num_frames;
+	task->num_errors++;
+}
+
+/* Returns true if data[] starts with something that frame_sync_() and
+ * read_frame_header_() would take for a frame header: a sync code, no
+ * invalid values and a matching CRC-8.
+ */
+FLAC__bool is_frame_header_(const FLAC__byte *data, size_t bytes)
+{
+	size_t len = 5, i, n;
+
+	if(bytes < 6 || data[0] != 0xff || data[1] >> 1 != 0x7c) /* MAGIC NUMBERs for the sync code and reserved bit */
+		return false;
+	if(data[2] >> 4 == 0 || (data[2] & 0x0f) == 0x0f)
+		return false;
+	/* channel assignments above 10 and sample size codes 3 and 7 are reserved */
+	if(data[3] >> 4 > 10 || (data[3] & 0x06) == 0x06 || (data[3] & 0x01))
+		return false;
+
+	/* the frame or sample number is UTF-8 coded */
+	if(!(data[4] & 0x80))
+		n = 0;
+	else if((data[4] & 0xe0) == 0xc0)
+		n = 1;
+	else if((data[4] & 0xf0) == 0xe0)
+		n = 2;
+	else if((data[4] & 0xf8) == 0xf0)
+		n = 3;
+	else if((data[4] & 0xfc) == 0xf8)
+		n = 4;
+	else if((data[4] & 0xfe) == 0xfc)
+		n = 5;
+	else if(data[4] == 0xfe)
+		n = 6;
+	else
+		return false;
+	if(bytes < len + n)
+		return false;
+	for(i = 0; i < n; i++) {
+		if((data[len++] & 0xc0) != 0x80)
+			return false;
+	}
+
+	if(data[2] >> 4 == 6)
+		len += 1;
+	else if(data[2] >> 4 == 7)
+		len += 2;
+	if((data[2] & 0x0f) == 12)
+		len += 1;
+	else if((data[2] & 0x0f) > 12)
+		len += 2;
+
+	return len < bytes && FLAC__crc8(data, (unsigned)len) == data[len];
+}
+
+/* Returns where in threadinput.data[] the first frame header at or after
+ * 'from' and before 'to' is, or 'to' if there is none.
+ */
+size_t find_frame_boundary_(FLAC__StreamDecoder *decoder, size_t from, size_t to)
+{
+	const FLAC__byte *data = decoder->private_->threadinput.data;
+	const size_t bytes = decoder->private_->threadinput.bytes;
+	size_t pos;
+
+	if(decoder->private_->threadinput.use_seek_table) {
+		const FLAC__StreamMetadata_SeekTable *seek_table = &decoder->private_->seek_table.data.seek_table;
+		const FLAC__uint64 offset = decoder->private_->threadinput.offset;
+		unsigned i;
+		/* seek points are sorted, so the ones already passed are never looked at again */
+		for(i = decoder->private_->threadinput.next_seek_point; i < seek_table->num_points; i++) {
+			const FLAC__StreamMetadata_SeekPoint *point = &seek_table->points[i];
+			if(point->sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER)
+				break;
+			if(point->stream_offset < offset + from)
+				continue;
+			if(point->stream_offset >= offset + to)
+				break;
+			pos = (size_t)(point->stream_offset - offset);
+			if(is_frame_header_(data + pos, bytes - pos)) {
+				decoder->private_->threadinput.next_seek_point = i + 1;
+				return pos;
+			}
+		}
+		decoder->private_->threadinput.next_seek_point = i;
+	}
+
+	for(pos = from; pos < to; pos++) {
+		if(data[pos] == 0xff && is_frame_header_(data + pos, bytes - pos))
+			return pos;
+	}
+	return to;
+}
+
+/* Reads input until threadinput.data[] holds at least 'bytes' bytes or
+ * the stream ends.  Returns false with the state set if the read callback
+ * aborted or memory ran out.
+ */
+FLAC__bool read_threadinput_(FLAC__StreamDecoder *decoder, size_t bytes)
+{
+	if(bytes > decoder->private_->threadinput.capacity) {
+		FLAC__byte *data = realloc(decoder->private_->threadinput.data, bytes);
+		if(0 == data) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		decoder->private_->threadinput.data = data;
+		decoder->private_->threadinput.capacity = bytes;
+	}
+
+	while(decoder->private_->threadinput.bytes < bytes && !decoder->private_->threadinput.eof) {
+		size_t n = decoder->private_->threadinput.capacity - decoder->private_->threadinput.bytes;
+		if(read_callback_(decoder->private_->threadinput.data + decoder->private_->threadinput.bytes, &n, decoder))
+			decoder->private_->threadinput.bytes += n;
+		else if(decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+			/* the state is set once the tasks have caught up */
+			decoder->protected_->state = FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC;
+			decoder->private_->threadinput.eof = true;
+		}
+		else
+			return false;
+	}
+
+	return true;
+}
+
+/* Gives the next stretch of input to a task; task->bytes is 0 if there is
+ * no input left.  Returns false with the state set on error.
+ */
+FLAC__bool fill_threadtask_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *task)
+{
+	const size_t wanted = decoder->private_->threadinput.task_bytes + decoder->private_->threadinput.overlap;
+	size_t bytes, limit;
+
+	if(!read_threadinput_(decoder, wanted))
+		return false;
+
+	if(decoder->private_->threadinput.eof && decoder->private_->threadinput.bytes <= wanted) {
+		bytes = limit = decoder->private_->threadinput.bytes;
+		task->is_last = true;
+	}
+	else {
+		limit = find_frame_boundary_(decoder, decoder->private_->threadinput.task_bytes, decoder->private_->threadinput.bytes - decoder->private_->threadinput.overlap);
+		bytes = limit + decoder->private_->threadinput.overlap;
+		task->is_last = false;
+	}
+
+	if(bytes > task->capacity) {
+		FLAC__byte *data = realloc(task->data, bytes);
+		if(0 == data) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		task->data = data;
+		task->capacity = bytes;
+	}
+	if(bytes > 0)
+		memcpy(task->data, decoder->private_->threadinput.data, bytes);
+	task->bytes = bytes;
+	task->limit = limit;
+	task->offset = decoder->private_->threadinput.offset;
+
+	memmove(decoder->private_->threadinput.data, decoder->private_->threadinput.data + limit, decoder->private_->threadinput.bytes - limit);
+	decoder->private_->threadinput.bytes -= limit;
+	decoder->private_->threadinput.offset += limit;
+
+	return true;
+}
+
+/* Passes the frames and errors of a decoded task on to the client.
+ * Returns false with the state set if decoding is to stop.
+ */
+FLAC__bool deliver_threadtask_(FLAC__StreamDecoder *decoder, FLAC__StreamDecoderThreadTask *task)
+{
+	const FLAC__uint64 total_samples = FLAC__stream_decoder_get_total_samples(decoder);
+	const FLAC__uint64 next_frame_offset = decoder->private_->threadinput.next_frame_offset;
+	unsigned f, e = 0, channel;
+
+	/* if the task was not cut where the last one ended, decode it again from there */
+	if(task->offset < next_frame_offset)
+		decode_threadtask_(task, (size_t)flac_min(next_frame_offset - task->offset, (FLAC__uint64)task->bytes));
+	else if(task->offset > next_frame_offset) {
+		/* the last task ran out of input; what it could not decode was kept */
+		const size_t carry_bytes = decoder->private_->threadinput.carry_bytes;
+		FLAC__ASSERT(next_frame_offset + carry_bytes == task->offset);
+		if(task->bytes + carry_bytes > task->capacity) {
+			FLAC__byte *data = realloc(task->data, task->bytes + carry_bytes);
+			if(0 == data) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return false;
+			}
+			task->data = data;
+			task->capacity = task->bytes + carry_bytes;
+		}
+		memmove(task->data + carry_bytes, task->data, task->bytes);
+		memcpy(task->data, decoder->private_->threadinput.carry, carry_bytes);
+		task->bytes += carry_bytes;
+		task->limit += carry_bytes;
+		task->offset = next_frame_offset;
+		decode_threadtask_(task, 0);
+	}
+	decoder->private_->threadinput.carry_bytes = 0;
+
+	if(task->out_of_memory) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+		return false;
+	}
+
+	for(f = 0; f <= task->num_frames; f++) {
+		/* like frame_sync_(), stop once all the samples in STREAMINFO are decoded */
+		if(total_samples > 0 && decoder->private_->samples_decoded >= total_samples) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+			return false;
+		}
+		for( ; e < task->num_errors && task->error[e].frame == f; e++)
+			send_error_to_client_(decoder, task->error[e].status);
+		if(f < task->num_frames) {
+			const FLAC__Frame *frame = &task->frame[f];
+			const FLAC__int32 *buffer[FLAC__MAX_CHANNELS];
+			for(channel = 0; channel < frame->header.channels; channel++)
+				buffer[channel] = task->samples + task->frame_samples[f] + (size_t)channel * frame->header.blocksize;
+
+			/* put the latest values into the public section of the decoder instance, as read_frame_() does */
+			decoder->protected_->channels = frame->header.channels;
+			decoder->protected_->channel_assignment = frame->header.channel_assignment;
+			decoder->protected_->bits_per_sample = frame->header.bits_per_sample;
+			decoder->protected_->sample_rate = frame->header.sample_rate;
+			decoder->protected_->blocksize = frame->header.blocksize;
+			FLAC__ASSERT(frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+			decoder->private_->samples_decoded = frame->header.number.sample_number + frame->header.blocksize;
+
+			if(write_audio_frame_to_client_(decoder, frame, buffer) != FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE) {
+				/* read_frame_() leaves the state as it was while reading the frame */
+				if(decoder->protected_->state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC)
+					decoder->protected_->state = FLAC__STREAM_DECODER_READ_FRAME;
+				return false;
+			}
+		}
+	}
+
+	if(task->failed) {
+		decoder->protected_->state = task->decoder->protected_->state;
+		decoder->private_->threadinput.failed = true;
+		return false;
+	}
+	if(task->end_of_stream) {
+		decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+		return false;
+	}
+	if(task->overrun) {
+		const size_t carry_bytes = task->limit - task->end;
+		if(carry_bytes > decoder->private_->threadinput.carry_capacity) {
+			FLAC__byte *carry = realloc(decoder->private_->threadinput.carry, carry_bytes);
+			if(0 == carry) {
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return false;
+			}
+			decoder->private_->threadinput.carry = carry;
+			decoder->private_->threadinput.carry_capacity = carry_bytes;
+		}
+		memcpy(decoder->private_->threadinput.carry, task->data + task->end, carry_bytes);
+		decoder->private_->threadinput.carry_bytes = carry_bytes;
+	}
+	decoder->private_->threadinput.next_frame_offset = task->offset + task->end;
+
+	return true;
+}
+
+/* Sets up the tasks and threads the first time, and hands them what the
+ * bitreader has already read.  Returns false with the state set on error.
+ */
+FLAC__bool begin_threaded_decoding_(FLAC__StreamDecoder *decoder)
+{
+	const FLAC__StreamMetadata_StreamInfo *stream_info = &decoder->private_->stream_info.data.stream_info;
+	const unsigned num_threads = flac_min(decoder->protected_->num_threads, (unsigned)FLAC__STREAM_DECODER_MAX_THREADS);
+	unsigned i, bytes;
+	FLAC__uint32 x;
+
+	if(decoder->private_->num_threadtasks == 0) {
+		for(i = 0; i < 2 * num_threads; i++) {
+			if(0 == (decoder->private_->threadtask[i] = threadtask_new_())) {
+				end_threaded_decoding_(decoder);
+				decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+				return false;
+			}
+			decoder->private_->num_threadtasks++;
+		}
+		if(!start_threads_(decoder, num_threads - 1)) {
+			end_threaded_decoding_(decoder);
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+	}
+
+	/* the tasks' decoders need STREAMINFO for frame headers that refer to it */
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		FLAC__StreamDecoder *task_decoder = decoder->private_->threadtask[i]->decoder;
+		task_decoder->private_->has_stream_info = true;
+		task_decoder->private_->stream_info = decoder->private_->stream_info;
+		task_decoder->private_->fixed_block_size = decoder->private_->fixed_block_size;
+	}
+
+	/* Frames can be as long as max_framesize, or if that is unknown, as
+	 * long as the longest possible verbatim frame.
+	 */
+	if(stream_info->max_framesize > 0)
+		decoder->private_->threadinput.overlap = stream_info->max_framesize;
+	else
+		decoder->private_->threadinput.overlap = stream_info->channels * (((size_t)stream_info->max_blocksize * (stream_info->bits_per_sample + 1) + 7) / 8 + 8);
+	decoder->private_->threadinput.overlap += 16; /* MAGIC NUMBER: the longest frame header, so one right at the limit can be checked */
+	decoder->private_->threadinput.task_bytes = flac_max(THREADTASK_BYTES_, 2 * decoder->private_->threadinput.overlap);
+	decoder->private_->threadinput.bytes = 0;
+	decoder->private_->threadinput.offset = 0;
+	decoder->private_->threadinput.eof = false;
+	decoder->private_->threadinput.carry_bytes = 0;
+	decoder->private_->threadinput.next_frame_offset = 0;
+	/* seek point offsets are relative to the first frame */
+	decoder->private_->threadinput.use_seek_table = decoder->private_->has_seek_table && decoder->private_->samples_decoded == 0;
+	decoder->private_->threadinput.next_seek_point = 0;
+	decoder->private_->threadinput.failed = false;
+
+	/* make sure we're byte aligned, as frame_sync_() does */
+	if(!FLAC__bitreader_is_consumed_byte_aligned(decoder->private_->input)) {
+		if(!FLAC__bitreader_read_raw_uint32(decoder->private_->input, &x, FLAC__bitreader_bits_left_for_byte_alignment(decoder->private_->input)))
+			return false; /* read_callback_ sets the state for us */
+	}
+	bytes = FLAC__stream_decoder_get_input_bytes_unconsumed(decoder) + (decoder->private_->cached? 1 : 0);
+	if(bytes > decoder->private_->threadinput.capacity) {
+		FLAC__byte *data = realloc(decoder->private_->threadinput.data, bytes);
+		if(0 == data) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+		decoder->private_->threadinput.data = data;
+		decoder->private_->threadinput.capacity = bytes;
+	}
+	if(decoder->private_->cached) {
+		decoder->private_->threadinput.data[decoder->private_->threadinput.bytes++] = decoder->private_->lookahead;
+		decoder->private_->cached = false;
+		bytes--;
+	}
+	if(bytes > 0 && !FLAC__bitreader_read_byte_block_aligned_no_crc(decoder->private_->input, decoder->private_->threadinput.data + decoder->private_->threadinput.bytes, bytes))
+		return false; /* read_callback_ sets the state for us */
+	decoder->private_->threadinput.bytes += bytes;
+
+	return true;
+}
+
+/* Stops the threads and frees the tasks; see FLAC__stream_decoder_finish(). */
+void end_threaded_decoding_(FLAC__StreamDecoder *decoder)
+{
+	unsigned i;
+
+	/* the threads must be gone before their tasks are freed */
+	stop_threads_(decoder);
+
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		threadtask_delete_(decoder->private_->threadtask[i]);
+		decoder->private_->threadtask[i] = 0;
+	}
+	decoder->private_->num_threadtasks = 0;
+
+	free(decoder->private_->threadinput.data);
+	decoder->private_->threadinput.data = 0;
+	decoder->private_->threadinput.bytes = decoder->private_->threadinput.capacity = 0;
+	free(decoder->private_->threadinput.carry);
+	decoder->private_->threadinput.carry = 0;
+	decoder->private_->threadinput.carry_bytes = decoder->private_->threadinput.carry_capacity = 0;
+}
+
+FLAC__bool process_until_end_of_stream_threaded_(FLAC__StreamDecoder *decoder)
+{
+	unsigned next_threadtask_to_fill = 0, next_threadtask_to_deliver = 0, num_threadtasks_in_flight = 0, i;
+	FLAC__StreamDecoderThreadTask *task;
+
+	if(!begin_threaded_decoding_(decoder))
+		return false; /* above function sets the state for us */
+
+	for(;;) {
+		/* keep the threads busy */
+		while(num_threadtasks_in_flight < decoder->private_->num_threadtasks) {
+			task = decoder->private_->threadtask[next_threadtask_to_fill];
+			if(decoder->private_->threadinput.eof && decoder->private_->threadinput.bytes == 0)
+				break;
+			if(!fill_threadtask_(decoder, task))
+				break; /* above function sets the state for us */
+			if(task->bytes == 0)
+				break;
+			pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+			task->status = THREADTASK_QUEUED;
+			pthread_cond_signal(&decoder->private_->cond_threadtask_queued);
+			pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+			next_threadtask_to_fill = (next_threadtask_to_fill + 1) % decoder->private_->num_threadtasks;
+			num_threadtasks_in_flight++;
+		}
+		if(decoder->protected_->state != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC)
+			break;
+		if(num_threadtasks_in_flight == 0) {
+			decoder->protected_->state = FLAC__STREAM_DECODER_END_OF_STREAM;
+			break;
+		}
+
+		/* pass on the oldest task, decoding queued ones while waiting for it */
+		task = decoder->private_->threadtask[next_threadtask_to_deliver];
+		pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+		while(task->status != THREADTASK_DONE) {
+			if(!decode_next_queued_threadtask_(decoder))
+				pthread_cond_wait(&decoder->private_->cond_threadtask_done, &decoder->private_->mutex_threadtasks);
+		}
+		/* only this thread queues tasks, so it is safe to free it before delivering */
+		task->status = THREADTASK_FREE;
+		pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+		next_threadtask_to_deliver = (next_threadtask_to_deliver + 1) % decoder->private_->num_threadtasks;
+		num_threadtasks_in_flight--;
+
+		if(!deliver_threadtask_(decoder, task))
+			break; /* above function sets the state for us */
+	}
+
+	/* drop the tasks that will not be delivered, once no thread is decoding them */
+	pthread_mutex_lock(&decoder->private_->mutex_threadtasks);
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		task = decoder->private_->threadtask[i];
+		if(task->status == THREADTASK_QUEUED)
+			task->status = THREADTASK_FREE;
+	}
+	for(i = 0; i < decoder->private_->num_threadtasks; i++) {
+		task = decoder->private_->threadtask[i];
+		while(task->status == THREADTASK_BUSY)
+			pthread_cond_wait(&decoder->private_->cond_threadtask_done, &decoder->private_->mutex_threadtasks);
+		task->status = THREADTASK_FREE;
+	}
+	decoder->private_->next_threadtask_to_decode = 0;
+	pthread_mutex_unlock(&decoder->private_->mutex_threadtasks);
+	decoder->private_->threadinput.bytes = 0;
+
+	return decoder->protected_->state == FLAC__STREAM_DECODER_END_OF_STREAM && !decoder->private_->threadinput.failed;
+}
+#endif
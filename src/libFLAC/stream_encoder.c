@@ -39,6 +39,9 @@
 #include <stdlib.h> /* for malloc() */
 #include <string.h> /* for memcpy() */
 #include <sys/types.h> /* for off_t */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "share/compat.h"
 #include "FLAC/assert.h"
 #include "FLAC/stream_decoder.h"
@@ -80,7 +83,8 @@
 typedef struct {
 	FLAC__int32 *data[FLAC__MAX_CHANNELS];
 	unsigned size; /* of each data[] in samples */
-	unsigned tail;
+	unsigned head; /* index of the oldest sample not yet verified; data[] is used as a ring */
+	unsigned tail; /* index where the next sample is appended */
 } verify_input_fifo;
 
 typedef struct {
@@ -120,6 +124,108 @@ static struct CompressionLevels {
 	/* here we use locale-independent 5e-1 instead of 0.5 or 0,5 */
 };
 
+typedef enum {
+	THREADTASK_FREE = 0,   /* idle, or being filled with input by the client's thread */
+	THREADTASK_QUEUED = 1, /* holds a full block waiting to be encoded */
+	THREADTASK_BUSY = 2,   /* being encoded */
+	THREADTASK_DONE = 3    /* encoded, waiting to be written out in order */
+} ThreadTaskStatus;
+
+/* With variable blocksize, a block can be split in halves, and those in
+ * halves again, up to SPLIT_LEVELS_-1 times.  The candidate frames form
+ * a binary tree kept in an array: node 0 is the whole block, nodes 1
+ * and 2 its halves, 3 to 6 its quarters; see split_level_().  When two
+ * blocks may be merged into one frame, the whole block is two of the
+ * blocksize set by the client and the tree has one level more.
+ */
+#define SPLIT_LEVELS_ 4
+#define SPLIT_NODES_ ((1u << SPLIT_LEVELS_) - 1)
+
+/* How many times more high frequency energy one part of a block must
+ * have than its neighbour for block_has_transient_() to try splitting.
+ */
+static const unsigned TRANSIENT_RATIO_ = 4;
+
+static inline unsigned split_level_(unsigned node)
+{
+	return FLAC__bitmath_ilog2(node + 1);
+}
+
+/* Where the part of the block coded by node starts */
+static inline unsigned split_offset_(unsigned node, unsigned blocksize)
+{
+	const unsigned level = split_level_(node);
+	return (node + 1 - (1u << level)) * (blocksize >> level);
+}
+
+/* Workspace for the search of one subframe.  A task normally has one,
+ * used for each channel in turn; with parallel subframes it has one for
+ * each channel and mid-side candidate so they can be searched at once.
+ */
+typedef struct {
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real *windowed_signal;                      /* the integer_signal[] * current window[] */
+#endif
+	FLAC__uint64 *abs_residual_partition_sums;        /* workspace where the sum of abs(candidate residual) for each partition is stored */
+	unsigned *raw_bits_per_partition;                 /* workspace where the sum of silog2(candidate residual) for each partition is stored */
+	/* unaligned (original) pointers to allocated data */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real *windowed_signal_unaligned;
+#endif
+	FLAC__uint64 *abs_residual_partition_sums_unaligned;
+	unsigned *raw_bits_per_partition_unaligned;
+	/*
+	 * These fields have been moved here from private function local
+	 * declarations merely to save stack space during encoding.
+	 */
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	FLAC__real lp_coeff[FLAC__MAX_LPC_ORDER][FLAC__MAX_LPC_ORDER]; /* from process_subframe_() */
+#endif
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_extra[2]; /* from find_best_partition_order_() */
+} FLAC__StreamEncoderSubframeScratch;
+
+/* Everything needed to encode one frame.  Without multithreading only
+ * threadtask[0] is used; otherwise there is one for each frame that
+ * can be in flight at the same time.
+ */
+typedef struct {
+	FLAC__int32 *integer_signal[FLAC__MAX_CHANNELS];  /* the integer version of the input signal */
+	FLAC__int32 *integer_signal_mid_side[2];          /* the integer version of the mid-side input signal (stereo only) */
+	unsigned subframe_bps[FLAC__MAX_CHANNELS];        /* the effective bits per sample of the input signal (stream bps - wasted bits) */
+	unsigned subframe_bps_mid_side[2];                /* the effective bits per sample of the mid-side input signal (stream bps - wasted bits + 0/1) */
+	FLAC__int32 *residual_workspace[FLAC__MAX_CHANNELS][2]; /* each channel has a candidate and best workspace where the subframe residual signals will be stored */
+	FLAC__int32 *residual_workspace_mid_side[2][2];
+	FLAC__Subframe subframe_workspace[FLAC__MAX_CHANNELS][2];
+	FLAC__Subframe subframe_workspace_mid_side[2][2];
+	FLAC__Subframe *subframe_workspace_ptr[FLAC__MAX_CHANNELS][2];
+	FLAC__Subframe *subframe_workspace_ptr_mid_side[2][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace_mid_side[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr[FLAC__MAX_CHANNELS][2];
+	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr_mid_side[FLAC__MAX_CHANNELS][2];
+	unsigned best_subframe[FLAC__MAX_CHANNELS];       /* index (0 or 1) into 2nd dimension of the above workspaces */
+	unsigned best_subframe_mid_side[2];
+	unsigned best_subframe_bits[FLAC__MAX_CHANNELS];  /* size in bits of the best subframe for each channel */
+	unsigned best_subframe_bits_mid_side[2];
+	FLAC__StreamEncoderSubframeScratch *scratch[FLAC__MAX_CHANNELS+2]; /* see num_scratch */
+	unsigned num_scratch;                             /* 1, or with parallel subframes one per channel plus 2 for mid-side */
+	FLAC__BitWriter *frame[SPLIT_NODES_];             /* the frames being worked on, one for each node of the split tree */
+	unsigned num_frames;                              /* 1, or SPLIT_NODES_ with variable blocksize */
+	unsigned split_node;                              /* the node of the split tree being encoded */
+	unsigned chosen_node[1u << (SPLIT_LEVELS_-1)];    /* the nodes picked to be written out, in order */
+	unsigned num_chosen_nodes;
+	FLAC__ChannelAssignment channel_assignment[SPLIT_NODES_]; /* the channel assignment picked for each node */
+	unsigned frame_number;                            /* number of the frame being worked on (fixed blocksize only) */
+	FLAC__uint64 sample_number;                       /* number of the first sample of the block */
+	ThreadTaskStatus status;
+	FLAC__StreamEncoderState state;                   /* FLAC__STREAM_ENCODER_OK unless encoding the frame failed */
+	/* unaligned (original) pointers to allocated data */
+	FLAC__int32 *integer_signal_unaligned[FLAC__MAX_CHANNELS];
+	FLAC__int32 *integer_signal_mid_side_unaligned[2];
+	FLAC__int32 *residual_workspace_unaligned[FLAC__MAX_CHANNELS][2];
+	FLAC__int32 *residual_workspace_mid_side_unaligned[2][2];
+} FLAC__StreamEncoderThreadTask;
+
 
 /***********************************************************************
  *
@@ -130,20 +236,38 @@ static struct CompressionLevels {
 static void set_defaults_(FLAC__StreamEncoder *encoder);
 static void free_(FLAC__StreamEncoder *encoder);
 static FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize);
-static FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, unsigned samples, FLAC__bool is_last_block);
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+static void compute_window_(const FLAC__StreamEncoder *encoder, unsigned a, FLAC__real *window, unsigned blocksize);
+#endif
+static FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, FLAC__BitWriter *frame, unsigned samples, FLAC__bool is_last_block);
 static FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, FLAC__bool is_last_block);
 static void update_metadata_(const FLAC__StreamEncoder *encoder);
 #if FLAC__HAS_OGG
 static void update_ogg_metadata_(FLAC__StreamEncoder *encoder);
 #endif
 static FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block);
-static FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block);
+static FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_fractional_block);
+static FLAC__bool block_has_transient_(const FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderThreadTask *task, unsigned num_levels);
+static void choose_split_nodes_(FLAC__StreamEncoderThreadTask *task, unsigned num_levels);
+static FLAC__bool write_threadtask_frames_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_last_block);
+static FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_fractional_block);
+
+static FLAC__bool process_subframe_job_(
+	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *task,
+	unsigned job,
+	unsigned min_partition_order,
+	unsigned max_partition_order,
+	const FLAC__FrameHeader *frame_header
+);
 
 static FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	unsigned min_partition_order,
 	unsigned max_partition_order,
 	const FLAC__FrameHeader *frame_header,
+	unsigned split_level,
 	unsigned subframe_bps,
 	const FLAC__int32 integer_signal[],
 	FLAC__Subframe *subframe[2],
@@ -154,7 +278,6 @@ static FLAC__bool process_subframe_(
 );
 
 static FLAC__bool add_subframe_(
-	FLAC__StreamEncoder *encoder,
 	unsigned blocksize,
 	unsigned subframe_bps,
 	const FLAC__Subframe *subframe,
@@ -171,6 +294,7 @@ static unsigned evaluate_constant_subframe_(
 
 static unsigned evaluate_fixed_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -191,6 +315,7 @@ static unsigned evaluate_fixed_subframe_(
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 static unsigned evaluate_lpc_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -221,6 +346,7 @@ static unsigned evaluate_verbatim_subframe_(
 
 static unsigned find_best_partition_order_(
 	struct FLAC__StreamEncoderPrivate *private_,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned raw_bits_per_partition[],
@@ -274,6 +400,28 @@ static FLAC__bool set_partitioned_rice_(
 
 static unsigned get_wasted_bits_(FLAC__int32 signal[], unsigned samples);
 
+/* multithreading-related routines: */
+static FLAC__StreamEncoderThreadTask *threadtask_new_(unsigned num_scratch, unsigned num_frames);
+static void threadtask_delete_(FLAC__StreamEncoderThreadTask *task, unsigned channels);
+#ifdef HAVE_PTHREAD
+static FLAC__bool start_threads_(FLAC__StreamEncoder *encoder, unsigned num_threads);
+static void stop_threads_(FLAC__StreamEncoder *encoder);
+static void *thread_main_(void *arg);
+static FLAC__bool encode_next_queued_threadtask_(FLAC__StreamEncoder *encoder);
+static FLAC__bool queue_threadtask_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task);
+static FLAC__bool write_threadtasks_(FLAC__StreamEncoder *encoder, unsigned max_in_flight);
+static FLAC__bool process_subframe_jobs_in_parallel_(
+	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *task,
+	const unsigned job[],
+	unsigned num_jobs,
+	unsigned min_partition_order,
+	unsigned max_partition_order,
+	const FLAC__FrameHeader *frame_header
+);
+static FLAC__bool process_next_subframe_job_(FLAC__StreamEncoder *encoder);
+#endif
+
 /* verify-related routines: */
 static void append_to_verify_fifo_(
 	verify_input_fifo *fifo,
@@ -295,6 +443,13 @@ static FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDec
 static FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data);
 static void verify_metadata_callback_(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data);
 static void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+static void set_verify_error_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderState state);
+#ifdef HAVE_PTHREAD
+static FLAC__bool start_verify_thread_(FLAC__StreamEncoder *encoder);
+static FLAC__bool stop_verify_thread_(FLAC__StreamEncoder *encoder);
+static void *verify_thread_main_(void *arg);
+static FLAC__bool queue_verify_bytes_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, FLAC__bool is_frame);
+#endif
 
 static FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
 static FLAC__StreamEncoderSeekStatus file_seek_callback_(const FLAC__StreamEncoder *encoder, FLAC__uint64 absolute_byte_offset, void *client_data);
@@ -311,33 +466,40 @@ static FILE *get_binary_stdout_(void);
 
 typedef struct FLAC__StreamEncoderPrivate {
 	unsigned input_capacity;                          /* current size (in samples) of the signal and residual buffers */
-	FLAC__int32 *integer_signal[FLAC__MAX_CHANNELS];  /* the integer version of the input signal */
-	FLAC__int32 *integer_signal_mid_side[2];          /* the integer version of the mid-side input signal (stereo only) */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	FLAC__real *real_signal[FLAC__MAX_CHANNELS];      /* (@@@ currently unused) the floating-point version of the input signal */
 	FLAC__real *real_signal_mid_side[2];              /* (@@@ currently unused) the floating-point version of the mid-side input signal (stereo only) */
-	FLAC__real *window[FLAC__MAX_APODIZATION_FUNCTIONS]; /* the pre-computed floating-point window for each apodization function */
-	FLAC__real *windowed_signal;                      /* the integer_signal[] * current window[] */
+	FLAC__real *window[SPLIT_LEVELS_][FLAC__MAX_APODIZATION_FUNCTIONS]; /* the pre-computed floating-point window for each apodization function, for each level of the split tree */
 #endif
-	unsigned subframe_bps[FLAC__MAX_CHANNELS];        /* the effective bits per sample of the input signal (stream bps - wasted bits) */
-	unsigned subframe_bps_mid_side[2];                /* the effective bits per sample of the mid-side input signal (stream bps - wasted bits + 0/1) */
-	FLAC__int32 *residual_workspace[FLAC__MAX_CHANNELS][2]; /* each channel has a candidate and best workspace where the subframe residual signals will be stored */
-	FLAC__int32 *residual_workspace_mid_side[2][2];
-	FLAC__Subframe subframe_workspace[FLAC__MAX_CHANNELS][2];
-	FLAC__Subframe subframe_workspace_mid_side[2][2];
-	FLAC__Subframe *subframe_workspace_ptr[FLAC__MAX_CHANNELS][2];
-	FLAC__Subframe *subframe_workspace_ptr_mid_side[2][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_workspace_mid_side[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr[FLAC__MAX_CHANNELS][2];
-	FLAC__EntropyCodingMethod_PartitionedRiceContents *partitioned_rice_contents_workspace_ptr_mid_side[FLAC__MAX_CHANNELS][2];
-	unsigned best_subframe[FLAC__MAX_CHANNELS];       /* index (0 or 1) into 2nd dimension of the above workspaces */
-	unsigned best_subframe_mid_side[2];
-	unsigned best_subframe_bits[FLAC__MAX_CHANNELS];  /* size in bits of the best subframe for each channel */
-	unsigned best_subframe_bits_mid_side[2];
-	FLAC__uint64 *abs_residual_partition_sums;        /* workspace where the sum of abs(candidate residual) for each partition is stored */
-	unsigned *raw_bits_per_partition;                 /* workspace where the sum of silog2(candidate residual) for each partition is stored */
-	FLAC__BitWriter *frame;                           /* the current frame being worked on */
+	FLAC__StreamEncoderThreadTask *threadtask[2*FLAC__STREAM_ENCODER_MAX_THREADS]; /* per-frame workspaces; see num_threadtasks */
+	unsigned num_threadtasks;                         /* 1 unless multithreading, else the number of frames that can be in flight */
+	unsigned current_threadtask;                      /* index of the task currently being filled with input */
+	unsigned num_split_levels;                        /* 1 unless blocks may be split; see SPLIT_LEVELS_ */
+	FLAC__bool merge_blocks;                          /* true if the block encoded at once is twice the blocksize setting */
+#ifdef HAVE_PTHREAD
+	pthread_t thread[FLAC__STREAM_ENCODER_MAX_THREADS];
+	unsigned num_running_threads;                     /* worker threads; the client's thread also encodes while it waits on them */
+	pthread_mutex_t mutex_threadtasks;                /* protects the status of all tasks and the fields below */
+	pthread_cond_t cond_threadtask_queued;
+	pthread_cond_t cond_threadtask_done;
+	unsigned next_threadtask_to_encode;
+	unsigned next_threadtask_to_write;
+	unsigned num_threadtasks_in_flight;               /* queued but not yet written */
+	FLAC__bool threads_started;
+	FLAC__bool quit_threads;
+	struct {
+		FLAC__StreamEncoderThreadTask *task;          /* the task whose subframes are being searched */
+		const FLAC__FrameHeader *frame_header;
+		unsigned min_partition_order;
+		unsigned max_partition_order;
+		unsigned job[FLAC__MAX_CHANNELS+2];           /* see process_subframe_job_() */
+		unsigned num_jobs;
+		unsigned next_job;                            /* the next job not yet taken by a thread */
+		unsigned num_jobs_done;
+		FLAC__bool ok;
+	} subframe_search;                                /* parallel subframe search state, protected by mutex_threadtasks */
+#endif
+	FLAC__BitWriter *frame;                           /* used for writing the metadata blocks */
 	unsigned loose_mid_side_stereo_frames;            /* rounded number of frames the encoder will use before trying both independent and mid/side frames again */
 	unsigned loose_mid_side_stereo_frame_count;       /* number of frames using the current channel assignment */
 	FLAC__ChannelAssignment last_channel_assignment;
@@ -346,6 +508,9 @@ typedef struct FLAC__StreamEncoderPrivate {
 	unsigned current_sample_number;
 	unsigned current_frame_number;
 	FLAC__MD5Context md5context;
+#ifdef HAVE_PTHREAD
+	FLAC__MD5Pipeline md5pipeline;                    /* used instead of accumulating md5context directly with threaded MD5 */
+#endif
 	FLAC__CPUInfo cpuinfo;
 	void (*local_precompute_partition_info_sums)(const FLAC__int32 residual[], FLAC__uint64 abs_residual_partition_sums[], unsigned residual_samples, unsigned predictor_order, unsigned min_partition_order, unsigned max_partition_order, unsigned bps);
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
@@ -384,26 +549,11 @@ typedef struct FLAC__StreamEncoderPrivate {
 	unsigned frames_written;
 	unsigned total_frames_estimate;
 	/* unaligned (original) pointers to allocated data */
-	FLAC__int32 *integer_signal_unaligned[FLAC__MAX_CHANNELS];
-	FLAC__int32 *integer_signal_mid_side_unaligned[2];
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	FLAC__real *real_signal_unaligned[FLAC__MAX_CHANNELS]; /* (@@@ currently unused) */
 	FLAC__real *real_signal_mid_side_unaligned[2]; /* (@@@ currently unused) */
-	FLAC__real *window_unaligned[FLAC__MAX_APODIZATION_FUNCTIONS];
-	FLAC__real *windowed_signal_unaligned;
-#endif
-	FLAC__int32 *residual_workspace_unaligned[FLAC__MAX_CHANNELS][2];
-	FLAC__int32 *residual_workspace_mid_side_unaligned[2][2];
-	FLAC__uint64 *abs_residual_partition_sums_unaligned;
-	unsigned *raw_bits_per_partition_unaligned;
-	/*
-	 * These fields have been moved here from private function local
-	 * declarations merely to save stack space during encoding.
-	 */
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-	FLAC__real lp_coeff[FLAC__MAX_LPC_ORDER][FLAC__MAX_LPC_ORDER]; /* from process_subframe_() */
+	FLAC__real *window_unaligned[SPLIT_LEVELS_][FLAC__MAX_APODIZATION_FUNCTIONS];
 #endif
-	FLAC__EntropyCodingMethod_PartitionedRiceContents partitioned_rice_contents_extra[2]; /* from find_best_partition_order_() */
 	/*
 	 * The data for the verify section
 	 */
@@ -413,6 +563,23 @@ typedef struct FLAC__StreamEncoderPrivate {
 		FLAC__bool needs_magic_hack;
 		verify_input_fifo input_fifo;
 		verify_output output;
+#ifdef HAVE_PTHREAD
+		struct {
+			pthread_t thread;
+			pthread_mutex_t mutex;                    /* protects the fields below */
+			pthread_cond_t cond_data;                 /* signalled when bytes are queued or the stream ends */
+			pthread_cond_t cond_space;                /* signalled when a frame has been verified or the thread is done */
+			FLAC__byte *data;                         /* encoded bytes not yet read by the verify decoder, from head to tail */
+			size_t capacity;
+			size_t head;
+			size_t tail;
+			unsigned frames_in_flight;                /* written but not yet verified */
+			FLAC__bool started;
+			FLAC__bool end_of_stream;
+			FLAC__bool done;
+			FLAC__StreamEncoderState error;           /* the first verify failure, or FLAC__STREAM_ENCODER_OK */
+		} thread;
+#endif
 		struct {
 			FLAC__uint64 absolute_sample;
 			unsigned frame_number;
@@ -497,6 +664,13 @@ FLAC_API const char * const FLAC__StreamEncoderTellStatusString[] = {
  */
 static const unsigned OVERREAD_ = 1;
 
+#ifdef HAVE_PTHREAD
+/* With threaded verify, how many frames the client's thread can write
+ * ahead of the verify thread before it has to wait for it.
+ */
+static const unsigned VERIFY_QUEUE_FRAMES_ = 8;
+#endif
+
 /***********************************************************************
  *
  * Class constructor/destructor
@@ -505,7 +679,6 @@ static const unsigned OVERREAD_ = 1;
 FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 {
 	FLAC__StreamEncoder *encoder;
-	unsigned i;
 
 	FLAC__ASSERT(sizeof(int) >= 4); /* we want to die right away if this is not true */
 
@@ -541,34 +714,6 @@ FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 
 	encoder->private_->is_being_deleted = false;
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		encoder->private_->subframe_workspace_ptr[i][0] = &encoder->private_->subframe_workspace[i][0];
-		encoder->private_->subframe_workspace_ptr[i][1] = &encoder->private_->subframe_workspace[i][1];
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->subframe_workspace_ptr_mid_side[i][0] = &encoder->private_->subframe_workspace_mid_side[i][0];
-		encoder->private_->subframe_workspace_ptr_mid_side[i][1] = &encoder->private_->subframe_workspace_mid_side[i][1];
-	}
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		encoder->private_->partitioned_rice_contents_workspace_ptr[i][0] = &encoder->private_->partitioned_rice_contents_workspace[i][0];
-		encoder->private_->partitioned_rice_contents_workspace_ptr[i][1] = &encoder->private_->partitioned_rice_contents_workspace[i][1];
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[i][0] = &encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0];
-		encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[i][1] = &encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1];
-	}
-
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace[i][1]);
-	}
-	for(i = 0; i < 2; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1]);
-	}
-	for(i = 0; i < 2; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&encoder->private_->partitioned_rice_contents_extra[i]);
-
 	encoder->protected_->state = FLAC__STREAM_ENCODER_UNINITIALIZED;
 
 	return encoder;
@@ -576,8 +721,6 @@ FLAC_API FLAC__StreamEncoder *FLAC__stream_encoder_new(void)
 
 FLAC_API void FLAC__stream_encoder_delete(FLAC__StreamEncoder *encoder)
 {
-	unsigned i;
-
 	if (encoder == NULL)
 		return ;
 
@@ -592,17 +735,6 @@ FLAC_API void FLAC__stream_encoder_delete(FLAC__StreamEncoder *encoder)
 	if(0 != encoder->private_->verify.decoder)
 		FLAC__stream_decoder_delete(encoder->private_->verify.decoder);
 
-	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace[i][1]);
-	}
-	for(i = 0; i < 2; i++) {
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][0]);
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_workspace_mid_side[i][1]);
-	}
-	for(i = 0; i < 2; i++)
-		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&encoder->private_->partitioned_rice_contents_extra[i]);
-
 	FLAC__bitwriter_delete(encoder->private_->frame);
 	free(encoder->private_);
 	free(encoder->protected_);
@@ -626,7 +758,13 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	FLAC__bool is_ogg
 )
 {
-	unsigned i;
+	unsigned i, num_scratch, frame_bits;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned level;
+#endif
+#ifdef HAVE_PTHREAD
+	unsigned num_threads;
+#endif
 	FLAC__bool metadata_has_seektable, metadata_has_vorbis_comment, metadata_picture_has_type1, metadata_picture_has_type2;
 
 	FLAC__ASSERT(0 != encoder);
@@ -664,6 +802,8 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	if(encoder->protected_->blocksize == 0) {
 		if(encoder->protected_->max_lpc_order == 0)
 			encoder->protected_->blocksize = 1152;
+		else if(encoder->protected_->do_variable_blocksize && encoder->protected_->streamable_subset && encoder->protected_->sample_rate <= 48000)
+			encoder->protected_->blocksize = FLAC__SUBSET_MAX_BLOCK_SIZE_48000HZ / 2; /* so two blocks can still be merged; see below */
 		else
 			encoder->protected_->blocksize = 4096;
 	}
@@ -823,35 +963,15 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	}
 
 	encoder->private_->input_capacity = 0;
-	for(i = 0; i < encoder->protected_->channels; i++) {
-		encoder->private_->integer_signal_unaligned[i] = encoder->private_->integer_signal[i] = 0;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
+	for(i = 0; i < encoder->protected_->channels; i++)
 		encoder->private_->real_signal_unaligned[i] = encoder->private_->real_signal[i] = 0;
-#endif
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->integer_signal_mid_side_unaligned[i] = encoder->private_->integer_signal_mid_side[i] = 0;
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	for(i = 0; i < 2; i++)
 		encoder->private_->real_signal_mid_side_unaligned[i] = encoder->private_->real_signal_mid_side[i] = 0;
+	for(level = 0; level < SPLIT_LEVELS_; level++)
+		for(i = 0; i < encoder->protected_->num_apodizations; i++)
+			encoder->private_->window_unaligned[level][i] = encoder->private_->window[level][i] = 0;
 #endif
-	}
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-	for(i = 0; i < encoder->protected_->num_apodizations; i++)
-		encoder->private_->window_unaligned[i] = encoder->private_->window[i] = 0;
-	encoder->private_->windowed_signal_unaligned = encoder->private_->windowed_signal = 0;
-#endif
-	for(i = 0; i < encoder->protected_->channels; i++) {
-		encoder->private_->residual_workspace_unaligned[i][0] = encoder->private_->residual_workspace[i][0] = 0;
-		encoder->private_->residual_workspace_unaligned[i][1] = encoder->private_->residual_workspace[i][1] = 0;
-		encoder->private_->best_subframe[i] = 0;
-	}
-	for(i = 0; i < 2; i++) {
-		encoder->private_->residual_workspace_mid_side_unaligned[i][0] = encoder->private_->residual_workspace_mid_side[i][0] = 0;
-		encoder->private_->residual_workspace_mid_side_unaligned[i][1] = encoder->private_->residual_workspace_mid_side[i][1] = 0;
-		encoder->private_->best_subframe_mid_side[i] = 0;
-	}
-	encoder->private_->abs_residual_partition_sums_unaligned = encoder->private_->abs_residual_partition_sums = 0;
-	encoder->private_->raw_bits_per_partition_unaligned = encoder->private_->raw_bits_per_partition = 0;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	encoder->private_->loose_mid_side_stereo_frames = (unsigned)((FLAC__double)encoder->protected_->sample_rate * 0.4 / (FLAC__double)encoder->protected_->blocksize + 0.5);
 #else
@@ -869,10 +989,49 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->current_sample_number = 0;
 	encoder->private_->current_frame_number = 0;
 
+	/*
+	 * With variable blocksize, two blocks can be coded as one frame if
+	 * the format allows frames that long.  Every frame then carries a
+	 * sample number, which is longer than a frame number, and merging
+	 * saves a whole frame header where it is picked, so the block that
+	 * is encoded at once is made twice as long.
+	 */
+	encoder->private_->merge_blocks = false;
+	if(encoder->protected_->do_variable_blocksize) {
+		const unsigned merged_blocksize = 2 * encoder->protected_->blocksize;
+		if(
+			merged_blocksize <= FLAC__MAX_BLOCK_SIZE &&
+			(!encoder->protected_->streamable_subset || FLAC__format_blocksize_is_subset(merged_blocksize, encoder->protected_->sample_rate)) &&
+			encoder->protected_->blocksize % 16 == 0 &&
+			encoder->protected_->blocksize > encoder->protected_->max_lpc_order
+		) {
+			encoder->protected_->blocksize = merged_blocksize;
+			encoder->private_->merge_blocks = true;
+		}
+	}
+
 	encoder->private_->use_wide_by_block = (encoder->protected_->bits_per_sample + FLAC__bitmath_ilog2(encoder->protected_->blocksize)+1 > 30);
 	encoder->private_->use_wide_by_order = (encoder->protected_->bits_per_sample + FLAC__bitmath_ilog2(flac_max(encoder->protected_->max_lpc_order, FLAC__MAX_FIXED_ORDER))+1 > 30); /*@@@ need to use this? */
 	encoder->private_->use_wide_by_partition = (false); /*@@@ need to set this */
 
+	/*
+	 * With variable blocksize, find out how many times a block can be
+	 * halved: every part must be a multiple of 16 samples, which also
+	 * keeps the signal of each part aligned, and longer than the LPC
+	 * order.  Blocks of the size the client set are split to quarters
+	 * at most.
+	 */
+	encoder->private_->num_split_levels = 1;
+	if(encoder->protected_->do_variable_blocksize) {
+		while(
+			encoder->private_->num_split_levels < SPLIT_LEVELS_ - (encoder->private_->merge_blocks? 0 : 1) &&
+			encoder->protected_->blocksize % (16u << encoder->private_->num_split_levels) == 0 &&
+			(encoder->protected_->blocksize >> encoder->private_->num_split_levels) > encoder->protected_->max_lpc_order
+		)
+			encoder->private_->num_split_levels++;
+	}
+	FLAC__ASSERT(!encoder->private_->merge_blocks || encoder->private_->num_split_levels > 1);
+
 	/*
 	 * get the CPU info and set the function pointers
 	 */
@@ -939,6 +1098,29 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation;
 		}
 #    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+		if(encoder->private_->cpuinfo.ia32.avx2) {
+			if(encoder->protected_->max_lpc_order < 8)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_8;
+			else if(encoder->protected_->max_lpc_order < 16)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16;
+			else if(encoder->protected_->max_lpc_order < 24)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_24;
+			else if(encoder->protected_->max_lpc_order < 32)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_32;
+			else
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_33;
+		}
+#    endif
+#    ifdef FLAC__AVX512_SUPPORTED
+		/* for lower orders AVX2 is as fast */
+		if(encoder->private_->cpuinfo.ia32.avx512f && encoder->protected_->max_lpc_order >= 16) {
+			if(encoder->protected_->max_lpc_order < 32)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_32;
+			else
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_33;
+		}
+#    endif
 
 #    ifdef FLAC__SSE2_SUPPORTED
 		if(encoder->private_->cpuinfo.ia32.sse2) {
@@ -986,6 +1168,29 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		else if(encoder->protected_->max_lpc_order < 16)
 			encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_sse_lag_16;
 #    endif
+#    ifdef FLAC__AVX2_SUPPORTED
+		if(encoder->private_->cpuinfo.x86.avx2) {
+			if(encoder->protected_->max_lpc_order < 8)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_8;
+			else if(encoder->protected_->max_lpc_order < 16)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_16;
+			else if(encoder->protected_->max_lpc_order < 24)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_24;
+			else if(encoder->protected_->max_lpc_order < 32)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_32;
+			else
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx2_lag_33;
+		}
+#    endif
+#    ifdef FLAC__AVX512_SUPPORTED
+		/* for lower orders AVX2 is as fast */
+		if(encoder->private_->cpuinfo.x86.avx512f && encoder->protected_->max_lpc_order >= 16) {
+			if(encoder->protected_->max_lpc_order < 32)
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_32;
+			else
+				encoder->private_->local_lpc_compute_autocorrelation = FLAC__lpc_compute_autocorrelation_intrin_avx512_lag_33;
+		}
+#    endif
 
 #    ifdef FLAC__SSE2_SUPPORTED
 		encoder->private_->local_lpc_compute_residual_from_qlp_coefficients_16bit = FLAC__lpc_compute_residual_from_qlp_coefficients_16_intrin_sse2;
@@ -1071,15 +1276,67 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->metadata_callback = metadata_callback;
 	encoder->private_->client_data = client_data;
 
+	/*
+	 * Set up one task per frame that can be in flight.  Loose mid-side
+	 * stereo makes each frame depend on the channel assignment chosen
+	 * for the previous one, so it is never encoded frame-parallel.  With
+	 * parallel subframes there is a single task, but with a separate
+	 * scratch space for each subframe that can be searched at once.
+	 */
+	encoder->private_->num_threadtasks = 1;
+	num_scratch = 1;
+#ifdef HAVE_PTHREAD
+	num_threads = flac_min(encoder->protected_->num_threads, (unsigned)FLAC__STREAM_ENCODER_MAX_THREADS);
+	if(num_threads > 1) {
+		if(encoder->protected_->do_parallel_subframes)
+			num_scratch = encoder->protected_->channels + (encoder->protected_->do_mid_side_stereo? 2 : 0);
+		else if(!encoder->protected_->loose_mid_side_stereo)
+			encoder->private_->num_threadtasks = 2 * num_threads;
+	}
+#endif
+	encoder->private_->current_threadtask = 0;
+#ifdef HAVE_PTHREAD
+	encoder->private_->threads_started = false;
+	encoder->private_->num_threadtasks_in_flight = 0;
+#endif
+	for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+		if(0 == (encoder->private_->threadtask[i] = threadtask_new_(num_scratch, (1u << encoder->private_->num_split_levels) - 1))) {
+			encoder->private_->num_threadtasks = i;
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
+	}
+
 	if(!resize_buffers_(encoder, encoder->protected_->blocksize)) {
 		/* the above function sets the state for us in case of an error */
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
 
-	if(!FLAC__bitwriter_init(encoder->private_->frame)) {
+	/*
+	 * Size the frame buffers for the worst case, a verbatim frame at the
+	 * (maximum) blocksize, so that encoding never has to grow them
+	 */
+	frame_bits =
+		16*8 /* longest frame header, including CRC-8 */ + FLAC__FRAME_FOOTER_CRC_LEN +
+		encoder->protected_->channels * (
+			FLAC__SUBFRAME_ZERO_PAD_LEN + FLAC__SUBFRAME_TYPE_LEN + FLAC__SUBFRAME_WASTED_BITS_FLAG_LEN +
+			(encoder->protected_->bits_per_sample + 1) * (encoder->protected_->blocksize + 1) /* +1 for side channel; extra sample covers the wasted bits count */
+		);
+
+	if(!FLAC__bitwriter_init(encoder->private_->frame) || !FLAC__bitwriter_reserve(encoder->private_->frame, frame_bits)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
+	for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+		FLAC__StreamEncoderThreadTask *task = encoder->private_->threadtask[i];
+		unsigned node;
+		for(node = 0; node < task->num_frames; node++) {
+			if(!FLAC__bitwriter_init(task->frame[node]) || !FLAC__bitwriter_reserve(task->frame[node], frame_bits)) {
+				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+			}
+		}
+	}
 
 	/*
 	 * Set up the verify stuff if necessary
@@ -1089,13 +1346,19 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		 * First, set up the fifo which will hold the
 		 * original signal to compare against
 		 */
-		encoder->private_->verify.input_fifo.size = encoder->protected_->blocksize+OVERREAD_;
+		encoder->private_->verify.input_fifo.size = encoder->protected_->blocksize*encoder->private_->num_threadtasks+OVERREAD_;
+#ifdef HAVE_PTHREAD
+		/* frames written but not yet checked by the verify thread are still in the fifo */
+		if(encoder->protected_->threaded_verify)
+			encoder->private_->verify.input_fifo.size += encoder->protected_->blocksize*VERIFY_QUEUE_FRAMES_;
+#endif
 		for(i = 0; i < encoder->protected_->channels; i++) {
 			if(0 == (encoder->private_->verify.input_fifo.data[i] = safe_malloc_mul_2op_p(sizeof(FLAC__int32), /*times*/encoder->private_->verify.input_fifo.size))) {
 				encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
 				return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 			}
 		}
+		encoder->private_->verify.input_fifo.head = 0;
 		encoder->private_->verify.input_fifo.tail = 0;
 
 		/*
@@ -1113,6 +1376,13 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
+
+#ifdef HAVE_PTHREAD
+		if(encoder->protected_->threaded_verify && !start_verify_thread_(encoder)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
+#endif
 	}
 	encoder->private_->verify.error_stats.absolute_sample = 0;
 	encoder->private_->verify.error_stats.frame_number = 0;
@@ -1140,7 +1410,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 		encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
-	if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+	if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 		/* the above function sets the state for us in case of an error */
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
@@ -1153,7 +1423,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.type = FLAC__METADATA_TYPE_STREAMINFO;
 	encoder->private_->streaminfo.is_last = false; /* we will have at a minimum a VORBIS_COMMENT afterwards */
 	encoder->private_->streaminfo.length = FLAC__STREAM_METADATA_STREAMINFO_LENGTH;
-	encoder->private_->streaminfo.data.stream_info.min_blocksize = encoder->protected_->blocksize; /* this encoder uses the same blocksize for the whole stream */
+	encoder->private_->streaminfo.data.stream_info.min_blocksize = encoder->protected_->blocksize >> (encoder->private_->num_split_levels-1); /* the same blocksize for the whole stream unless splitting blocks */
 	encoder->private_->streaminfo.data.stream_info.max_blocksize = encoder->protected_->blocksize;
 	encoder->private_->streaminfo.data.stream_info.min_framesize = 0; /* we don't know this yet; have to fill it in later */
 	encoder->private_->streaminfo.data.stream_info.max_framesize = 0; /* we don't know this yet; have to fill it in later */
@@ -1162,13 +1432,20 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.data.stream_info.bits_per_sample = encoder->protected_->bits_per_sample;
 	encoder->private_->streaminfo.data.stream_info.total_samples = encoder->protected_->total_samples_estimate; /* we will replace this later with the real total */
 	memset(encoder->private_->streaminfo.data.stream_info.md5sum, 0, 16); /* we don't know this yet; have to fill it in later */
-	if(encoder->protected_->do_md5)
+	if(encoder->protected_->do_md5) {
 		FLAC__MD5Init(&encoder->private_->md5context);
+#ifdef HAVE_PTHREAD
+		if(encoder->protected_->threaded_md5 && !FLAC__MD5PipelineStart(&encoder->private_->md5pipeline, &encoder->private_->md5context)) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+		}
+#endif
+	}
 	if(!FLAC__add_metadata_block(&encoder->private_->streaminfo, encoder->private_->frame)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
-	if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+	if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 		/* the above function sets the state for us in case of an error */
 		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 	}
@@ -1180,6 +1457,13 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	encoder->private_->streaminfo.data.stream_info.min_framesize = (1u << FLAC__STREAM_METADATA_STREAMINFO_MIN_FRAME_SIZE_LEN) - 1;
 	/* ... and clear this to 0 */
 	encoder->private_->streaminfo.data.stream_info.total_samples = 0;
+	/* when blocks may be split, the blocksizes actually used are kept
+	 * track of as the frames are written; see write_threadtask_frames_()
+	 */
+	if(encoder->private_->num_split_levels > 1) {
+		encoder->private_->streaminfo.data.stream_info.min_blocksize = encoder->protected_->blocksize;
+		encoder->private_->streaminfo.data.stream_info.max_blocksize = 0;
+	}
 
 	/*
 	 * Check to see if the supplied metadata contains a VORBIS_COMMENT;
@@ -1204,7 +1488,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
-		if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+		if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 			/* the above function sets the state for us in case of an error */
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
@@ -1219,7 +1503,7 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
-		if(!write_bitbuffer_(encoder, 0, /*is_last_block=*/false)) {
+		if(!write_bitbuffer_(encoder, encoder->private_->frame, 0, /*is_last_block=*/false)) {
 			/* the above function sets the state for us in case of an error */
 			return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
 		}
@@ -1234,6 +1518,13 @@ static FLAC__StreamEncoderInitStatus init_stream_internal_(
 	if(encoder->protected_->verify)
 		encoder->private_->verify.state_hint = ENCODER_IN_AUDIO;
 
+#ifdef HAVE_PTHREAD
+	if((encoder->private_->num_threadtasks > 1 || num_scratch > 1) && !start_threads_(encoder, num_threads - 1)) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		return FLAC__STREAM_ENCODER_INIT_STATUS_ENCODER_ERROR;
+	}
+#endif
+
 	return FLAC__STREAM_ENCODER_INIT_STATUS_OK;
 }
 
@@ -1431,14 +1722,32 @@ FLAC_API FLAC__bool FLAC__stream_encoder_finish(FLAC__StreamEncoder *encoder)
 		return true;
 
 	if(encoder->protected_->state == FLAC__STREAM_ENCODER_OK && !encoder->private_->is_being_deleted) {
-		if(encoder->private_->current_sample_number != 0) {
+#ifdef HAVE_PTHREAD
+		/* write out all frames still in flight before the final one */
+		if(encoder->private_->threads_started && !write_threadtasks_(encoder, /*max_in_flight=*/0))
+			error = true;
+#endif
+		if(!error && encoder->private_->current_sample_number != 0) {
 			const FLAC__bool is_fractional_block = encoder->protected_->blocksize != encoder->private_->current_sample_number;
 			encoder->protected_->blocksize = encoder->private_->current_sample_number;
 			if(!process_frame_(encoder, is_fractional_block, /*is_last_block=*/true))
 				error = true;
 		}
+		/* if only the last block was written, the min blocksize was never lowered and the max has to be raised to it */
+		encoder->private_->streaminfo.data.stream_info.max_blocksize = flac_max(encoder->private_->streaminfo.data.stream_info.max_blocksize, encoder->private_->streaminfo.data.stream_info.min_blocksize);
 	}
 
+#ifdef HAVE_PTHREAD
+	/* wait for the verify thread to check everything written so far */
+	if(encoder->private_->verify.thread.started && !stop_verify_thread_(encoder))
+		error = true;
+	/* the MD5 thread must have hashed every block before the signature is final */
+	if(encoder->private_->md5pipeline.started && !FLAC__MD5PipelineStop(&encoder->private_->md5pipeline) && !error) {
+		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+		error = true;
+	}
+#endif
+
 	if(encoder->protected_->do_md5)
 		FLAC__MD5Final(encoder->private_->streaminfo.data.stream_info.md5sum, &encoder->private_->md5context);
 
@@ -1893,63 +2202,118 @@ FLAC_API FLAC__bool FLAC__stream_encoder_set_metadata(FLAC__StreamEncoder *encod
 	return true;
 }
 
-/*
- * These three functions are not static, but not publically exposed in
- * include/FLAC/ either.  They are used by the test suite.
- */
-FLAC_API FLAC__bool FLAC__stream_encoder_disable_constant_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_num_threads(FLAC__StreamEncoder *encoder, unsigned value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
 	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
 		return false;
-	encoder->private_->disable_constant_subframes = value;
+	encoder->protected_->num_threads = value;
 	return true;
 }
 
-FLAC_API FLAC__bool FLAC__stream_encoder_disable_fixed_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_do_parallel_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
 	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
 		return false;
-	encoder->private_->disable_fixed_subframes = value;
+	encoder->protected_->do_parallel_subframes = value;
 	return true;
 }
 
-FLAC_API FLAC__bool FLAC__stream_encoder_disable_verbatim_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_do_variable_blocksize(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
 	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
 		return false;
-	encoder->private_->disable_verbatim_subframes = value;
+	encoder->protected_->do_variable_blocksize = value;
 	return true;
 }
 
-FLAC_API FLAC__StreamEncoderState FLAC__stream_encoder_get_state(const FLAC__StreamEncoder *encoder)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_threaded_verify(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
-	return encoder->protected_->state;
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->threaded_verify = value;
+	return true;
 }
 
-FLAC_API FLAC__StreamDecoderState FLAC__stream_encoder_get_verify_decoder_state(const FLAC__StreamEncoder *encoder)
+FLAC_API FLAC__bool FLAC__stream_encoder_set_threaded_md5(FLAC__StreamEncoder *encoder, FLAC__bool value)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
-	if(encoder->protected_->verify)
-		return FLAC__stream_decoder_get_state(encoder->private_->verify.decoder);
-	else
-		return FLAC__STREAM_DECODER_UNINITIALIZED;
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->protected_->threaded_md5 = value;
+	return true;
 }
 
-FLAC_API const char *FLAC__stream_encoder_get_resolved_state_string(const FLAC__StreamEncoder *encoder)
+/*
+ * These three functions are not static, but not publically exposed in
+ * include/FLAC/ either.  They are used by the test suite.
+ */
+FLAC_API FLAC__bool FLAC__stream_encoder_disable_constant_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->private_->disable_constant_subframes = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_disable_fixed_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->private_->disable_fixed_subframes = value;
+	return true;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_disable_verbatim_subframes(FLAC__StreamEncoder *encoder, FLAC__bool value)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->state != FLAC__STREAM_ENCODER_UNINITIALIZED)
+		return false;
+	encoder->private_->disable_verbatim_subframes = value;
+	return true;
+}
+
+FLAC_API FLAC__StreamEncoderState FLAC__stream_encoder_get_state(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->state;
+}
+
+FLAC_API FLAC__StreamDecoderState FLAC__stream_encoder_get_verify_decoder_state(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	if(encoder->protected_->verify)
+		return FLAC__stream_decoder_get_state(encoder->private_->verify.decoder);
+	else
+		return FLAC__STREAM_DECODER_UNINITIALIZED;
+}
+
+FLAC_API const char *FLAC__stream_encoder_get_resolved_state_string(const FLAC__StreamEncoder *encoder)
 {
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
@@ -2032,7 +2396,8 @@ FLAC_API unsigned FLAC__stream_encoder_get_blocksize(const FLAC__StreamEncoder *
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
 	FLAC__ASSERT(0 != encoder->protected_);
-	return encoder->protected_->blocksize;
+	/* with merging, blocks are encoded two at a time; see init_stream_internal_() */
+	return encoder->private_->merge_blocks? encoder->protected_->blocksize / 2 : encoder->protected_->blocksize;
 }
 
 FLAC_API FLAC__bool FLAC__stream_encoder_get_do_mid_side_stereo(const FLAC__StreamEncoder *encoder)
@@ -2123,10 +2488,51 @@ FLAC_API FLAC__uint64 FLAC__stream_encoder_get_total_samples_estimate(const FLAC
 	return encoder->protected_->total_samples_estimate;
 }
 
+FLAC_API unsigned FLAC__stream_encoder_get_num_threads(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->num_threads;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_do_parallel_subframes(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->do_parallel_subframes;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_do_variable_blocksize(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->do_variable_blocksize;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_threaded_verify(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->threaded_verify;
+}
+
+FLAC_API FLAC__bool FLAC__stream_encoder_get_threaded_md5(const FLAC__StreamEncoder *encoder)
+{
+	FLAC__ASSERT(0 != encoder);
+	FLAC__ASSERT(0 != encoder->private_);
+	FLAC__ASSERT(0 != encoder->protected_);
+	return encoder->protected_->threaded_md5;
+}
+
 FLAC_API FLAC__bool FLAC__stream_encoder_process(FLAC__StreamEncoder *encoder, const FLAC__int32 * const buffer[], unsigned samples)
 {
 	unsigned i, j = 0, channel;
 	const unsigned channels = encoder->protected_->channels, blocksize = encoder->protected_->blocksize;
+	FLAC__StreamEncoderThreadTask *task, *next;
 
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
@@ -2136,18 +2542,20 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process(FLAC__StreamEncoder *encoder, c
 	do {
 		const unsigned n = flac_min(blocksize+OVERREAD_-encoder->private_->current_sample_number, samples-j);
 
+		task = encoder->private_->threadtask[encoder->private_->current_threadtask];
+
 		if(encoder->protected_->verify)
 			append_to_verify_fifo_(&encoder->private_->verify.input_fifo, buffer, j, channels, n);
 
 		for(channel = 0; channel < channels; channel++)
-			memcpy(&encoder->private_->integer_signal[channel][encoder->private_->current_sample_number], &buffer[channel][j], sizeof(buffer[channel][0]) * n);
+			memcpy(&task->integer_signal[channel][encoder->private_->current_sample_number], &buffer[channel][j], sizeof(buffer[channel][0]) * n);
 
 		if(encoder->protected_->do_mid_side_stereo) {
 			FLAC__ASSERT(channels == 2);
 			/* "i <= blocksize" to overread 1 sample; see comment in OVERREAD_ decl */
 			for(i = encoder->private_->current_sample_number; i <= blocksize && j < samples; i++, j++) {
-				encoder->private_->integer_signal_mid_side[1][i] = buffer[0][j] - buffer[1][j];
-				encoder->private_->integer_signal_mid_side[0][i] = (buffer[0][j] + buffer[1][j]) >> 1; /* NOTE: not the same as 'mid = (buffer[0][j] + buffer[1][j]) / 2' ! */
+				task->integer_signal_mid_side[1][i] = buffer[0][j] - buffer[1][j];
+				task->integer_signal_mid_side[0][i] = (buffer[0][j] + buffer[1][j]) >> 1; /* NOTE: not the same as 'mid = (buffer[0][j] + buffer[1][j]) / 2' ! */
 			}
 		}
 		else
@@ -2161,12 +2569,13 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process(FLAC__StreamEncoder *encoder, c
 			FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
 			if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
 				return false;
-			/* move unprocessed overread samples to beginnings of arrays */
+			/* move unprocessed overread samples to beginnings of arrays (of the next task when multithreading) */
+			next = encoder->private_->threadtask[encoder->private_->current_threadtask];
 			for(channel = 0; channel < channels; channel++)
-				encoder->private_->integer_signal[channel][0] = encoder->private_->integer_signal[channel][blocksize];
+				next->integer_signal[channel][0] = task->integer_signal[channel][blocksize];
 			if(encoder->protected_->do_mid_side_stereo) {
-				encoder->private_->integer_signal_mid_side[0][0] = encoder->private_->integer_signal_mid_side[0][blocksize];
-				encoder->private_->integer_signal_mid_side[1][0] = encoder->private_->integer_signal_mid_side[1][blocksize];
+				next->integer_signal_mid_side[0][0] = task->integer_signal_mid_side[0][blocksize];
+				next->integer_signal_mid_side[1][0] = task->integer_signal_mid_side[1][blocksize];
 			}
 			encoder->private_->current_sample_number = 1;
 		}
@@ -2180,6 +2589,7 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process_interleaved(FLAC__StreamEncoder
 	unsigned i, j, k, channel;
 	FLAC__int32 x, mid, side;
 	const unsigned channels = encoder->protected_->channels, blocksize = encoder->protected_->blocksize;
+	FLAC__StreamEncoderThreadTask *task, *next;
 
 	FLAC__ASSERT(0 != encoder);
 	FLAC__ASSERT(0 != encoder->private_);
@@ -2196,32 +2606,35 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process_interleaved(FLAC__StreamEncoder
 		 * stereo coding: unroll channel loop
 		 */
 		do {
+			task = encoder->private_->threadtask[encoder->private_->current_threadtask];
+
 			if(encoder->protected_->verify)
 				append_to_verify_fifo_interleaved_(&encoder->private_->verify.input_fifo, buffer, j, channels, flac_min(blocksize+OVERREAD_-encoder->private_->current_sample_number, samples-j));
 
 			/* "i <= blocksize" to overread 1 sample; see comment in OVERREAD_ decl */
 			for(i = encoder->private_->current_sample_number; i <= blocksize && j < samples; i++, j++) {
-				encoder->private_->integer_signal[0][i] = mid = side = buffer[k++];
+				task->integer_signal[0][i] = mid = side = buffer[k++];
 				x = buffer[k++];
-				encoder->private_->integer_signal[1][i] = x;
+				task->integer_signal[1][i] = x;
 				mid += x;
 				side -= x;
 				mid >>= 1; /* NOTE: not the same as 'mid = (left + right) / 2' ! */
-				encoder->private_->integer_signal_mid_side[1][i] = side;
-				encoder->private_->integer_signal_mid_side[0][i] = mid;
+				task->integer_signal_mid_side[1][i] = side;
+				task->integer_signal_mid_side[0][i] = mid;
 			}
 			encoder->private_->current_sample_number = i;
 			/* we only process if we have a full block + 1 extra sample; final block is always handled by FLAC__stream_encoder_finish() */
 			if(i > blocksize) {
 				if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
 					return false;
-				/* move unprocessed overread samples to beginnings of arrays */
+				/* move unprocessed overread samples to beginnings of arrays (of the next task when multithreading) */
 				FLAC__ASSERT(i == blocksize+OVERREAD_);
 				FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
-				encoder->private_->integer_signal[0][0] = encoder->private_->integer_signal[0][blocksize];
-				encoder->private_->integer_signal[1][0] = encoder->private_->integer_signal[1][blocksize];
-				encoder->private_->integer_signal_mid_side[0][0] = encoder->private_->integer_signal_mid_side[0][blocksize];
-				encoder->private_->integer_signal_mid_side[1][0] = encoder->private_->integer_signal_mid_side[1][blocksize];
+				next = encoder->private_->threadtask[encoder->private_->current_threadtask];
+				next->integer_signal[0][0] = task->integer_signal[0][blocksize];
+				next->integer_signal[1][0] = task->integer_signal[1][blocksize];
+				next->integer_signal_mid_side[0][0] = task->integer_signal_mid_side[0][blocksize];
+				next->integer_signal_mid_side[1][0] = task->integer_signal_mid_side[1][blocksize];
 				encoder->private_->current_sample_number = 1;
 			}
 		} while(j < samples);
@@ -2231,24 +2644,27 @@ FLAC_API FLAC__bool FLAC__stream_encoder_process_interleaved(FLAC__StreamEncoder
 		 * independent channel coding: buffer each channel in inner loop
 		 */
 		do {
+			task = encoder->private_->threadtask[encoder->private_->current_threadtask];
+
 			if(encoder->protected_->verify)
 				append_to_verify_fifo_interleaved_(&encoder->private_->verify.input_fifo, buffer, j, channels, flac_min(blocksize+OVERREAD_-encoder->private_->current_sample_number, samples-j));
 
 			/* "i <= blocksize" to overread 1 sample; see comment in OVERREAD_ decl */
 			for(i = encoder->private_->current_sample_number; i <= blocksize && j < samples; i++, j++) {
 				for(channel = 0; channel < channels; channel++)
-					encoder->private_->integer_signal[channel][i] = buffer[k++];
+					task->integer_signal[channel][i] = buffer[k++];
 			}
 			encoder->private_->current_sample_number = i;
 			/* we only process if we have a full block + 1 extra sample; final block is always handled by FLAC__stream_encoder_finish() */
 			if(i > blocksize) {
 				if(!process_frame_(encoder, /*is_fractional_block=*/false, /*is_last_block=*/false))
 					return false;
-				/* move unprocessed overread samples to beginnings of arrays */
+				/* move unprocessed overread samples to beginnings of arrays (of the next task when multithreading) */
 				FLAC__ASSERT(i == blocksize+OVERREAD_);
 				FLAC__ASSERT(OVERREAD_ == 1); /* assert we only overread 1 sample which simplifies the rest of the code below */
+				next = encoder->private_->threadtask[encoder->private_->current_threadtask];
 				for(channel = 0; channel < channels; channel++)
-					encoder->private_->integer_signal[channel][0] = encoder->private_->integer_signal[channel][blocksize];
+					next->integer_signal[channel][0] = task->integer_signal[channel][blocksize];
 				encoder->private_->current_sample_number = 1;
 			}
 		} while(j < samples);
@@ -2293,11 +2709,17 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 	encoder->protected_->min_residual_partition_order = 0;
 	encoder->protected_->max_residual_partition_order = 0;
 	encoder->protected_->rice_parameter_search_dist = 0;
+	encoder->protected_->num_threads = 1;
+	encoder->protected_->do_parallel_subframes = false;
+	encoder->protected_->do_variable_blocksize = false;
+	encoder->protected_->threaded_verify = false;
+	encoder->protected_->threaded_md5 = false;
 	encoder->protected_->total_samples_estimate = 0;
 	encoder->protected_->metadata = 0;
 	encoder->protected_->num_metadata_blocks = 0;
 
 	encoder->private_->seek_table = 0;
+	encoder->private_->merge_blocks = false;
 	encoder->private_->disable_constant_subframes = false;
 	encoder->private_->disable_fixed_subframes = false;
 	encoder->private_->disable_verbatim_subframes = false;
@@ -2321,74 +2743,48 @@ void set_defaults_(FLAC__StreamEncoder *encoder)
 
 void free_(FLAC__StreamEncoder *encoder)
 {
-	unsigned i, channel;
+	unsigned i;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned level;
+#endif
 
 	FLAC__ASSERT(0 != encoder);
+#ifdef HAVE_PTHREAD
+	/* the worker threads must be gone before their tasks are freed */
+	stop_threads_(encoder);
+#endif
 	if(encoder->protected_->metadata) {
 		free(encoder->protected_->metadata);
 		encoder->protected_->metadata = 0;
 		encoder->protected_->num_metadata_blocks = 0;
 	}
-	for(i = 0; i < encoder->protected_->channels; i++) {
-		if(0 != encoder->private_->integer_signal_unaligned[i]) {
-			free(encoder->private_->integer_signal_unaligned[i]);
-			encoder->private_->integer_signal_unaligned[i] = 0;
-		}
+	for(i = 0; i < encoder->private_->num_threadtasks; i++) {
+		threadtask_delete_(encoder->private_->threadtask[i], encoder->protected_->channels);
+		encoder->private_->threadtask[i] = 0;
+	}
+	encoder->private_->num_threadtasks = 0;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
+	for(i = 0; i < encoder->protected_->channels; i++) {
 		if(0 != encoder->private_->real_signal_unaligned[i]) {
 			free(encoder->private_->real_signal_unaligned[i]);
 			encoder->private_->real_signal_unaligned[i] = 0;
 		}
-#endif
 	}
 	for(i = 0; i < 2; i++) {
-		if(0 != encoder->private_->integer_signal_mid_side_unaligned[i]) {
-			free(encoder->private_->integer_signal_mid_side_unaligned[i]);
-			encoder->private_->integer_signal_mid_side_unaligned[i] = 0;
-		}
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
 		if(0 != encoder->private_->real_signal_mid_side_unaligned[i]) {
 			free(encoder->private_->real_signal_mid_side_unaligned[i]);
 			encoder->private_->real_signal_mid_side_unaligned[i] = 0;
 		}
-#endif
 	}
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-	for(i = 0; i < encoder->protected_->num_apodizations; i++) {
-		if(0 != encoder->private_->window_unaligned[i]) {
-			free(encoder->private_->window_unaligned[i]);
-			encoder->private_->window_unaligned[i] = 0;
-		}
-	}
-	if(0 != encoder->private_->windowed_signal_unaligned) {
-		free(encoder->private_->windowed_signal_unaligned);
-		encoder->private_->windowed_signal_unaligned = 0;
-	}
-#endif
-	for(channel = 0; channel < encoder->protected_->channels; channel++) {
-		for(i = 0; i < 2; i++) {
-			if(0 != encoder->private_->residual_workspace_unaligned[channel][i]) {
-				free(encoder->private_->residual_workspace_unaligned[channel][i]);
-				encoder->private_->residual_workspace_unaligned[channel][i] = 0;
-			}
-		}
-	}
-	for(channel = 0; channel < 2; channel++) {
-		for(i = 0; i < 2; i++) {
-			if(0 != encoder->private_->residual_workspace_mid_side_unaligned[channel][i]) {
-				free(encoder->private_->residual_workspace_mid_side_unaligned[channel][i]);
-				encoder->private_->residual_workspace_mid_side_unaligned[channel][i] = 0;
+	for(level = 0; level < SPLIT_LEVELS_; level++) {
+		for(i = 0; i < encoder->protected_->num_apodizations; i++) {
+			if(0 != encoder->private_->window_unaligned[level][i]) {
+				free(encoder->private_->window_unaligned[level][i]);
+				encoder->private_->window_unaligned[level][i] = 0;
 			}
 		}
 	}
-	if(0 != encoder->private_->abs_residual_partition_sums_unaligned) {
-		free(encoder->private_->abs_residual_partition_sums_unaligned);
-		encoder->private_->abs_residual_partition_sums_unaligned = 0;
-	}
-	if(0 != encoder->private_->raw_bits_per_partition_unaligned) {
-		free(encoder->private_->raw_bits_per_partition_unaligned);
-		encoder->private_->raw_bits_per_partition_unaligned = 0;
-	}
+#endif
 	if(encoder->protected_->verify) {
 		for(i = 0; i < encoder->protected_->channels; i++) {
 			if(0 != encoder->private_->verify.input_fifo.data[i]) {
@@ -2397,13 +2793,23 @@ void free_(FLAC__StreamEncoder *encoder)
 			}
 		}
 	}
+#ifdef HAVE_PTHREAD
+	if(0 != encoder->private_->verify.thread.data) {
+		free(encoder->private_->verify.thread.data);
+		encoder->private_->verify.thread.data = 0;
+		encoder->private_->verify.thread.capacity = 0;
+	}
+#endif
 	FLAC__bitwriter_free(encoder->private_->frame);
 }
 
 FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 {
 	FLAC__bool ok;
-	unsigned i, channel;
+	unsigned i, channel, t;
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+	unsigned level;
+#endif
 
 	FLAC__ASSERT(new_blocksize > 0);
 	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
@@ -2421,114 +2827,69 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 	 * alignment purposes; we use 4 in front to keep the data well-aligned.
 	 */
 
-	for(i = 0; ok && i < encoder->protected_->channels; i++) {
-		ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_unaligned[i], &encoder->private_->integer_signal[i]);
-		memset(encoder->private_->integer_signal[i], 0, sizeof(FLAC__int32)*4);
-		encoder->private_->integer_signal[i] += 4;
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 #if 0 /* @@@ currently unused */
+	for(i = 0; ok && i < encoder->protected_->channels; i++) {
 		if(encoder->protected_->max_lpc_order > 0)
 			ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize+OVERREAD_, &encoder->private_->real_signal_unaligned[i], &encoder->private_->real_signal[i]);
-#endif
-#endif
 	}
 	for(i = 0; ok && i < 2; i++) {
-		ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &encoder->private_->integer_signal_mid_side_unaligned[i], &encoder->private_->integer_signal_mid_side[i]);
-		memset(encoder->private_->integer_signal_mid_side[i], 0, sizeof(FLAC__int32)*4);
-		encoder->private_->integer_signal_mid_side[i] += 4;
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
-#if 0 /* @@@ currently unused */
 		if(encoder->protected_->max_lpc_order > 0)
 			ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize+OVERREAD_, &encoder->private_->real_signal_mid_side_unaligned[i], &encoder->private_->real_signal_mid_side[i]);
-#endif
-#endif
 	}
-#ifndef FLAC__INTEGER_ONLY_LIBRARY
+#endif
 	if(ok && encoder->protected_->max_lpc_order > 0) {
-		for(i = 0; ok && i < encoder->protected_->num_apodizations; i++)
-			ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize, &encoder->private_->window_unaligned[i], &encoder->private_->window[i]);
-		ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize, &encoder->private_->windowed_signal_unaligned, &encoder->private_->windowed_signal);
+		for(level = 0; ok && level < encoder->private_->num_split_levels; level++)
+			for(i = 0; ok && i < encoder->protected_->num_apodizations; i++)
+				ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize >> level, &encoder->private_->window_unaligned[level][i], &encoder->private_->window[level][i]);
 	}
 #endif
-	for(channel = 0; ok && channel < encoder->protected_->channels; channel++) {
-		for(i = 0; ok && i < 2; i++) {
-			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &encoder->private_->residual_workspace_unaligned[channel][i], &encoder->private_->residual_workspace[channel][i]);
+	for(t = 0; ok && t < encoder->private_->num_threadtasks; t++) {
+		FLAC__StreamEncoderThreadTask *task = encoder->private_->threadtask[t];
+		for(i = 0; ok && i < encoder->protected_->channels; i++) {
+			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &task->integer_signal_unaligned[i], &task->integer_signal[i]);
+			if(ok) {
+				memset(task->integer_signal[i], 0, sizeof(FLAC__int32)*4);
+				task->integer_signal[i] += 4;
+			}
 		}
-	}
-	for(channel = 0; ok && channel < 2; channel++) {
 		for(i = 0; ok && i < 2; i++) {
-			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &encoder->private_->residual_workspace_mid_side_unaligned[channel][i], &encoder->private_->residual_workspace_mid_side[channel][i]);
+			ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize+4+OVERREAD_, &task->integer_signal_mid_side_unaligned[i], &task->integer_signal_mid_side[i]);
+			if(ok) {
+				memset(task->integer_signal_mid_side[i], 0, sizeof(FLAC__int32)*4);
+				task->integer_signal_mid_side[i] += 4;
+			}
+		}
+		for(channel = 0; ok && channel < encoder->protected_->channels; channel++) {
+			for(i = 0; ok && i < 2; i++) {
+				ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &task->residual_workspace_unaligned[channel][i], &task->residual_workspace[channel][i]);
+			}
+		}
+		for(channel = 0; ok && channel < 2; channel++) {
+			for(i = 0; ok && i < 2; i++) {
+				ok = ok && FLAC__memory_alloc_aligned_int32_array(new_blocksize, &task->residual_workspace_mid_side_unaligned[channel][i], &task->residual_workspace_mid_side[channel][i]);
+			}
+		}
+		for(i = 0; ok && i < task->num_scratch; i++) {
+			FLAC__StreamEncoderSubframeScratch *scratch = task->scratch[i];
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+			if(encoder->protected_->max_lpc_order > 0)
+				ok = ok && FLAC__memory_alloc_aligned_real_array(new_blocksize, &scratch->windowed_signal_unaligned, &scratch->windowed_signal);
+#endif
+			/* the *2 is an approximation to the series 1 + 1/2 + 1/4 + ... that sums tree occupies in a flat array */
+			/*@@@ new_blocksize*2 is too pessimistic, but to fix, we need smarter logic because a smaller new_blocksize can actually increase the # of partitions; would require moving this out into a separate function, then checking its capacity against the need of the current blocksize&min/max_partition_order (and maybe predictor order) */
+			ok = ok && FLAC__memory_alloc_aligned_uint64_array(new_blocksize * 2, &scratch->abs_residual_partition_sums_unaligned, &scratch->abs_residual_partition_sums);
+			if(encoder->protected_->do_escape_coding)
+				ok = ok && FLAC__memory_alloc_aligned_unsigned_array(new_blocksize * 2, &scratch->raw_bits_per_partition_unaligned, &scratch->raw_bits_per_partition);
 		}
 	}
-	/* the *2 is an approximation to the series 1 + 1/2 + 1/4 + ... that sums tree occupies in a flat array */
-	/*@@@ new_blocksize*2 is too pessimistic, but to fix, we need smarter logic because a smaller new_blocksize can actually increase the # of partitions; would require moving this out into a separate function, then checking its capacity against the need of the current blocksize&min/max_partition_order (and maybe predictor order) */
-	ok = ok && FLAC__memory_alloc_aligned_uint64_array(new_blocksize * 2, &encoder->private_->abs_residual_partition_sums_unaligned, &encoder->private_->abs_residual_partition_sums);
-	if(encoder->protected_->do_escape_coding)
-		ok = ok && FLAC__memory_alloc_aligned_unsigned_array(new_blocksize * 2, &encoder->private_->raw_bits_per_partition_unaligned, &encoder->private_->raw_bits_per_partition);
 
 	/* now adjust the windows if the blocksize has changed */
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 	if(ok && new_blocksize != encoder->private_->input_capacity && encoder->protected_->max_lpc_order > 0) {
-		for(i = 0; ok && i < encoder->protected_->num_apodizations; i++) {
-			switch(encoder->protected_->apodizations[i].type) {
-				case FLAC__APODIZATION_BARTLETT:
-					FLAC__window_bartlett(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BARTLETT_HANN:
-					FLAC__window_bartlett_hann(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BLACKMAN:
-					FLAC__window_blackman(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_BLACKMAN_HARRIS_4TERM_92DB_SIDELOBE:
-					FLAC__window_blackman_harris_4term_92db_sidelobe(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_CONNES:
-					FLAC__window_connes(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_FLATTOP:
-					FLAC__window_flattop(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_GAUSS:
-					FLAC__window_gauss(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.gauss.stddev);
-					break;
-				case FLAC__APODIZATION_HAMMING:
-					FLAC__window_hamming(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_HANN:
-					FLAC__window_hann(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_KAISER_BESSEL:
-					FLAC__window_kaiser_bessel(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_NUTTALL:
-					FLAC__window_nuttall(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_RECTANGLE:
-					FLAC__window_rectangle(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_TRIANGLE:
-					FLAC__window_triangle(encoder->private_->window[i], new_blocksize);
-					break;
-				case FLAC__APODIZATION_TUKEY:
-					FLAC__window_tukey(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.tukey.p);
-					break;
-				case FLAC__APODIZATION_PARTIAL_TUKEY:
-					FLAC__window_partial_tukey(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.multiple_tukey.p, encoder->protected_->apodizations[i].parameters.multiple_tukey.start, encoder->protected_->apodizations[i].parameters.multiple_tukey.end);
-					break;
-				case FLAC__APODIZATION_PUNCHOUT_TUKEY:
-					FLAC__window_punchout_tukey(encoder->private_->window[i], new_blocksize, encoder->protected_->apodizations[i].parameters.multiple_tukey.p, encoder->protected_->apodizations[i].parameters.multiple_tukey.start, encoder->protected_->apodizations[i].parameters.multiple_tukey.end);
-					break;
-				case FLAC__APODIZATION_WELCH:
-					FLAC__window_welch(encoder->private_->window[i], new_blocksize);
-					break;
-				default:
-					FLAC__ASSERT(0);
-					/* double protection */
-					FLAC__window_hann(encoder->private_->window[i], new_blocksize);
-					break;
-			}
-		}
+		for(level = 0; level < encoder->private_->num_split_levels; level++)
+			for(i = 0; i < encoder->protected_->num_apodizations; i++)
+				compute_window_(encoder, i, encoder->private_->window[level][i], new_blocksize >> level);
 	}
 #endif
 
@@ -2540,44 +2901,120 @@ FLAC__bool resize_buffers_(FLAC__StreamEncoder *encoder, unsigned new_blocksize)
 	return ok;
 }
 
-FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, unsigned samples, FLAC__bool is_last_block)
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+void compute_window_(const FLAC__StreamEncoder *encoder, unsigned a, FLAC__real *window, unsigned blocksize)
+{
+	switch(encoder->protected_->apodizations[a].type) {
+		case FLAC__APODIZATION_BARTLETT:
+			FLAC__window_bartlett(window, blocksize);
+			break;
+		case FLAC__APODIZATION_BARTLETT_HANN:
+			FLAC__window_bartlett_hann(window, blocksize);
+			break;
+		case FLAC__APODIZATION_BLACKMAN:
+			FLAC__window_blackman(window, blocksize);
+			break;
+		case FLAC__APODIZATION_BLACKMAN_HARRIS_4TERM_92DB_SIDELOBE:
+			FLAC__window_blackman_harris_4term_92db_sidelobe(window, blocksize);
+			break;
+		case FLAC__APODIZATION_CONNES:
+			FLAC__window_connes(window, blocksize);
+			break;
+		case FLAC__APODIZATION_FLATTOP:
+			FLAC__window_flattop(window, blocksize);
+			break;
+		case FLAC__APODIZATION_GAUSS:
+			FLAC__window_gauss(window, blocksize, encoder->protected_->apodizations[a].parameters.gauss.stddev);
+			break;
+		case FLAC__APODIZATION_HAMMING:
+			FLAC__window_hamming(window, blocksize);
+			break;
+		case FLAC__APODIZATION_HANN:
+			FLAC__window_hann(window, blocksize);
+			break;
+		case FLAC__APODIZATION_KAISER_BESSEL:
+			FLAC__window_kaiser_bessel(window, blocksize);
+			break;
+		case FLAC__APODIZATION_NUTTALL:
+			FLAC__window_nuttall(window, blocksize);
+			break;
+		case FLAC__APODIZATION_RECTANGLE:
+			FLAC__window_rectangle(window, blocksize);
+			break;
+		case FLAC__APODIZATION_TRIANGLE:
+			FLAC__window_triangle(window, blocksize);
+			break;
+		case FLAC__APODIZATION_TUKEY:
+			FLAC__window_tukey(window, blocksize, encoder->protected_->apodizations[a].parameters.tukey.p);
+			break;
+		case FLAC__APODIZATION_PARTIAL_TUKEY:
+			FLAC__window_partial_tukey(window, blocksize, encoder->protected_->apodizations[a].parameters.multiple_tukey.p, encoder->protected_->apodizations[a].parameters.multiple_tukey.start, encoder->protected_->apodizations[a].parameters.multiple_tukey.end);
+			break;
+		case FLAC__APODIZATION_PUNCHOUT_TUKEY:
+			FLAC__window_punchout_tukey(window, blocksize, encoder->protected_->apodizations[a].parameters.multiple_tukey.p, encoder->protected_->apodizations[a].parameters.multiple_tukey.start, encoder->protected_->apodizations[a].parameters.multiple_tukey.end);
+			break;
+		case FLAC__APODIZATION_WELCH:
+			FLAC__window_welch(window, blocksize);
+			break;
+		default:
+			FLAC__ASSERT(0);
+			/* double protection */
+			FLAC__window_hann(window, blocksize);
+			break;
+	}
+}
+#endif
+
+FLAC__bool write_bitbuffer_(FLAC__StreamEncoder *encoder, FLAC__BitWriter *frame, unsigned samples, FLAC__bool is_last_block)
 {
 	const FLAC__byte *buffer;
 	size_t bytes;
 
-	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(encoder->private_->frame));
+	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(frame));
 
-	if(!FLAC__bitwriter_get_buffer(encoder->private_->frame, &buffer, &bytes)) {
+	if(!FLAC__bitwriter_get_buffer(frame, &buffer, &bytes)) {
 		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
 		return false;
 	}
 
 	if(encoder->protected_->verify) {
-		encoder->private_->verify.output.data = buffer;
-		encoder->private_->verify.output.bytes = bytes;
-		if(encoder->private_->verify.state_hint == ENCODER_IN_MAGIC) {
-			encoder->private_->verify.needs_magic_hack = true;
-		}
-		else {
-			if(!FLAC__stream_decoder_process_single(encoder->private_->verify.decoder)) {
-				FLAC__bitwriter_release_buffer(encoder->private_->frame);
-				FLAC__bitwriter_clear(encoder->private_->frame);
-				if(encoder->protected_->state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA)
-					encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+#ifdef HAVE_PTHREAD
+		if(encoder->private_->verify.thread.started) {
+			if(!queue_verify_bytes_(encoder, buffer, bytes, /*is_frame=*/samples > 0)) {
+				FLAC__bitwriter_release_buffer(frame);
+				FLAC__bitwriter_clear(frame);
 				return false;
 			}
 		}
+		else
+#endif
+		{
+			encoder->private_->verify.output.data = buffer;
+			encoder->private_->verify.output.bytes = bytes;
+			if(encoder->private_->verify.state_hint == ENCODER_IN_MAGIC) {
+				encoder->private_->verify.needs_magic_hack = true;
+			}
+			else {
+				if(!FLAC__stream_decoder_process_single(encoder->private_->verify.decoder)) {
+					FLAC__bitwriter_release_buffer(frame);
+					FLAC__bitwriter_clear(frame);
+					if(encoder->protected_->state != FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA)
+						encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+					return false;
+				}
+			}
+		}
 	}
 
 	if(write_frame_(encoder, buffer, bytes, samples, is_last_block) != FLAC__STREAM_ENCODER_WRITE_STATUS_OK) {
-		FLAC__bitwriter_release_buffer(encoder->private_->frame);
-		FLAC__bitwriter_clear(encoder->private_->frame);
+		FLAC__bitwriter_release_buffer(frame);
+		FLAC__bitwriter_clear(frame);
 		encoder->protected_->state = FLAC__STREAM_ENCODER_CLIENT_ERROR;
 		return false;
 	}
 
-	FLAC__bitwriter_release_buffer(encoder->private_->frame);
-	FLAC__bitwriter_clear(encoder->private_->frame);
+	FLAC__bitwriter_release_buffer(frame);
+	FLAC__bitwriter_clear(frame);
 
 	if(samples > 0) {
 		encoder->private_->streaminfo.data.stream_info.min_framesize = flac_min(bytes, encoder->private_->streaminfo.data.stream_info.min_framesize);
@@ -2619,9 +3056,8 @@ FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const
 	 * frame yet)
 	 */
 	if(0 != encoder->private_->seek_table && encoder->protected_->audio_offset > 0 && encoder->private_->seek_table->num_points > 0) {
-		const unsigned blocksize = FLAC__stream_encoder_get_blocksize(encoder);
 		const FLAC__uint64 frame_first_sample = encoder->private_->samples_written;
-		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)blocksize - 1;
+		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)samples - 1;
 		FLAC__uint64 test_sample;
 		unsigned i;
 		for(i = encoder->private_->first_seekpoint_to_check; i < encoder->private_->seek_table->num_points; i++) {
@@ -2632,7 +3068,7 @@ FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const
 			else if(test_sample >= frame_first_sample) {
 				encoder->private_->seek_table->points[i].sample_number = frame_first_sample;
 				encoder->private_->seek_table->points[i].stream_offset = output_position - encoder->protected_->audio_offset;
-				encoder->private_->seek_table->points[i].frame_samples = blocksize;
+				encoder->private_->seek_table->points[i].frame_samples = samples;
 				encoder->private_->first_seekpoint_to_check++;
 				/* DO NOT: "break;" and here's why:
 				 * The seektable template may contain more than one target
@@ -2683,9 +3119,11 @@ FLAC__StreamEncoderWriteStatus write_frame_(FLAC__StreamEncoder *encoder, const
 /* Gets called when the encoding process has finished so that we can update the STREAMINFO and SEEKTABLE blocks.  */
 void update_metadata_(const FLAC__StreamEncoder *encoder)
 {
-	FLAC__byte b[flac_max(6u, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)];
+	FLAC__byte b[flac_max(10u, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)];
 	const FLAC__StreamMetadata *metadata = &encoder->private_->streaminfo;
 	const FLAC__uint64 samples = metadata->data.stream_info.total_samples;
+	const unsigned min_blocksize = metadata->data.stream_info.min_blocksize;
+	const unsigned max_blocksize = metadata->data.stream_info.max_blocksize;
 	const unsigned min_framesize = metadata->data.stream_info.min_framesize;
 	const unsigned max_framesize = metadata->data.stream_info.max_framesize;
 	const unsigned bps = metadata->data.stream_info.bits_per_sample;
@@ -2760,28 +3198,27 @@ void update_metadata_(const FLAC__StreamEncoder *encoder)
 	}
 
 	/*
-	 * Write min/max framesize
+	 * Write min/max blocksize (which only changes with variable blocksize) and min/max framesize
 	 */
 	{
-		const unsigned min_framesize_offset =
-			FLAC__STREAM_METADATA_HEADER_LENGTH +
-			(
-				FLAC__STREAM_METADATA_STREAMINFO_MIN_BLOCK_SIZE_LEN +
-				FLAC__STREAM_METADATA_STREAMINFO_MAX_BLOCK_SIZE_LEN
-			) / 8;
-
-		b[0] = (FLAC__byte)((min_framesize >> 16) & 0xFF);
-		b[1] = (FLAC__byte)((min_framesize >> 8) & 0xFF);
-		b[2] = (FLAC__byte)(min_framesize & 0xFF);
-		b[3] = (FLAC__byte)((max_framesize >> 16) & 0xFF);
-		b[4] = (FLAC__byte)((max_framesize >> 8) & 0xFF);
-		b[5] = (FLAC__byte)(max_framesize & 0xFF);
-		if((seek_status = encoder->private_->seek_callback(encoder, encoder->protected_->streaminfo_offset + min_framesize_offset, encoder->private_->client_data)) != FLAC__STREAM_ENCODER_SEEK_STATUS_OK) {
+		const unsigned min_blocksize_offset = FLAC__STREAM_METADATA_HEADER_LENGTH;
+
+		b[0] = (FLAC__byte)((min_blocksize >> 8) & 0xFF);
+		b[1] = (FLAC__byte)(min_blocksize & 0xFF);
+		b[2] = (FLAC__byte)((max_blocksize >> 8) & 0xFF);
+		b[3] = (FLAC__byte)(max_blocksize & 0xFF);
+		b[4] = (FLAC__byte)((min_framesize >> 16) & 0xFF);
+		b[5] = (FLAC__byte)((min_framesize >> 8) & 0xFF);
+		b[6] = (FLAC__byte)(min_framesize & 0xFF);
+		b[7] = (FLAC__byte)((max_framesize >> 16) & 0xFF);
+		b[8] = (FLAC__byte)((max_framesize >> 8) & 0xFF);
+		b[9] = (FLAC__byte)(max_framesize & 0xFF);
+		if((seek_status = encoder->private_->seek_callback(encoder, encoder->protected_->streaminfo_offset + min_blocksize_offset, encoder->private_->client_data)) != FLAC__STREAM_ENCODER_SEEK_STATUS_OK) {
 			if(seek_status == FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR)
 				encoder->protected_->state = FLAC__STREAM_ENCODER_CLIENT_ERROR;
 			return;
 		}
-		if(encoder->private_->write_callback(encoder, b, 6, 0, 0, encoder->private_->client_data) != FLAC__STREAM_ENCODER_WRITE_STATUS_OK) {
+		if(encoder->private_->write_callback(encoder, b, 10, 0, 0, encoder->private_->client_data) != FLAC__STREAM_ENCODER_WRITE_STATUS_OK) {
 			encoder->protected_->state = FLAC__STREAM_ENCODER_CLIENT_ERROR;
 			return;
 		}
@@ -2848,9 +3285,11 @@ void update_ogg_metadata_(FLAC__StreamEncoder *encoder)
 		FLAC__OGG_MAPPING_NUM_HEADERS_LENGTH +
 		FLAC__STREAM_SYNC_LENGTH
 	;
-	FLAC__byte b[flac_max(6u, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)];
+	FLAC__byte b[flac_max(10u, FLAC__STREAM_METADATA_SEEKPOINT_LENGTH)];
 	const FLAC__StreamMetadata *metadata = &encoder->private_->streaminfo;
 	const FLAC__uint64 samples = metadata->data.stream_info.total_samples;
+	const unsigned min_blocksize = metadata->data.stream_info.min_blocksize;
+	const unsigned max_blocksize = metadata->data.stream_info.max_blocksize;
 	const unsigned min_framesize = metadata->data.stream_info.min_framesize;
 	const unsigned max_framesize = metadata->data.stream_info.max_framesize;
 	ogg_page page;
@@ -2937,29 +3376,29 @@ void update_ogg_metadata_(FLAC__StreamEncoder *encoder)
 	}
 
 	/*
-	 * Write min/max framesize
+	 * Write min/max blocksize (which only changes with variable blocksize) and min/max framesize
 	 */
 	{
-		const unsigned min_framesize_offset =
+		const unsigned min_blocksize_offset =
 			FIRST_OGG_PACKET_STREAMINFO_PREFIX_LENGTH +
-			FLAC__STREAM_METADATA_HEADER_LENGTH +
-			(
-				FLAC__STREAM_METADATA_STREAMINFO_MIN_BLOCK_SIZE_LEN +
-				FLAC__STREAM_METADATA_STREAMINFO_MAX_BLOCK_SIZE_LEN
-			) / 8;
+			FLAC__STREAM_METADATA_HEADER_LENGTH;
 
-		if(min_framesize_offset + 6 > (unsigned)page.body_len) {
+		if(min_blocksize_offset + 10 > (unsigned)page.body_len) {
 			encoder->protected_->state = FLAC__STREAM_ENCODER_OGG_ERROR;
 			simple_ogg_page__clear(&page);
 			return;
 		}
-		b[0] = (FLAC__byte)((min_framesize >> 16) & 0xFF);
-		b[1] = (FLAC__byte)((min_framesize >> 8) & 0xFF);
-		b[2] = (FLAC__byte)(min_framesize & 0xFF);
-		b[3] = (FLAC__byte)((max_framesize >> 16) & 0xFF);
-		b[4] = (FLAC__byte)((max_framesize >> 8) & 0xFF);
-		b[5] = (FLAC__byte)(max_framesize & 0xFF);
-		memcpy(page.body + min_framesize_offset, b, 6);
+		b[0] = (FLAC__byte)((min_blocksize >> 8) & 0xFF);
+		b[1] = (FLAC__byte)(min_blocksize & 0xFF);
+		b[2] = (FLAC__byte)((max_blocksize >> 8) & 0xFF);
+		b[3] = (FLAC__byte)(max_blocksize & 0xFF);
+		b[4] = (FLAC__byte)((min_framesize >> 16) & 0xFF);
+		b[5] = (FLAC__byte)((min_framesize >> 8) & 0xFF);
+		b[6] = (FLAC__byte)(min_framesize & 0xFF);
+		b[7] = (FLAC__byte)((max_framesize >> 16) & 0xFF);
+		b[8] = (FLAC__byte)((max_framesize >> 8) & 0xFF);
+		b[9] = (FLAC__byte)(max_framesize & 0xFF);
+		memcpy(page.body + min_blocksize_offset, b, 10);
 	}
 	if(!simple_ogg_page__set_at(encoder, encoder->protected_->streaminfo_offset, &page, encoder->private_->seek_callback, encoder->private_->write_callback, encoder->private_->client_data)) {
 		simple_ogg_page__clear(&page);
@@ -3028,49 +3467,60 @@ void update_ogg_metadata_(FLAC__StreamEncoder *encoder)
 
 FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block, FLAC__bool is_last_block)
 {
-	FLAC__uint16 crc;
+	FLAC__StreamEncoderThreadTask *task = encoder->private_->threadtask[encoder->private_->current_threadtask];
+
 	FLAC__ASSERT(encoder->protected_->state == FLAC__STREAM_ENCODER_OK);
 
 	/*
 	 * Accumulate raw signal to the MD5 signature
 	 */
-	if(encoder->protected_->do_md5 && !FLAC__MD5Accumulate(&encoder->private_->md5context, (const FLAC__int32 * const *)encoder->private_->integer_signal, encoder->protected_->channels, encoder->protected_->blocksize, (encoder->protected_->bits_per_sample+7) / 8)) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-		return false;
-	}
-
-	/*
-	 * Process the frame header and subframes into the frame bitbuffer
-	 */
-	if(!process_subframes_(encoder, is_fractional_block)) {
-		/* the above function sets the state for us in case of an error */
-		return false;
+	if(encoder->protected_->do_md5) {
+		FLAC__bool ok;
+#ifdef HAVE_PTHREAD
+		if(encoder->private_->md5pipeline.started)
+			ok = FLAC__MD5PipelineAccumulate(&encoder->private_->md5pipeline, (const FLAC__int32 * const *)task->integer_signal, encoder->protected_->channels, encoder->protected_->blocksize, (encoder->protected_->bits_per_sample+7) / 8);
+		else
+#endif
+		ok = FLAC__MD5Accumulate(&encoder->private_->md5context, (const FLAC__int32 * const *)task->integer_signal, encoder->protected_->channels, encoder->protected_->blocksize, (encoder->protected_->bits_per_sample+7) / 8);
+		if(!ok) {
+			encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
 	}
 
+#ifdef HAVE_PTHREAD
 	/*
-	 * Zero-pad the frame to a byte_boundary
+	 * Hand full blocks to the worker threads; they are written out in
+	 * order as they finish.  The last block is only encoded after all
+	 * others have been written; see FLAC__stream_encoder_finish().
 	 */
-	if(!FLAC__bitwriter_zero_pad_to_byte_boundary(encoder->private_->frame)) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
-		return false;
+	if(encoder->private_->num_threadtasks > 1 && !is_last_block) {
+		FLAC__ASSERT(encoder->private_->threads_started);
+		FLAC__ASSERT(!is_fractional_block);
+		task->sample_number = encoder->private_->streaminfo.data.stream_info.total_samples;
+		if(!queue_threadtask_(encoder, task))
+			return false;
+		encoder->private_->current_sample_number = 0;
+		encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)encoder->protected_->blocksize;
+		return true;
 	}
+	FLAC__ASSERT(encoder->private_->num_threadtasks_in_flight == 0);
+#endif
 
 	/*
-	 * CRC-16 the whole thing
+	 * Process the frame header and subframes into the frame bitbuffer
 	 */
-	FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(encoder->private_->frame));
-	if(
-		!FLAC__bitwriter_get_write_crc16(encoder->private_->frame, &crc) ||
-		!FLAC__bitwriter_write_raw_uint32(encoder->private_->frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)
-	) {
-		encoder->protected_->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+	task->frame_number = encoder->private_->current_frame_number;
+	task->sample_number = encoder->private_->streaminfo.data.stream_info.total_samples;
+	if(!encode_frame_(encoder, task, is_fractional_block)) {
+		encoder->protected_->state = task->state;
 		return false;
 	}
 
 	/*
 	 * Write it
 	 */
-	if(!write_bitbuffer_(encoder, encoder->protected_->blocksize, is_last_block)) {
+	if(!write_threadtask_frames_(encoder, task, is_last_block)) {
 		/* the above function sets the state for us in case of an error */
 		return false;
 	}
@@ -3079,16 +3529,198 @@ FLAC__bool process_frame_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional
 	 * Get ready for the next frame
 	 */
 	encoder->private_->current_sample_number = 0;
-	encoder->private_->current_frame_number++;
 	encoder->private_->streaminfo.data.stream_info.total_samples += (FLAC__uint64)encoder->protected_->blocksize;
 
 	return true;
 }
 
-FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fractional_block)
+/* Encodes the block in task into one frame, or with variable blocksize
+ * possibly into several; see choose_split_nodes_().  The whole split
+ * tree is only tried where block_has_transient_() finds a reason to;
+ * otherwise, when merging, just the merged frame and the two blocks
+ * it is made of are.  The frames to be written out are left in
+ * task->chosen_node[].
+ */
+FLAC__bool encode_frame_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_fractional_block)
+{
+	FLAC__uint16 crc;
+	unsigned node, num_levels = 1;
+
+	if(!is_fractional_block && encoder->private_->num_split_levels > 1) {
+		if(block_has_transient_(encoder, task, encoder->private_->num_split_levels))
+			num_levels = encoder->private_->num_split_levels;
+		else if(encoder->private_->merge_blocks)
+			num_levels = 2;
+	}
+
+	for(node = 0; node < (1u << num_levels) - 1; node++) {
+		FLAC__BitWriter *frame = task->frame[node];
+
+		FLAC__bitwriter_clear(frame);
+		task->split_node = node;
+
+		/*
+		 * Process the frame header and subframes into the frame bitbuffer
+		 */
+		if(!process_subframes_(encoder, task, is_fractional_block)) {
+			/* the above function sets the task state for us in case of an error */
+			return false;
+		}
+
+		/*
+		 * Zero-pad the frame to a byte_boundary
+		 */
+		if(!FLAC__bitwriter_zero_pad_to_byte_boundary(frame)) {
+			task->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+
+		/*
+		 * CRC-16 the whole thing
+		 */
+		FLAC__ASSERT(FLAC__bitwriter_is_byte_aligned(frame));
+		if(
+			!FLAC__bitwriter_get_write_crc16(frame, &crc) ||
+			!FLAC__bitwriter_write_raw_uint32(frame, crc, FLAC__FRAME_FOOTER_CRC_LEN)
+		) {
+			task->state = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+			return false;
+		}
+	}
+
+	if(num_levels > 1)
+		choose_split_nodes_(task, num_levels);
+	else {
+		task->chosen_node[0] = 0;
+		task->num_chosen_nodes = 1;
+	}
+
+	return true;
+}
+
+/* A cheap transient detector.  The block is cut into as many parts as
+ * the deepest split would give, and the sum of the absolute differences
+ * between neighbouring samples over all channels, a rough measure of
+ * the high frequency energy, is compared between parts.  A big jump
+ * means one predictor will not fit the whole block well.
+ */
+FLAC__bool block_has_transient_(const FLAC__StreamEncoder *encoder, const FLAC__StreamEncoderThreadTask *task, unsigned num_levels)
+{
+	const unsigned num_parts = 1u << (num_levels - 1);
+	const unsigned part_size = encoder->protected_->blocksize >> (num_levels - 1);
+	FLAC__uint64 energy[1u << (SPLIT_LEVELS_-1)];
+	unsigned channel, part, i;
+
+	FLAC__ASSERT(num_levels > 1 && num_levels <= SPLIT_LEVELS_);
+
+	/* start each sum at one per sample so near silence does not count */
+	for(part = 0; part < num_parts; part++)
+		energy[part] = part_size;
+
+	for(channel = 0; channel < encoder->protected_->channels; channel++) {
+		const FLAC__int32 *signal = task->integer_signal[channel];
+		for(part = 0; part < num_parts; part++) {
+			FLAC__uint64 sum = 0;
+			for(i = flac_max(part * part_size, 1u); i < (part + 1) * part_size; i++) {
+				const FLAC__int64 d = (FLAC__int64)signal[i] - signal[i-1];
+				sum += (FLAC__uint64)(d < 0? -d : d);
+			}
+			energy[part] += sum;
+		}
+	}
+
+	for(part = 1; part < num_parts; part++) {
+		if(energy[part] > TRANSIENT_RATIO_ * energy[part-1] || energy[part-1] > TRANSIENT_RATIO_ * energy[part])
+			return true;
+	}
+	return false;
+}
+
+/* Picks the frames that code the block in the fewest bits, working up
+ * from the smallest: a node is replaced by its two halves if they come
+ * out smaller together, otherwise the larger frame is kept.  The sizes
+ * are of the whole serialized frames, so the header, footer and padding
+ * each extra frame costs are counted against it.
+ */
+void choose_split_nodes_(FLAC__StreamEncoderThreadTask *task, unsigned num_levels)
+{
+	const unsigned num_nodes = (1u << num_levels) - 1;
+	unsigned bits[SPLIT_NODES_];
+	FLAC__bool split[SPLIT_NODES_];
+	unsigned node;
+
+	for(node = num_nodes; node-- > 0; ) {
+		bits[node] = FLAC__bitwriter_get_input_bits_unconsumed(task->frame[node]);
+		split[node] = false;
+		if(2*node+2 < num_nodes && bits[2*node+1] + bits[2*node+2] < bits[node]) {
+			bits[node] = bits[2*node+1] + bits[2*node+2];
+			split[node] = true;
+		}
+	}
+
+	/* walk the chosen leaves in order */
+	task->num_chosen_nodes = 0;
+	node = 0;
+	for(;;) {
+		while(split[node])
+			node = 2*node+1;
+		task->chosen_node[task->num_chosen_nodes++] = node;
+		/* up past the nodes this one is the second half of, then over to the second half */
+		while(node > 0 && node % 2 == 0)
+			node = (node-1) / 2;
+		if(node == 0)
+			break;
+		node++;
+	}
+}
+
+/* Writes out the frames chosen for the block in task, in order, and
+ * does the bookkeeping that has to follow the order of the stream.
+ */
+FLAC__bool write_threadtask_frames_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_last_block)
+{
+	unsigned i;
+
+	for(i = 0; i < task->num_chosen_nodes; i++) {
+		const unsigned node = task->chosen_node[i];
+		const unsigned blocksize = encoder->protected_->blocksize >> split_level_(node);
+		const FLAC__bool is_last_frame = is_last_block && i == task->num_chosen_nodes - 1;
+
+		FLAC__ASSERT(encoder->private_->num_split_levels > 1 || task->frame_number == encoder->private_->current_frame_number);
+		if(!write_bitbuffer_(encoder, task->frame[node], blocksize, is_last_frame)) {
+			/* the above function sets the state for us in case of an error */
+			return false;
+		}
+
+		/* only the last frame may be smaller than the STREAMINFO min blocksize; the max blocksize must cover every frame */
+		if(encoder->private_->num_split_levels > 1) {
+			if(!is_last_frame)
+				encoder->private_->streaminfo.data.stream_info.min_blocksize = flac_min(blocksize, encoder->private_->streaminfo.data.stream_info.min_blocksize);
+			encoder->private_->streaminfo.data.stream_info.max_blocksize = flac_max(blocksize, encoder->private_->streaminfo.data.stream_info.max_blocksize);
+		}
+
+		/* loose mid-side stereo is never used with frames in flight, so this stays in step with the encoding */
+		if(encoder->protected_->loose_mid_side_stereo) {
+			encoder->private_->loose_mid_side_stereo_frame_count++;
+			if(encoder->private_->loose_mid_side_stereo_frame_count >= encoder->private_->loose_mid_side_stereo_frames)
+				encoder->private_->loose_mid_side_stereo_frame_count = 0;
+			encoder->private_->last_channel_assignment = task->channel_assignment[node];
+		}
+
+		encoder->private_->current_frame_number++;
+	}
+
+	return true;
+}
+
+FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task, FLAC__bool is_fractional_block)
 {
 	FLAC__FrameHeader frame_header;
+	FLAC__BitWriter *frame = task->frame[task->split_node];
+	const unsigned blocksize = encoder->protected_->blocksize >> split_level_(task->split_node);
+	const unsigned offset = split_offset_(task->split_node, encoder->protected_->blocksize);
 	unsigned channel, min_partition_order = encoder->protected_->min_residual_partition_order, max_partition_order;
+	unsigned i, job[FLAC__MAX_CHANNELS+2], num_jobs;
 	FLAC__bool do_independent, do_mid_side;
 
 	/*
@@ -3098,7 +3730,7 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 		max_partition_order = 0;
 	}
 	else {
-		max_partition_order = FLAC__format_get_max_rice_partition_order_from_blocksize(encoder->protected_->blocksize);
+		max_partition_order = FLAC__format_get_max_rice_partition_order_from_blocksize(blocksize);
 		max_partition_order = flac_min(max_partition_order, encoder->protected_->max_residual_partition_order);
 	}
 	min_partition_order = flac_min(min_partition_order, max_partition_order);
@@ -3106,13 +3738,20 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	/*
 	 * Setup the frame
 	 */
-	frame_header.blocksize = encoder->protected_->blocksize;
+	frame_header.blocksize = blocksize;
 	frame_header.sample_rate = encoder->protected_->sample_rate;
 	frame_header.channels = encoder->protected_->channels;
 	frame_header.channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT; /* the default unless the encoder determines otherwise */
 	frame_header.bits_per_sample = encoder->protected_->bits_per_sample;
-	frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
-	frame_header.number.frame_number = encoder->private_->current_frame_number;
+	if(encoder->private_->num_split_levels > 1) {
+		/* variable blocksize streams must number their frames by sample */
+		frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER;
+		frame_header.number.sample_number = task->sample_number + offset;
+	}
+	else {
+		frame_header.number_type = FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER;
+		frame_header.number.frame_number = task->frame_number;
+	}
 
 	/*
 	 * Figure out what channel assignments to try
@@ -3145,66 +3784,45 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 	 */
 	if(do_independent) {
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			const unsigned w = get_wasted_bits_(encoder->private_->integer_signal[channel], encoder->protected_->blocksize);
-			encoder->private_->subframe_workspace[channel][0].wasted_bits = encoder->private_->subframe_workspace[channel][1].wasted_bits = w;
-			encoder->private_->subframe_bps[channel] = encoder->protected_->bits_per_sample - w;
+			const unsigned w = get_wasted_bits_(task->integer_signal[channel]+offset, blocksize);
+			task->subframe_workspace[channel][0].wasted_bits = task->subframe_workspace[channel][1].wasted_bits = w;
+			task->subframe_bps[channel] = encoder->protected_->bits_per_sample - w;
 		}
 	}
 	if(do_mid_side) {
 		FLAC__ASSERT(encoder->protected_->channels == 2);
 		for(channel = 0; channel < 2; channel++) {
-			const unsigned w = get_wasted_bits_(encoder->private_->integer_signal_mid_side[channel], encoder->protected_->blocksize);
-			encoder->private_->subframe_workspace_mid_side[channel][0].wasted_bits = encoder->private_->subframe_workspace_mid_side[channel][1].wasted_bits = w;
-			encoder->private_->subframe_bps_mid_side[channel] = encoder->protected_->bits_per_sample - w + (channel==0? 0:1);
+			const unsigned w = get_wasted_bits_(task->integer_signal_mid_side[channel]+offset, blocksize);
+			task->subframe_workspace_mid_side[channel][0].wasted_bits = task->subframe_workspace_mid_side[channel][1].wasted_bits = w;
+			task->subframe_bps_mid_side[channel] = encoder->protected_->bits_per_sample - w + (channel==0? 0:1);
 		}
 	}
 
 	/*
-	 * First do a normal encoding pass of each independent channel
+	 * Search for the best subframe of each independent channel, then of
+	 * the mid and side channels if requested
 	 */
+	num_jobs = 0;
 	if(do_independent) {
-		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			if(!
-				process_subframe_(
-					encoder,
-					min_partition_order,
-					max_partition_order,
-					&frame_header,
-					encoder->private_->subframe_bps[channel],
-					encoder->private_->integer_signal[channel],
-					encoder->private_->subframe_workspace_ptr[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr[channel],
-					encoder->private_->residual_workspace[channel],
-					encoder->private_->best_subframe+channel,
-					encoder->private_->best_subframe_bits+channel
-				)
-			)
-				return false;
-		}
+		for(channel = 0; channel < encoder->protected_->channels; channel++)
+			job[num_jobs++] = channel;
 	}
-
-	/*
-	 * Now do mid and side channels if requested
-	 */
 	if(do_mid_side) {
 		FLAC__ASSERT(encoder->protected_->channels == 2);
+		for(channel = 0; channel < 2; channel++)
+			job[num_jobs++] = encoder->protected_->channels + channel;
+	}
 
-		for(channel = 0; channel < 2; channel++) {
-			if(!
-				process_subframe_(
-					encoder,
-					min_partition_order,
-					max_partition_order,
-					&frame_header,
-					encoder->private_->subframe_bps_mid_side[channel],
-					encoder->private_->integer_signal_mid_side[channel],
-					encoder->private_->subframe_workspace_ptr_mid_side[channel],
-					encoder->private_->partitioned_rice_contents_workspace_ptr_mid_side[channel],
-					encoder->private_->residual_workspace_mid_side[channel],
-					encoder->private_->best_subframe_mid_side+channel,
-					encoder->private_->best_subframe_bits_mid_side+channel
-				)
-			)
+#ifdef HAVE_PTHREAD
+	if(task->num_scratch > 1) {
+		if(!process_subframe_jobs_in_parallel_(encoder, task, job, num_jobs, min_partition_order, max_partition_order, &frame_header))
+			return false;
+	}
+	else
+#endif
+	{
+		for(i = 0; i < num_jobs; i++) {
+			if(!process_subframe_job_(encoder, task, job[i], min_partition_order, max_partition_order, &frame_header))
 				return false;
 		}
 	}
@@ -3234,10 +3852,10 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 			FLAC__ASSERT(do_independent && do_mid_side);
 
 			/* We have to figure out which channel assignent results in the smallest frame */
-			bits[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = encoder->private_->best_subframe_bits         [0] + encoder->private_->best_subframe_bits         [1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE  ] = encoder->private_->best_subframe_bits         [0] + encoder->private_->best_subframe_bits_mid_side[1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE ] = encoder->private_->best_subframe_bits         [1] + encoder->private_->best_subframe_bits_mid_side[1];
-			bits[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE   ] = encoder->private_->best_subframe_bits_mid_side[0] + encoder->private_->best_subframe_bits_mid_side[1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT] = task->best_subframe_bits         [0] + task->best_subframe_bits         [1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE  ] = task->best_subframe_bits         [0] + task->best_subframe_bits_mid_side[1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE ] = task->best_subframe_bits         [1] + task->best_subframe_bits_mid_side[1];
+			bits[FLAC__CHANNEL_ASSIGNMENT_MID_SIDE   ] = task->best_subframe_bits_mid_side[0] + task->best_subframe_bits_mid_side[1];
 
 			channel_assignment = FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT;
 			min_bits = bits[channel_assignment];
@@ -3251,27 +3869,27 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 
 		frame_header.channel_assignment = channel_assignment;
 
-		if(!FLAC__frame_add_header(&frame_header, encoder->private_->frame)) {
-			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+		if(!FLAC__frame_add_header(&frame_header, frame)) {
+			task->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return false;
 		}
 
 		switch(channel_assignment) {
 			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
-				left_subframe  = &encoder->private_->subframe_workspace         [0][encoder->private_->best_subframe         [0]];
-				right_subframe = &encoder->private_->subframe_workspace         [1][encoder->private_->best_subframe         [1]];
+				left_subframe  = &task->subframe_workspace         [0][task->best_subframe         [0]];
+				right_subframe = &task->subframe_workspace         [1][task->best_subframe         [1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace         [0][encoder->private_->best_subframe         [0]];
-				right_subframe = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
+				left_subframe  = &task->subframe_workspace         [0][task->best_subframe         [0]];
+				right_subframe = &task->subframe_workspace_mid_side[1][task->best_subframe_mid_side[1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
-				right_subframe = &encoder->private_->subframe_workspace         [1][encoder->private_->best_subframe         [1]];
+				left_subframe  = &task->subframe_workspace_mid_side[1][task->best_subframe_mid_side[1]];
+				right_subframe = &task->subframe_workspace         [1][task->best_subframe         [1]];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-				left_subframe  = &encoder->private_->subframe_workspace_mid_side[0][encoder->private_->best_subframe_mid_side[0]];
-				right_subframe = &encoder->private_->subframe_workspace_mid_side[1][encoder->private_->best_subframe_mid_side[1]];
+				left_subframe  = &task->subframe_workspace_mid_side[0][task->best_subframe_mid_side[0]];
+				right_subframe = &task->subframe_workspace_mid_side[1][task->best_subframe_mid_side[1]];
 				break;
 			default:
 				FLAC__ASSERT(0);
@@ -3279,61 +3897,120 @@ FLAC__bool process_subframes_(FLAC__StreamEncoder *encoder, FLAC__bool is_fracti
 
 		switch(channel_assignment) {
 			case FLAC__CHANNEL_ASSIGNMENT_INDEPENDENT:
-				left_bps  = encoder->private_->subframe_bps         [0];
-				right_bps = encoder->private_->subframe_bps         [1];
+				left_bps  = task->subframe_bps         [0];
+				right_bps = task->subframe_bps         [1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_LEFT_SIDE:
-				left_bps  = encoder->private_->subframe_bps         [0];
-				right_bps = encoder->private_->subframe_bps_mid_side[1];
+				left_bps  = task->subframe_bps         [0];
+				right_bps = task->subframe_bps_mid_side[1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_RIGHT_SIDE:
-				left_bps  = encoder->private_->subframe_bps_mid_side[1];
-				right_bps = encoder->private_->subframe_bps         [1];
+				left_bps  = task->subframe_bps_mid_side[1];
+				right_bps = task->subframe_bps         [1];
 				break;
 			case FLAC__CHANNEL_ASSIGNMENT_MID_SIDE:
-				left_bps  = encoder->private_->subframe_bps_mid_side[0];
-				right_bps = encoder->private_->subframe_bps_mid_side[1];
+				left_bps  = task->subframe_bps_mid_side[0];
+				right_bps = task->subframe_bps_mid_side[1];
 				break;
 			default:
 				FLAC__ASSERT(0);
 		}
 
-		/* note that encoder_add_subframe_ sets the state for us in case of an error */
-		if(!add_subframe_(encoder, frame_header.blocksize, left_bps , left_subframe , encoder->private_->frame))
-			return false;
-		if(!add_subframe_(encoder, frame_header.blocksize, right_bps, right_subframe, encoder->private_->frame))
+		if(
+			!add_subframe_(frame_header.blocksize, left_bps , left_subframe , frame) ||
+			!add_subframe_(frame_header.blocksize, right_bps, right_subframe, frame)
+		) {
+			task->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return false;
+		}
 	}
 	else {
-		if(!FLAC__frame_add_header(&frame_header, encoder->private_->frame)) {
-			encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+		if(!FLAC__frame_add_header(&frame_header, frame)) {
+			task->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 			return false;
 		}
 
 		for(channel = 0; channel < encoder->protected_->channels; channel++) {
-			if(!add_subframe_(encoder, frame_header.blocksize, encoder->private_->subframe_bps[channel], &encoder->private_->subframe_workspace[channel][encoder->private_->best_subframe[channel]], encoder->private_->frame)) {
-				/* the above function sets the state for us in case of an error */
+			if(!add_subframe_(frame_header.blocksize, task->subframe_bps[channel], &task->subframe_workspace[channel][task->best_subframe[channel]], frame)) {
+				task->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
 				return false;
 			}
 		}
 	}
 
-	if(encoder->protected_->loose_mid_side_stereo) {
-		encoder->private_->loose_mid_side_stereo_frame_count++;
-		if(encoder->private_->loose_mid_side_stereo_frame_count >= encoder->private_->loose_mid_side_stereo_frames)
-			encoder->private_->loose_mid_side_stereo_frame_count = 0;
-	}
-
-	encoder->private_->last_channel_assignment = frame_header.channel_assignment;
+	/* the loose mid-side stereo state is updated when the frame is written */
+	task->channel_assignment[task->split_node] = frame_header.channel_assignment;
 
 	return true;
 }
 
+/* Searches for the best subframe of independent channel 'job', or if
+ * job >= channels, of the mid (job == channels) or side channel.  With
+ * parallel subframes each job has its own scratch space, so different
+ * jobs of the same task can be run at the same time.
+ */
+FLAC__bool process_subframe_job_(
+	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *task,
+	unsigned job,
+	unsigned min_partition_order,
+	unsigned max_partition_order,
+	const FLAC__FrameHeader *frame_header
+)
+{
+	FLAC__StreamEncoderSubframeScratch *scratch = task->scratch[task->num_scratch > 1? job : 0];
+	const unsigned channels = encoder->protected_->channels;
+	const unsigned split_level = split_level_(task->split_node);
+	const unsigned offset = split_offset_(task->split_node, encoder->protected_->blocksize);
+
+	FLAC__ASSERT(job < task->num_scratch || task->num_scratch == 1);
+
+	if(job < channels) {
+		return process_subframe_(
+			encoder,
+			scratch,
+			min_partition_order,
+			max_partition_order,
+			frame_header,
+			split_level,
+			task->subframe_bps[job],
+			task->integer_signal[job]+offset,
+			task->subframe_workspace_ptr[job],
+			task->partitioned_rice_contents_workspace_ptr[job],
+			task->residual_workspace[job],
+			task->best_subframe+job,
+			task->best_subframe_bits+job
+		);
+	}
+	else {
+		const unsigned channel = job - channels;
+		FLAC__ASSERT(channels == 2);
+		FLAC__ASSERT(channel < 2);
+		return process_subframe_(
+			encoder,
+			scratch,
+			min_partition_order,
+			max_partition_order,
+			frame_header,
+			split_level,
+			task->subframe_bps_mid_side[channel],
+			task->integer_signal_mid_side[channel]+offset,
+			task->subframe_workspace_ptr_mid_side[channel],
+			task->partitioned_rice_contents_workspace_ptr_mid_side[channel],
+			task->residual_workspace_mid_side[channel],
+			task->best_subframe_mid_side+channel,
+			task->best_subframe_bits_mid_side+channel
+		);
+	}
+}
+
 FLAC__bool process_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	unsigned min_partition_order,
 	unsigned max_partition_order,
 	const FLAC__FrameHeader *frame_header,
+	unsigned split_level,
 	unsigned subframe_bps,
 	const FLAC__int32 integer_signal[],
 	FLAC__Subframe *subframe[2],
@@ -3362,6 +4039,10 @@ FLAC__bool process_subframe_(
 	/* only use RICE2 partitions if stream bps > 16 */
 	const unsigned rice_parameter_limit = FLAC__stream_encoder_get_bits_per_sample(encoder) > 16? FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2_ESCAPE_PARAMETER : FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE_ESCAPE_PARAMETER;
 
+#ifdef FLAC__INTEGER_ONLY_LIBRARY
+	(void)split_level;
+#endif
+
 	FLAC__ASSERT(frame_header->blocksize > 0);
 
 	/* verbatim subframe is the baseline against which we measure other compressed subframes */
@@ -3432,10 +4113,11 @@ FLAC__bool process_subframe_(
 					_candidate_bits =
 						evaluate_fixed_subframe_(
 							encoder,
+							scratch,
 							integer_signal,
 							residual[!_best_subframe],
-							encoder->private_->abs_residual_partition_sums,
-							encoder->private_->raw_bits_per_partition,
+							scratch->abs_residual_partition_sums,
+							scratch->raw_bits_per_partition,
 							frame_header->blocksize,
 							subframe_bps,
 							fixed_order,
@@ -3465,11 +4147,11 @@ FLAC__bool process_subframe_(
 				if(max_lpc_order > 0) {
 					unsigned a;
 					for (a = 0; a < encoder->protected_->num_apodizations; a++) {
-						FLAC__lpc_window_data(integer_signal, encoder->private_->window[a], encoder->private_->windowed_signal, frame_header->blocksize);
-						encoder->private_->local_lpc_compute_autocorrelation(encoder->private_->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc);
+						FLAC__lpc_window_data(integer_signal, encoder->private_->window[split_level][a], scratch->windowed_signal, frame_header->blocksize);
+						encoder->private_->local_lpc_compute_autocorrelation(scratch->windowed_signal, frame_header->blocksize, max_lpc_order+1, autoc);
 						/* if autoc[0] == 0.0, the signal is constant and we usually won't get here, but it can happen */
 						if(autoc[0] != 0.0) {
-							FLAC__lpc_compute_lp_coefficients(autoc, &max_lpc_order, encoder->private_->lp_coeff, lpc_error);
+							FLAC__lpc_compute_lp_coefficients(autoc, &max_lpc_order, scratch->lp_coeff, lpc_error);
 							if(encoder->protected_->do_exhaustive_model_search) {
 								min_lpc_order = 1;
 							}
@@ -3518,11 +4200,12 @@ FLAC__bool process_subframe_(
 									_candidate_bits =
 										evaluate_lpc_subframe_(
 											encoder,
+											scratch,
 											integer_signal,
 											residual[!_best_subframe],
-											encoder->private_->abs_residual_partition_sums,
-											encoder->private_->raw_bits_per_partition,
-											encoder->private_->lp_coeff[lpc_order-1],
+											scratch->abs_residual_partition_sums,
+											scratch->raw_bits_per_partition,
+											scratch->lp_coeff[lpc_order-1],
 											frame_header->blocksize,
 											subframe_bps,
 											lpc_order,
@@ -3565,7 +4248,6 @@ FLAC__bool process_subframe_(
 }
 
 FLAC__bool add_subframe_(
-	FLAC__StreamEncoder *encoder,
 	unsigned blocksize,
 	unsigned subframe_bps,
 	const FLAC__Subframe *subframe,
@@ -3574,28 +4256,20 @@ FLAC__bool add_subframe_(
 {
 	switch(subframe->type) {
 		case FLAC__SUBFRAME_TYPE_CONSTANT:
-			if(!FLAC__subframe_add_constant(&(subframe->data.constant), subframe_bps, subframe->wasted_bits, frame)) {
-				encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+			if(!FLAC__subframe_add_constant(&(subframe->data.constant), subframe_bps, subframe->wasted_bits, frame))
 				return false;
-			}
 			break;
 		case FLAC__SUBFRAME_TYPE_FIXED:
-			if(!FLAC__subframe_add_fixed(&(subframe->data.fixed), blocksize - subframe->data.fixed.order, subframe_bps, subframe->wasted_bits, frame)) {
-				encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+			if(!FLAC__subframe_add_fixed(&(subframe->data.fixed), blocksize - subframe->data.fixed.order, subframe_bps, subframe->wasted_bits, frame))
 				return false;
-			}
 			break;
 		case FLAC__SUBFRAME_TYPE_LPC:
-			if(!FLAC__subframe_add_lpc(&(subframe->data.lpc), blocksize - subframe->data.lpc.order, subframe_bps, subframe->wasted_bits, frame)) {
-				encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+			if(!FLAC__subframe_add_lpc(&(subframe->data.lpc), blocksize - subframe->data.lpc.order, subframe_bps, subframe->wasted_bits, frame))
 				return false;
-			}
 			break;
 		case FLAC__SUBFRAME_TYPE_VERBATIM:
-			if(!FLAC__subframe_add_verbatim(&(subframe->data.verbatim), blocksize, subframe_bps, subframe->wasted_bits, frame)) {
-				encoder->protected_->state = FLAC__STREAM_ENCODER_FRAMING_ERROR;
+			if(!FLAC__subframe_add_verbatim(&(subframe->data.verbatim), blocksize, subframe_bps, subframe->wasted_bits, frame))
 				return false;
-			}
 			break;
 		default:
 			FLAC__ASSERT(0);
@@ -3624,7 +4298,7 @@ static void spotcheck_subframe_estimate_(
 		fprintf(stderr, "EST: can't init frame\n");
 		return;
 	}
-	ret = add_subframe_(encoder, blocksize, subframe_bps, subframe, frame);
+	ret = add_subframe_(blocksize, subframe_bps, subframe, frame);
 	FLAC__ASSERT(ret);
 	{
 		const unsigned actual = FLAC__bitwriter_get_input_bits_unconsumed(frame);
@@ -3660,6 +4334,7 @@ unsigned evaluate_constant_subframe_(
 
 unsigned evaluate_fixed_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -3691,6 +4366,7 @@ unsigned evaluate_fixed_subframe_(
 	residual_bits =
 		find_best_partition_order_(
 			encoder->private_,
+			scratch,
 			residual,
 			abs_residual_partition_sums,
 			raw_bits_per_partition,
@@ -3722,6 +4398,7 @@ unsigned evaluate_fixed_subframe_(
 #ifndef FLAC__INTEGER_ONLY_LIBRARY
 unsigned evaluate_lpc_subframe_(
 	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 signal[],
 	FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
@@ -3774,6 +4451,7 @@ unsigned evaluate_lpc_subframe_(
 	residual_bits =
 		find_best_partition_order_(
 			encoder->private_,
+			scratch,
 			residual,
 			abs_residual_partition_sums,
 			raw_bits_per_partition,
@@ -3833,6 +4511,7 @@ unsigned evaluate_verbatim_subframe_(
 
 unsigned find_best_partition_order_(
 	FLAC__StreamEncoderPrivate *private_,
+	FLAC__StreamEncoderSubframeScratch *scratch,
 	const FLAC__int32 residual[],
 	FLAC__uint64 abs_residual_partition_sums[],
 	unsigned raw_bits_per_partition[],
@@ -3880,7 +4559,7 @@ unsigned find_best_partition_order_(
 					rice_parameter_search_dist,
 					(unsigned)partition_order,
 					do_escape_coding,
-					&private_->partitioned_rice_contents_extra[!best_parameters_index],
+					&scratch->partitioned_rice_contents_extra[!best_parameters_index],
 					&residual_bits
 				)
 			)
@@ -3909,9 +4588,9 @@ unsigned find_best_partition_order_(
 
 		/* save best parameters and raw_bits */
 		FLAC__format_entropy_coding_method_partitioned_rice_contents_ensure_size(prc, flac_max(6u, best_partition_order));
-		memcpy(prc->parameters, private_->partitioned_rice_contents_extra[best_parameters_index].parameters, sizeof(unsigned)*(1<<(best_partition_order)));
+		memcpy(prc->parameters, scratch->partitioned_rice_contents_extra[best_parameters_index].parameters, sizeof(unsigned)*(1<<(best_partition_order)));
 		if(do_escape_coding)
-			memcpy(prc->raw_bits, private_->partitioned_rice_contents_extra[best_parameters_index].raw_bits, sizeof(unsigned)*(1<<(best_partition_order)));
+			memcpy(prc->raw_bits, scratch->partitioned_rice_contents_extra[best_parameters_index].raw_bits, sizeof(unsigned)*(1<<(best_partition_order)));
 		/*
 		 * Now need to check if the type should be changed to
 		 * FLAC__ENTROPY_CODING_METHOD_PARTITIONED_RICE2 based on the
@@ -4304,16 +4983,390 @@ unsigned get_wasted_bits_(FLAC__int32 signal[], unsigned samples)
 	return shift;
 }
 
+FLAC__StreamEncoderThreadTask *threadtask_new_(unsigned num_scratch, unsigned num_frames)
+{
+	FLAC__StreamEncoderThreadTask *task;
+	unsigned i;
+
+	FLAC__ASSERT(num_scratch > 0 && num_scratch <= FLAC__MAX_CHANNELS+2);
+	FLAC__ASSERT(num_frames > 0 && num_frames <= SPLIT_NODES_);
+
+	task = calloc(1, sizeof(FLAC__StreamEncoderThreadTask));
+	if(task == 0)
+		return 0;
+
+	for(i = 0; i < num_frames; i++) {
+		if(0 == (task->frame[i] = FLAC__bitwriter_new())) {
+			threadtask_delete_(task, 0);
+			return 0;
+		}
+		task->num_frames++;
+	}
+
+	for(i = 0; i < num_scratch; i++) {
+		if(0 == (task->scratch[i] = calloc(1, sizeof(FLAC__StreamEncoderSubframeScratch)))) {
+			threadtask_delete_(task, 0);
+			return 0;
+		}
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->scratch[i]->partitioned_rice_contents_extra[0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->scratch[i]->partitioned_rice_contents_extra[1]);
+		task->num_scratch++;
+	}
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		task->subframe_workspace_ptr[i][0] = &task->subframe_workspace[i][0];
+		task->subframe_workspace_ptr[i][1] = &task->subframe_workspace[i][1];
+	}
+	for(i = 0; i < 2; i++) {
+		task->subframe_workspace_ptr_mid_side[i][0] = &task->subframe_workspace_mid_side[i][0];
+		task->subframe_workspace_ptr_mid_side[i][1] = &task->subframe_workspace_mid_side[i][1];
+	}
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		task->partitioned_rice_contents_workspace_ptr[i][0] = &task->partitioned_rice_contents_workspace[i][0];
+		task->partitioned_rice_contents_workspace_ptr[i][1] = &task->partitioned_rice_contents_workspace[i][1];
+	}
+	for(i = 0; i < 2; i++) {
+		task->partitioned_rice_contents_workspace_ptr_mid_side[i][0] = &task->partitioned_rice_contents_workspace_mid_side[i][0];
+		task->partitioned_rice_contents_workspace_ptr_mid_side[i][1] = &task->partitioned_rice_contents_workspace_mid_side[i][1];
+	}
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->partitioned_rice_contents_workspace[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->partitioned_rice_contents_workspace[i][1]);
+	}
+	for(i = 0; i < 2; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->partitioned_rice_contents_workspace_mid_side[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_init(&task->partitioned_rice_contents_workspace_mid_side[i][1]);
+	}
+	task->status = THREADTASK_FREE;
+	task->state = FLAC__STREAM_ENCODER_OK;
+
+	return task;
+}
+
+void threadtask_delete_(FLAC__StreamEncoderThreadTask *task, unsigned channels)
+{
+	unsigned i, channel;
+
+	for(i = 0; i < channels; i++) {
+		if(0 != task->integer_signal_unaligned[i])
+			free(task->integer_signal_unaligned[i]);
+	}
+	for(i = 0; i < 2; i++) {
+		if(0 != task->integer_signal_mid_side_unaligned[i])
+			free(task->integer_signal_mid_side_unaligned[i]);
+	}
+	for(channel = 0; channel < channels; channel++) {
+		for(i = 0; i < 2; i++) {
+			if(0 != task->residual_workspace_unaligned[channel][i])
+				free(task->residual_workspace_unaligned[channel][i]);
+		}
+	}
+	for(channel = 0; channel < 2; channel++) {
+		for(i = 0; i < 2; i++) {
+			if(0 != task->residual_workspace_mid_side_unaligned[channel][i])
+				free(task->residual_workspace_mid_side_unaligned[channel][i]);
+		}
+	}
+	for(i = 0; i < task->num_scratch; i++) {
+		FLAC__StreamEncoderSubframeScratch *scratch = task->scratch[i];
+#ifndef FLAC__INTEGER_ONLY_LIBRARY
+		if(0 != scratch->windowed_signal_unaligned)
+			free(scratch->windowed_signal_unaligned);
+#endif
+		if(0 != scratch->abs_residual_partition_sums_unaligned)
+			free(scratch->abs_residual_partition_sums_unaligned);
+		if(0 != scratch->raw_bits_per_partition_unaligned)
+			free(scratch->raw_bits_per_partition_unaligned);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&scratch->partitioned_rice_contents_extra[0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&scratch->partitioned_rice_contents_extra[1]);
+		free(scratch);
+	}
+
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&task->partitioned_rice_contents_workspace[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&task->partitioned_rice_contents_workspace[i][1]);
+	}
+	for(i = 0; i < 2; i++) {
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&task->partitioned_rice_contents_workspace_mid_side[i][0]);
+		FLAC__format_entropy_coding_method_partitioned_rice_contents_clear(&task->partitioned_rice_contents_workspace_mid_side[i][1]);
+	}
+	for(i = 0; i < task->num_frames; i++)
+		FLAC__bitwriter_delete(task->frame[i]);
+	free(task);
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * How the multithreaded encoder works:
+ *
+ * The threadtask[] array is used as a ring.  The client's thread fills
+ * threadtask[current_threadtask] with input, accumulates it into the MD5
+ * signature and queues it; the worker threads take queued tasks in ring
+ * order and encode them into their own bitwriter.  The client's thread
+ * then writes the finished frames strictly in ring order, which is
+ * frame order, so the output is exactly the same as when encoding in a
+ * single thread.  While it has to wait for a frame, the client's thread
+ * encodes queued frames itself.
+ *
+ * The status of every task and next_threadtask_to_encode are protected
+ * by mutex_threadtasks; everything else is only touched by the client's
+ * thread, or by the one thread that has a task in THREADTASK_BUSY.
+ */
+FLAC__bool start_threads_(FLAC__StreamEncoder *encoder, unsigned num_threads)
+{
+	unsigned i;
+
+	FLAC__ASSERT(num_threads < FLAC__STREAM_ENCODER_MAX_THREADS);
+	FLAC__ASSERT(!encoder->private_->threads_started);
+
+	if(0 != pthread_mutex_init(&encoder->private_->mutex_threadtasks, 0))
+		return false;
+	if(0 != pthread_cond_init(&encoder->private_->cond_threadtask_queued, 0)) {
+		pthread_mutex_destroy(&encoder->private_->mutex_threadtasks);
+		return false;
+	}
+	if(0 != pthread_cond_init(&encoder->private_->cond_threadtask_done, 0)) {
+		pthread_cond_destroy(&encoder->private_->cond_threadtask_queued);
+		pthread_mutex_destroy(&encoder->private_->mutex_threadtasks);
+		return false;
+	}
+
+	encoder->private_->next_threadtask_to_encode = 0;
+	encoder->private_->next_threadtask_to_write = 0;
+	encoder->private_->num_threadtasks_in_flight = 0;
+	encoder->private_->subframe_search.task = 0;
+	encoder->private_->subframe_search.num_jobs = 0;
+	encoder->private_->subframe_search.next_job = 0;
+	encoder->private_->quit_threads = false;
+	encoder->private_->threads_started = true;
+
+	/* The client's thread counts as one of the threads, so num_threads
+	 * is the number of others.  If not all of them can be created we
+	 * just carry on with what we have; in the worst case the client's
+	 * thread ends up doing all the work.
+	 */
+	encoder->private_->num_running_threads = 0;
+	for(i = 0; i < num_threads; i++) {
+		if(0 != pthread_create(&encoder->private_->thread[i], 0, thread_main_, encoder))
+			break;
+		encoder->private_->num_running_threads++;
+	}
+
+	return true;
+}
+
+void stop_threads_(FLAC__StreamEncoder *encoder)
+{
+	unsigned i;
+
+	if(!encoder->private_->threads_started)
+		return;
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	encoder->private_->quit_threads = true;
+	pthread_cond_broadcast(&encoder->private_->cond_threadtask_queued);
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	for(i = 0; i < encoder->private_->num_running_threads; i++)
+		pthread_join(encoder->private_->thread[i], 0);
+	encoder->private_->num_running_threads = 0;
+
+	pthread_cond_destroy(&encoder->private_->cond_threadtask_done);
+	pthread_cond_destroy(&encoder->private_->cond_threadtask_queued);
+	pthread_mutex_destroy(&encoder->private_->mutex_threadtasks);
+
+	encoder->private_->num_threadtasks_in_flight = 0;
+	encoder->private_->threads_started = false;
+}
+
+void *thread_main_(void *arg)
+{
+	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)arg;
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	while(!encoder->private_->quit_threads) {
+		if(!encode_next_queued_threadtask_(encoder) && !process_next_subframe_job_(encoder))
+			pthread_cond_wait(&encoder->private_->cond_threadtask_queued, &encoder->private_->mutex_threadtasks);
+	}
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	return 0;
+}
+
+/* Must be called with mutex_threadtasks locked; it is unlocked while the
+ * frame is being encoded.  Returns false if there was nothing queued.
+ */
+FLAC__bool encode_next_queued_threadtask_(FLAC__StreamEncoder *encoder)
+{
+	FLAC__StreamEncoderThreadTask *task = encoder->private_->threadtask[encoder->private_->next_threadtask_to_encode];
+
+	if(task->status != THREADTASK_QUEUED)
+		return false;
+
+	task->status = THREADTASK_BUSY;
+	encoder->private_->next_threadtask_to_encode = (encoder->private_->next_threadtask_to_encode + 1) % encoder->private_->num_threadtasks;
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	/* errors are kept in task->state and reported when the frame is written */
+	(void)encode_frame_(encoder, task, /*is_fractional_block=*/false);
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	task->status = THREADTASK_DONE;
+	pthread_cond_signal(&encoder->private_->cond_threadtask_done);
+
+	return true;
+}
+
+FLAC__bool queue_threadtask_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderThreadTask *task)
+{
+	FLAC__ASSERT(task == encoder->private_->threadtask[encoder->private_->current_threadtask]);
+	FLAC__ASSERT(encoder->private_->num_threadtasks_in_flight < encoder->private_->num_threadtasks);
+
+	task->frame_number = encoder->private_->current_frame_number + encoder->private_->num_threadtasks_in_flight;
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	task->status = THREADTASK_QUEUED;
+	pthread_cond_signal(&encoder->private_->cond_threadtask_queued);
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	encoder->private_->num_threadtasks_in_flight++;
+	encoder->private_->current_threadtask = (encoder->private_->current_threadtask + 1) % encoder->private_->num_threadtasks;
+
+	/* write what is finished, and make sure the next task is free for input */
+	return write_threadtasks_(encoder, /*max_in_flight=*/encoder->private_->num_threadtasks - 1);
+}
+
+/* Writes finished frames in order.  As long as more than max_in_flight
+ * frames are in flight, waits for the oldest one to be finished.
+ */
+FLAC__bool write_threadtasks_(FLAC__StreamEncoder *encoder, unsigned max_in_flight)
+{
+	while(encoder->private_->num_threadtasks_in_flight > 0) {
+		FLAC__StreamEncoderThreadTask *task = encoder->private_->threadtask[encoder->private_->next_threadtask_to_write];
+		FLAC__bool is_done;
+
+		pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+		while(task->status != THREADTASK_DONE && encoder->private_->num_threadtasks_in_flight > max_in_flight) {
+			if(!encode_next_queued_threadtask_(encoder))
+				pthread_cond_wait(&encoder->private_->cond_threadtask_done, &encoder->private_->mutex_threadtasks);
+		}
+		is_done = (task->status == THREADTASK_DONE);
+		/* only this thread queues tasks, so it is safe to free it before writing */
+		if(is_done)
+			task->status = THREADTASK_FREE;
+		pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+		if(!is_done)
+			break;
+
+		encoder->private_->next_threadtask_to_write = (encoder->private_->next_threadtask_to_write + 1) % encoder->private_->num_threadtasks;
+		encoder->private_->num_threadtasks_in_flight--;
+
+		if(task->state != FLAC__STREAM_ENCODER_OK) {
+			encoder->protected_->state = task->state;
+			return false;
+		}
+
+		if(!write_threadtask_frames_(encoder, task, /*is_last_block=*/false)) {
+			/* the above function sets the state for us in case of an error */
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Hands the subframe searches of one frame to the worker threads and
+ * takes part in them until all are done.  Only used with parallel
+ * subframes, in which case no frames are ever queued.
+ */
+FLAC__bool process_subframe_jobs_in_parallel_(
+	FLAC__StreamEncoder *encoder,
+	FLAC__StreamEncoderThreadTask *task,
+	const unsigned job[],
+	unsigned num_jobs,
+	unsigned min_partition_order,
+	unsigned max_partition_order,
+	const FLAC__FrameHeader *frame_header
+)
+{
+	FLAC__bool ok;
+
+	FLAC__ASSERT(encoder->private_->threads_started);
+	FLAC__ASSERT(encoder->private_->num_threadtasks == 1);
+	FLAC__ASSERT(num_jobs <= FLAC__MAX_CHANNELS+2);
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	FLAC__ASSERT(encoder->private_->subframe_search.next_job == encoder->private_->subframe_search.num_jobs);
+	encoder->private_->subframe_search.task = task;
+	encoder->private_->subframe_search.frame_header = frame_header;
+	encoder->private_->subframe_search.min_partition_order = min_partition_order;
+	encoder->private_->subframe_search.max_partition_order = max_partition_order;
+	memcpy(encoder->private_->subframe_search.job, job, sizeof(unsigned)*num_jobs);
+	encoder->private_->subframe_search.num_jobs = num_jobs;
+	encoder->private_->subframe_search.next_job = 0;
+	encoder->private_->subframe_search.num_jobs_done = 0;
+	encoder->private_->subframe_search.ok = true;
+	pthread_cond_broadcast(&encoder->private_->cond_threadtask_queued);
+
+	while(encoder->private_->subframe_search.num_jobs_done < num_jobs) {
+		if(!process_next_subframe_job_(encoder))
+			pthread_cond_wait(&encoder->private_->cond_threadtask_done, &encoder->private_->mutex_threadtasks);
+	}
+
+	ok = encoder->private_->subframe_search.ok;
+	encoder->private_->subframe_search.task = 0;
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	return ok;
+}
+
+/* Must be called with mutex_threadtasks locked; it is unlocked while the
+ * subframe is being searched.  Returns false if there was no job left.
+ */
+FLAC__bool process_next_subframe_job_(FLAC__StreamEncoder *encoder)
+{
+	FLAC__StreamEncoderThreadTask *task = encoder->private_->subframe_search.task;
+	const FLAC__FrameHeader *frame_header = encoder->private_->subframe_search.frame_header;
+	const unsigned min_partition_order = encoder->private_->subframe_search.min_partition_order;
+	const unsigned max_partition_order = encoder->private_->subframe_search.max_partition_order;
+	unsigned job;
+	FLAC__bool ok;
+
+	if(encoder->private_->subframe_search.next_job >= encoder->private_->subframe_search.num_jobs)
+		return false;
+
+	job = encoder->private_->subframe_search.job[encoder->private_->subframe_search.next_job++];
+	pthread_mutex_unlock(&encoder->private_->mutex_threadtasks);
+
+	ok = process_subframe_job_(encoder, task, job, min_partition_order, max_partition_order, frame_header);
+
+	pthread_mutex_lock(&encoder->private_->mutex_threadtasks);
+	if(!ok)
+		encoder->private_->subframe_search.ok = false;
+	if(++encoder->private_->subframe_search.num_jobs_done == encoder->private_->subframe_search.num_jobs)
+		pthread_cond_signal(&encoder->private_->cond_threadtask_done);
+
+	return true;
+}
+#endif
+
 void append_to_verify_fifo_(verify_input_fifo *fifo, const FLAC__int32 * const input[], unsigned input_offset, unsigned channels, unsigned wide_samples)
 {
 	unsigned channel;
+	const unsigned n = flac_min(wide_samples, fifo->size - fifo->tail); /* how many fit before the ring wraps */
 
-	for(channel = 0; channel < channels; channel++)
-		memcpy(&fifo->data[channel][fifo->tail], &input[channel][input_offset], sizeof(FLAC__int32) * wide_samples);
+	FLAC__ASSERT(wide_samples <= fifo->size);
 
-	fifo->tail += wide_samples;
+	for(channel = 0; channel < channels; channel++) {
+		memcpy(&fifo->data[channel][fifo->tail], &input[channel][input_offset], sizeof(FLAC__int32) * n);
+		memcpy(&fifo->data[channel][0], &input[channel][input_offset+n], sizeof(FLAC__int32) * (wide_samples - n));
+	}
 
-	FLAC__ASSERT(fifo->tail <= fifo->size);
+	fifo->tail += wide_samples;
+	if(fifo->tail >= fifo->size)
+		fifo->tail -= fifo->size;
 }
 
 void append_to_verify_fifo_interleaved_(verify_input_fifo *fifo, const FLAC__int32 input[], unsigned input_offset, unsigned channels, unsigned wide_samples)
@@ -4322,15 +5375,16 @@ void append_to_verify_fifo_interleaved_(verify_input_fifo *fifo, const FLAC__int
 	unsigned sample, wide_sample;
 	unsigned tail = fifo->tail;
 
+	FLAC__ASSERT(wide_samples <= fifo->size);
+
 	sample = input_offset * channels;
 	for(wide_sample = 0; wide_sample < wide_samples; wide_sample++) {
 		for(channel = 0; channel < channels; channel++)
 			fifo->data[channel][tail] = input[sample++];
-		tail++;
+		if(++tail == fifo->size)
+			tail = 0;
 	}
 	fifo->tail = tail;
-
-	FLAC__ASSERT(fifo->tail <= fifo->size);
 }
 
 FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
@@ -4339,6 +5393,28 @@ FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDecoder *d
 	const size_t encoded_bytes = encoder->private_->verify.output.bytes;
 	(void)decoder;
 
+#ifdef HAVE_PTHREAD
+	if(encoder->private_->verify.thread.started) {
+		/* wait for the client's thread to write more, or to finish */
+		pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+		while(encoder->private_->verify.thread.head == encoder->private_->verify.thread.tail && !encoder->private_->verify.thread.end_of_stream)
+			pthread_cond_wait(&encoder->private_->verify.thread.cond_data, &encoder->private_->verify.thread.mutex);
+		if(encoder->private_->verify.thread.head == encoder->private_->verify.thread.tail) {
+			pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+			*bytes = 0;
+			return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+		}
+		if(encoder->private_->verify.thread.tail - encoder->private_->verify.thread.head < *bytes)
+			*bytes = encoder->private_->verify.thread.tail - encoder->private_->verify.thread.head;
+		memcpy(buffer, encoder->private_->verify.thread.data + encoder->private_->verify.thread.head, *bytes);
+		encoder->private_->verify.thread.head += *bytes;
+		if(encoder->private_->verify.thread.head == encoder->private_->verify.thread.tail)
+			encoder->private_->verify.thread.head = encoder->private_->verify.thread.tail = 0;
+		pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+		return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+	}
+#endif
+
 	if(encoder->private_->verify.needs_magic_hack) {
 		FLAC__ASSERT(*bytes >= FLAC__STREAM_SYNC_LENGTH);
 		*bytes = FLAC__STREAM_SYNC_LENGTH;
@@ -4367,22 +5443,27 @@ FLAC__StreamDecoderReadStatus verify_read_callback_(const FLAC__StreamDecoder *d
 FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder *)client_data;
+	verify_input_fifo *fifo = &encoder->private_->verify.input_fifo;
 	unsigned channel;
 	const unsigned channels = frame->header.channels;
 	const unsigned blocksize = frame->header.blocksize;
-	const unsigned bytes_per_block = sizeof(FLAC__int32) * blocksize;
+	const unsigned n = flac_min(blocksize, fifo->size - fifo->head); /* how many are before the ring wraps */
 
 	(void)decoder;
 
 	for(channel = 0; channel < channels; channel++) {
-		if(0 != memcmp(buffer[channel], encoder->private_->verify.input_fifo.data[channel], bytes_per_block)) {
+		if(
+			0 != memcmp(buffer[channel], &fifo->data[channel][fifo->head], sizeof(FLAC__int32) * n) ||
+			0 != memcmp(buffer[channel] + n, &fifo->data[channel][0], sizeof(FLAC__int32) * (blocksize - n))
+		) {
 			unsigned i, sample = 0;
 			FLAC__int32 expect = 0, got = 0;
 
 			for(i = 0; i < blocksize; i++) {
-				if(buffer[channel][i] != encoder->private_->verify.input_fifo.data[channel][i]) {
+				const FLAC__int32 original = fifo->data[channel][i < n? fifo->head + i : i - n];
+				if(buffer[channel][i] != original) {
 					sample = i;
-					expect = (FLAC__int32)encoder->private_->verify.input_fifo.data[channel][i];
+					expect = original;
 					got = (FLAC__int32)buffer[channel][i];
 					break;
 				}
@@ -4395,15 +5476,22 @@ FLAC__StreamDecoderWriteStatus verify_write_callback_(const FLAC__StreamDecoder
 			encoder->private_->verify.error_stats.sample = sample;
 			encoder->private_->verify.error_stats.expected = expect;
 			encoder->private_->verify.error_stats.got = got;
-			encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA;
+			set_verify_error_(encoder, FLAC__STREAM_ENCODER_VERIFY_MISMATCH_IN_AUDIO_DATA);
 			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 		}
 	}
 	/* dequeue the frame from the fifo */
-	encoder->private_->verify.input_fifo.tail -= blocksize;
-	FLAC__ASSERT(encoder->private_->verify.input_fifo.tail <= OVERREAD_);
-	for(channel = 0; channel < channels; channel++)
-		memmove(&encoder->private_->verify.input_fifo.data[channel][0], &encoder->private_->verify.input_fifo.data[channel][blocksize], encoder->private_->verify.input_fifo.tail * sizeof(encoder->private_->verify.input_fifo.data[0][0]));
+	fifo->head += blocksize;
+	if(fifo->head >= fifo->size)
+		fifo->head -= fifo->size;
+#ifdef HAVE_PTHREAD
+	if(encoder->private_->verify.thread.started) {
+		pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+		encoder->private_->verify.thread.frames_in_flight--;
+		pthread_cond_signal(&encoder->private_->verify.thread.cond_space);
+		pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+	}
+#endif
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -4416,8 +5504,165 @@ void verify_error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 {
 	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)client_data;
 	(void)decoder, (void)status;
-	encoder->protected_->state = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR;
+	set_verify_error_(encoder, FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR);
+}
+
+/* With threaded verify, the verify decoder's callbacks run on the verify
+ * thread, so a failure is only recorded here; the client's thread picks
+ * it up the next time it writes a frame, or in FLAC__stream_encoder_finish().
+ */
+void set_verify_error_(FLAC__StreamEncoder *encoder, FLAC__StreamEncoderState state)
+{
+#ifdef HAVE_PTHREAD
+	if(encoder->private_->verify.thread.started) {
+		pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+		if(encoder->private_->verify.thread.error == FLAC__STREAM_ENCODER_OK)
+			encoder->private_->verify.thread.error = state;
+		pthread_cond_signal(&encoder->private_->verify.thread.cond_space);
+		pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+		return;
+	}
+#endif
+	encoder->protected_->state = state;
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * How threaded verify works:
+ *
+ * Instead of running the verify decoder one frame at a time from
+ * write_bitbuffer_(), the client's thread appends everything it writes
+ * to verify.thread.data, and the verify thread decodes it from there as
+ * one continuous stream, comparing against verify.input_fifo as usual.
+ * The client's thread waits when VERIFY_QUEUE_FRAMES_ frames have been
+ * written but not yet verified, which bounds both the byte queue and how
+ * much larger the input fifo has to be.
+ *
+ * The input fifo itself needs no locking: the client's thread only
+ * appends at the tail and the verify thread only removes at the head,
+ * and a frame's samples are always appended before the frame is queued.
+ */
+FLAC__bool start_verify_thread_(FLAC__StreamEncoder *encoder)
+{
+	encoder->private_->verify.thread.head = encoder->private_->verify.thread.tail = 0;
+	encoder->private_->verify.thread.frames_in_flight = 0;
+	encoder->private_->verify.thread.end_of_stream = false;
+	encoder->private_->verify.thread.done = false;
+	encoder->private_->verify.thread.error = FLAC__STREAM_ENCODER_OK;
+
+	if(0 != pthread_mutex_init(&encoder->private_->verify.thread.mutex, 0))
+		return false;
+	if(0 != pthread_cond_init(&encoder->private_->verify.thread.cond_data, 0)) {
+		pthread_mutex_destroy(&encoder->private_->verify.thread.mutex);
+		return false;
+	}
+	if(0 != pthread_cond_init(&encoder->private_->verify.thread.cond_space, 0)) {
+		pthread_cond_destroy(&encoder->private_->verify.thread.cond_data);
+		pthread_mutex_destroy(&encoder->private_->verify.thread.mutex);
+		return false;
+	}
+	/* set before the thread runs, since its callbacks check it */
+	encoder->private_->verify.thread.started = true;
+	if(0 != pthread_create(&encoder->private_->verify.thread.thread, 0, verify_thread_main_, encoder)) {
+		encoder->private_->verify.thread.started = false;
+		pthread_cond_destroy(&encoder->private_->verify.thread.cond_space);
+		pthread_cond_destroy(&encoder->private_->verify.thread.cond_data);
+		pthread_mutex_destroy(&encoder->private_->verify.thread.mutex);
+		return false;
+	}
+	return true;
+}
+
+/* Ends the stream, waits for the verify thread to check everything
+ * queued and exit, and returns false if verification failed.
+ */
+FLAC__bool stop_verify_thread_(FLAC__StreamEncoder *encoder)
+{
+	FLAC__StreamEncoderState error;
+
+	pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+	encoder->private_->verify.thread.end_of_stream = true;
+	pthread_cond_signal(&encoder->private_->verify.thread.cond_data);
+	pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+
+	pthread_join(encoder->private_->verify.thread.thread, 0);
+	encoder->private_->verify.thread.started = false;
+
+	pthread_cond_destroy(&encoder->private_->verify.thread.cond_space);
+	pthread_cond_destroy(&encoder->private_->verify.thread.cond_data);
+	pthread_mutex_destroy(&encoder->private_->verify.thread.mutex);
+
+	error = encoder->private_->verify.thread.error;
+	if(error == FLAC__STREAM_ENCODER_OK)
+		return true;
+	if(encoder->protected_->state == FLAC__STREAM_ENCODER_OK)
+		encoder->protected_->state = error;
+	return false;
+}
+
+void *verify_thread_main_(void *arg)
+{
+	FLAC__StreamEncoder *encoder = (FLAC__StreamEncoder*)arg;
+
+	if(!FLAC__stream_decoder_process_until_end_of_stream(encoder->private_->verify.decoder))
+		set_verify_error_(encoder, FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR);
+
+	pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+	encoder->private_->verify.thread.done = true;
+	pthread_cond_signal(&encoder->private_->verify.thread.cond_space);
+	pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+
+	return 0;
+}
+
+FLAC__bool queue_verify_bytes_(FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, FLAC__bool is_frame)
+{
+	FLAC__StreamEncoderState error;
+
+	pthread_mutex_lock(&encoder->private_->verify.thread.mutex);
+	while(is_frame && encoder->private_->verify.thread.frames_in_flight >= VERIFY_QUEUE_FRAMES_ && encoder->private_->verify.thread.error == FLAC__STREAM_ENCODER_OK && !encoder->private_->verify.thread.done)
+		pthread_cond_wait(&encoder->private_->verify.thread.cond_space, &encoder->private_->verify.thread.mutex);
+
+	error = encoder->private_->verify.thread.error;
+	if(error == FLAC__STREAM_ENCODER_OK && encoder->private_->verify.thread.done)
+		error = FLAC__STREAM_ENCODER_VERIFY_DECODER_ERROR; /* the verify decoder quit before the end of the stream */
+
+	if(error == FLAC__STREAM_ENCODER_OK) {
+		if(encoder->private_->verify.thread.tail + bytes > encoder->private_->verify.thread.capacity) {
+			/* make room: first move the unread bytes to the front, then grow if that is not enough */
+			const size_t unread = encoder->private_->verify.thread.tail - encoder->private_->verify.thread.head;
+			memmove(encoder->private_->verify.thread.data, encoder->private_->verify.thread.data + encoder->private_->verify.thread.head, unread);
+			encoder->private_->verify.thread.head = 0;
+			encoder->private_->verify.thread.tail = unread;
+			if(unread + bytes > encoder->private_->verify.thread.capacity) {
+				const size_t capacity = flac_max(unread + bytes, 2 * encoder->private_->verify.thread.capacity);
+				FLAC__byte *data = realloc(encoder->private_->verify.thread.data, capacity);
+				if(0 == data)
+					error = FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR;
+				else {
+					encoder->private_->verify.thread.data = data;
+					encoder->private_->verify.thread.capacity = capacity;
+				}
+			}
+		}
+	}
+
+	if(error == FLAC__STREAM_ENCODER_OK) {
+		memcpy(encoder->private_->verify.thread.data + encoder->private_->verify.thread.tail, buffer, bytes);
+		encoder->private_->verify.thread.tail += bytes;
+		if(is_frame)
+			encoder->private_->verify.thread.frames_in_flight++;
+		pthread_cond_signal(&encoder->private_->verify.thread.cond_data);
+	}
+	pthread_mutex_unlock(&encoder->private_->verify.thread.mutex);
+
+	if(error != FLAC__STREAM_ENCODER_OK) {
+		encoder->protected_->state = error;
+		return false;
+	}
+	return true;
 }
+#endif
 
 FLAC__StreamEncoderReadStatus file_read_callback_(const FLAC__StreamEncoder *encoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
 {
@@ -409,6 +409,10 @@ FLAC__bool do_shorthand_operation(const char *filename, FLAC__bool prefix_with_f
 		case OP__ADD_PADDING:
 			ok = do_shorthand_operation__add_padding(filename, chain, operation->argument.add_padding.length, needs_write);
 			break;
+		case OP__REBUILD_STREAMINFO:
+		case OP__REBUILD_MD5SUM:
+			ok = do_shorthand_operation__rebuild_streaminfo(filename, chain, operation, needs_write);
+			break;
 		default:
 			ok = false;
 			FLAC__ASSERT(0);
@@ -421,6 +425,7 @@ FLAC__bool do_shorthand_operation(const char *filename, FLAC__bool prefix_with_f
 FLAC__bool do_shorthand_operation__add_replay_gain(char **filenames, unsigned num_files, FLAC__bool preserve_modtime)
 {
 	FLAC__StreamMetadata streaminfo;
+	grabbag__ReplayGainContext *context;
 	float *title_gains = 0, *title_peaks = 0;
 	float album_gain, album_peak;
 	unsigned sample_rate = 0;
@@ -469,10 +474,14 @@ FLAC__bool do_shorthand_operation__add_replay_gain(char **filenames, unsigned nu
 	}
 	FLAC__ASSERT(bits_per_sample >= FLAC__MIN_BITS_PER_SAMPLE && bits_per_sample <= FLAC__MAX_BITS_PER_SAMPLE);
 
-	if(!grabbag__replaygain_init(sample_rate)) {
+	if(0 == (context = grabbag__replaygain_new()))
+		die("out of memory allocating ReplayGain analysis");
+
+	if(!grabbag__replaygain_init(context, sample_rate)) {
 		FLAC__ASSERT(0);
 		/* double protection */
 		flac_fprintf(stderr, "internal error\n");
+		grabbag__replaygain_delete(context);
 		return false;
 	}
 
@@ -483,14 +492,16 @@ FLAC__bool do_shorthand_operation__add_replay_gain(char **filenames, unsigned nu
 		die("out of memory allocating space for title gains/peaks");
 
 	for(i = 0; i < num_files; i++) {
-		if(0 != (error = grabbag__replaygain_analyze_file(filenames[i], title_gains+i, title_peaks+i))) {
+		if(0 != (error = grabbag__replaygain_analyze_file(context, filenames[i], title_gains+i, title_peaks+i))) {
 			flac_fprintf(stderr, "%s: ERROR: during analysis (%s)\n", filenames[i], error);
+			grabbag__replaygain_delete(context);
 			free(title_gains);
 			free(title_peaks);
 			return false;
 		}
 	}
-	grabbag__replaygain_get_album(&album_gain, &album_peak);
+	grabbag__replaygain_get_album(context, &album_gain, &album_peak);
+	grabbag__replaygain_delete(context);
 
 	for(i = 0; i < num_files; i++) {
 		if(0 != (error = grabbag__replaygain_store_to_file(filenames[i], album_gain, album_peak, title_gains[i], title_peaks[i], preserve_modtime))) {
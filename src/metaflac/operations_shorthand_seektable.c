@@ -98,23 +98,30 @@ FLAC__bool do_shorthand_operation__add_seekpoints(const char *filename, FLAC__Me
 
 typedef struct {
 	FLAC__StreamMetadata_SeekTable *seektable_template;
-	FLAC__uint64 samples_written;
-	FLAC__uint64 audio_offset, last_offset;
+	FLAC__uint64 audio_offset;
 	unsigned first_seekpoint_to_check;
 	FLAC__bool error_occurred;
 	FLAC__StreamDecoderErrorStatus error_status;
 } ClientData;
 
 static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	/* never called, the frames are only scanned */
+	(void)decoder, (void)frame, (void)buffer, (void)client_data;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+}
+
+static FLAC__bool scan_callback_(const FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data)
 {
 	ClientData *cd = (ClientData*)client_data;
 
-	(void)buffer;
+	(void)decoder, (void)frame_bytes;
 	FLAC__ASSERT(0 != cd);
+	FLAC__ASSERT(header->number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
 
 	if(!cd->error_occurred) {
-		const unsigned blocksize = frame->header.blocksize;
-		const FLAC__uint64 frame_first_sample = cd->samples_written;
+		const unsigned blocksize = header->blocksize;
+		const FLAC__uint64 frame_first_sample = header->number.sample_number;
 		const FLAC__uint64 frame_last_sample = frame_first_sample + (FLAC__uint64)blocksize - 1;
 		FLAC__uint64 test_sample;
 		unsigned i;
@@ -125,7 +132,7 @@ static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder
 			}
 			else if(test_sample >= frame_first_sample) {
 				cd->seektable_template->points[i].sample_number = frame_first_sample;
-				cd->seektable_template->points[i].stream_offset = cd->last_offset - cd->audio_offset;
+				cd->seektable_template->points[i].stream_offset = frame_offset - cd->audio_offset;
 				cd->seektable_template->points[i].frame_samples = blocksize;
 				cd->first_seekpoint_to_check++;
 				/* DO NOT: "break;" and here's why:
@@ -139,13 +146,10 @@ static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder
 				cd->first_seekpoint_to_check++;
 			}
 		}
-		cd->samples_written += blocksize;
-		if(!FLAC__stream_decoder_get_decode_position(decoder, &cd->last_offset))
-			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		return true;
 	}
 	else
-		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		return false;
 }
 
 static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
@@ -171,7 +175,6 @@ FLAC__bool populate_seekpoint_values(const char *filename, FLAC__StreamMetadata
 	FLAC__ASSERT(block->type == FLAC__METADATA_TYPE_SEEKTABLE);
 
 	client_data.seektable_template = &block->data.seek_table;
-	client_data.samples_written = 0;
 	/* client_data.audio_offset must be determined later */
 	client_data.first_seekpoint_to_check = 0;
 	client_data.error_occurred = false;
@@ -200,9 +203,9 @@ FLAC__bool populate_seekpoint_values(const char *filename, FLAC__StreamMetadata
 		flac_fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file\n", filename);
 		ok = false;
 	}
-	client_data.last_offset = client_data.audio_offset;
 
-	if(ok && !FLAC__stream_decoder_process_until_end_of_stream(decoder)) {
+	/* only the frame headers are needed to place the seekpoints, so don't decode */
+	if(ok && !FLAC__stream_decoder_scan_until_end_of_stream(decoder, scan_callback_, /*total_samples=*/0)) {
 		flac_fprintf(stderr, "%s: ERROR (--add-seekpoint) decoding file (%s)\n", filename, FLAC__stream_decoder_get_resolved_state_string(decoder));
 		ok = false;
 	}
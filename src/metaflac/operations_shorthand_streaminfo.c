@@ -25,10 +25,14 @@
 #include "utils.h"
 #include "FLAC/assert.h"
 #include "FLAC/metadata.h"
+#include "FLAC/stream_decoder.h"
 #include "share/compat.h"
 #include <string.h>
 #include "operations_shorthand.h"
 
+static FLAC__bool rebuild_streaminfo(const char *filename, FLAC__StreamMetadata *block, FLAC__bool compute_md5);
+static FLAC__bool needs_seektable(FLAC__Metadata_Chain *chain);
+
 FLAC__bool do_shorthand_operation__streaminfo(const char *filename, FLAC__bool prefix_with_filename, FLAC__Metadata_Chain *chain, const Operation *operation, FLAC__bool *needs_write)
 {
 	unsigned i;
@@ -125,3 +129,172 @@ FLAC__bool do_shorthand_operation__streaminfo(const char *filename, FLAC__bool p
 
 	return ok;
 }
+
+FLAC__bool do_shorthand_operation__rebuild_streaminfo(const char *filename, FLAC__Metadata_Chain *chain, const Operation *operation, FLAC__bool *needs_write)
+{
+	FLAC__bool ok;
+	FLAC__StreamMetadata *block;
+	FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
+
+	if(0 == iterator)
+		die("out of memory allocating iterator");
+
+	FLAC__metadata_iterator_init(iterator, chain);
+
+	block = FLAC__metadata_iterator_get_block(iterator);
+
+	FLAC__ASSERT(0 != block);
+	FLAC__ASSERT(block->type == FLAC__METADATA_TYPE_STREAMINFO);
+
+	FLAC__metadata_iterator_delete(iterator);
+
+	ok = rebuild_streaminfo(filename, block, /*compute_md5=*/operation->type == OP__REBUILD_MD5SUM);
+	if(ok)
+		*needs_write = true;
+
+	/*
+	 * A file from an encoder that could not seek back has no seek points
+	 * either, so give it the same ones flac would have by default.  Points
+	 * already in the table are looked up again in case they are stale.
+	 */
+	if(ok && operation->type == OP__REBUILD_STREAMINFO)
+		ok = do_shorthand_operation__add_seekpoints(filename, chain, needs_seektable(chain)? "10s;" : "", needs_write);
+
+	return ok;
+}
+
+/*
+ * local routines
+ */
+
+typedef struct {
+	unsigned min_blocksize, max_blocksize, last_blocksize;
+	unsigned min_framesize, max_framesize;
+	FLAC__bool error_occurred;
+	FLAC__StreamDecoderErrorStatus error_status;
+} ClientData;
+
+static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	/* never called, the frames are only scanned or hashed */
+	(void)decoder, (void)frame, (void)buffer, (void)client_data;
+	return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+}
+
+static FLAC__bool scan_callback_(const FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data)
+{
+	ClientData *cd = (ClientData*)client_data;
+
+	(void)decoder, (void)frame_offset;
+	FLAC__ASSERT(0 != cd);
+
+	/* the minimum blocksize doesn't count the last frame, so only count a frame once another follows it */
+	if(cd->last_blocksize > 0 && (cd->min_blocksize == 0 || cd->last_blocksize < cd->min_blocksize))
+		cd->min_blocksize = cd->last_blocksize;
+	cd->last_blocksize = header->blocksize;
+	if(header->blocksize > cd->max_blocksize)
+		cd->max_blocksize = header->blocksize;
+	if(cd->min_framesize == 0 || frame_bytes < cd->min_framesize)
+		cd->min_framesize = frame_bytes;
+	if(frame_bytes > cd->max_framesize)
+		cd->max_framesize = frame_bytes;
+
+	return !cd->error_occurred;
+}
+
+static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	ClientData *cd = (ClientData*)client_data;
+
+	(void)decoder;
+	FLAC__ASSERT(0 != cd);
+
+	if(!cd->error_occurred) { /* don't let multiple errors overwrite the first one */
+		cd->error_occurred = true;
+		cd->error_status = status;
+	}
+}
+
+FLAC__bool rebuild_streaminfo(const char *filename, FLAC__StreamMetadata *block, FLAC__bool compute_md5)
+{
+	const char *option = compute_md5? "--rebuild-md5sum" : "--rebuild-streaminfo";
+	FLAC__StreamDecoder *decoder;
+	ClientData client_data;
+	FLAC__uint64 total_samples = 0;
+	FLAC__byte md5sum[16];
+	FLAC__bool ok = true;
+
+	memset(&client_data, 0, sizeof(client_data));
+
+	decoder = FLAC__stream_decoder_new();
+
+	if(0 == decoder) {
+		flac_fprintf(stderr, "%s: ERROR (%s) creating the decoder instance\n", filename, option);
+		return false;
+	}
+
+	FLAC__stream_decoder_set_md5_checking(decoder, false);
+	FLAC__stream_decoder_set_metadata_ignore_all(decoder);
+
+	if(FLAC__stream_decoder_init_file(decoder, filename, write_callback_, /*metadata_callback=*/0, error_callback_, &client_data) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		flac_fprintf(stderr, "%s: ERROR (%s) initializing the decoder instance (%s)\n", filename, option, FLAC__stream_decoder_get_resolved_state_string(decoder));
+		ok = false;
+	}
+
+	/* only the MD5 signature needs the audio; everything else comes from the frame headers */
+	if(ok) {
+		ok = compute_md5?
+			FLAC__stream_decoder_compute_md5_signature(decoder, md5sum) :
+			FLAC__stream_decoder_scan_until_end_of_stream(decoder, scan_callback_, &total_samples)
+		;
+		if(!ok)
+			flac_fprintf(stderr, "%s: ERROR (%s) decoding file (%s)\n", filename, option, FLAC__stream_decoder_get_resolved_state_string(decoder));
+	}
+
+	if(ok && client_data.error_occurred) {
+		flac_fprintf(stderr, "%s: ERROR (%s) decoding file (%u:%s)\n", filename, option, (unsigned)client_data.error_status, FLAC__StreamDecoderErrorStatusString[client_data.error_status]);
+		ok = false;
+	}
+
+	if(ok) {
+		if(compute_md5)
+			memcpy(block->data.stream_info.md5sum, md5sum, 16);
+		else {
+			/* a stream with a single frame has only the last frame to go by */
+			if(client_data.min_blocksize == 0)
+				client_data.min_blocksize = client_data.last_blocksize;
+			block->data.stream_info.min_blocksize = client_data.min_blocksize;
+			block->data.stream_info.max_blocksize = client_data.max_blocksize;
+			block->data.stream_info.min_framesize = client_data.min_framesize;
+			block->data.stream_info.max_framesize = client_data.max_framesize;
+			block->data.stream_info.total_samples = total_samples;
+		}
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+	return ok;
+}
+
+/* true if there is no SEEKTABLE block or it has nothing but placeholders */
+FLAC__bool needs_seektable(FLAC__Metadata_Chain *chain)
+{
+	FLAC__bool needed = true;
+	FLAC__Metadata_Iterator *iterator = FLAC__metadata_iterator_new();
+
+	if(0 == iterator)
+		die("out of memory allocating iterator");
+
+	FLAC__metadata_iterator_init(iterator, chain);
+
+	do {
+		const FLAC__StreamMetadata *block = FLAC__metadata_iterator_get_block(iterator);
+		if(block->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+			needed = block->data.seek_table.num_points == 0 || block->data.seek_table.points[0].sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER;
+			break;
+		}
+	} while(FLAC__metadata_iterator_next(iterator));
+
+	FLAC__metadata_iterator_delete(iterator);
+
+	return needed;
+}
@@ -81,6 +81,8 @@ struct share__option long_options_[] = {
 	{ "add-replay-gain", 0, 0, 0 },
 	{ "remove-replay-gain", 0, 0, 0 },
 	{ "add-padding", 1, 0, 0 },
+	{ "rebuild-streaminfo", 0, 0, 0 },
+	{ "rebuild-md5sum", 0, 0, 0 },
 	/* major operations */
 	{ "help", 0, 0, 0 },
 	{ "version", 0, 0, 0 },
@@ -639,6 +641,12 @@ FLAC__bool parse_option(int option_index, const char *option_argument, CommandLi
 			ok = false;
 		}
 	}
+	else if(0 == strcmp(opt, "rebuild-streaminfo")) {
+		(void) append_shorthand_operation(options, OP__REBUILD_STREAMINFO);
+	}
+	else if(0 == strcmp(opt, "rebuild-md5sum")) {
+		(void) append_shorthand_operation(options, OP__REBUILD_MD5SUM);
+	}
 	else if(0 == strcmp(opt, "help")) {
 		options->show_long_help = true;
 	}
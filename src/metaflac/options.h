@@ -66,6 +66,8 @@ typedef enum {
 	OP__ADD_SEEKPOINT,
 	OP__ADD_REPLAY_GAIN,
 	OP__ADD_PADDING,
+	OP__REBUILD_STREAMINFO,
+	OP__REBUILD_MD5SUM,
 	OP__LIST,
 	OP__APPEND,
 	OP__REMOVE,
@@ -235,6 +235,15 @@ int long_usage(const char *message, ...)
 	fprintf(out, "--add-padding=length  Add a padding block of the given length (in bytes).\n");
 	fprintf(out, "                      The overall length of the new block will be 4 + length;\n");
 	fprintf(out, "                      the extra 4 bytes is for the metadata block header.\n");
+	fprintf(out, "--rebuild-streaminfo  Recompute the min/max blocksize, min/max framesize and\n");
+	fprintf(out, "                      total samples in the STREAMINFO block from the frame\n");
+	fprintf(out, "                      headers, for files from an encoder that could not seek\n");
+	fprintf(out, "                      back to fill them in, e.g. when writing to a pipe.  The\n");
+	fprintf(out, "                      audio is not decoded.  Existing seek points are looked up\n");
+	fprintf(out, "                      again; if there are none, a seek point is added every 10\n");
+	fprintf(out, "                      seconds, as flac does by default.\n");
+	fprintf(out, "--rebuild-md5sum      Decode the audio to recompute the MD5 signature in the\n");
+	fprintf(out, "                      STREAMINFO block.\n");
 	fprintf(out, "\n");
 	fprintf(out, "Major operations:\n");
 	fprintf(out, "--version\n");
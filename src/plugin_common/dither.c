@@ -55,7 +55,7 @@ typedef struct {
 	FLAC__int32 random;
 } dither_state;
 
-static FLAC__int32 linear_dither(unsigned source_bps, unsigned target_bps, FLAC__int32 sample, dither_state *dither, const FLAC__int32 MIN, const FLAC__int32 MAX)
+static inline FLAC__int32 linear_dither(unsigned source_bps, unsigned target_bps, FLAC__int32 sample, dither_state *dither, const FLAC__int32 MIN, const FLAC__int32 MAX)
 {
 	unsigned scalebits;
 	FLAC__int32 output, mask, random;
@@ -106,6 +106,37 @@ static FLAC__int32 linear_dither(unsigned source_bps, unsigned target_bps, FLAC_
 	return output >> scalebits;
 }
 
+/* The samples are dithered in blocks of this many before they are packed. */
+#define DITHER_BLOCK 256
+
+/* Dithers 'samples' samples of 'channels' channels, which is 1 or 2.  Each
+ * sample depends on the error of the one before, so two channels are done
+ * in the same loop to let their computations overlap; the state is copied
+ * to locals so that the stores to 'output' cannot alias it.
+ */
+static void linear_dither_block(unsigned source_bps, unsigned target_bps, const FLAC__int32 * const input[], FLAC__int32 output[][DITHER_BLOCK], unsigned channels, unsigned samples, dither_state dither[], const FLAC__int32 MIN, const FLAC__int32 MAX)
+{
+	dither_state d0 = dither[0], d1;
+	unsigned i;
+
+	FLAC__ASSERT(channels == 1 || channels == 2);
+	FLAC__ASSERT(samples <= DITHER_BLOCK);
+
+	if(channels == 2) {
+		d1 = dither[1];
+		for(i = 0; i < samples; i++) {
+			output[0][i] = linear_dither(source_bps, target_bps, input[0][i], &d0, MIN, MAX);
+			output[1][i] = linear_dither(source_bps, target_bps, input[1][i], &d1, MIN, MAX);
+		}
+		dither[1] = d1;
+	}
+	else {
+		for(i = 0; i < samples; i++)
+			output[0][i] = linear_dither(source_bps, target_bps, input[0][i], &d0, MIN, MAX);
+	}
+	dither[0] = d0;
+}
+
 size_t FLAC__plugin_common__pack_pcm_signed_big_endian(FLAC__byte *data, const FLAC__int32 * const input[], unsigned wide_samples, unsigned channels, unsigned source_bps, unsigned target_bps)
 {
 	static dither_state dither[FLAC_PLUGIN__MAX_SUPPORTED_CHANNELS];
@@ -127,31 +158,42 @@ size_t FLAC__plugin_common__pack_pcm_signed_big_endian(FLAC__byte *data, const F
 		const FLAC__int32 MIN = -(1L << (source_bps - 1));
 		const FLAC__int32 MAX = ~MIN; /*(1L << (source_bps-1)) - 1 */
 
-		for(channel = 0; channel < channels; channel++) {
-			
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = linear_dither(source_bps, target_bps, *input_++, &dither[channel], MIN, MAX);
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 16:
-						data[0] = (FLAC__byte)(sample >> 8);
-						data[1] = (FLAC__byte)sample;
-						break;
-					case 24:
-						data[0] = (FLAC__byte)(sample >> 16);
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[2] = (FLAC__byte)sample;
-						break;
+		FLAC__int32 dithered[2][DITHER_BLOCK];
+		const FLAC__int32 *pair_input[2];
+		unsigned pair, c, i, n, offset;
+
+		for(channel = 0; channel < channels; channel += pair) {
+			pair = channels - channel >= 2? 2 : 1;
+
+			for(offset = 0; offset < wide_samples; offset += n) {
+				n = wide_samples - offset < DITHER_BLOCK? wide_samples - offset : DITHER_BLOCK;
+				for(c = 0; c < pair; c++)
+					pair_input[c] = input[channel + c] + offset;
+				linear_dither_block(source_bps, target_bps, pair_input, dithered, pair, n, &dither[channel], MIN, MAX);
+
+				for(c = 0; c < pair; c++) {
+					data = start + bytes_per_sample * (channel + c) + incr * offset;
+					for(i = 0; i < n; i++) {
+						sample = dithered[c][i];
+
+						switch(target_bps) {
+							case 8:
+								data[0] = sample ^ 0x80;
+								break;
+							case 16:
+								data[0] = (FLAC__byte)(sample >> 8);
+								data[1] = (FLAC__byte)sample;
+								break;
+							case 24:
+								data[0] = (FLAC__byte)(sample >> 16);
+								data[1] = (FLAC__byte)(sample >> 8);
+								data[2] = (FLAC__byte)sample;
+								break;
+						}
+
+						data += incr;
+					}
 				}
-
-				data += incr;
 			}
 		}
 	}
@@ -208,28 +250,39 @@ size_t FLAC__plugin_common__pack_pcm_signed_little_endian(FLAC__byte *data, cons
 		const FLAC__int32 MIN = -(1L << (source_bps - 1));
 		const FLAC__int32 MAX = ~MIN; /*(1L << (source_bps-1)) - 1 */
 
-		for(channel = 0; channel < channels; channel++) {
-			
-			samples = wide_samples;
-			data = start + bytes_per_sample * channel;
-			input_ = input[channel];
-
-			while(samples--) {
-				sample = linear_dither(source_bps, target_bps, *input_++, &dither[channel], MIN, MAX);
-
-				switch(target_bps) {
-					case 8:
-						data[0] = sample ^ 0x80;
-						break;
-					case 24:
-						data[2] = (FLAC__byte)(sample >> 16);
-						/* fall through */
-					case 16:
-						data[1] = (FLAC__byte)(sample >> 8);
-						data[0] = (FLAC__byte)sample;
+		FLAC__int32 dithered[2][DITHER_BLOCK];
+		const FLAC__int32 *pair_input[2];
+		unsigned pair, c, i, n, offset;
+
+		for(channel = 0; channel < channels; channel += pair) {
+			pair = channels - channel >= 2? 2 : 1;
+
+			for(offset = 0; offset < wide_samples; offset += n) {
+				n = wide_samples - offset < DITHER_BLOCK? wide_samples - offset : DITHER_BLOCK;
+				for(c = 0; c < pair; c++)
+					pair_input[c] = input[channel + c] + offset;
+				linear_dither_block(source_bps, target_bps, pair_input, dithered, pair, n, &dither[channel], MIN, MAX);
+
+				for(c = 0; c < pair; c++) {
+					data = start + bytes_per_sample * (channel + c) + incr * offset;
+					for(i = 0; i < n; i++) {
+						sample = dithered[c][i];
+
+						switch(target_bps) {
+							case 8:
+								data[0] = sample ^ 0x80;
+								break;
+							case 24:
+								data[2] = (FLAC__byte)(sample >> 16);
+								/* fall through */
+							case 16:
+								data[1] = (FLAC__byte)(sample >> 8);
+								data[0] = (FLAC__byte)sample;
+						}
+
+						data += incr;
+					}
 				}
-
-				data += incr;
 			}
 		}
 	}
@@ -0,0 +1,751 @@
+/* grabbag - Convenience lib for various routines common to several tools
+ * Copyright (C) 2014  Xiph.Org Foundation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FLAC/assert.h"
+#include "FLAC/metadata.h"
+#include "share/compat.h"
+#include "share/cpu.h"
+#include "share/grabbag.h"
+
+#ifdef SHARE__X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef local_min
+#undef local_min
+#endif
+#define local_min(a,b) ((a)<(b)?(a):(b))
+
+#ifdef local_max
+#undef local_max
+#endif
+#define local_max(a,b) ((a)>(b)?(a):(b))
+
+/* samples per channel filtered at a time */
+#define CHUNK_SIZE_ 2048
+
+/* the gating blocks are made of 100 ms sub-blocks: 4 for the 400 ms blocks
+ * of the integrated loudness and 30 for the 3 s blocks of the loudness range,
+ * each starting a sub-block after the one before
+ */
+#define SUBBLOCKS_PER_BLOCK_ 4
+#define SUBBLOCKS_PER_SHORT_TERM_BLOCK_ 30
+
+/* the blocks are counted in bins of 0.01 LU from the absolute gate up */
+#define HISTOGRAM_STEPS_PER_LU_ 100
+#define HISTOGRAM_BINS_ (80 * HISTOGRAM_STEPS_PER_LU_)
+
+/* the true peak interpolation filter of BS.1770 annex 2: 4 phases of 12 taps */
+#define TP_PHASES_ 4
+#define TP_TAPS_ 12
+
+static const char *loudness_format_ = "%s=%.1f LUFS";
+static const char *range_format_ = "%s=%.1f LU";
+static const char *true_peak_format_ = "%s=%.1f dBTP";
+
+const unsigned GRABBAG__LOUDNESS_MAX_TAG_SPACE_REQUIRED = 212;
+/*
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 19 + 1 + 10 +
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 25 + 1 + 7 +
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 20 + 1 + 10 +
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 19 + 1 + 10 +
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 25 + 1 + 7 +
+	FLAC__STREAM_METADATA_VORBIS_COMMENT_ENTRY_LENGTH_LEN/8 + 20 + 1 + 10
+*/
+
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_LOUDNESS = (const FLAC__byte * const)"R128_TRACK_LOUDNESS";
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_RANGE = (const FLAC__byte * const)"R128_TRACK_LOUDNESS_RANGE";
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_TITLE_TRUE_PEAK = (const FLAC__byte * const)"R128_TRACK_TRUE_PEAK";
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_LOUDNESS = (const FLAC__byte * const)"R128_ALBUM_LOUDNESS";
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_RANGE = (const FLAC__byte * const)"R128_ALBUM_LOUDNESS_RANGE";
+const FLAC__byte * const GRABBAG__LOUDNESS_TAG_ALBUM_TRUE_PEAK = (const FLAC__byte * const)"R128_ALBUM_TRUE_PEAK";
+
+static const float tp_coefs_[TP_PHASES_][TP_TAPS_] = {
+	{  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,  0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+	{ -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,  0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+	{ -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,  0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+	{ -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,  0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f }
+};
+
+/* the channel weights of BS.1770 for FLAC's channel assignments: the
+ * surround channels count 1.5 dB more and the LFE channel not at all
+ */
+static const double weights_[FLAC__MAX_CHANNELS][FLAC__MAX_CHANNELS] = {
+	{ 1. },
+	{ 1., 1. },
+	{ 1., 1., 1. },
+	{ 1., 1., 1.41, 1.41 },
+	{ 1., 1., 1., 1.41, 1.41 },
+	{ 1., 1., 1., 0., 1.41, 1.41 },
+	{ 1., 1., 1., 0., 1.41, 1.41, 1.41 },
+	{ 1., 1., 1., 0., 1.41, 1.41, 1.41, 1.41 }
+};
+
+typedef struct {
+	FLAC__uint32 count[HISTOGRAM_BINS_];
+	double energy[HISTOGRAM_BINS_]; /* the sum of the blocks' mean squares */
+} histogram_;
+
+struct grabbag__LoudnessContext {
+	unsigned channels;
+	double weight[FLAC__MAX_CHANNELS];
+	/* the two biquads of the K-weighting filter, run in transposed direct
+	 * form II; the state of channel c is z[0..1][c] for the first one and
+	 * z[2..3][c] for the second
+	 */
+	double b[2][3], a[2][3];
+	double z[4][FLAC__MAX_CHANNELS];
+	double sum[FLAC__MAX_CHANNELS]; /* the filtered samples squared, so far in this sub-block */
+	unsigned subblock_length, subblock_samples;
+	double subblock[SUBBLOCKS_PER_SHORT_TERM_BLOCK_]; /* the last sub-blocks' weighted sums, oldest first from subblock[next_subblock] */
+	unsigned next_subblock, subblocks;
+	unsigned tp_phases; /* how many of the interpolation filter's phases are used: 4, 2 or none */
+	float tp_history[FLAC__MAX_CHANNELS][TP_TAPS_ - 1 + CHUNK_SIZE_];
+	float title_peak, album_peak;
+	histogram_ title_blocks, title_short_term, album_blocks, album_short_term;
+	void (*k_filter)(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned samples, double scale);
+	float (*true_peak)(const float x[], unsigned samples, unsigned phases, float peak);
+};
+
+
+static double loudness_(double energy)
+{
+	return -0.691 + 10. * log10(energy);
+}
+
+static void histogram_add_(histogram_ *h, double energy)
+{
+	double loudness;
+	int bin;
+
+	if(energy <= 0.)
+		return;
+	loudness = loudness_(energy);
+	if(loudness < GRABBAG__LOUDNESS_FLOOR)
+		return;
+	bin = (int)((loudness - GRABBAG__LOUDNESS_FLOOR) * HISTOGRAM_STEPS_PER_LU_);
+	if(bin >= HISTOGRAM_BINS_)
+		bin = HISTOGRAM_BINS_ - 1;
+	h->count[bin]++;
+	h->energy[bin] += energy;
+}
+
+static void histogram_merge_(histogram_ *to, const histogram_ *from)
+{
+	unsigned i;
+	for(i = 0; i < HISTOGRAM_BINS_; i++) {
+		to->count[i] += from->count[i];
+		to->energy[i] += from->energy[i];
+	}
+}
+
+/* Returns the first bin at or above the relative gate, 'below' LU under the
+ * mean energy of all the blocks.  A bin is judged by the mean of its blocks,
+ * so at most the blocks within 0.01 LU of the gate are put on the wrong side.
+ */
+static unsigned histogram_gate_(const histogram_ *h, double below)
+{
+	double energy = 0., gate;
+	FLAC__uint64 count = 0;
+	unsigned i;
+
+	for(i = 0; i < HISTOGRAM_BINS_; i++) {
+		count += h->count[i];
+		energy += h->energy[i];
+	}
+	if(count == 0)
+		return HISTOGRAM_BINS_;
+	gate = loudness_(energy / (double)count) - below;
+	for(i = 0; i < HISTOGRAM_BINS_; i++)
+		if(h->count[i] > 0 && loudness_(h->energy[i] / h->count[i]) >= gate)
+			break;
+	return i;
+}
+
+/* the integrated loudness of EBU Tech 3341 */
+static double integrated_(const histogram_ *h)
+{
+	double energy = 0.;
+	FLAC__uint64 count = 0;
+	unsigned i;
+
+	for(i = histogram_gate_(h, 10.); i < HISTOGRAM_BINS_; i++) {
+		count += h->count[i];
+		energy += h->energy[i];
+	}
+	if(count == 0)
+		return GRABBAG__LOUDNESS_FLOOR;
+	return local_max(loudness_(energy / (double)count), GRABBAG__LOUDNESS_FLOOR);
+}
+
+/* the loudness range of EBU Tech 3342: from the 10th to the 95th percentile
+ * of the short-term loudness above the relative gate 20 LU down
+ */
+static double range_(const histogram_ *h)
+{
+	FLAC__uint64 count = 0, low, high, n;
+	double low_loudness = 0., high_loudness = 0.;
+	unsigned first, i;
+
+	first = histogram_gate_(h, 20.);
+	for(i = first; i < HISTOGRAM_BINS_; i++)
+		count += h->count[i];
+	if(count == 0)
+		return 0.;
+	low = (FLAC__uint64)((double)(count - 1) * 0.10 + 0.5);
+	high = (FLAC__uint64)((double)(count - 1) * 0.95 + 0.5);
+	for(i = first, n = 0; i < HISTOGRAM_BINS_; i++) {
+		if(h->count[i] == 0)
+			continue;
+		if(n <= low && low < n + h->count[i])
+			low_loudness = loudness_(h->energy[i] / h->count[i]);
+		if(n <= high && high < n + h->count[i]) {
+			high_loudness = loudness_(h->energy[i] / h->count[i]);
+			break;
+		}
+		n += h->count[i];
+	}
+	return high_loudness - low_loudness;
+}
+
+static double true_peak_db_(float peak)
+{
+	if(peak <= 0.f)
+		return GRABBAG__LOUDNESS_FLOOR;
+	return local_max(20. * log10(peak), GRABBAG__LOUDNESS_FLOOR);
+}
+
+/*
+ * The K-weighting filter.  Each channel is a recurrence, so only separate
+ * channels can be filtered in parallel: the SSE2 and AVX2 versions take
+ * them two at a time and do exactly the operations of the plain C one, so
+ * all give the same results.
+ */
+
+static void k_filter_channel_(grabbag__LoudnessContext *context, unsigned c, const FLAC__int32 input[], unsigned samples, double scale)
+{
+	const double *b0 = context->b[0], *a0 = context->a[0], *b1 = context->b[1], *a1 = context->a[1];
+	double z0 = context->z[0][c], z1 = context->z[1][c], z2 = context->z[2][c], z3 = context->z[3][c];
+	double sum = context->sum[c], x, y;
+	unsigned i;
+
+	for(i = 0; i < samples; i++) {
+		x = input[i] * scale;
+		y = b0[0] * x + z0;
+		z0 = b0[1] * x - a0[1] * y + z1;
+		z1 = b0[2] * x - a0[2] * y;
+		x = y;
+		y = b1[0] * x + z2;
+		z2 = b1[1] * x - a1[1] * y + z3;
+		z3 = b1[2] * x - a1[2] * y;
+		sum += y * y;
+	}
+
+	context->z[0][c] = z0;
+	context->z[1][c] = z1;
+	context->z[2][c] = z2;
+	context->z[3][c] = z3;
+	context->sum[c] = sum;
+}
+
+static void k_filter_(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned samples, double scale)
+{
+	unsigned c;
+	for(c = 0; c < context->channels; c++)
+		k_filter_channel_(context, c, input[c], samples, scale);
+}
+
+#ifdef SHARE__X86_SIMD
+SHARE__SIMD_TARGET("sse2")
+static void k_filter_sse2_(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned samples, double scale)
+{
+	const __m128d vscale = _mm_set1_pd(scale);
+	const __m128d b00 = _mm_set1_pd(context->b[0][0]), b01 = _mm_set1_pd(context->b[0][1]), b02 = _mm_set1_pd(context->b[0][2]);
+	const __m128d a01 = _mm_set1_pd(context->a[0][1]), a02 = _mm_set1_pd(context->a[0][2]);
+	const __m128d b10 = _mm_set1_pd(context->b[1][0]), b11 = _mm_set1_pd(context->b[1][1]), b12 = _mm_set1_pd(context->b[1][2]);
+	const __m128d a11 = _mm_set1_pd(context->a[1][1]), a12 = _mm_set1_pd(context->a[1][2]);
+	unsigned c, i;
+
+	for(c = 0; c + 2 <= context->channels; c += 2) {
+		const FLAC__int32 *in0 = input[c], *in1 = input[c+1];
+		__m128d z0 = _mm_loadu_pd(&context->z[0][c]), z1 = _mm_loadu_pd(&context->z[1][c]);
+		__m128d z2 = _mm_loadu_pd(&context->z[2][c]), z3 = _mm_loadu_pd(&context->z[3][c]);
+		__m128d sum = _mm_loadu_pd(&context->sum[c]), x, y;
+
+		for(i = 0; i < samples; i++) {
+			x = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpacklo_epi32(_mm_cvtsi32_si128(in0[i]), _mm_cvtsi32_si128(in1[i]))), vscale);
+			y = _mm_add_pd(_mm_mul_pd(b00, x), z0);
+			z0 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b01, x), _mm_mul_pd(a01, y)), z1);
+			z1 = _mm_sub_pd(_mm_mul_pd(b02, x), _mm_mul_pd(a02, y));
+			x = y;
+			y = _mm_add_pd(_mm_mul_pd(b10, x), z2);
+			z2 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b11, x), _mm_mul_pd(a11, y)), z3);
+			z3 = _mm_sub_pd(_mm_mul_pd(b12, x), _mm_mul_pd(a12, y));
+			sum = _mm_add_pd(sum, _mm_mul_pd(y, y));
+		}
+
+		_mm_storeu_pd(&context->z[0][c], z0);
+		_mm_storeu_pd(&context->z[1][c], z1);
+		_mm_storeu_pd(&context->z[2][c], z2);
+		_mm_storeu_pd(&context->z[3][c], z3);
+		_mm_storeu_pd(&context->sum[c], sum);
+	}
+	if(c < context->channels)
+		k_filter_channel_(context, c, input[c], samples, scale);
+}
+
+/* The same for AVX2, which also runs the two biquads side by side: the low
+ * half of each register has the first biquad on sample i of both channels,
+ * the high half the second one on sample i-1, which came out of the first
+ * one in the pass before.
+ */
+SHARE__SIMD_TARGET("avx2")
+static void k_filter_avx2_(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned samples, double scale)
+{
+	const __m128d vscale = _mm_set1_pd(scale);
+	const __m256d b0 = _mm256_setr_pd(context->b[0][0], context->b[0][0], context->b[1][0], context->b[1][0]);
+	const __m256d b1 = _mm256_setr_pd(context->b[0][1], context->b[0][1], context->b[1][1], context->b[1][1]);
+	const __m256d b2 = _mm256_setr_pd(context->b[0][2], context->b[0][2], context->b[1][2], context->b[1][2]);
+	const __m256d a1 = _mm256_setr_pd(context->a[0][1], context->a[0][1], context->a[1][1], context->a[1][1]);
+	const __m256d a2 = _mm256_setr_pd(context->a[0][2], context->a[0][2], context->a[1][2], context->a[1][2]);
+	unsigned c, i;
+
+	if(samples < 2) {
+		k_filter_(context, input, samples, scale);
+		return;
+	}
+
+	for(c = 0; c + 2 <= context->channels; c += 2) {
+		const FLAC__int32 *in0 = input[c], *in1 = input[c+1];
+		__m256d za = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(&context->z[0][c])), _mm_loadu_pd(&context->z[2][c]), 1);
+		__m256d zb = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(&context->z[1][c])), _mm_loadu_pd(&context->z[3][c]), 1);
+		__m128d sum = _mm_loadu_pd(&context->sum[c]), x, y1;
+		__m256d xx, y;
+
+		/* sample 0 only goes through the first biquad */
+		x = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpacklo_epi32(_mm_cvtsi32_si128(in0[0]), _mm_cvtsi32_si128(in1[0]))), vscale);
+		y1 = _mm_add_pd(_mm_mul_pd(_mm256_castpd256_pd128(b0), x), _mm256_castpd256_pd128(za));
+		za = _mm256_blend_pd(za, _mm256_castpd128_pd256(_mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm256_castpd256_pd128(b1), x), _mm_mul_pd(_mm256_castpd256_pd128(a1), y1)), _mm256_castpd256_pd128(zb))), 3);
+		zb = _mm256_blend_pd(zb, _mm256_castpd128_pd256(_mm_sub_pd(_mm_mul_pd(_mm256_castpd256_pd128(b2), x), _mm_mul_pd(_mm256_castpd256_pd128(a2), y1))), 3);
+
+		for(i = 1; i < samples; i++) {
+			x = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpacklo_epi32(_mm_cvtsi32_si128(in0[i]), _mm_cvtsi32_si128(in1[i]))), vscale);
+			xx = _mm256_insertf128_pd(_mm256_castpd128_pd256(x), y1, 1);
+			y = _mm256_add_pd(_mm256_mul_pd(b0, xx), za);
+			za = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, xx), _mm256_mul_pd(a1, y)), zb);
+			zb = _mm256_sub_pd(_mm256_mul_pd(b2, xx), _mm256_mul_pd(a2, y));
+			y1 = _mm256_castpd256_pd128(y);
+			x = _mm256_extractf128_pd(y, 1);
+			sum = _mm_add_pd(sum, _mm_mul_pd(x, x));
+		}
+
+		/* and sample samples-1 only through the second */
+		x = _mm_add_pd(_mm_mul_pd(_mm256_extractf128_pd(b0, 1), y1), _mm256_extractf128_pd(za, 1));
+		_mm_storeu_pd(&context->z[2][c], _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm256_extractf128_pd(b1, 1), y1), _mm_mul_pd(_mm256_extractf128_pd(a1, 1), x)), _mm256_extractf128_pd(zb, 1)));
+		_mm_storeu_pd(&context->z[3][c], _mm_sub_pd(_mm_mul_pd(_mm256_extractf128_pd(b2, 1), y1), _mm_mul_pd(_mm256_extractf128_pd(a2, 1), x)));
+		_mm_storeu_pd(&context->z[0][c], _mm256_castpd256_pd128(za));
+		_mm_storeu_pd(&context->z[1][c], _mm256_castpd256_pd128(zb));
+		_mm_storeu_pd(&context->sum[c], _mm_add_pd(sum, _mm_mul_pd(x, x)));
+	}
+	if(c < context->channels)
+		k_filter_channel_(context, c, input[c], samples, scale);
+}
+#endif
+
+/*
+ * The true peak: the largest magnitude of the samples and of the signal
+ * interpolated between them.  x[] has TP_TAPS_-1 samples of history in
+ * front.  The SIMD versions interpolate 4 or 8 consecutive samples at once.
+ */
+
+static float true_peak_(const float x[], unsigned samples, unsigned phases, float peak)
+{
+	float y;
+	unsigned i, p, k;
+
+	for(i = 0; i < samples; i++) {
+		peak = local_max(peak, (float)fabs(x[i]));
+		for(p = 0; p < phases; p++) {
+			const float *h = tp_coefs_[p * TP_PHASES_ / phases];
+			y = h[0] * x[i];
+			for(k = 1; k < TP_TAPS_; k++)
+				y += h[k] * x[(int)i - (int)k];
+			peak = local_max(peak, (float)fabs(y));
+		}
+	}
+	return peak;
+}
+
+#ifdef SHARE__X86_SIMD
+SHARE__SIMD_TARGET("sse2")
+static float true_peak_sse2_(const float x[], unsigned samples, unsigned phases, float peak)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vpeak = _mm_set1_ps(peak), y;
+	float peaks[4];
+	unsigned i, p, k;
+
+	for(i = 0; i + 4 <= samples; i += 4) {
+		vpeak = _mm_max_ps(vpeak, _mm_and_ps(_mm_loadu_ps(x + i), abs_mask));
+		for(p = 0; p < phases; p++) {
+			const float *h = tp_coefs_[p * TP_PHASES_ / phases];
+			y = _mm_mul_ps(_mm_set1_ps(h[0]), _mm_loadu_ps(x + i));
+			for(k = 1; k < TP_TAPS_; k++)
+				y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(h[k]), _mm_loadu_ps(x + i - k)));
+			vpeak = _mm_max_ps(vpeak, _mm_and_ps(y, abs_mask));
+		}
+	}
+	_mm_storeu_ps(peaks, vpeak);
+	for(k = 0; k < 4; k++)
+		peak = local_max(peak, peaks[k]);
+	return true_peak_(x + i, samples - i, phases, peak);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static float true_peak_avx2_(const float x[], unsigned samples, unsigned phases, float peak)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 vpeak = _mm256_set1_ps(peak), y;
+	float peaks[8];
+	unsigned i, p, k;
+
+	for(i = 0; i + 8 <= samples; i += 8) {
+		vpeak = _mm256_max_ps(vpeak, _mm256_and_ps(_mm256_loadu_ps(x + i), abs_mask));
+		for(p = 0; p < phases; p++) {
+			const float *h = tp_coefs_[p * TP_PHASES_ / phases];
+			y = _mm256_mul_ps(_mm256_set1_ps(h[0]), _mm256_loadu_ps(x + i));
+			for(k = 1; k < TP_TAPS_; k++)
+				y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(h[k]), _mm256_loadu_ps(x + i - k)));
+			vpeak = _mm256_max_ps(vpeak, _mm256_and_ps(y, abs_mask));
+		}
+	}
+	_mm256_storeu_ps(peaks, vpeak);
+	for(k = 0; k < 8; k++)
+		peak = local_max(peak, peaks[k]);
+	return true_peak_(x + i, samples - i, phases, peak);
+}
+#endif
+
+/* the start of a title: no history in the filters or the blocks */
+static void reset_title_(grabbag__LoudnessContext *context)
+{
+	memset(context->z, 0, sizeof(context->z));
+	memset(context->sum, 0, sizeof(context->sum));
+	memset(context->tp_history, 0, sizeof(context->tp_history));
+	context->subblock_samples = 0;
+	context->next_subblock = context->subblocks = 0;
+	context->title_peak = 0.f;
+	memset(&context->title_blocks, 0, sizeof(context->title_blocks));
+	memset(&context->title_short_term, 0, sizeof(context->title_short_term));
+}
+
+static void end_subblock_(grabbag__LoudnessContext *context)
+{
+	double energy = 0.;
+	unsigned c, i, j;
+
+	for(c = 0; c < context->channels; c++) {
+		energy += context->weight[c] * context->sum[c];
+		context->sum[c] = 0.;
+	}
+	context->subblock[context->next_subblock] = energy;
+	context->next_subblock = (context->next_subblock + 1) % SUBBLOCKS_PER_SHORT_TERM_BLOCK_;
+	if(context->subblocks < SUBBLOCKS_PER_SHORT_TERM_BLOCK_)
+		context->subblocks++;
+	context->subblock_samples = 0;
+
+	if(context->subblocks >= SUBBLOCKS_PER_BLOCK_) {
+		energy = 0.;
+		for(i = 0, j = context->next_subblock + SUBBLOCKS_PER_SHORT_TERM_BLOCK_ - SUBBLOCKS_PER_BLOCK_; i < SUBBLOCKS_PER_BLOCK_; i++, j++)
+			energy += context->subblock[j % SUBBLOCKS_PER_SHORT_TERM_BLOCK_];
+		histogram_add_(&context->title_blocks, energy / (double)(SUBBLOCKS_PER_BLOCK_ * context->subblock_length));
+	}
+	if(context->subblocks == SUBBLOCKS_PER_SHORT_TERM_BLOCK_) {
+		energy = 0.;
+		for(i = 0, j = context->next_subblock; i < SUBBLOCKS_PER_SHORT_TERM_BLOCK_; i++, j++)
+			energy += context->subblock[j % SUBBLOCKS_PER_SHORT_TERM_BLOCK_];
+		histogram_add_(&context->title_short_term, energy / (double)(SUBBLOCKS_PER_SHORT_TERM_BLOCK_ * context->subblock_length));
+	}
+}
+
+FLAC__bool grabbag__loudness_is_valid_format(unsigned sample_frequency, unsigned channels)
+{
+	return sample_frequency >= 8000 && channels >= 1 && channels <= FLAC__MAX_CHANNELS;
+}
+
+grabbag__LoudnessContext *grabbag__loudness_new(void)
+{
+	grabbag__LoudnessContext *context = calloc(1, sizeof(grabbag__LoudnessContext));
+	share__CPUInfo cpu;
+
+	if(0 == context)
+		return 0;
+
+	share__cpu_info(&cpu);
+	context->k_filter = k_filter_;
+	context->true_peak = true_peak_;
+#ifdef SHARE__X86_SIMD
+	if(cpu.sse2) {
+		context->k_filter = k_filter_sse2_;
+		context->true_peak = true_peak_sse2_;
+	}
+	if(cpu.avx2) {
+		context->k_filter = k_filter_avx2_;
+		context->true_peak = true_peak_avx2_;
+	}
+#endif
+	return context;
+}
+
+void grabbag__loudness_delete(grabbag__LoudnessContext *context)
+{
+	free(context);
+}
+
+FLAC__bool grabbag__loudness_init(grabbag__LoudnessContext *context, unsigned sample_frequency, unsigned channels)
+{
+	const double rate = (double)sample_frequency;
+	double f0, gain, q, k, vh, vb, a0;
+	unsigned c;
+
+	FLAC__ASSERT(0 != context);
+
+	if(!grabbag__loudness_is_valid_format(sample_frequency, channels))
+		return false;
+
+	context->channels = channels;
+	for(c = 0; c < channels; c++)
+		context->weight[c] = weights_[channels-1][c];
+
+	/* BS.1770 gives both biquads for 48 kHz only; these are the analog
+	 * prototypes they were made from, mapped with the bilinear transform
+	 */
+	f0 = 1681.974450955533;
+	gain = 3.999843853973347;
+	q = 0.7071752369554196;
+	k = tan(M_PI * f0 / rate);
+	vh = pow(10., gain / 20.);
+	vb = pow(vh, 0.4996667741545416);
+	a0 = 1. + k / q + k * k;
+	context->b[0][0] = (vh + vb * k / q + k * k) / a0;
+	context->b[0][1] = 2. * (k * k - vh) / a0;
+	context->b[0][2] = (vh - vb * k / q + k * k) / a0;
+	context->a[0][0] = 1.;
+	context->a[0][1] = 2. * (k * k - 1.) / a0;
+	context->a[0][2] = (1. - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / rate);
+	a0 = 1. + k / q + k * k;
+	context->b[1][0] = 1.;
+	context->b[1][1] = -2.;
+	context->b[1][2] = 1.;
+	context->a[1][0] = 1.;
+	context->a[1][1] = 2. * (k * k - 1.) / a0;
+	context->a[1][2] = (1. - k / q + k * k) / a0;
+
+	context->subblock_length = (sample_frequency + 5) / 10;
+
+	/* oversample to at least 192 kHz */
+	context->tp_phases = sample_frequency < 96000? 4 : sample_frequency < 192000? 2 : 0;
+
+	reset_title_(context);
+	context->album_peak = 0.f;
+	memset(&context->album_blocks, 0, sizeof(context->album_blocks));
+	memset(&context->album_short_term, 0, sizeof(context->album_short_term));
+	return true;
+}
+
+void grabbag__loudness_analyze(grabbag__LoudnessContext *context, const FLAC__int32 * const input[], unsigned bps, unsigned samples)
+{
+	const double scale = 1. / (double)(1u << (bps - 1));
+	const FLAC__int32 *in[FLAC__MAX_CHANNELS];
+	unsigned c, i, n, m;
+
+	FLAC__ASSERT(bps >= 4 && bps <= 32);
+
+	for(c = 0; c < context->channels; c++)
+		in[c] = input[c];
+
+	while(samples > 0) {
+		n = local_min(samples, CHUNK_SIZE_);
+
+		for(c = 0; c < context->channels; c++) {
+			float *x = context->tp_history[c];
+			for(i = 0; i < n; i++)
+				x[TP_TAPS_ - 1 + i] = (float)(in[c][i] * scale);
+			context->title_peak = context->true_peak(x + TP_TAPS_ - 1, n, context->tp_phases, context->title_peak);
+			memmove(x, x + n, (TP_TAPS_ - 1) * sizeof(float));
+		}
+
+		for(i = 0; i < n; i += m) {
+			const FLAC__int32 *sub[FLAC__MAX_CHANNELS];
+			m = local_min(n - i, context->subblock_length - context->subblock_samples);
+			for(c = 0; c < context->channels; c++)
+				sub[c] = in[c] + i;
+			context->k_filter(context, sub, m, scale);
+			context->subblock_samples += m;
+			if(context->subblock_samples == context->subblock_length)
+				end_subblock_(context);
+		}
+
+		/* the filters' state only decays during silence; keep it out of the slow denormal range */
+		for(c = 0; c < context->channels; c++)
+			for(i = 0; i < 4; i++)
+				if(fabs(context->z[i][c]) < 1e-20)
+					context->z[i][c] = 0.;
+
+		for(c = 0; c < context->channels; c++)
+			in[c] += n;
+		samples -= n;
+	}
+}
+
+void grabbag__loudness_get_album(grabbag__LoudnessContext *context, grabbag__Loudness *album)
+{
+	album->integrated = integrated_(&context->album_blocks);
+	album->range = range_(&context->album_short_term);
+	album->true_peak = true_peak_db_(context->album_peak);
+}
+
+void grabbag__loudness_get_title(grabbag__LoudnessContext *context, grabbag__Loudness *title)
+{
+	title->integrated = integrated_(&context->title_blocks);
+	title->range = range_(&context->title_short_term);
+	title->true_peak = true_peak_db_(context->title_peak);
+
+	histogram_merge_(&context->album_blocks, &context->title_blocks);
+	histogram_merge_(&context->album_short_term, &context->title_short_term);
+	context->album_peak = local_max(context->album_peak, context->title_peak);
+	reset_title_(context);
+}
+
+void grabbag__loudness_merge_album(grabbag__LoudnessContext *album, const grabbag__LoudnessContext *title)
+{
+	histogram_merge_(&album->album_blocks, &title->album_blocks);
+	histogram_merge_(&album->album_short_term, &title->album_short_term);
+	album->album_peak = local_max(album->album_peak, title->album_peak);
+}
+
+static FLAC__bool append_tag_(FLAC__StreamMetadata *block, const char *format, const FLAC__byte *name, double value)
+{
+	char buffer[256];
+	char *saved_locale;
+	FLAC__StreamMetadata_VorbisComment_Entry entry;
+
+	FLAC__ASSERT(0 != block);
+	FLAC__ASSERT(block->type == FLAC__METADATA_TYPE_VORBIS_COMMENT);
+	FLAC__ASSERT(0 != format);
+	FLAC__ASSERT(0 != name);
+
+	/* the tags have one decimal; don't write "-0.0" for what rounds to 0 */
+	if(value > -0.05 && value < 0.05)
+		value = 0.0;
+
+	buffer[sizeof(buffer)-1] = '\0';
+	/* like the ReplayGain tags, always with a '.' */
+	saved_locale = strdup(setlocale(LC_ALL, 0));
+	if (0 == saved_locale)
+		return false;
+	setlocale(LC_ALL, "C");
+	flac_snprintf(buffer, sizeof(buffer), format, name, value);
+	setlocale(LC_ALL, saved_locale);
+	free(saved_locale);
+
+	entry.entry = (FLAC__byte *)buffer;
+	entry.length = strlen(buffer);
+
+	return FLAC__metadata_object_vorbiscomment_append_comment(block, entry, /*copy=*/true);
+}
+
+static const char *store_to_vorbiscomment_(FLAC__StreamMetadata *block, const grabbag__Loudness *loudness, const FLAC__byte *loudness_tag, const FLAC__byte *range_tag, const FLAC__byte *true_peak_tag)
+{
+	FLAC__ASSERT(0 != block);
+	FLAC__ASSERT(block->type == FLAC__METADATA_TYPE_VORBIS_COMMENT);
+
+	if(
+		FLAC__metadata_object_vorbiscomment_remove_entries_matching(block, (const char *)loudness_tag) < 0 ||
+		FLAC__metadata_object_vorbiscomment_remove_entries_matching(block, (const char *)range_tag) < 0 ||
+		FLAC__metadata_object_vorbiscomment_remove_entries_matching(block, (const char *)true_peak_tag) < 0
+	)
+		return "memory allocation error";
+
+	if(
+		!append_tag_(block, loudness_format_, loudness_tag, loudness->integrated) ||
+		!append_tag_(block, range_format_, range_tag, loudness->range) ||
+		!append_tag_(block, true_peak_format_, true_peak_tag, loudness->true_peak)
+	)
+		return "memory allocation error";
+
+	return 0;
+}
+
+const char *grabbag__loudness_store_to_vorbiscomment_album(FLAC__StreamMetadata *block, const grabbag__Loudness *album)
+{
+	return store_to_vorbiscomment_(block, album, GRABBAG__LOUDNESS_TAG_ALBUM_LOUDNESS, GRABBAG__LOUDNESS_TAG_ALBUM_RANGE, GRABBAG__LOUDNESS_TAG_ALBUM_TRUE_PEAK);
+}
+
+const char *grabbag__loudness_store_to_vorbiscomment_title(FLAC__StreamMetadata *block, const grabbag__Loudness *title)
+{
+	return store_to_vorbiscomment_(block, title, GRABBAG__LOUDNESS_TAG_TITLE_LOUDNESS, GRABBAG__LOUDNESS_TAG_TITLE_RANGE, GRABBAG__LOUDNESS_TAG_TITLE_TRUE_PEAK);
+}
+
+const char *grabbag__loudness_store_to_file_album(const char *filename, const grabbag__Loudness *album, FLAC__bool preserve_modtime)
+{
+	FLAC__Metadata_Chain *chain;
+	FLAC__StreamMetadata *block = NULL;
+	const char *error;
+
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
+		return error;
+
+	if(0 != (error = grabbag__loudness_store_to_vorbiscomment_album(block, album))) {
+		FLAC__metadata_chain_delete(chain);
+		return error;
+	}
+
+	return grabbag__file_write_metadata_chain(filename, chain, preserve_modtime);
+}
+
+const char *grabbag__loudness_store_to_file_title(const char *filename, const grabbag__Loudness *title, FLAC__bool preserve_modtime)
+{
+	FLAC__Metadata_Chain *chain;
+	FLAC__StreamMetadata *block = NULL;
+	const char *error;
+
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
+		return error;
+
+	if(0 != (error = grabbag__loudness_store_to_vorbiscomment_title(block, title))) {
+		FLAC__metadata_chain_delete(chain);
+		return error;
+	}
+
+	return grabbag__file_write_metadata_chain(filename, chain, preserve_modtime);
+}
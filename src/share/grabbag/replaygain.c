@@ -26,18 +26,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#if defined _MSC_VER || defined __MINGW32__
-#include <io.h> /* for chmod() */
-#endif
-#include <sys/stat.h> /* for stat(), maybe chmod() */
 
 #include "FLAC/assert.h"
 #include "FLAC/metadata.h"
 #include "FLAC/stream_decoder.h"
+#include "share/cpu.h"
 #include "share/grabbag.h"
 #include "share/replaygain_analysis.h"
 #include "share/safe_str.h"
 
+#ifdef SHARE__X86_SIMD
+#include <immintrin.h>
+#endif
+
 #ifdef local_min
 #undef local_min
 #endif
@@ -52,7 +53,13 @@ static const char *reference_format_ = "%s=%2.1f dB";
 static const char *gain_format_ = "%s=%+2.2f dB";
 static const char *peak_format_ = "%s=%1.8f";
 
-static double album_peak_, title_peak_;
+struct grabbag__ReplayGainContext {
+	ReplayGainContext *analysis;
+	double album_peak, title_peak;
+	/* using a small buffer improves data locality; we'd like it to fit easily in the dcache */
+	flac_float_t lbuffer[2048], rbuffer[2048];
+	FLAC__int32 (*convert)(flac_float_t out[], const FLAC__int32 in[], unsigned samples, flac_float_t scale, FLAC__int32 peak);
+};
 
 const unsigned GRABBAG__REPLAYGAIN_MAX_TAG_SPACE_REQUIRED = 190;
 /*
@@ -70,21 +77,6 @@ const FLAC__byte * const GRABBAG__REPLAYGAIN_TAG_ALBUM_GAIN = (const FLAC__byte
 const FLAC__byte * const GRABBAG__REPLAYGAIN_TAG_ALBUM_PEAK = (const FLAC__byte * const)"REPLAYGAIN_ALBUM_PEAK";
 
 
-static FLAC__bool get_file_stats_(const char *filename, struct flac_stat_s *stats)
-{
-	FLAC__ASSERT(0 != filename);
-	FLAC__ASSERT(0 != stats);
-	return (0 == flac_stat(filename, stats));
-}
-
-static void set_file_stats_(const char *filename, struct flac_stat_s *stats)
-{
-	FLAC__ASSERT(0 != filename);
-	FLAC__ASSERT(0 != stats);
-
-	(void)flac_chmod(filename, stats->st_mode);
-}
-
 static FLAC__bool append_tag_(FLAC__StreamMetadata *block, const char *format, const FLAC__byte *name, float value)
 {
 	char buffer[256];
@@ -115,143 +107,160 @@ static FLAC__bool append_tag_(FLAC__StreamMetadata *block, const char *format, c
 	return FLAC__metadata_object_vorbiscomment_append_comment(block, entry, /*copy=*/true);
 }
 
+/* Converts the samples to floats multiplied by scale, a power of two (so
+ * that the result is exact), and returns the largest of peak and their
+ * magnitudes.
+ */
+static FLAC__int32 convert_(flac_float_t out[], const FLAC__int32 in[], unsigned samples, flac_float_t scale, FLAC__int32 peak)
+{
+	FLAC__int32 s;
+	unsigned i;
+
+	for(i = 0; i < samples; i++) {
+		s = in[i];
+		out[i] = (flac_float_t)s * scale;
+		s = abs(s);
+		peak = local_max(peak, s);
+	}
+	return peak;
+}
+
+#ifdef SHARE__X86_SIMD
+SHARE__SIMD_TARGET("sse2")
+static FLAC__int32 convert_sse2_(flac_float_t out[], const FLAC__int32 in[], unsigned samples, flac_float_t scale, FLAC__int32 peak)
+{
+	const __m128 vscale = _mm_set1_ps(scale);
+	__m128i vpeak = _mm_setzero_si128();
+	FLAC__int32 peaks[4];
+	unsigned i;
+
+	for(i = 0; i + 4 <= samples; i += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i*)(in + i));
+		const __m128i sign = _mm_srai_epi32(s, 31);
+		const __m128i a = _mm_sub_epi32(_mm_xor_si128(s, sign), sign);
+		const __m128i gt = _mm_cmpgt_epi32(a, vpeak);
+		vpeak = _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, vpeak));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(s), vscale));
+	}
+	_mm_storeu_si128((__m128i*)peaks, vpeak);
+	for(i = 0; i < 4; i++)
+		peak = local_max(peak, peaks[i]);
+	i = samples & ~3u;
+	return convert_(out + i, in + i, samples - i, scale, peak);
+}
+#endif
+
 FLAC__bool grabbag__replaygain_is_valid_sample_frequency(unsigned sample_frequency)
 {
         return ValidGainFrequency( sample_frequency );
 }
 
-FLAC__bool grabbag__replaygain_init(unsigned sample_frequency)
+grabbag__ReplayGainContext *grabbag__replaygain_new(void)
 {
-	title_peak_ = album_peak_ = 0.0;
-	return InitGainAnalysis((long)sample_frequency) == INIT_GAIN_ANALYSIS_OK;
+	grabbag__ReplayGainContext *context = malloc(sizeof(grabbag__ReplayGainContext));
+	share__CPUInfo cpu;
+
+	if(0 == context)
+		return 0;
+	if(0 == (context->analysis = CreateGainAnalysis())) {
+		free(context);
+		return 0;
+	}
+	context->album_peak = context->title_peak = 0.0;
+
+	share__cpu_info(&cpu);
+	context->convert = convert_;
+#ifdef SHARE__X86_SIMD
+	if(cpu.sse2)
+		context->convert = convert_sse2_;
+#endif
+	return context;
 }
 
-FLAC__bool grabbag__replaygain_analyze(const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples)
+void grabbag__replaygain_delete(grabbag__ReplayGainContext *context)
 {
-	/* using a small buffer improves data locality; we'd like it to fit easily in the dcache */
-	static flac_float_t lbuffer[2048], rbuffer[2048];
-	static const unsigned nbuffer = sizeof(lbuffer) / sizeof(lbuffer[0]);
-	FLAC__int32 block_peak = 0, s;
-	unsigned i, j;
+	if(0 != context) {
+		DeleteGainAnalysis(context->analysis);
+		free(context);
+	}
+}
+
+FLAC__bool grabbag__replaygain_init(grabbag__ReplayGainContext *context, unsigned sample_frequency)
+{
+	FLAC__ASSERT(0 != context);
+	context->title_peak = context->album_peak = 0.0;
+	return InitGainAnalysis(context->analysis, (long)sample_frequency) == INIT_GAIN_ANALYSIS_OK;
+}
+
+FLAC__bool grabbag__replaygain_analyze(grabbag__ReplayGainContext *context, const FLAC__int32 * const input[], FLAC__bool is_stereo, unsigned bps, unsigned samples)
+{
+	flac_float_t *lbuffer = context->lbuffer, *rbuffer = context->rbuffer;
+	const unsigned nbuffer = sizeof(context->lbuffer) / sizeof(context->lbuffer[0]);
+	const flac_float_t scale = (flac_float_t)(
+		(bps > 16)?
+			(double)1. / (double)(1u << (bps - 16)) :
+			(double)(1u << (16 - bps))
+	);
+	FLAC__int32 block_peak = 0;
+	unsigned j;
 
 	FLAC__ASSERT(bps >= 4 && bps <= FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE);
 	FLAC__ASSERT(FLAC__MIN_BITS_PER_SAMPLE == 4);
 	/*
 	 * We use abs() on a FLAC__int32 which is undefined for the most negative value.
 	 * If the reference codec ever handles 32bps we will have to write a special
-	 * case here.
+	 * case here.  The conversion to float is only exact up to 24 bps.
 	 */
-	FLAC__ASSERT(FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE < 32);
-
-	if(bps == 16) {
-		if(is_stereo) {
-			j = 0;
-			while(samples > 0) {
-				const unsigned n = local_min(samples, nbuffer);
-				for(i = 0; i < n; i++, j++) {
-					s = input[0][j];
-					lbuffer[i] = (flac_float_t)s;
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-
-					s = input[1][j];
-					rbuffer[i] = (flac_float_t)s;
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-				}
-				samples -= n;
-				if(AnalyzeSamples(lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
-					return false;
-			}
-		}
-		else {
-			j = 0;
-			while(samples > 0) {
-				const unsigned n = local_min(samples, nbuffer);
-				for(i = 0; i < n; i++, j++) {
-					s = input[0][j];
-					lbuffer[i] = (flac_float_t)s;
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-				}
-				samples -= n;
-				if(AnalyzeSamples(lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
-					return false;
-			}
-		}
-	}
-	else { /* bps must be < 32 according to above assertion */
-		const double scale = (
-			(bps > 16)?
-				(double)1. / (double)(1u << (bps - 16)) :
-				(double)(1u << (16 - bps))
-		);
-
-		if(is_stereo) {
-			j = 0;
-			while(samples > 0) {
-				const unsigned n = local_min(samples, nbuffer);
-				for(i = 0; i < n; i++, j++) {
-					s = input[0][j];
-					lbuffer[i] = (flac_float_t)(scale * (double)s);
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-
-					s = input[1][j];
-					rbuffer[i] = (flac_float_t)(scale * (double)s);
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-				}
-				samples -= n;
-				if(AnalyzeSamples(lbuffer, rbuffer, n, 2) != GAIN_ANALYSIS_OK)
-					return false;
-			}
-		}
-		else {
-			j = 0;
-			while(samples > 0) {
-				const unsigned n = local_min(samples, nbuffer);
-				for(i = 0; i < n; i++, j++) {
-					s = input[0][j];
-					lbuffer[i] = (flac_float_t)(scale * (double)s);
-					s = abs(s);
-					block_peak = local_max(block_peak, s);
-				}
-				samples -= n;
-				if(AnalyzeSamples(lbuffer, 0, n, 1) != GAIN_ANALYSIS_OK)
-					return false;
-			}
-		}
+	FLAC__ASSERT(FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE <= 24);
+
+	j = 0;
+	while(samples > 0) {
+		const unsigned n = local_min(samples, nbuffer);
+		block_peak = context->convert(lbuffer, input[0] + j, n, scale, block_peak);
+		if(is_stereo)
+			block_peak = context->convert(rbuffer, input[1] + j, n, scale, block_peak);
+		j += n;
+		samples -= n;
+		if(AnalyzeSamples(context->analysis, lbuffer, is_stereo? rbuffer : 0, n, is_stereo? 2 : 1) != GAIN_ANALYSIS_OK)
+			return false;
 	}
 
 	{
 		const double peak_scale = (double)(1u << (bps - 1));
 		double peak = (double)block_peak / peak_scale;
-		if(peak > title_peak_)
-			title_peak_ = peak;
-		if(peak > album_peak_)
-			album_peak_ = peak;
+		if(peak > context->title_peak)
+			context->title_peak = peak;
+		if(peak > context->album_peak)
+			context->album_peak = peak;
 	}
 
 	return true;
 }
 
-void grabbag__replaygain_get_album(float *gain, float *peak)
+void grabbag__replaygain_get_album(grabbag__ReplayGainContext *context, float *gain, float *peak)
 {
-	*gain = (float)GetAlbumGain();
-	*peak = (float)album_peak_;
-	album_peak_ = 0.0;
+	*gain = (float)GetAlbumGain(context->analysis);
+	*peak = (float)context->album_peak;
+	context->album_peak = 0.0;
 }
 
-void grabbag__replaygain_get_title(float *gain, float *peak)
+void grabbag__replaygain_get_title(grabbag__ReplayGainContext *context, float *gain, float *peak)
 {
-	*gain = (float)GetTitleGain();
-	*peak = (float)title_peak_;
-	title_peak_ = 0.0;
+	*gain = (float)GetTitleGain(context->analysis);
+	*peak = (float)context->title_peak;
+	context->title_peak = 0.0;
+}
+
+void grabbag__replaygain_merge_album(grabbag__ReplayGainContext *album, const grabbag__ReplayGainContext *title)
+{
+	MergeAlbumGain(album->analysis, title->analysis);
+	if(title->album_peak > album->album_peak)
+		album->album_peak = title->album_peak;
 }
 
 
 typedef struct {
+	grabbag__ReplayGainContext *context;
 	unsigned channels;
 	unsigned bits_per_sample;
 	unsigned sample_rate;
@@ -275,7 +284,7 @@ static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder
 		channels == instance->channels &&
 		sample_rate == instance->sample_rate
 	) {
-		instance->error = !grabbag__replaygain_analyze(buffer, channels==2, bits_per_sample, samples);
+		instance->error = !grabbag__replaygain_analyze(instance->context, buffer, channels==2, bits_per_sample, samples);
 	}
 	else {
 		instance->error = true;
@@ -319,7 +328,7 @@ static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDeco
 	instance->error = true;
 }
 
-const char *grabbag__replaygain_analyze_file(const char *filename, float *title_gain, float *title_peak)
+const char *grabbag__replaygain_analyze_file(grabbag__ReplayGainContext *context, const char *filename, float *title_gain, float *title_peak)
 {
 	DecoderInstance instance;
 	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new();
@@ -327,6 +336,7 @@ const char *grabbag__replaygain_analyze_file(const char *filename, float *title_
 	if(0 == decoder)
 		return "memory allocation error";
 
+	instance.context = context;
 	instance.error = false;
 
 	/* It does these three by default but lets be explicit: */
@@ -346,7 +356,7 @@ const char *grabbag__replaygain_analyze_file(const char *filename, float *title_
 
 	FLAC__stream_decoder_delete(decoder);
 
-	grabbag__replaygain_get_title(title_gain, title_peak);
+	grabbag__replaygain_get_title(context, title_gain, title_peak);
 
 	return 0;
 }
@@ -421,92 +431,13 @@ const char *grabbag__replaygain_store_to_vorbiscomment_title(FLAC__StreamMetadat
 	return 0;
 }
 
-static const char *store_to_file_pre_(const char *filename, FLAC__Metadata_Chain **chain, FLAC__StreamMetadata **block)
-{
-	FLAC__Metadata_Iterator *iterator;
-	const char *error;
-	FLAC__bool found_vc_block = false;
-
-	if(0 == (*chain = FLAC__metadata_chain_new()))
-		return "memory allocation error";
-
-	if(!FLAC__metadata_chain_read(*chain, filename)) {
-		error = FLAC__Metadata_ChainStatusString[FLAC__metadata_chain_status(*chain)];
-		FLAC__metadata_chain_delete(*chain);
-		return error;
-	}
-
-	if(0 == (iterator = FLAC__metadata_iterator_new())) {
-		FLAC__metadata_chain_delete(*chain);
-		return "memory allocation error";
-	}
-
-	FLAC__metadata_iterator_init(iterator, *chain);
-
-	do {
-		*block = FLAC__metadata_iterator_get_block(iterator);
-		if((*block)->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
-			found_vc_block = true;
-	} while(!found_vc_block && FLAC__metadata_iterator_next(iterator));
-
-	if(!found_vc_block) {
-		/* create a new block */
-		*block = FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
-		if(0 == *block) {
-			FLAC__metadata_chain_delete(*chain);
-			FLAC__metadata_iterator_delete(iterator);
-			return "memory allocation error";
-		}
-		while(FLAC__metadata_iterator_next(iterator))
-			;
-		if(!FLAC__metadata_iterator_insert_block_after(iterator, *block)) {
-			error = FLAC__Metadata_ChainStatusString[FLAC__metadata_chain_status(*chain)];
-			FLAC__metadata_chain_delete(*chain);
-			FLAC__metadata_iterator_delete(iterator);
-			return error;
-		}
-		/* iterator is left pointing to new block */
-		FLAC__ASSERT(FLAC__metadata_iterator_get_block(iterator) == *block);
-	}
-
-	FLAC__metadata_iterator_delete(iterator);
-
-	FLAC__ASSERT(0 != *block);
-	FLAC__ASSERT((*block)->type == FLAC__METADATA_TYPE_VORBIS_COMMENT);
-
-	return 0;
-}
-
-static const char *store_to_file_post_(const char *filename, FLAC__Metadata_Chain *chain, FLAC__bool preserve_modtime)
-{
-	struct flac_stat_s stats;
-	const FLAC__bool have_stats = get_file_stats_(filename, &stats);
-
-	(void)grabbag__file_change_stats(filename, /*read_only=*/false);
-
-	FLAC__metadata_chain_sort_padding(chain);
-	if(!FLAC__metadata_chain_write(chain, /*use_padding=*/true, preserve_modtime)) {
-		const char *error;
-		error = FLAC__Metadata_ChainStatusString[FLAC__metadata_chain_status(chain)];
-		FLAC__metadata_chain_delete(chain);
-		return error;
-	}
-
-	FLAC__metadata_chain_delete(chain);
-
-	if(have_stats)
-		set_file_stats_(filename, &stats);
-
-	return 0;
-}
-
 const char *grabbag__replaygain_store_to_file(const char *filename, float album_gain, float album_peak, float title_gain, float title_peak, FLAC__bool preserve_modtime)
 {
 	FLAC__Metadata_Chain *chain;
 	FLAC__StreamMetadata *block = NULL;
 	const char *error;
 
-	if(0 != (error = store_to_file_pre_(filename, &chain, &block)))
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
 		return error;
 
 	if(0 != (error = grabbag__replaygain_store_to_vorbiscomment(block, album_gain, album_peak, title_gain, title_peak))) {
@@ -514,7 +445,7 @@ const char *grabbag__replaygain_store_to_file(const char *filename, float album_
 		return error;
 	}
 
-	if(0 != (error = store_to_file_post_(filename, chain, preserve_modtime)))
+	if(0 != (error = grabbag__file_write_metadata_chain(filename, chain, preserve_modtime)))
 		return error;
 
 	return 0;
@@ -526,7 +457,7 @@ const char *grabbag__replaygain_store_to_file_reference(const char *filename, FL
 	FLAC__StreamMetadata *block = NULL;
 	const char *error;
 
-	if(0 != (error = store_to_file_pre_(filename, &chain, &block)))
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
 		return error;
 
 	if(0 != (error = grabbag__replaygain_store_to_vorbiscomment_reference(block))) {
@@ -534,7 +465,7 @@ const char *grabbag__replaygain_store_to_file_reference(const char *filename, FL
 		return error;
 	}
 
-	if(0 != (error = store_to_file_post_(filename, chain, preserve_modtime)))
+	if(0 != (error = grabbag__file_write_metadata_chain(filename, chain, preserve_modtime)))
 		return error;
 
 	return 0;
@@ -546,7 +477,7 @@ const char *grabbag__replaygain_store_to_file_album(const char *filename, float
 	FLAC__StreamMetadata *block = NULL;
 	const char *error;
 
-	if(0 != (error = store_to_file_pre_(filename, &chain, &block)))
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
 		return error;
 
 	if(0 != (error = grabbag__replaygain_store_to_vorbiscomment_album(block, album_gain, album_peak))) {
@@ -554,7 +485,7 @@ const char *grabbag__replaygain_store_to_file_album(const char *filename, float
 		return error;
 	}
 
-	if(0 != (error = store_to_file_post_(filename, chain, preserve_modtime)))
+	if(0 != (error = grabbag__file_write_metadata_chain(filename, chain, preserve_modtime)))
 		return error;
 
 	return 0;
@@ -566,7 +497,7 @@ const char *grabbag__replaygain_store_to_file_title(const char *filename, float
 	FLAC__StreamMetadata *block = NULL;
 	const char *error;
 
-	if(0 != (error = store_to_file_pre_(filename, &chain, &block)))
+	if(0 != (error = grabbag__file_read_vorbis_comment(filename, &chain, &block)))
 		return error;
 
 	if(0 != (error = grabbag__replaygain_store_to_vorbiscomment_title(block, title_gain, title_peak))) {
@@ -574,7 +505,7 @@ const char *grabbag__replaygain_store_to_file_title(const char *filename, float
 		return error;
 	}
 
-	if(0 != (error = store_to_file_post_(filename, chain, preserve_modtime)))
+	if(0 != (error = grabbag__file_write_metadata_chain(filename, chain, preserve_modtime)))
 		return error;
 
 	return 0;
@@ -0,0 +1,891 @@
+/* grabbag - Convenience lib for various routines common to several tools
+ * Copyright (C) 2002-2009  Josh Coalson
+ * Copyright (C) 2011-2014  Xiph.Org Foundation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FLAC/assert.h"
+#include "FLAC/stream_decoder.h"
+#include "FLAC/stream_encoder.h"
+#include "share/alloc.h"
+#include "share/compat.h"
+#include "share/grabbag.h"
+
+/* sync code and codes (4), frame/sample number (up to 7), blocksize (up to 2), sample rate (up to 2), CRC-8 (1) */
+#define MAX_FRAME_HEADER_LEN 16
+
+/* with a SEEKTABLE, a seek point is put every this many seconds, as flac does by default */
+#define SEEK_POINT_SPACING 10
+
+typedef struct {
+	FLAC__uint64 offset;
+	FLAC__uint64 sample;
+	unsigned bytes;
+	unsigned blocksize;
+} Frame;
+
+/* one frame of the output */
+typedef struct {
+	unsigned segment;
+	FLAC__uint64 sample; /* the first sample, as numbered in the segment's file */
+	unsigned blocksize;
+	FLAC__uint64 offset; /* of the frame in the segment's file */
+	unsigned bytes;
+	FLAC__bool reencode; /* if true, the frame is not copied but decoded and encoded again into 'data' */
+	FLAC__byte *data;
+} Piece;
+
+typedef struct {
+	FLAC__byte crc8_table[256];
+	FLAC__uint16 crc16_table[256];
+	unsigned compression_level;
+
+	/* the input being scanned */
+	FLAC__StreamMetadata_StreamInfo input_stream_info;
+	FLAC__bool got_stream_info;
+	FLAC__bool decoder_error;
+	FLAC__bool out_of_memory;
+	Frame *frames;
+	unsigned num_frames, frames_capacity;
+
+	/* the samples of a piece being encoded again */
+	FLAC__int32 *pcm[FLAC__MAX_CHANNELS];
+	unsigned pcm_capacity;
+	FLAC__uint64 first_sample;
+	unsigned samples, samples_got;
+	FLAC__byte *encoded_frame;
+	unsigned encoded_frame_bytes;
+
+	/* the output */
+	FLAC__StreamMetadata_StreamInfo stream_info;
+	Piece *pieces;
+	unsigned num_pieces, pieces_capacity;
+	FLAC__byte *metadata; /* the blocks copied from the first input */
+	size_t metadata_bytes, last_block;
+	FLAC__bool has_seektable;
+	FLAC__StreamMetadata_SeekPoint *points;
+	unsigned *point_pieces;
+	unsigned num_points;
+} Splice;
+
+static void init_crc_tables_(Splice *s)
+{
+	unsigned i, j;
+
+	for(i = 0; i < 256; i++) {
+		unsigned crc8 = i, crc16 = i << 8;
+		for(j = 0; j < 8; j++) {
+			crc8 = (crc8 & 0x80)? (crc8 << 1) ^ 0x07 : crc8 << 1;
+			crc16 = (crc16 & 0x8000)? (crc16 << 1) ^ 0x8005 : crc16 << 1;
+		}
+		s->crc8_table[i] = (FLAC__byte)crc8;
+		s->crc16_table[i] = (FLAC__uint16)crc16;
+	}
+}
+
+static FLAC__byte crc8_(const Splice *s, const FLAC__byte *data, unsigned len)
+{
+	FLAC__byte crc = 0;
+	while(len--)
+		crc = s->crc8_table[crc ^ *data++];
+	return crc;
+}
+
+static FLAC__uint16 crc16_(const Splice *s, FLAC__uint16 crc, const FLAC__byte *data, unsigned len)
+{
+	while(len--)
+		crc = (FLAC__uint16)((crc << 8) ^ s->crc16_table[(crc >> 8) ^ *data++]);
+	return crc;
+}
+
+/*
+ * decoding
+ */
+
+static FLAC__StreamDecoderWriteStatus write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
+{
+	Splice *s = (Splice*)client_data;
+	const FLAC__uint64 first = frame->header.number.sample_number;
+	const FLAC__uint64 next = first + frame->header.blocksize;
+	const FLAC__uint64 wanted = s->first_sample + s->samples_got;
+
+	(void)decoder;
+
+	FLAC__ASSERT(frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER);
+
+	/* after seeking, the frames come in order starting at the wanted sample */
+	if(wanted >= first && wanted < next && s->samples_got < s->samples) {
+		const unsigned offset = (unsigned)(wanted - first);
+		unsigned n = frame->header.blocksize - offset, channel;
+		if(n > s->samples - s->samples_got)
+			n = s->samples - s->samples_got;
+		for(channel = 0; channel < frame->header.channels; channel++)
+			memcpy(s->pcm[channel] + s->samples_got, buffer[channel] + offset, n * sizeof(FLAC__int32));
+		s->samples_got += n;
+	}
+
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void metadata_callback_(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
+{
+	Splice *s = (Splice*)client_data;
+
+	(void)decoder;
+
+	if(metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+		s->input_stream_info = metadata->data.stream_info;
+		s->got_stream_info = true;
+	}
+}
+
+static void error_callback_(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+	Splice *s = (Splice*)client_data;
+
+	(void)decoder, (void)status;
+
+	/* a damaged frame must not be copied with a newly computed CRC */
+	s->decoder_error = true;
+}
+
+static FLAC__bool scan_callback_(const FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data)
+{
+	Splice *s = (Splice*)client_data;
+	Frame *frame;
+
+	(void)decoder;
+
+	if(s->num_frames == s->frames_capacity) {
+		const unsigned capacity = s->frames_capacity? s->frames_capacity * 2 : 1024;
+		Frame *frames = safe_realloc_mul_2op_(s->frames, capacity, sizeof(Frame));
+		if(0 == frames) {
+			s->out_of_memory = true;
+			return false;
+		}
+		s->frames = frames;
+		s->frames_capacity = capacity;
+	}
+
+	frame = &s->frames[s->num_frames++];
+	frame->offset = frame_offset;
+	frame->sample = header->number.sample_number;
+	frame->bytes = frame_bytes;
+	frame->blocksize = header->blocksize;
+
+	return true;
+}
+
+/* returns the index of the frame holding 'sample' */
+static unsigned find_frame_(const Splice *s, FLAC__uint64 sample)
+{
+	unsigned lo = 0, hi = s->num_frames - 1;
+
+	FLAC__ASSERT(s->num_frames > 0);
+
+	while(lo < hi) {
+		const unsigned mid = (lo + hi + 1) / 2;
+		if(s->frames[mid].sample <= sample)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/*
+ * encoding
+ */
+
+static FLAC__StreamEncoderWriteStatus encoder_write_callback_(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	Splice *s = (Splice*)client_data;
+
+	(void)encoder, (void)current_frame;
+
+	/* skip the metadata, and keep the one frame */
+	if(samples > 0) {
+		if(0 != s->encoded_frame)
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		if(0 == (s->encoded_frame = safe_malloc_(bytes)))
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		memcpy(s->encoded_frame, buffer, bytes);
+		s->encoded_frame_bytes = (unsigned)bytes;
+	}
+
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static const char *encode_piece_(Splice *s, FLAC__StreamDecoder *decoder, Piece *piece)
+{
+	const FLAC__StreamMetadata_StreamInfo *stream_info = &s->stream_info;
+	FLAC__StreamEncoder *encoder;
+	FLAC__bool ok;
+	unsigned channel;
+
+	FLAC__ASSERT(piece->reencode);
+
+	if(piece->blocksize > s->pcm_capacity) {
+		for(channel = 0; channel < stream_info->channels; channel++) {
+			free(s->pcm[channel]);
+			if(0 == (s->pcm[channel] = safe_malloc_mul_2op_(piece->blocksize, sizeof(FLAC__int32)))) {
+				s->pcm_capacity = 0;
+				return "memory allocation error";
+			}
+		}
+		s->pcm_capacity = piece->blocksize;
+	}
+
+	s->first_sample = piece->sample;
+	s->samples = piece->blocksize;
+	s->samples_got = 0;
+	if(!FLAC__stream_decoder_seek_absolute(decoder, piece->sample))
+		return "decoding input";
+	while(s->samples_got < s->samples) {
+		if(FLAC__stream_decoder_get_state(decoder) == FLAC__STREAM_DECODER_END_OF_STREAM || !FLAC__stream_decoder_process_single(decoder))
+			return "decoding input";
+	}
+	if(s->decoder_error)
+		return "decoding input";
+
+	if(0 == (encoder = FLAC__stream_encoder_new()))
+		return "memory allocation error";
+
+	FLAC__stream_encoder_set_channels(encoder, stream_info->channels);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, stream_info->bits_per_sample);
+	FLAC__stream_encoder_set_sample_rate(encoder, stream_info->sample_rate);
+	FLAC__stream_encoder_set_compression_level(encoder, s->compression_level);
+	/* the encoder needs a legal blocksize, but it will still write a single shorter frame */
+	FLAC__stream_encoder_set_blocksize(encoder, piece->blocksize < FLAC__MIN_BLOCK_SIZE? FLAC__MIN_BLOCK_SIZE : piece->blocksize);
+	FLAC__stream_encoder_set_streamable_subset(encoder, FLAC__format_sample_rate_is_subset(stream_info->sample_rate) && FLAC__format_blocksize_is_subset(piece->blocksize, stream_info->sample_rate));
+	FLAC__stream_encoder_set_total_samples_estimate(encoder, piece->blocksize);
+
+	FLAC__ASSERT(0 == s->encoded_frame);
+	if(FLAC__stream_encoder_init_stream(encoder, encoder_write_callback_, /*seek_callback=*/0, /*tell_callback=*/0, /*metadata_callback=*/0, s) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		FLAC__stream_encoder_delete(encoder);
+		return "initializing encoder";
+	}
+	ok = FLAC__stream_encoder_process(encoder, (const FLAC__int32 * const *)s->pcm, piece->blocksize);
+	ok = FLAC__stream_encoder_finish(encoder) && ok;
+	FLAC__stream_encoder_delete(encoder);
+
+	if(!ok || 0 == s->encoded_frame) {
+		free(s->encoded_frame);
+		s->encoded_frame = 0;
+		return "encoding";
+	}
+
+	piece->data = s->encoded_frame;
+	piece->bytes = s->encoded_frame_bytes;
+	s->encoded_frame = 0;
+
+	return 0;
+}
+
+/*
+ * planning
+ */
+
+static FLAC__bool add_piece_(Splice *s, unsigned segment, const Frame *frame, FLAC__uint64 sample, unsigned blocksize)
+{
+	Piece *piece;
+
+	if(s->num_pieces == s->pieces_capacity) {
+		const unsigned capacity = s->pieces_capacity? s->pieces_capacity * 2 : 1024;
+		Piece *pieces = safe_realloc_mul_2op_(s->pieces, capacity, sizeof(Piece));
+		if(0 == pieces)
+			return false;
+		s->pieces = pieces;
+		s->pieces_capacity = capacity;
+	}
+
+	piece = &s->pieces[s->num_pieces++];
+	piece->segment = segment;
+	piece->sample = sample;
+	piece->blocksize = blocksize;
+	piece->offset = frame->offset;
+	piece->bytes = frame->bytes;
+	piece->reencode = (sample != frame->sample || blocksize != frame->blocksize);
+	piece->data = 0;
+
+	return true;
+}
+
+/* joins pieces[i] and pieces[i+1] of the same segment into one frame to be encoded again */
+static void merge_pieces_(Splice *s, unsigned i)
+{
+	FLAC__ASSERT(i + 1 < s->num_pieces);
+	FLAC__ASSERT(s->pieces[i].segment == s->pieces[i+1].segment);
+
+	if(s->pieces[i].blocksize + s->pieces[i+1].blocksize > FLAC__MAX_BLOCK_SIZE)
+		return;
+
+	s->pieces[i].blocksize += s->pieces[i+1].blocksize;
+	s->pieces[i].reencode = true;
+	memmove(&s->pieces[i+1], &s->pieces[i+2], (s->num_pieces - i - 2) * sizeof(Piece));
+	s->num_pieces--;
+}
+
+static const char *add_segment_(Splice *s, unsigned index, const grabbag__SpliceSegment *segment, FLAC__bool is_last)
+{
+	FLAC__StreamDecoder *decoder;
+	FLAC__uint64 total_samples = 0, until;
+	const unsigned first_piece = s->num_pieces;
+	unsigned i, first, last;
+	const char *error = 0;
+
+	s->num_frames = 0;
+	s->got_stream_info = false;
+	s->decoder_error = false;
+	s->out_of_memory = false;
+
+	if(0 == (decoder = FLAC__stream_decoder_new()))
+		return "memory allocation error";
+
+	FLAC__stream_decoder_set_md5_checking(decoder, false);
+	FLAC__stream_decoder_set_frame_index(decoder, true);
+
+	if(FLAC__stream_decoder_init_file(decoder, segment->filename, write_callback_, metadata_callback_, error_callback_, s) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		FLAC__stream_decoder_delete(decoder);
+		return "initializing decoder";
+	}
+
+	if(!FLAC__stream_decoder_scan_until_end_of_stream(decoder, scan_callback_, &total_samples))
+		error = s->out_of_memory? "memory allocation error" : "reading input";
+	else if(s->decoder_error)
+		error = "input has damaged frames";
+	else if(!s->got_stream_info || s->num_frames == 0)
+		error = "input has no audio";
+	else if(index == 0)
+		s->stream_info = s->input_stream_info;
+	else if(
+		s->input_stream_info.sample_rate != s->stream_info.sample_rate ||
+		s->input_stream_info.channels != s->stream_info.channels ||
+		s->input_stream_info.bits_per_sample != s->stream_info.bits_per_sample
+	)
+		error = "inputs have different sample rates, channels or bits per sample";
+
+	until = segment->until? segment->until : total_samples;
+	if(0 == error && (segment->skip >= until || until > total_samples))
+		error = "segment is not within the input";
+
+	if(0 == error) {
+		first = find_frame_(s, segment->skip);
+		last = find_frame_(s, until - 1);
+		if(first == last) {
+			if(!add_piece_(s, index, &s->frames[first], segment->skip, (unsigned)(until - segment->skip)))
+				error = "memory allocation error";
+		}
+		else {
+			const Frame *frame = &s->frames[first];
+			if(!add_piece_(s, index, frame, segment->skip, (unsigned)(frame->sample + frame->blocksize - segment->skip)))
+				error = "memory allocation error";
+			for(i = first + 1; i < last && 0 == error; i++) {
+				if(!add_piece_(s, index, &s->frames[i], s->frames[i].sample, s->frames[i].blocksize))
+					error = "memory allocation error";
+			}
+			frame = &s->frames[last];
+			if(0 == error && !add_piece_(s, index, frame, frame->sample, (unsigned)(until - frame->sample)))
+				error = "memory allocation error";
+		}
+	}
+
+	if(0 == error) {
+		/* only the last frame of a stream may be shorter than FLAC__MIN_BLOCK_SIZE */
+		if(s->num_pieces - first_piece > 1 && s->pieces[first_piece].blocksize < FLAC__MIN_BLOCK_SIZE)
+			merge_pieces_(s, first_piece);
+		if(!is_last && s->num_pieces - first_piece > 1 && s->pieces[s->num_pieces-1].blocksize < FLAC__MIN_BLOCK_SIZE)
+			merge_pieces_(s, s->num_pieces - 2);
+
+		for(i = first_piece; i < s->num_pieces && 0 == error; i++) {
+			if(s->pieces[i].reencode)
+				error = encode_piece_(s, decoder, &s->pieces[i]);
+		}
+	}
+
+	FLAC__stream_decoder_delete(decoder);
+
+	return error;
+}
+
+/* copies the metadata blocks of the file, except STREAMINFO, SEEKTABLE and CUESHEET */
+static const char *read_metadata_(Splice *s, const char *filename)
+{
+	FILE *f;
+	FLAC__byte header[10];
+	FLAC__bool is_last;
+
+	if(0 == (f = flac_fopen(filename, "rb")))
+		return "opening input";
+
+	if(fread(header, 1, 4, f) != 4) {
+		fclose(f);
+		return "reading input";
+	}
+	if(0 == memcmp(header, "ID3", 3)) {
+		FLAC__off_t skip;
+		if(fread(header+4, 1, 6, f) != 6) {
+			fclose(f);
+			return "reading input";
+		}
+		skip = 10 + ((header[6] & 0x7f) << 21 | (header[7] & 0x7f) << 14 | (header[8] & 0x7f) << 7 | (header[9] & 0x7f));
+		if(header[5] & 0x10)
+			skip += 10; /* footer */
+		if(fseeko(f, skip, SEEK_SET) < 0 || fread(header, 1, 4, f) != 4) {
+			fclose(f);
+			return "reading input";
+		}
+	}
+	if(memcmp(header, "fLaC", 4)) {
+		fclose(f);
+		return "input is not a FLAC file";
+	}
+
+	do {
+		unsigned type, length;
+		if(fread(header, 1, FLAC__STREAM_METADATA_HEADER_LENGTH, f) != FLAC__STREAM_METADATA_HEADER_LENGTH) {
+			fclose(f);
+			return "reading input";
+		}
+		is_last = (header[0] & 0x80)? true : false;
+		type = header[0] & 0x7f;
+		length = (unsigned)header[1] << 16 | (unsigned)header[2] << 8 | header[3];
+		if(type == FLAC__METADATA_TYPE_STREAMINFO || type == FLAC__METADATA_TYPE_SEEKTABLE || type == FLAC__METADATA_TYPE_CUESHEET) {
+			if(type == FLAC__METADATA_TYPE_SEEKTABLE)
+				s->has_seektable = true;
+			if(fseeko(f, length, SEEK_CUR) < 0) {
+				fclose(f);
+				return "reading input";
+			}
+		}
+		else {
+			FLAC__byte *metadata = safe_realloc_add_3op_(s->metadata, s->metadata_bytes, FLAC__STREAM_METADATA_HEADER_LENGTH, length);
+			if(0 == metadata) {
+				fclose(f);
+				return "memory allocation error";
+			}
+			s->metadata = metadata;
+			s->last_block = s->metadata_bytes;
+			header[0] &= 0x7f;
+			memcpy(s->metadata + s->metadata_bytes, header, FLAC__STREAM_METADATA_HEADER_LENGTH);
+			s->metadata_bytes += FLAC__STREAM_METADATA_HEADER_LENGTH;
+			if(fread(s->metadata + s->metadata_bytes, 1, length, f) != length) {
+				fclose(f);
+				return "reading input";
+			}
+			s->metadata_bytes += length;
+		}
+	} while(!is_last);
+
+	fclose(f);
+
+	if(s->metadata_bytes > 0)
+		s->metadata[s->last_block] |= 0x80;
+
+	return 0;
+}
+
+/* picks the frame for a seek point every SEEK_POINT_SPACING seconds */
+static const char *plan_seek_points_(Splice *s)
+{
+	const FLAC__uint64 spacing = (FLAC__uint64)SEEK_POINT_SPACING * s->stream_info.sample_rate;
+	FLAC__uint64 sample = 0, target = 0;
+	unsigned i, max_points = (unsigned)(s->stream_info.total_samples / spacing) + 1;
+
+	if(
+		0 == (s->points = safe_malloc_mul_2op_(max_points, sizeof(FLAC__StreamMetadata_SeekPoint))) ||
+		0 == (s->point_pieces = safe_malloc_mul_2op_(max_points, sizeof(unsigned)))
+	)
+		return "memory allocation error";
+
+	for(i = 0; i < s->num_pieces; i++) {
+		const FLAC__uint64 next = sample + s->pieces[i].blocksize;
+		if(target < next) {
+			FLAC__ASSERT(s->num_points < max_points);
+			s->points[s->num_points].sample_number = sample;
+			s->points[s->num_points].stream_offset = 0; /* filled in while writing */
+			s->points[s->num_points].frame_samples = s->pieces[i].blocksize;
+			s->point_pieces[s->num_points] = i;
+			s->num_points++;
+			while(target < next)
+				target += spacing;
+		}
+		sample = next;
+	}
+
+	return 0;
+}
+
+/*
+ * writing
+ */
+
+static void pack_uint_(FLAC__byte *b, FLAC__uint64 val, unsigned bytes)
+{
+	while(bytes--) {
+		b[bytes] = (FLAC__byte)(val & 0xff);
+		val >>= 8;
+	}
+}
+
+static void pack_metadata_block_header_(FLAC__byte b[FLAC__STREAM_METADATA_HEADER_LENGTH], FLAC__bool is_last, FLAC__MetadataType type, unsigned length)
+{
+	pack_uint_(b+1, length, 3);
+	b[0] = (FLAC__byte)((is_last? 0x80 : 0) | type);
+}
+
+static void pack_stream_info_(FLAC__byte b[FLAC__STREAM_METADATA_STREAMINFO_LENGTH], const FLAC__StreamMetadata_StreamInfo *stream_info)
+{
+	pack_uint_(b, stream_info->min_blocksize, 2);
+	pack_uint_(b+2, stream_info->max_blocksize, 2);
+	pack_uint_(b+4, stream_info->min_framesize, 3);
+	pack_uint_(b+7, stream_info->max_framesize, 3);
+	/* 20 bits sample rate, 3 bits channels-1, 5 bits bps-1, 36 bits total samples */
+	pack_uint_(b+10,
+		(FLAC__uint64)stream_info->sample_rate << 44 |
+		(FLAC__uint64)(stream_info->channels - 1) << 41 |
+		(FLAC__uint64)(stream_info->bits_per_sample - 1) << 36 |
+		(stream_info->total_samples & FLAC__U64L(0xFFFFFFFFF)),
+		8
+	);
+	memcpy(b+18, stream_info->md5sum, 16);
+}
+
+static void pack_seek_points_(FLAC__byte *b, const FLAC__StreamMetadata_SeekPoint *points, unsigned num_points)
+{
+	unsigned i;
+	for(i = 0; i < num_points; i++, b += FLAC__STREAM_METADATA_SEEKPOINT_LENGTH) {
+		pack_uint_(b, points[i].sample_number, 8);
+		pack_uint_(b+8, points[i].stream_offset, 8);
+		pack_uint_(b+16, points[i].frame_samples, 2);
+	}
+}
+
+static unsigned utf8_length_(FLAC__byte x)
+{
+	if(!(x & 0x80))
+		return 1;
+	else if((x & 0xE0) == 0xC0)
+		return 2;
+	else if((x & 0xF0) == 0xE0)
+		return 3;
+	else if((x & 0xF8) == 0xF0)
+		return 4;
+	else if((x & 0xFC) == 0xF8)
+		return 5;
+	else if((x & 0xFE) == 0xFC)
+		return 6;
+	else if(x == 0xFE)
+		return 7;
+	else
+		return 0;
+}
+
+static unsigned pack_utf8_(FLAC__byte *b, FLAC__uint64 val)
+{
+	static const FLAC__byte prefix[8] = { 0, 0, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC, 0xFE };
+	unsigned len, i;
+
+	FLAC__ASSERT(val < FLAC__U64L(0x1000000000));
+
+	if(val < 0x80) {
+		b[0] = (FLAC__byte)val;
+		return 1;
+	}
+	for(len = 2; len < 7 && val >= (FLAC__U64L(1) << (5 * len + 1)); len++)
+		;
+	for(i = len - 1; i > 0; i--) {
+		b[i] = (FLAC__byte)(0x80 | (val & 0x3F));
+		val >>= 6;
+	}
+	b[0] = (FLAC__byte)(prefix[len] | val);
+	return len;
+}
+
+/* returns the length of the frame header, or 0 if it is not a valid one */
+static unsigned frame_header_length_(const FLAC__byte *frame, unsigned bytes)
+{
+	const unsigned blocksize_code = frame[2] >> 4, sample_rate_code = frame[2] & 0x0f;
+	unsigned len;
+
+	if(bytes < 6 || frame[0] != 0xff || (frame[1] & 0xfe) != 0xf8)
+		return 0;
+	if(0 == (len = utf8_length_(frame[4])))
+		return 0;
+	len += 4;
+	if(blocksize_code == 6)
+		len += 1;
+	else if(blocksize_code == 7)
+		len += 2;
+	if(sample_rate_code == 12)
+		len += 1;
+	else if(sample_rate_code == 13 || sample_rate_code == 14)
+		len += 2;
+	len++; /* CRC-8 */
+	if(len + 2 > bytes)
+		return 0;
+	return len;
+}
+
+/* writes the frame with a new frame or sample number; the CRCs are only
+ * computed again if the header changes */
+static FLAC__bool write_frame_(const Splice *s, FILE *out, const FLAC__byte *frame, unsigned bytes, FLAC__bool variable_blocksize, FLAC__uint64 number, unsigned *written)
+{
+	FLAC__byte header[MAX_FRAME_HEADER_LEN], footer[2];
+	unsigned header_len, old_header_len, old_number_len, body_len;
+	FLAC__uint16 crc16;
+
+	if(0 == (old_header_len = frame_header_length_(frame, bytes)))
+		return false;
+	old_number_len = utf8_length_(frame[4]);
+
+	header[0] = frame[0];
+	header[1] = (FLAC__byte)((frame[1] & 0xfe) | (variable_blocksize? 1 : 0));
+	header[2] = frame[2];
+	header[3] = frame[3];
+	header_len = 4 + pack_utf8_(header+4, number);
+	/* the blocksize and sample rate at the end of the header, if any, stay the same */
+	memcpy(header+header_len, frame+4+old_number_len, old_header_len-4-old_number_len-1);
+	header_len += old_header_len-4-old_number_len-1;
+	header[header_len] = crc8_(s, header, header_len);
+	header_len++;
+
+	if(header_len == old_header_len && 0 == memcmp(header, frame, header_len)) {
+		*written = bytes;
+		return fwrite(frame, 1, bytes, out) == bytes;
+	}
+
+	body_len = bytes - old_header_len - 2;
+	crc16 = crc16_(s, 0, header, header_len);
+	crc16 = crc16_(s, crc16, frame+old_header_len, body_len);
+	footer[0] = (FLAC__byte)(crc16 >> 8);
+	footer[1] = (FLAC__byte)(crc16 & 0xff);
+
+	*written = header_len + body_len + 2;
+	return
+		fwrite(header, 1, header_len, out) == header_len &&
+		fwrite(frame+old_header_len, 1, body_len, out) == body_len &&
+		fwrite(footer, 1, 2, out) == 2;
+}
+
+static const char *write_frames_(Splice *s, const grabbag__SpliceSegment segments[], FILE *out, FLAC__bool variable_blocksize)
+{
+	FILE *in = 0;
+	unsigned in_segment = 0, next_point = 0, i;
+	FLAC__uint64 in_position = 0, sample = 0, out_offset = 0;
+	FLAC__byte *buffer = 0;
+	unsigned buffer_bytes = 0;
+	const char *error = 0;
+
+	for(i = 0; i < s->num_pieces && 0 == error; i++) {
+		const Piece *piece = &s->pieces[i];
+		const FLAC__byte *frame;
+		unsigned written;
+
+		if(piece->reencode)
+			frame = piece->data;
+		else {
+			if(0 == in || piece->segment != in_segment) {
+				if(0 != in)
+					fclose(in);
+				in_segment = piece->segment;
+				in_position = 0;
+				if(0 == (in = flac_fopen(segments[in_segment].filename, "rb"))) {
+					error = "opening input";
+					break;
+				}
+			}
+			if(piece->bytes > buffer_bytes) {
+				free(buffer);
+				if(0 == (buffer = safe_malloc_(piece->bytes))) {
+					error = "memory allocation error";
+					break;
+				}
+				buffer_bytes = piece->bytes;
+			}
+			if(piece->offset != in_position && fseeko(in, (FLAC__off_t)piece->offset, SEEK_SET) < 0) {
+				error = "reading input";
+				break;
+			}
+			if(fread(buffer, 1, piece->bytes, in) != piece->bytes) {
+				error = "reading input";
+				break;
+			}
+			in_position = piece->offset + piece->bytes;
+			frame = buffer;
+		}
+
+		if(!write_frame_(s, out, frame, piece->bytes, variable_blocksize, variable_blocksize? sample : i, &written)) {
+			error = "writing output";
+			break;
+		}
+
+		if(next_point < s->num_points && s->point_pieces[next_point] == i)
+			s->points[next_point++].stream_offset = out_offset;
+		if(s->stream_info.min_framesize == 0 || written < s->stream_info.min_framesize)
+			s->stream_info.min_framesize = written;
+		if(written > s->stream_info.max_framesize)
+			s->stream_info.max_framesize = written;
+		out_offset += written;
+		sample += piece->blocksize;
+	}
+
+	if(0 != in)
+		fclose(in);
+	free(buffer);
+
+	return error;
+}
+
+static const char *write_output_(Splice *s, const grabbag__SpliceSegment segments[], const char *outfilename)
+{
+	const FLAC__bool to_stdout = (0 == strcmp(outfilename, "-"));
+	FLAC__byte b[FLAC__STREAM_METADATA_HEADER_LENGTH + FLAC__STREAM_METADATA_STREAMINFO_LENGTH];
+	FLAC__byte *seektable = 0;
+	unsigned seektable_length;
+	FLAC__bool variable_blocksize = false;
+	FILE *out;
+	const char *error = 0;
+	unsigned i;
+
+	FLAC__ASSERT(s->num_pieces > 0);
+
+	/* a fixed-blocksize stream numbers its frames, which only works if
+	 * they are all the same size except the last one */
+	for(i = 0; i < s->num_pieces; i++) {
+		if(s->pieces[i].blocksize != s->pieces[0].blocksize && (i < s->num_pieces - 1 || s->pieces[i].blocksize > s->pieces[0].blocksize))
+			variable_blocksize = true;
+	}
+
+	s->stream_info.min_blocksize = s->stream_info.max_blocksize = s->pieces[0].blocksize;
+	s->stream_info.min_framesize = s->stream_info.max_framesize = 0;
+	s->stream_info.total_samples = 0;
+	memset(s->stream_info.md5sum, 0, sizeof(s->stream_info.md5sum));
+	for(i = 0; i < s->num_pieces; i++) {
+		const unsigned blocksize = s->pieces[i].blocksize;
+		if(variable_blocksize) {
+			if(blocksize < s->stream_info.min_blocksize && i < s->num_pieces - 1)
+				s->stream_info.min_blocksize = blocksize;
+			if(blocksize > s->stream_info.max_blocksize)
+				s->stream_info.max_blocksize = blocksize;
+		}
+		s->stream_info.total_samples += blocksize;
+	}
+
+	/* the seek points can only be filled in if the output can be rewritten */
+	if(s->has_seektable && !to_stdout && 0 != (error = plan_seek_points_(s)))
+		return error;
+	seektable_length = s->num_points * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH;
+
+	if(to_stdout)
+		out = grabbag__file_get_binary_stdout();
+	else if(0 == (out = flac_fopen(outfilename, "wb")))
+		return "opening output";
+
+	if(fwrite("fLaC", 1, 4, out) != 4)
+		error = "writing output";
+
+	pack_metadata_block_header_(b, s->num_points == 0 && s->metadata_bytes == 0, FLAC__METADATA_TYPE_STREAMINFO, FLAC__STREAM_METADATA_STREAMINFO_LENGTH);
+	pack_stream_info_(b + FLAC__STREAM_METADATA_HEADER_LENGTH, &s->stream_info);
+	if(0 == error && fwrite(b, 1, sizeof(b), out) != sizeof(b))
+		error = "writing output";
+
+	if(0 == error && s->num_points > 0) {
+		if(0 == (seektable = safe_malloc_add_2op_(FLAC__STREAM_METADATA_HEADER_LENGTH, seektable_length)))
+			error = "memory allocation error";
+		else {
+			pack_metadata_block_header_(seektable, s->metadata_bytes == 0, FLAC__METADATA_TYPE_SEEKTABLE, seektable_length);
+			pack_seek_points_(seektable + FLAC__STREAM_METADATA_HEADER_LENGTH, s->points, s->num_points);
+			if(fwrite(seektable, 1, FLAC__STREAM_METADATA_HEADER_LENGTH + seektable_length, out) != FLAC__STREAM_METADATA_HEADER_LENGTH + seektable_length)
+				error = "writing output";
+		}
+	}
+
+	if(0 == error && s->metadata_bytes > 0 && fwrite(s->metadata, 1, s->metadata_bytes, out) != s->metadata_bytes)
+		error = "writing output";
+
+	if(0 == error)
+		error = write_frames_(s, segments, out, variable_blocksize);
+
+	/* go back for the frame sizes and seek point offsets */
+	if(0 == error && !to_stdout) {
+		pack_stream_info_(b + FLAC__STREAM_METADATA_HEADER_LENGTH, &s->stream_info);
+		if(fseeko(out, 4, SEEK_SET) < 0 || fwrite(b, 1, sizeof(b), out) != sizeof(b))
+			error = "writing output";
+		if(0 == error && s->num_points > 0) {
+			pack_seek_points_(seektable + FLAC__STREAM_METADATA_HEADER_LENGTH, s->points, s->num_points);
+			if(fwrite(seektable, 1, FLAC__STREAM_METADATA_HEADER_LENGTH + seektable_length, out) != FLAC__STREAM_METADATA_HEADER_LENGTH + seektable_length)
+				error = "writing output";
+		}
+	}
+
+	free(seektable);
+
+	if(to_stdout) {
+		if(0 == error && fflush(out) != 0)
+			error = "writing output";
+	}
+	else {
+		if(fclose(out) != 0 && 0 == error)
+			error = "writing output";
+		if(0 != error)
+			flac_unlink(outfilename);
+	}
+
+	return error;
+}
+
+const char *grabbag__splice(const grabbag__SpliceSegment segments[], unsigned num_segments, const char *outfilename, unsigned compression_level)
+{
+	Splice s;
+	const char *error = 0;
+	unsigned i;
+
+	FLAC__ASSERT(0 != segments);
+	FLAC__ASSERT(num_segments > 0);
+	FLAC__ASSERT(0 != outfilename);
+
+	memset(&s, 0, sizeof(s));
+	init_crc_tables_(&s);
+	s.compression_level = compression_level;
+
+	for(i = 0; i < num_segments && 0 == error; i++)
+		error = add_segment_(&s, i, &segments[i], i == num_segments - 1);
+	if(0 == error)
+		error = read_metadata_(&s, segments[0].filename);
+	if(0 == error)
+		error = write_output_(&s, segments, outfilename);
+
+	for(i = 0; i < s.num_pieces; i++)
+		free(s.pieces[i].data);
+	for(i = 0; i < FLAC__MAX_CHANNELS; i++)
+		free(s.pcm[i]);
+	free(s.pieces);
+	free(s.frames);
+	free(s.encoded_frame);
+	free(s.metadata);
+	free(s.points);
+	free(s.point_pieces);
+
+	return error;
+}
@@ -32,13 +32,20 @@
  */
 
 /*
- *  Here's the deal. Call
+ *  Here's the deal. All the state of an analysis is kept in a
+ *  ReplayGainContext, so several can go on at once, e.g. one per thread.
+ *  Call
  *
- *    InitGainAnalysis ( long samplefreq );
+ *    CreateGainAnalysis ( void );
+ *
+ *  to get a context (NULL means out of memory), and
+ *
+ *    InitGainAnalysis ( ReplayGainContext* ctx, long samplefreq );
  *
  *  to initialize everything. Call
  *
- *    AnalyzeSamples ( const flac_float_t*  left_samples,
+ *    AnalyzeSamples ( ReplayGainContext*   ctx,
+ *                     const flac_float_t*  left_samples,
  *                     const flac_float_t*  right_samples,
  *                     size_t          num_samples,
  *                     int             num_channels );
@@ -47,16 +54,22 @@
  *  If mono, pass the sample buffer in through left_samples, leave
  *  right_samples NULL, and make sure num_channels = 1.
  *
- *    GetTitleGain()
+ *    GetTitleGain ( ctx )
  *
  *  will return the recommended dB level change for all samples analyzed
  *  SINCE THE LAST TIME you called GetTitleGain() OR InitGainAnalysis().
  *
- *    GetAlbumGain()
+ *    GetAlbumGain ( ctx )
  *
  *  will return the recommended dB level change for all samples analyzed
  *  since InitGainAnalysis() was called and finalized with GetTitleGain().
  *
+ *    MergeAlbumGain ( ReplayGainContext* album, const ReplayGainContext* title );
+ *
+ *  adds everything finalized in title to album, as if it had been analyzed
+ *  there; the album result is the same whatever the order. Free a context
+ *  with DeleteGainAnalysis ( ctx ).
+ *
  *  Pseudo-code to process an album:
  *
  *    flac_float_t       l_samples [4096];
@@ -64,14 +77,20 @@
  *    size_t        num_samples;
  *    unsigned int  num_songs;
  *    unsigned int  i;
+ *    ReplayGainContext*  ctx = CreateGainAnalysis ();
  *
- *    InitGainAnalysis ( 44100 );
+ *    InitGainAnalysis ( ctx, 44100 );
  *    for ( i = 1; i <= num_songs; i++ ) {
  *        while ( ( num_samples = getSongSamples ( song[i], left_samples, right_samples ) ) > 0 )
- *            AnalyzeSamples ( left_samples, right_samples, num_samples, 2 );
- *        fprintf ("Recommended dB change for song %2d: %+6.2f dB\n", i, GetTitleGain() );
+ *            AnalyzeSamples ( ctx, left_samples, right_samples, num_samples, 2 );
+ *        fprintf ("Recommended dB change for song %2d: %+6.2f dB\n", i, GetTitleGain(ctx) );
  *    }
- *    fprintf ("Recommended dB change for whole album: %+6.2f dB\n", GetAlbumGain() );
+ *    fprintf ("Recommended dB change for whole album: %+6.2f dB\n", GetAlbumGain(ctx) );
+ *    DeleteGainAnalysis ( ctx );
+ *
+ *  or, to do the songs in parallel, analyze each in a context of its own
+ *  and MergeAlbumGain() them all into a new one (it does not need to be
+ *  initialized for this), then call GetAlbumGain() on that.
  */
 
 /*
@@ -87,6 +106,13 @@
  *  simple routine.
  *
  *  Optimization/clarity suggestions are welcome.
+ *
+ *  [FLAC] The left and right channels are kept interleaved in the buffers
+ *  so that both go through a filter at once, in the two lanes of an SSE2
+ *  register where the CPU has it (AVX2 runs both filters side by side as
+ *  well, see filterYuleButter_avx2()).  Every lane does the same float and double
+ *  operations in the same order as the plain C filter, so the results do not
+ *  depend on which code runs.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -98,8 +124,13 @@
 #include <string.h>
 #include <math.h>
 #include "share/compat.h"
+#include "share/cpu.h"
 #include "share/replaygain_analysis.h"
 
+#ifdef SHARE__X86_SIMD
+#include <immintrin.h>
+#endif
+
 flac_float_t ReplayGainReferenceLoudness = 89.0; /* in dB SPL */
 
 #define YULE_ORDER         10
@@ -111,31 +142,7 @@ flac_float_t ReplayGainReferenceLoudness = 89.0; /* in dB SPL */
 
 #define MAX_ORDER               (BUTTER_ORDER > YULE_ORDER ? BUTTER_ORDER : YULE_ORDER)
 #define PINK_REF                64.82 /* 298640883795 */                          /* calibration value */
-
-static flac_float_t          linprebuf [MAX_ORDER * 2];
-static flac_float_t*         linpre;                                          /* left input samples, with pre-buffer */
-static flac_float_t*         lstepbuf;
-static flac_float_t*         lstep;                                           /* left "first step" (i.e. post first filter) samples */
-static flac_float_t*         loutbuf;
-static flac_float_t*         lout;                                            /* left "out" (i.e. post second filter) samples */
-static flac_float_t          rinprebuf [MAX_ORDER * 2];
-static flac_float_t*         rinpre;                                          /* right input samples ... */
-static flac_float_t*         rstepbuf;
-static flac_float_t*         rstep;
-static flac_float_t*         routbuf;
-static flac_float_t*         rout;
-static unsigned int              sampleWindow;                           /* number of samples required to reach number of milliseconds required for RMS window */
-static unsigned long    totsamp;
-static double           lsum;
-static double           rsum;
-#if 0
-static uint32_t  A [(size_t)(STEPS_per_dB * MAX_dB)];
-static uint32_t  B [(size_t)(STEPS_per_dB * MAX_dB)];
-#else
-/* [JEC] Solaris Forte compiler doesn't like float calc in array indices */
-static uint32_t  A [120 * 100];
-static uint32_t  B [120 * 100];
-#endif
+#define INPUT_BLOCK          2048       /* samples (after downsampling) taken into the input buffer at a time */
 
 #ifdef _MSC_VER
 #pragma warning ( disable : 4305 )
@@ -150,7 +157,30 @@ struct ReplayGainFilter {
     flac_float_t AButter[BUTTER_ORDER+1];
 };
 
-static struct ReplayGainFilter *replaygainfilter;
+/* All the sample buffers hold left/right pairs, each after MAX_ORDER pairs of history */
+struct ReplayGainContext {
+    flac_float_t          inbuf [(MAX_ORDER + INPUT_BLOCK) * 2];           /* input samples */
+    flac_float_t*         stepbuf;
+    flac_float_t*         step;                                            /* "first step" (i.e. post first filter) samples */
+    flac_float_t*         outbuf;
+    flac_float_t*         out;                                             /* "out" (i.e. post second filter) samples */
+    unsigned int          sampleWindow;                                    /* number of samples required to reach number of milliseconds required for RMS window */
+    unsigned long         totsamp;
+    double                lsum;
+    double                rsum;
+#if 0
+    uint32_t              A [(size_t)(STEPS_per_dB * MAX_dB)];
+    uint32_t              B [(size_t)(STEPS_per_dB * MAX_dB)];
+#else
+    /* [JEC] Solaris Forte compiler doesn't like float calc in array indices */
+    uint32_t              A [120 * 100];                                   /* the title's histogram */
+    uint32_t              B [120 * 100];                                   /* the album's, the titles so far added together */
+#endif
+    struct ReplayGainFilter *replaygainfilter;
+#ifdef SHARE__X86_SIMD
+    share__CPUInfo        cpu;
+#endif
+};
 
 static const struct ReplayGainFilter ReplayGainFilters[] = {
 
@@ -265,36 +295,183 @@ static const struct ReplayGainFilter ReplayGainFilters[] = {
 #pragma warning ( default : 4305 )
 #endif
 
-/* When calling this procedure, make sure that ip[-order] and op[-order] point to real data! */
+/* When calling these procedures, make sure that input[-2*order] and output[-2*order] point to real data! */
 
 static void
-filter ( const flac_float_t* input, flac_float_t* output, size_t nSamples, const flac_float_t* a, const flac_float_t* b, size_t order, unsigned downsample )
+filter ( const flac_float_t* input, flac_float_t* output, size_t nSamples, const flac_float_t* a, const flac_float_t* b, size_t order )
 {
-    double  y;
+    double  yl;
+    double  yr;
     size_t  i;
     size_t  k;
 
-    const flac_float_t* input_head = input;
-    const flac_float_t* input_tail;
+    for ( i = 0; i < nSamples; i++, input += 2, output += 2 ) {
+        yl = input[0] * b[0];
+        yr = input[1] * b[0];
+
+        for ( k = 1; k <= order; k++ ) {
+            yl += input[-2*(long)k  ] * b[k] - output[-2*(long)k  ] * a[k];
+            yr += input[-2*(long)k+1] * b[k] - output[-2*(long)k+1] * a[k];
+        }
+
+        output[0] = (flac_float_t)yl;
+        output[1] = (flac_float_t)yr;
+    }
+}
+
+static void
+squares ( ReplayGainContext* ctx, const flac_float_t* output, size_t nSamples )
+{
+    size_t  i;
+
+    for ( i = 0; i < nSamples; i++, output += 2 ) {
+        ctx->lsum += output[0] * output[0];
+        ctx->rsum += output[1] * output[1];
+    }
+}
 
-    flac_float_t* output_head = output;
-    flac_float_t* output_tail;
+#ifdef SHARE__X86_SIMD
 
-    for ( i = 0; i < nSamples; i++, input_head += downsample, ++output_head ) {
+/* a left/right pair in the low half of a register, and one in the high half */
 
-        input_tail = input_head;
-        output_tail = output_head;
+SHARE__SIMD_TARGET("sse2")
+static inline __m128
+load_pair_sse2 ( const flac_float_t* p )
+{
+    return _mm_castsi128_ps ( _mm_loadl_epi64 ( (const __m128i*)p ) );
+}
 
-        y = *input_head * b[0];
+SHARE__SIMD_TARGET("sse2")
+static inline void
+store_pair_sse2 ( flac_float_t* p, __m128 v )
+{
+    _mm_storel_epi64 ( (__m128i*)p, _mm_castps_si128 ( v ) );
+}
 
-        for ( k = 1; k <= order; k++ ) {
-            input_tail -= downsample;
-            --output_tail;
-            y += *input_tail * b[k] - *output_tail * a[k];
-        }
+SHARE__SIMD_TARGET("sse2")
+static void
+filter_sse2 ( const flac_float_t* input, flac_float_t* output, size_t nSamples, const flac_float_t* a, const flac_float_t* b, size_t order )
+{
+    __m128   av [MAX_ORDER + 1];
+    __m128   bv [MAX_ORDER + 1];
+    __m128d  y;
+    size_t   i;
+    size_t   k;
+
+    for ( k = 0; k <= order; k++ ) {
+        av[k] = _mm_set1_ps ( a[k] );
+        bv[k] = _mm_set1_ps ( b[k] );
+    }
+
+    for ( i = 0; i < nSamples; i++, input += 2, output += 2 ) {
+        y = _mm_cvtps_pd ( _mm_mul_ps ( load_pair_sse2 ( input ), bv[0] ) );
+
+        for ( k = 1; k <= order; k++ )
+            y = _mm_add_pd ( y, _mm_cvtps_pd ( _mm_sub_ps ( _mm_mul_ps ( load_pair_sse2 ( input  - 2*k ), bv[k] ),
+                                                            _mm_mul_ps ( load_pair_sse2 ( output - 2*k ), av[k] ) ) ) );
+
+        store_pair_sse2 ( output, _mm_cvtpd_ps ( y ) );
+    }
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void
+squares_sse2 ( ReplayGainContext* ctx, const flac_float_t* output, size_t nSamples )
+{
+    __m128   v;
+    __m128d  sum = _mm_set_pd ( ctx->rsum, ctx->lsum );
+    size_t   i;
+
+    for ( i = 0; i < nSamples; i++, output += 2 ) {
+        v   = load_pair_sse2 ( output );
+        sum = _mm_add_pd ( sum, _mm_cvtps_pd ( _mm_mul_ps ( v, v ) ) );
+    }
+
+    _mm_storel_pd ( &ctx->lsum, sum );
+    _mm_storeh_pd ( &ctx->rsum, sum );
+}
+
+/*
+ *  Both filters in one pass, four lanes wide: the low half of each register
+ *  runs the Yule filter on sample i while the high half runs the Butterworth
+ *  filter on sample i-1, whose input came out of the Yule filter the pass
+ *  before.  The Butterworth coefficients are padded with zeroes up to
+ *  YULE_ORDER; adding the resulting zero terms leaves its sums unchanged.
+ */
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m128
+load_pairs_avx2 ( const flac_float_t* lo, const flac_float_t* hi )
+{
+    return _mm_loadh_pi ( _mm_castsi128_ps ( _mm_loadl_epi64 ( (const __m128i*)lo ) ), (const __m64*)hi );
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void
+filterYuleButter_avx2 ( const flac_float_t* input, flac_float_t* step, flac_float_t* output, size_t nSamples, const struct ReplayGainFilter* f )
+{
+    __m128   av [YULE_ORDER + 1];
+    __m128   bv [YULE_ORDER + 1];
+    __m128   r;
+    __m256d  y;
+    size_t   i;
+    size_t   k;
+
+    for ( k = 0; k <= YULE_ORDER; k++ ) {
+        flac_float_t  ab = k <= BUTTER_ORDER ? f->AButter[k] : 0.f;
+        flac_float_t  bb = k <= BUTTER_ORDER ? f->BButter[k] : 0.f;
+        av[k] = _mm_setr_ps ( f->AYule[k], f->AYule[k], ab, ab );
+        bv[k] = _mm_setr_ps ( f->BYule[k], f->BYule[k], bb, bb );
+    }
+
+    filter_sse2 ( input, step, 1, f->AYule, f->BYule, YULE_ORDER );
+
+    for ( i = 1; i < nSamples; i++ ) {
+        const flac_float_t*  x  = input  +  i      * 2;
+        flac_float_t*        ys = step   +  i      * 2;
+        flac_float_t*        yo = output + (i - 1) * 2;
+
+        y = _mm256_cvtps_pd ( _mm_mul_ps ( load_pairs_avx2 ( x, ys - 2 ), bv[0] ) );
+
+        for ( k = 1; k <= YULE_ORDER; k++ )
+            y = _mm256_add_pd ( y, _mm256_cvtps_pd ( _mm_sub_ps ( _mm_mul_ps ( load_pairs_avx2 ( x  - 2*k, ys - 2 - 2*k ), bv[k] ),
+                                                                  _mm_mul_ps ( load_pairs_avx2 ( ys - 2*k, yo     - 2*k ), av[k] ) ) ) );
 
-        output[i] = (flac_float_t)y;
+        r = _mm256_cvtpd_ps ( y );
+        _mm_storel_pi ( (__m64*)ys, r );
+        _mm_storeh_pi ( (__m64*)yo, r );
     }
+
+    filter_sse2 ( step + (nSamples - 1) * 2, output + (nSamples - 1) * 2, 1, f->AButter, f->BButter, BUTTER_ORDER );
+}
+
+#endif /* SHARE__X86_SIMD */
+
+/* Runs nSamples pairs from input through both filters into the current window and adds up their squares */
+
+static void
+filterWindow ( ReplayGainContext* ctx, const flac_float_t* input, size_t nSamples )
+{
+    const struct ReplayGainFilter*  f = ctx->replaygainfilter;
+    flac_float_t*  step = ctx->step + ctx->totsamp * 2;
+    flac_float_t*  out  = ctx->out  + ctx->totsamp * 2;
+
+#ifdef SHARE__X86_SIMD
+    if ( ctx->cpu.avx2 ) {
+        filterYuleButter_avx2 ( input, step, out, nSamples, f );
+        squares_sse2 ( ctx, out, nSamples );
+        return;
+    }
+    if ( ctx->cpu.sse2 ) {
+        filter_sse2 ( input, step, nSamples, f->AYule, f->BYule, YULE_ORDER );
+        filter_sse2 ( step, out, nSamples, f->AButter, f->BButter, BUTTER_ORDER );
+        squares_sse2 ( ctx, out, nSamples );
+        return;
+    }
+#endif
+    filter ( input, step, nSamples, f->AYule, f->BYule, YULE_ORDER );
+    filter ( step, out, nSamples, f->AButter, f->BButter, BUTTER_ORDER );
+    squares ( ctx, out, nSamples );
 }
 
 /* returns a INIT_GAIN_ANALYSIS_OK if successful, INIT_GAIN_ANALYSIS_ERROR if not */
@@ -340,7 +517,7 @@ static void*
 ReallocateWindowBuffer(unsigned window_size, flac_float_t **window_buffer)
 {
     void *p = realloc(
-        *window_buffer, sizeof(**window_buffer) * (window_size + MAX_ORDER));
+        *window_buffer, sizeof(**window_buffer) * (window_size + MAX_ORDER) * 2);
 
     if (p)
         *window_buffer = p;
@@ -349,37 +526,35 @@ ReallocateWindowBuffer(unsigned window_size, flac_float_t **window_buffer)
 }
 
 static int
-ResetSampleFrequency ( long samplefreq ) {
+ResetSampleFrequency ( ReplayGainContext* ctx, long samplefreq ) {
     int  i;
 
-    free(replaygainfilter);
+    free(ctx->replaygainfilter);
 
-    replaygainfilter = CreateGainFilter( samplefreq );
+    ctx->replaygainfilter = CreateGainFilter( samplefreq );
 
-    if ( ! replaygainfilter)
+    if ( ! ctx->replaygainfilter)
         return INIT_GAIN_ANALYSIS_ERROR;
 
-    sampleWindow = (int) ceil ((double)samplefreq * (double)RMS_WINDOW_TIME / 1000.0);
-    sampleWindow =
-        (replaygainfilter->rate * RMS_WINDOW_TIME + 1000-1) / 1000;
+    ctx->sampleWindow = (int) ceil ((double)samplefreq * (double)RMS_WINDOW_TIME / 1000.0);
+    ctx->sampleWindow =
+        (ctx->replaygainfilter->rate * RMS_WINDOW_TIME + 1000-1) / 1000;
 
-    if ( ! ReallocateWindowBuffer(sampleWindow, &lstepbuf) ||
-         ! ReallocateWindowBuffer(sampleWindow, &rstepbuf) ||
-         ! ReallocateWindowBuffer(sampleWindow, &loutbuf)  ||
-         ! ReallocateWindowBuffer(sampleWindow, &routbuf) ) {
+    if ( ! ReallocateWindowBuffer(ctx->sampleWindow, &ctx->stepbuf) ||
+         ! ReallocateWindowBuffer(ctx->sampleWindow, &ctx->outbuf) ) {
 
         return INIT_GAIN_ANALYSIS_ERROR;
     }
 
     /* zero out initial values */
-    for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.;
+    for ( i = 0; i < MAX_ORDER * 2; i++ )
+        ctx->inbuf[i] = ctx->stepbuf[i] = ctx->outbuf[i] = 0.;
 
-    lsum         = 0.;
-    rsum         = 0.;
-    totsamp      = 0;
+    ctx->lsum         = 0.;
+    ctx->rsum         = 0.;
+    ctx->totsamp      = 0;
 
-    memset ( A, 0, sizeof(A) );
+    memset ( ctx->A, 0, sizeof(ctx->A) );
 
     return INIT_GAIN_ANALYSIS_OK;
 }
@@ -394,21 +569,41 @@ ValidGainFrequency ( long samplefreq )
     return gainfilter != 0;
 }
 
+ReplayGainContext*
+CreateGainAnalysis ( void )
+{
+    /* the window buffers are allocated by InitGainAnalysis() */
+    ReplayGainContext* ctx = calloc ( 1, sizeof(ReplayGainContext) );
+
+#ifdef SHARE__X86_SIMD
+    if ( ctx )
+        share__cpu_info ( &ctx->cpu );
+#endif
+    return ctx;
+}
+
+void
+DeleteGainAnalysis ( ReplayGainContext* ctx )
+{
+    if ( ! ctx )
+        return;
+    free ( ctx->replaygainfilter );
+    free ( ctx->stepbuf );
+    free ( ctx->outbuf );
+    free ( ctx );
+}
+
 int
-InitGainAnalysis ( long samplefreq )
+InitGainAnalysis ( ReplayGainContext* ctx, long samplefreq )
 {
-    if (ResetSampleFrequency(samplefreq) != INIT_GAIN_ANALYSIS_OK) {
+    if (ResetSampleFrequency(ctx, samplefreq) != INIT_GAIN_ANALYSIS_OK) {
             return INIT_GAIN_ANALYSIS_ERROR;
     }
 
-    linpre       = linprebuf + MAX_ORDER;
-    rinpre       = rinprebuf + MAX_ORDER;
-    lstep        = lstepbuf  + MAX_ORDER;
-    rstep        = rstepbuf  + MAX_ORDER;
-    lout         = loutbuf   + MAX_ORDER;
-    rout         = routbuf   + MAX_ORDER;
+    ctx->step         = ctx->stepbuf + MAX_ORDER * 2;
+    ctx->out          = ctx->outbuf  + MAX_ORDER * 2;
 
-    memset ( B, 0, sizeof(B) );
+    memset ( ctx->B, 0, sizeof(ctx->B) );
 
     return INIT_GAIN_ANALYSIS_OK;
 }
@@ -416,102 +611,62 @@ InitGainAnalysis ( long samplefreq )
 /* returns GAIN_ANALYSIS_OK if successful, GAIN_ANALYSIS_ERROR if not */
 
 int
-AnalyzeSamples ( const flac_float_t* left_samples, const flac_float_t* right_samples, size_t num_samples, int num_channels )
+AnalyzeSamples ( ReplayGainContext* ctx, const flac_float_t* left_samples, const flac_float_t* right_samples, size_t num_samples, int num_channels )
 {
-    unsigned        downsample = replaygainfilter->downsample;
-    const flac_float_t*  curleft;
-    const flac_float_t*  curright;
-    long            prebufsamples;
-    long            batchsamples;
-    long            cursamples;
-    long            cursamplepos;
-    int             i;
+    unsigned        downsample = ctx->replaygainfilter->downsample;
+    flac_float_t*   inpre      = ctx->inbuf + MAX_ORDER * 2;
+    size_t          batchsamples;
+    size_t          cursamples;
+    size_t          cursamplepos;
+    size_t          i;
 
     num_samples /= downsample;
 
     if ( num_samples == 0 )
         return GAIN_ANALYSIS_OK;
 
-    cursamplepos = 0;
-    batchsamples = num_samples;
-
     switch ( num_channels) {
     case  1: right_samples = left_samples;
     case  2: break;
     default: return GAIN_ANALYSIS_ERROR;
     }
 
-    prebufsamples = MAX_ORDER;
-    if ((size_t) prebufsamples > num_samples)
-        prebufsamples = num_samples;
-
-    for ( i = 0; i < prebufsamples; ++i ) {
-        linprebuf[i+MAX_ORDER] = left_samples [i * downsample];
-        rinprebuf[i+MAX_ORDER] = right_samples[i * downsample];
-    }
-
-    while ( batchsamples > 0 ) {
-        cursamples = batchsamples > (long)(sampleWindow-totsamp)  ?  (long)(sampleWindow - totsamp)  :  batchsamples;
-        if ( cursamplepos < MAX_ORDER ) {
-            downsample = 1;
-            curleft  = linpre+cursamplepos;
-            curright = rinpre+cursamplepos;
-            if (cursamples > MAX_ORDER - cursamplepos )
-                cursamples = MAX_ORDER - cursamplepos;
-        }
-        else {
-            downsample = replaygainfilter->downsample;
-            curleft  = left_samples  + cursamplepos * downsample;
-            curright = right_samples + cursamplepos * downsample;
-        }
-
-        filter ( curleft , lstep + totsamp, cursamples, replaygainfilter->AYule, replaygainfilter->BYule, YULE_ORDER, downsample );
-        filter ( curright, rstep + totsamp, cursamples, replaygainfilter->AYule, replaygainfilter->BYule, YULE_ORDER, downsample );
-
-        filter ( lstep + totsamp, lout + totsamp, cursamples, replaygainfilter->AButter, replaygainfilter->BButter, BUTTER_ORDER, 1 );
-        filter ( rstep + totsamp, rout + totsamp, cursamples, replaygainfilter->AButter, replaygainfilter->BButter, BUTTER_ORDER, 1 );
+    while ( num_samples > 0 ) {
+        batchsamples = num_samples > INPUT_BLOCK  ?  INPUT_BLOCK  :  num_samples;
 
-        for ( i = 0; i < cursamples; i++ ) {             /* Get the squared values */
-            lsum += lout [totsamp+i] * lout [totsamp+i];
-            rsum += rout [totsamp+i] * rout [totsamp+i];
+        for ( i = 0; i < batchsamples; i++ ) {  /* interleave them after the ones kept from before */
+            inpre[2*i  ] = left_samples [i * downsample];
+            inpre[2*i+1] = right_samples[i * downsample];
         }
-
-        batchsamples -= cursamples;
-        cursamplepos += cursamples;
-        totsamp      += cursamples;
-        if ( totsamp == sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
-            double  val  = STEPS_per_dB * 10. * log10 ( (lsum+rsum) / totsamp * 0.5 + 1.e-37 );
-            int     ival = (int) val;
-            if ( ival <                     0 ) ival = 0;
-            if ( ival >= (int)(sizeof(A)/sizeof(*A)) ) ival = (int)(sizeof(A)/sizeof(*A)) - 1;
-            A [ival]++;
-            lsum = rsum = 0.;
-            memmove ( loutbuf , loutbuf  + totsamp, MAX_ORDER * sizeof(flac_float_t) );
-            memmove ( routbuf , routbuf  + totsamp, MAX_ORDER * sizeof(flac_float_t) );
-            memmove ( lstepbuf, lstepbuf + totsamp, MAX_ORDER * sizeof(flac_float_t) );
-            memmove ( rstepbuf, rstepbuf + totsamp, MAX_ORDER * sizeof(flac_float_t) );
-            totsamp = 0;
+        left_samples  += batchsamples * downsample;
+        right_samples += batchsamples * downsample;
+        num_samples   -= batchsamples;
+
+        for ( cursamplepos = 0; cursamplepos < batchsamples; cursamplepos += cursamples ) {
+            cursamples = batchsamples - cursamplepos;
+            if ( cursamples > ctx->sampleWindow - ctx->totsamp )
+                cursamples = ctx->sampleWindow - ctx->totsamp;
+
+            filterWindow ( ctx, inpre + cursamplepos * 2, cursamples );
+
+            ctx->totsamp += cursamples;
+            if ( ctx->totsamp == ctx->sampleWindow ) {  /* Get the Root Mean Square (RMS) for this set of samples */
+                double  val  = STEPS_per_dB * 10. * log10 ( (ctx->lsum+ctx->rsum) / ctx->totsamp * 0.5 + 1.e-37 );
+                int     ival = (int) val;
+                if ( ival <                     0 ) ival = 0;
+                if ( ival >= (int)(sizeof(ctx->A)/sizeof(*ctx->A)) ) ival = (int)(sizeof(ctx->A)/sizeof(*ctx->A)) - 1;
+                ctx->A [ival]++;
+                ctx->lsum = ctx->rsum = 0.;
+                memmove ( ctx->outbuf , ctx->outbuf  + ctx->totsamp * 2, MAX_ORDER * 2 * sizeof(flac_float_t) );
+                memmove ( ctx->stepbuf, ctx->stepbuf + ctx->totsamp * 2, MAX_ORDER * 2 * sizeof(flac_float_t) );
+                ctx->totsamp = 0;
+            }
+            if ( ctx->totsamp > ctx->sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
+                return GAIN_ANALYSIS_ERROR;
         }
-        if ( totsamp > sampleWindow )   /* somehow I really screwed up: Error in programming! Contact author about totsamp > sampleWindow */
-            return GAIN_ANALYSIS_ERROR;
-    }
 
-    if ( num_samples < MAX_ORDER ) {
-        memmove ( linprebuf,                           linprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(flac_float_t) );
-        memmove ( rinprebuf,                           rinprebuf + num_samples, (MAX_ORDER-num_samples) * sizeof(flac_float_t) );
-        memcpy  ( linprebuf + MAX_ORDER - num_samples, left_samples,          num_samples             * sizeof(flac_float_t) );
-        memcpy  ( rinprebuf + MAX_ORDER - num_samples, right_samples,         num_samples             * sizeof(flac_float_t) );
-    }
-    else {
-        downsample = replaygainfilter->downsample;
-
-        left_samples  += (num_samples - MAX_ORDER) * downsample;
-        right_samples += (num_samples - MAX_ORDER) * downsample;
-
-        for ( i = 0; i < MAX_ORDER; ++i ) {
-            linprebuf[i] = left_samples [i * downsample];
-            rinprebuf[i] = right_samples[i * downsample];
-        }
+        /* keep the last MAX_ORDER pairs in front for the next batch */
+        memmove ( ctx->inbuf, ctx->inbuf + batchsamples * 2, MAX_ORDER * 2 * sizeof(flac_float_t) );
     }
 
     return GAIN_ANALYSIS_OK;
@@ -519,7 +674,7 @@ AnalyzeSamples ( const flac_float_t* left_samples, const flac_float_t* right_sam
 
 
 static flac_float_t
-analyzeResult ( uint32_t* Array, size_t len )
+analyzeResult ( const uint32_t* Array, size_t len )
 {
     uint32_t  elems;
     int32_t   upper;
@@ -547,31 +702,41 @@ analyzeResult ( uint32_t* Array, size_t len )
 
 
 flac_float_t
-GetTitleGain ( void )
+GetTitleGain ( ReplayGainContext* ctx )
 {
     flac_float_t  retval;
     unsigned int    i;
 
-    retval = analyzeResult ( A, sizeof(A)/sizeof(*A) );
+    retval = analyzeResult ( ctx->A, sizeof(ctx->A)/sizeof(*ctx->A) );
 
-    for ( i = 0; i < sizeof(A)/sizeof(*A); i++ ) {
-        B[i] += A[i];
-        A[i]  = 0;
+    for ( i = 0; i < sizeof(ctx->A)/sizeof(*ctx->A); i++ ) {
+        ctx->B[i] += ctx->A[i];
+        ctx->A[i]  = 0;
     }
 
-    for ( i = 0; i < MAX_ORDER; i++ )
-        linprebuf[i] = lstepbuf[i] = loutbuf[i] = rinprebuf[i] = rstepbuf[i] = routbuf[i] = 0.f;
+    for ( i = 0; i < MAX_ORDER * 2; i++ )
+        ctx->inbuf[i] = ctx->stepbuf[i] = ctx->outbuf[i] = 0.f;
 
-    totsamp = 0;
-    lsum    = rsum = 0.;
+    ctx->totsamp = 0;
+    ctx->lsum    = ctx->rsum = 0.;
     return retval;
 }
 
 
 flac_float_t
-GetAlbumGain ( void )
+GetAlbumGain ( const ReplayGainContext* ctx )
 {
-    return analyzeResult ( B, sizeof(B)/sizeof(*B) );
+    return analyzeResult ( ctx->B, sizeof(ctx->B)/sizeof(*ctx->B) );
+}
+
+
+void
+MergeAlbumGain ( ReplayGainContext* album, const ReplayGainContext* title )
+{
+    unsigned int    i;
+
+    for ( i = 0; i < sizeof(album->B)/sizeof(*album->B); i++ )
+        album->B[i] += title->B[i];
 }
 
 /* end of replaygain_analysis.c */
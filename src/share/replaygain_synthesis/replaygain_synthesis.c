@@ -42,8 +42,13 @@
 #include <string.h> /* for memset() */
 #include <math.h>
 #include "share/replaygain_synthesis.h"
+#include "share/cpu.h"
 #include "FLAC/assert.h"
 
+#ifdef SHARE__X86_SIMD
+#include <immintrin.h>
+#endif
+
 #define FLAC__I64L(x) x##LL
 
 
@@ -77,9 +82,17 @@
  *  The first has an period of 3*5*17*257*65537, the second of 7*47*73*178481,
  *  which gives a period of 18.410.713.077.675.721.215. The result is the
  *  XORed values of both generators.
+ *
+ *  Each DitherContext runs FLAC_SHARE__RANDOM_GENERATORS of these side by side,
+ *  from different seeds, and takes their outputs in turn.  That way the next
+ *  value of every generator can be computed at once with SIMD instructions.
  */
 
-static unsigned int random_int_(void)
+static const FLAC__uint32 random_seeds_[FLAC_SHARE__RANDOM_GENERATORS] = {
+	0x00000001, 0x9E3779B9, 0x3C6EF372, 0xDAA66D2B, 0x78DDE6E4, 0x1715609D, 0xB54CDA56, 0x5384540F
+};
+
+static void random_fill_(FLAC__uint32 state[2][FLAC_SHARE__RANDOM_GENERATORS], FLAC__int32 out[], unsigned count)
 {
 	static const unsigned char parity_[256] = {
 		0,1,1,0,1,0,0,1,1,0,0,1,0,1,1,0,1,0,0,1,0,1,1,0,0,1,1,0,1,0,0,1,
@@ -91,113 +104,413 @@ static unsigned int random_int_(void)
 		0,1,1,0,1,0,0,1,1,0,0,1,0,1,1,0,1,0,0,1,0,1,1,0,0,1,1,0,1,0,0,1,
 		1,0,0,1,0,1,1,0,0,1,1,0,1,0,0,1,0,1,1,0,1,0,0,1,1,0,0,1,0,1,1,0
 	};
-	static unsigned int r1_ = 1;
-	static unsigned int r2_ = 1;
+	FLAC__uint32 t1, t2, t3, t4;
+	unsigned i, j;
+
+	/* 'count' must be a multiple of FLAC_SHARE__RANDOM_GENERATORS */
+	FLAC__ASSERT(count % FLAC_SHARE__RANDOM_GENERATORS == 0);
+
+	for (i = 0; i < count; i += FLAC_SHARE__RANDOM_GENERATORS) {
+		for (j = 0; j < FLAC_SHARE__RANDOM_GENERATORS; j++) {
+			/* Parity calculation is done via table lookup, this is also available
+			 * on CPUs without parity, can be implemented in C and avoid unpredictable
+			 * jumps and slow rotate through the carry flag operations.
+			 */
+			t3   = t1 = state[0][j]; t4   = t2 = state[1][j];
+			t1  &= 0xF5;             t2 >>= 25;
+			t1   = parity_[t1];      t2  &= 0x63;
+			t1 <<= 31;               t2   = parity_[t2];
+
+			out[i+j] = (FLAC__int32)((state[0][j] = (t3 >> 1) | t1 ) ^ (state[1][j] = (t4 + t4) | t2 ));
+		}
+	}
+}
 
-	unsigned int t1, t2, t3, t4;
+#ifdef SHARE__X86_SIMD
+/* The parities are computed by folding the bits instead of a table. */
+SHARE__SIMD_TARGET("sse2")
+static void random_fill_sse2_(FLAC__uint32 state[2][FLAC_SHARE__RANDOM_GENERATORS], FLAC__int32 out[], unsigned count)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i tap1 = _mm_set1_epi32(0xF5);
+	const __m128i tap2 = _mm_set1_epi32(0x63);
+	__m128i r1[2], r2[2], t1, t2;
+	unsigned i, j;
 
-	/* Parity calculation is done via table lookup, this is also available
-	 * on CPUs without parity, can be implemented in C and avoid unpredictable
-	 * jumps and slow rotate through the carry flag operations.
-	 */
-	t3   = t1 = r1_;    t4   = t2 = r2_;
-	t1  &= 0xF5;        t2 >>= 25;
-	t1   = parity_[t1]; t2  &= 0x63;
-	t1 <<= 31;          t2   = parity_[t2];
+	FLAC__ASSERT(count % FLAC_SHARE__RANDOM_GENERATORS == 0);
 
-	return (r1_ = (t3 >> 1) | t1 ) ^ (r2_ = (t4 + t4) | t2 );
+	for (j = 0; j < 2; j++) {
+		r1[j] = _mm_loadu_si128((const __m128i*)(state[0] + 4*j));
+		r2[j] = _mm_loadu_si128((const __m128i*)(state[1] + 4*j));
+	}
+	for (i = 0; i < count; i += FLAC_SHARE__RANDOM_GENERATORS) {
+		for (j = 0; j < 2; j++) {
+			t1 = _mm_and_si128(r1[j], tap1);
+			t2 = _mm_and_si128(_mm_srli_epi32(r2[j], 25), tap2);
+			t1 = _mm_xor_si128(t1, _mm_srli_epi32(t1, 4));
+			t2 = _mm_xor_si128(t2, _mm_srli_epi32(t2, 4));
+			t1 = _mm_xor_si128(t1, _mm_srli_epi32(t1, 2));
+			t2 = _mm_xor_si128(t2, _mm_srli_epi32(t2, 2));
+			t1 = _mm_xor_si128(t1, _mm_srli_epi32(t1, 1));
+			t2 = _mm_xor_si128(t2, _mm_srli_epi32(t2, 1));
+			r1[j] = _mm_or_si128(_mm_srli_epi32(r1[j], 1), _mm_slli_epi32(t1, 31));
+			r2[j] = _mm_or_si128(_mm_add_epi32(r2[j], r2[j]), _mm_and_si128(t2, one));
+			_mm_storeu_si128((__m128i*)(out + i + 4*j), _mm_xor_si128(r1[j], r2[j]));
+		}
+	}
+	for (j = 0; j < 2; j++) {
+		_mm_storeu_si128((__m128i*)(state[0] + 4*j), r1[j]);
+		_mm_storeu_si128((__m128i*)(state[1] + 4*j), r2[j]);
+	}
 }
 
-/* gives a equal distributed random number */
-/* between -2^31*mult and +2^31*mult */
-static double random_equi_(double mult)
+SHARE__SIMD_TARGET("avx2")
+static void random_fill_avx2_(FLAC__uint32 state[2][FLAC_SHARE__RANDOM_GENERATORS], FLAC__int32 out[], unsigned count)
 {
-	return mult * (int) random_int_();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i tap1 = _mm256_set1_epi32(0xF5);
+	const __m256i tap2 = _mm256_set1_epi32(0x63);
+	__m256i r1 = _mm256_loadu_si256((const __m256i*)state[0]);
+	__m256i r2 = _mm256_loadu_si256((const __m256i*)state[1]);
+	__m256i t1, t2;
+	unsigned i;
+
+	FLAC__ASSERT(count % FLAC_SHARE__RANDOM_GENERATORS == 0);
+
+	for (i = 0; i < count; i += FLAC_SHARE__RANDOM_GENERATORS) {
+		t1 = _mm256_and_si256(r1, tap1);
+		t2 = _mm256_and_si256(_mm256_srli_epi32(r2, 25), tap2);
+		t1 = _mm256_xor_si256(t1, _mm256_srli_epi32(t1, 4));
+		t2 = _mm256_xor_si256(t2, _mm256_srli_epi32(t2, 4));
+		t1 = _mm256_xor_si256(t1, _mm256_srli_epi32(t1, 2));
+		t2 = _mm256_xor_si256(t2, _mm256_srli_epi32(t2, 2));
+		t1 = _mm256_xor_si256(t1, _mm256_srli_epi32(t1, 1));
+		t2 = _mm256_xor_si256(t2, _mm256_srli_epi32(t2, 1));
+		r1 = _mm256_or_si256(_mm256_srli_epi32(r1, 1), _mm256_slli_epi32(t1, 31));
+		r2 = _mm256_or_si256(_mm256_add_epi32(r2, r2), _mm256_and_si256(t2, one));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_xor_si256(r1, r2));
+	}
+	_mm256_storeu_si256((__m256i*)state[0], r1);
+	_mm256_storeu_si256((__m256i*)state[1], r2);
 }
+#endif
 
-/* gives a triangular distributed random number */
-/* between -2^32*mult and +2^32*mult */
-static double random_triangular_(double mult)
-{
-	return mult * ( (double) (int) random_int_() + (double) (int) random_int_() );
-}
 
+/* The extra 0 at the end lets noise_shape_() use 16 coefficients from F[1] on. */
 
-static const float  F44_0 [16 + 32] = {
+static const float  F44_0 [16 + 1] = {
 	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0,
 	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0,
-
-	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0,
-	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0,
-
-	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0,
-	(float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0, (float)0
+	(float)0
 };
 
 
-static const float  F44_1 [16 + 32] = {  /* SNR(w) = 4.843163 dB, SNR = -3.192134 dB */
-	(float) 0.85018292704024355931, (float) 0.29089597350995344721, (float)-0.05021866022121039450, (float)-0.23545456294599161833,
-	(float)-0.58362726442227032096, (float)-0.67038978965193036429, (float)-0.38566861572833459221, (float)-0.15218663390367969967,
-	(float)-0.02577543084864530676, (float) 0.14119295297688728127, (float) 0.22398848581628781612, (float) 0.15401727203382084116,
-	(float) 0.05216161232906000929, (float)-0.00282237820999675451, (float)-0.03042794608323867363, (float)-0.03109780942998826024,
-
-	(float) 0.85018292704024355931, (float) 0.29089597350995344721, (float)-0.05021866022121039450, (float)-0.23545456294599161833,
-	(float)-0.58362726442227032096, (float)-0.67038978965193036429, (float)-0.38566861572833459221, (float)-0.15218663390367969967,
-	(float)-0.02577543084864530676, (float) 0.14119295297688728127, (float) 0.22398848581628781612, (float) 0.15401727203382084116,
-	(float) 0.05216161232906000929, (float)-0.00282237820999675451, (float)-0.03042794608323867363, (float)-0.03109780942998826024,
-
+static const float  F44_1 [16 + 1] = {  /* SNR(w) = 4.843163 dB, SNR = -3.192134 dB */
 	(float) 0.85018292704024355931, (float) 0.29089597350995344721, (float)-0.05021866022121039450, (float)-0.23545456294599161833,
 	(float)-0.58362726442227032096, (float)-0.67038978965193036429, (float)-0.38566861572833459221, (float)-0.15218663390367969967,
 	(float)-0.02577543084864530676, (float) 0.14119295297688728127, (float) 0.22398848581628781612, (float) 0.15401727203382084116,
 	(float) 0.05216161232906000929, (float)-0.00282237820999675451, (float)-0.03042794608323867363, (float)-0.03109780942998826024,
+	(float)0
 };
 
 
-static const float  F44_2 [16 + 32] = {  /* SNR(w) = 10.060213 dB, SNR = -12.766730 dB */
-	(float) 1.78827593892108555290, (float) 0.95508210637394326553, (float)-0.18447626783899924429, (float)-0.44198126506275016437,
-	(float)-0.88404052492547413497, (float)-1.42218907262407452967, (float)-1.02037566838362314995, (float)-0.34861755756425577264,
-	(float)-0.11490230170431934434, (float) 0.12498899339968611803, (float) 0.38065885268563131927, (float) 0.31883491321310506562,
-	(float) 0.10486838686563442765, (float)-0.03105361685110374845, (float)-0.06450524884075370758, (float)-0.02939198261121969816,
-
-	(float) 1.78827593892108555290, (float) 0.95508210637394326553, (float)-0.18447626783899924429, (float)-0.44198126506275016437,
-	(float)-0.88404052492547413497, (float)-1.42218907262407452967, (float)-1.02037566838362314995, (float)-0.34861755756425577264,
-	(float)-0.11490230170431934434, (float) 0.12498899339968611803, (float) 0.38065885268563131927, (float) 0.31883491321310506562,
-	(float) 0.10486838686563442765, (float)-0.03105361685110374845, (float)-0.06450524884075370758, (float)-0.02939198261121969816,
-
+static const float  F44_2 [16 + 1] = {  /* SNR(w) = 10.060213 dB, SNR = -12.766730 dB */
 	(float) 1.78827593892108555290, (float) 0.95508210637394326553, (float)-0.18447626783899924429, (float)-0.44198126506275016437,
 	(float)-0.88404052492547413497, (float)-1.42218907262407452967, (float)-1.02037566838362314995, (float)-0.34861755756425577264,
 	(float)-0.11490230170431934434, (float) 0.12498899339968611803, (float) 0.38065885268563131927, (float) 0.31883491321310506562,
 	(float) 0.10486838686563442765, (float)-0.03105361685110374845, (float)-0.06450524884075370758, (float)-0.02939198261121969816,
+	(float)0
 };
 
 
-static const float  F44_3 [16 + 32] = {  /* SNR(w) = 15.382598 dB, SNR = -29.402334 dB */
+static const float  F44_3 [16 + 1] = {  /* SNR(w) = 15.382598 dB, SNR = -29.402334 dB */
 	(float) 2.89072132015058161445, (float) 2.68932810943698754106, (float) 0.21083359339410251227, (float)-0.98385073324997617515,
 	(float)-1.11047823227097316719, (float)-2.18954076314139673147, (float)-2.36498032881953056225, (float)-0.95484132880101140785,
 	(float)-0.23924057925542965158, (float)-0.13865235703915925642, (float) 0.43587843191057992846, (float) 0.65903257226026665927,
 	(float) 0.24361815372443152787, (float)-0.00235974960154720097, (float) 0.01844166574603346289, (float) 0.01722945988740875099,
+	(float)0
+};
 
-	(float) 2.89072132015058161445, (float) 2.68932810943698754106, (float) 0.21083359339410251227, (float)-0.98385073324997617515,
-	(float)-1.11047823227097316719, (float)-2.18954076314139673147, (float)-2.36498032881953056225, (float)-0.95484132880101140785,
-	(float)-0.23924057925542965158, (float)-0.13865235703915925642, (float) 0.43587843191057992846, (float) 0.65903257226026665927,
-	(float) 0.24361815372443152787, (float)-0.00235974960154720097, (float) 0.01844166574603346289, (float) 0.01722945988740875099,
 
-	(float) 2.89072132015058161445, (float) 2.68932810943698754106, (float) 0.21083359339410251227, (float)-0.98385073324997617515,
-	(float)-1.11047823227097316719, (float)-2.18954076314139673147, (float)-2.36498032881953056225, (float)-0.95484132880101140785,
-	(float)-0.23924057925542965158, (float)-0.13865235703915925642, (float) 0.43587843191057992846, (float) 0.65903257226026665927,
-	(float) 0.24361815372443152787, (float)-0.00235974960154720097, (float) 0.01844166574603346289, (float) 0.01722945988740875099
-};
+/* The products are summed up as a tree, in the same order as the SIMD
+ * versions below do it, so that all of them give the same result.
+ */
+static float scalar16_(const float* x, const float* y)
+{
+	float s[4];
+	unsigned j;
+
+	for (j = 0; j < 4; j++)
+		s[j] = (x[j]*y[j] + x[j+8]*y[j+8]) + (x[j+4]*y[j+4] + x[j+12]*y[j+12]);
+
+	return (s[0] + s[2]) + (s[1] + s[3]);
+}
 
 
-static double scalar16_(const float* x, const float* y)
+/*
+ * the following is based on parts of wavegain.c
+ */
+
+#define BLOCK_SAMPLES_ 256
+
+static inline FLAC__int64 round64_(double x, double add)
 {
-	return
-		x[ 0]*y[ 0] + x[ 1]*y[ 1] + x[ 2]*y[ 2] + x[ 3]*y[ 3] +
-		x[ 4]*y[ 4] + x[ 5]*y[ 5] + x[ 6]*y[ 6] + x[ 7]*y[ 7] +
-		x[ 8]*y[ 8] + x[ 9]*y[ 9] + x[10]*y[10] + x[11]*y[11] +
-		x[12]*y[12] + x[13]*y[13] + x[14]*y[14] + x[15]*y[15];
+	union {
+		double d;
+		FLAC__int64 i;
+	} doubletmp;
+
+	doubletmp.d = x + add + (FLAC__int64)FLAC__I64L(0x001FFFFD80000000);
+	return doubletmp.i - (FLAC__int64)FLAC__I64L(0x433FFFFD80000000);
 }
 
+/* Noise shaping with triangular dither, for one channel and two random
+ * numbers per sample.  The histories are kept newest first.  Everything but
+ * the newest value is summed up one sample ahead, with the coefficients moved
+ * by one, so that only a multiply and an add wait for the previous sample.
+ */
+static void noise_shape_channel_(DitherContext *d, unsigned k, const double in[], const FLAC__int32 random[], FLAC__int64 out[], unsigned samples)
+{
+	/* the histories start at [p] and move down by one for every sample;
+	 * when they reach the start they are copied up to [16] again
+	 */
+	const float *c = d->FilterCoeff;
+	float dither_history[33], error_history[33];
+	float rest_d, rest_e, next_rest_d, next_rest_e;
+	double Sum, Sum2;
+	FLAC__int64 val;
+	unsigned j, p = 16;
+
+	memcpy(dither_history + 16, d->DitherHistory[k], sizeof(d->DitherHistory[k]));
+	memcpy(error_history + 16, d->ErrorHistory[k], sizeof(d->ErrorHistory[k]));
+	dither_history[32] = error_history[32] = 0.0f;
+	rest_d = scalar16_(dither_history + 17, c + 1);
+	rest_e = scalar16_(error_history + 17, c + 1);
+
+	for (j = 0; j < samples; j++) {
+		next_rest_d = scalar16_(dither_history + p, c + 1);
+		next_rest_e = scalar16_(error_history + p, c + 1);
+		if (p == 0) {
+			memcpy(dither_history + 16, dither_history, 16 * sizeof(float));
+			memcpy(error_history + 16, error_history, 16 * sizeof(float));
+			p = 16;
+		}
+		p--;
+
+		Sum = in[j];
+		Sum2 = d->Dither * ( (double) random[2*j] + (double) random[2*j+1] ) - (c[0] * dither_history[p+1] + rest_d);
+		Sum += dither_history[p] = (float)Sum2;
+		Sum2 = Sum + (c[0] * error_history[p+1] + rest_e);
+		val = round64_(Sum2, d->Add) & d->Mask;
+		error_history[p] = (float)(Sum - val);
+		out[j] = val;
+
+		rest_d = next_rest_d;
+		rest_e = next_rest_e;
+	}
+
+	memcpy(d->DitherHistory[k], dither_history + p, sizeof(d->DitherHistory[k]));
+	memcpy(d->ErrorHistory[k], error_history + p, sizeof(d->ErrorHistory[k]));
+}
+
+/* 'channels' is 1 or 2, for channel 'k' and the one after it */
+static void noise_shape_(DitherContext *d, unsigned k, unsigned channels, const double * const in[], const FLAC__int32 * const random[], FLAC__int64 * const out[], unsigned samples)
+{
+	unsigned i;
+
+	for (i = 0; i < channels; i++)
+		noise_shape_channel_(d, k + i, in[i], random[i], out[i], samples);
+}
+
+#ifdef SHARE__X86_SIMD
+/* The same with each history in four registers, moved along by one value
+ * for every sample.
+ */
+SHARE__SIMD_TARGET("sse2")
+static inline float sum16_sse2_(__m128 x0, __m128 x4, __m128 x8, __m128 x12, __m128 y0, __m128 y4, __m128 y8, __m128 y12)
+{
+	__m128 s = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(x0, y0), _mm_mul_ps(x8, y8)),
+		_mm_add_ps(_mm_mul_ps(x4, y4), _mm_mul_ps(x12, y12))
+	);
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+/* h[3..0] = { v, h[0..2] }, { h[0] lane 3, h[1] lanes 0..2 }, ... */
+SHARE__SIMD_TARGET("sse2")
+static inline void shift16_sse2_(__m128 h[4], float v)
+{
+	h[3] = _mm_shuffle_ps(_mm_shuffle_ps(h[2], h[3], _MM_SHUFFLE(1,0,3,3)), h[3], _MM_SHUFFLE(2,1,2,0));
+	h[2] = _mm_shuffle_ps(_mm_shuffle_ps(h[1], h[2], _MM_SHUFFLE(1,0,3,3)), h[2], _MM_SHUFFLE(2,1,2,0));
+	h[1] = _mm_shuffle_ps(_mm_shuffle_ps(h[0], h[1], _MM_SHUFFLE(1,0,3,3)), h[1], _MM_SHUFFLE(2,1,2,0));
+	h[0] = _mm_shuffle_ps(_mm_shuffle_ps(_mm_set_ss(v), h[0], _MM_SHUFFLE(1,0,0,0)), h[0], _MM_SHUFFLE(2,1,2,0));
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void noise_shape_channel_sse2_(DitherContext *d, unsigned k, const double in[], const FLAC__int32 random[], FLAC__int64 out[], unsigned samples)
+{
+	const float *c = d->FilterCoeff;
+	const __m128 c1 = _mm_loadu_ps(c + 1), c5 = _mm_loadu_ps(c + 5), c9 = _mm_loadu_ps(c + 9), c13 = _mm_loadu_ps(c + 13);
+	__m128 hd[4], he[4];
+	float tmp[16], last_d, last_e, rest_d, rest_e, next_rest_d, next_rest_e;
+	double Sum, Sum2;
+	FLAC__int64 val;
+	unsigned j;
+
+	memcpy(tmp, d->DitherHistory[k] + 1, 15 * sizeof(float));
+	tmp[15] = 0.0f;
+	rest_d = sum16_sse2_(_mm_loadu_ps(tmp), _mm_loadu_ps(tmp + 4), _mm_loadu_ps(tmp + 8), _mm_loadu_ps(tmp + 12), c1, c5, c9, c13);
+	memcpy(tmp, d->ErrorHistory[k] + 1, 15 * sizeof(float));
+	rest_e = sum16_sse2_(_mm_loadu_ps(tmp), _mm_loadu_ps(tmp + 4), _mm_loadu_ps(tmp + 8), _mm_loadu_ps(tmp + 12), c1, c5, c9, c13);
+	for (j = 0; j < 4; j++) {
+		hd[j] = _mm_loadu_ps(d->DitherHistory[k] + 4*j);
+		he[j] = _mm_loadu_ps(d->ErrorHistory[k] + 4*j);
+	}
+	last_d = d->DitherHistory[k][0];
+	last_e = d->ErrorHistory[k][0];
+
+	for (j = 0; j < samples; j++) {
+		next_rest_d = sum16_sse2_(hd[0], hd[1], hd[2], hd[3], c1, c5, c9, c13);
+		next_rest_e = sum16_sse2_(he[0], he[1], he[2], he[3], c1, c5, c9, c13);
+
+		Sum = in[j];
+		Sum2 = d->Dither * ( (double) random[2*j] + (double) random[2*j+1] ) - (c[0] * last_d + rest_d);
+		Sum += last_d = (float)Sum2;
+		Sum2 = Sum + (c[0] * last_e + rest_e);
+		val = round64_(Sum2, d->Add) & d->Mask;
+		last_e = (float)(Sum - val);
+		out[j] = val;
+
+		shift16_sse2_(hd, last_d);
+		shift16_sse2_(he, last_e);
+		rest_d = next_rest_d;
+		rest_e = next_rest_e;
+	}
+
+	for (j = 0; j < 4; j++) {
+		_mm_storeu_ps(d->DitherHistory[k] + 4*j, hd[j]);
+		_mm_storeu_ps(d->ErrorHistory[k] + 4*j, he[j]);
+	}
+}
+
+SHARE__SIMD_TARGET("sse2")
+static void noise_shape_sse2_(DitherContext *d, unsigned k, unsigned channels, const double * const in[], const FLAC__int32 * const random[], FLAC__int64 * const out[], unsigned samples)
+{
+	unsigned i;
+
+	for (i = 0; i < channels; i++)
+		noise_shape_channel_sse2_(d, k + i, in[i], random[i], out[i], samples);
+}
+
+/* Both channels at once, one in each half of the registers: the two chains
+ * from sample to sample are independent, so they can overlap.
+ */
+SHARE__SIMD_TARGET("avx2")
+static inline __m256 sum16_avx2_(const __m256 x[4], __m256 y0, __m256 y4, __m256 y8, __m256 y12)
+{
+	__m256 s = _mm256_add_ps(
+		_mm256_add_ps(_mm256_mul_ps(x[0], y0), _mm256_mul_ps(x[2], y8)),
+		_mm256_add_ps(_mm256_mul_ps(x[1], y4), _mm256_mul_ps(x[3], y12))
+	);
+	s = _mm256_add_ps(s, _mm256_permute_ps(s, _MM_SHUFFLE(1,0,3,2)));
+	return _mm256_add_ps(s, _mm256_permute_ps(s, _MM_SHUFFLE(2,3,0,1)));
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline void shift16_avx2_(__m256 h[4], float v0, float v1)
+{
+	h[3] = _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(h[3]), _mm256_castps_si256(h[2]), 12));
+	h[2] = _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(h[2]), _mm256_castps_si256(h[1]), 12));
+	h[1] = _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(h[1]), _mm256_castps_si256(h[0]), 12));
+	h[0] = _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_castps_si256(h[0]), _mm256_castps_si256(_mm256_set_ps(v1, 0.0f, 0.0f, 0.0f, v0, 0.0f, 0.0f, 0.0f)), 12));
+}
+
+SHARE__SIMD_TARGET("avx2")
+static inline __m256 load16_avx2_(const float *x0, const float *x1)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(x0)), _mm_loadu_ps(x1), 1);
+}
+
+SHARE__SIMD_TARGET("avx2")
+static void noise_shape_avx2_(DitherContext *d, unsigned k, unsigned channels, const double * const in[], const FLAC__int32 * const random[], FLAC__int64 * const out[], unsigned samples)
+{
+	const float *c = d->FilterCoeff;
+	const __m256 c1 = load16_avx2_(c + 1, c + 1), c5 = load16_avx2_(c + 5, c + 5), c9 = load16_avx2_(c + 9, c + 9), c13 = load16_avx2_(c + 13, c + 13);
+	float *dh0 = d->DitherHistory[k], *dh1 = d->DitherHistory[k+1], *eh0 = d->ErrorHistory[k], *eh1 = d->ErrorHistory[k+1];
+	const double *in0 = in[0], *in1 = in[1];
+	const FLAC__int32 *random0 = random[0], *random1 = random[1];
+	FLAC__int64 *out0 = out[0], *out1 = out[1];
+	__m256 hd[4], he[4], rest;
+	float tmp[2][16], last_d0, last_d1, last_e0, last_e1, rest_d0, rest_d1, rest_e0, rest_e1;
+	double Sum0, Sum1, Sum2;
+	FLAC__int64 val;
+	unsigned j;
+
+	if (channels < 2) {
+		noise_shape_sse2_(d, k, channels, in, random, out, samples);
+		return;
+	}
+
+	memcpy(tmp[0], dh0 + 1, 15 * sizeof(float));
+	memcpy(tmp[1], dh1 + 1, 15 * sizeof(float));
+	tmp[0][15] = tmp[1][15] = 0.0f;
+	for (j = 0; j < 4; j++)
+		hd[j] = load16_avx2_(tmp[0] + 4*j, tmp[1] + 4*j);
+	rest = sum16_avx2_(hd, c1, c5, c9, c13);
+	rest_d0 = _mm256_cvtss_f32(rest);
+	rest_d1 = _mm_cvtss_f32(_mm256_extractf128_ps(rest, 1));
+	memcpy(tmp[0], eh0 + 1, 15 * sizeof(float));
+	memcpy(tmp[1], eh1 + 1, 15 * sizeof(float));
+	for (j = 0; j < 4; j++)
+		he[j] = load16_avx2_(tmp[0] + 4*j, tmp[1] + 4*j);
+	rest = sum16_avx2_(he, c1, c5, c9, c13);
+	rest_e0 = _mm256_cvtss_f32(rest);
+	rest_e1 = _mm_cvtss_f32(_mm256_extractf128_ps(rest, 1));
+
+	for (j = 0; j < 4; j++) {
+		hd[j] = load16_avx2_(dh0 + 4*j, dh1 + 4*j);
+		he[j] = load16_avx2_(eh0 + 4*j, eh1 + 4*j);
+	}
+	last_d0 = dh0[0]; last_d1 = dh1[0];
+	last_e0 = eh0[0]; last_e1 = eh1[0];
+
+	for (j = 0; j < samples; j++) {
+		const __m256 next_rest_d = sum16_avx2_(hd, c1, c5, c9, c13);
+		const __m256 next_rest_e = sum16_avx2_(he, c1, c5, c9, c13);
+
+		Sum0 = in0[j];
+		Sum1 = in1[j];
+		Sum2 = d->Dither * ( (double) random0[2*j] + (double) random0[2*j+1] ) - (c[0] * last_d0 + rest_d0);
+		Sum0 += last_d0 = (float)Sum2;
+		Sum2 = d->Dither * ( (double) random1[2*j] + (double) random1[2*j+1] ) - (c[0] * last_d1 + rest_d1);
+		Sum1 += last_d1 = (float)Sum2;
+		Sum2 = Sum0 + (c[0] * last_e0 + rest_e0);
+		val = round64_(Sum2, d->Add) & d->Mask;
+		last_e0 = (float)(Sum0 - val);
+		out0[j] = val;
+		Sum2 = Sum1 + (c[0] * last_e1 + rest_e1);
+		val = round64_(Sum2, d->Add) & d->Mask;
+		last_e1 = (float)(Sum1 - val);
+		out1[j] = val;
+
+		shift16_avx2_(hd, last_d0, last_d1);
+		shift16_avx2_(he, last_e0, last_e1);
+		rest_d0 = _mm256_cvtss_f32(next_rest_d);
+		rest_d1 = _mm_cvtss_f32(_mm256_extractf128_ps(next_rest_d, 1));
+		rest_e0 = _mm256_cvtss_f32(next_rest_e);
+		rest_e1 = _mm_cvtss_f32(_mm256_extractf128_ps(next_rest_e, 1));
+	}
+
+	for (j = 0; j < 4; j++) {
+		_mm_storeu_ps(dh0 + 4*j, _mm256_castps256_ps128(hd[j]));
+		_mm_storeu_ps(dh1 + 4*j, _mm256_extractf128_ps(hd[j], 1));
+		_mm_storeu_ps(eh0 + 4*j, _mm256_castps256_ps128(he[j]));
+		_mm_storeu_ps(eh1 + 4*j, _mm256_extractf128_ps(he[j], 1));
+	}
+}
+#endif
 
 void FLAC__replaygain_synthesis__init_dither_context(DitherContext *d, int bits, int shapingtype)
 {
@@ -220,45 +533,27 @@ void FLAC__replaygain_synthesis__init_dither_context(DitherContext *d, int bits,
 	d->Mask   = ((FLAC__uint64)-1) << (32 - bits);
 	d->Add    = 0.5     * ((1L << (32 - bits)) - 1);
 	d->Dither = 0.01f*default_dither[indx] / (((FLAC__int64)1) << bits);
-	d->LastHistoryIndex = 0;
-}
-
-/*
- * the following is based on parts of wavegain.c
- */
-
-static FLAC__int64 dither_output_(DitherContext *d, FLAC__bool do_dithering, int shapingtype, int i, double Sum, int k)
-{
-	union {
-		double d;
-		FLAC__int64 i;
-	} doubletmp;
-	double Sum2;
-	FLAC__int64 val;
 
-#define ROUND64(x)   ( doubletmp.d = (x) + d->Add + (FLAC__int64)FLAC__I64L(0x001FFFFD80000000), doubletmp.i - (FLAC__int64)FLAC__I64L(0x433FFFFD80000000) )
-
-	if(do_dithering) {
-		if(shapingtype == 0) {
-			double  tmp = random_equi_(d->Dither);
-			Sum2 = tmp - d->LastRandomNumber [k];
-			d->LastRandomNumber [k] = (int)tmp;
-			Sum2 = Sum += Sum2;
-			val = ROUND64(Sum2) & d->Mask;
+	memset ( d->LastRandomNumber, 0, sizeof (d->LastRandomNumber) );
+	memcpy ( d->RandomState[0], random_seeds_, sizeof (random_seeds_) );
+	memcpy ( d->RandomState[1], random_seeds_, sizeof (random_seeds_) );
+
+	d->RandomFill = random_fill_;
+	d->NoiseShape = noise_shape_;
+#ifdef SHARE__X86_SIMD
+	{
+		share__CPUInfo cpu;
+		share__cpu_info(&cpu);
+		if (cpu.avx2) {
+			d->RandomFill = random_fill_avx2_;
+			d->NoiseShape = noise_shape_avx2_;
 		}
-		else {
-			Sum2 = random_triangular_(d->Dither) - scalar16_(d->DitherHistory[k], d->FilterCoeff + i);
-			Sum += d->DitherHistory [k] [(-1-i)&15] = (float)Sum2;
-			Sum2 = Sum + scalar16_(d->ErrorHistory [k], d->FilterCoeff + i);
-			val = ROUND64(Sum2) & d->Mask;
-			d->ErrorHistory [k] [(-1-i)&15] = (float)(Sum - val);
+		else if (cpu.sse2) {
+			d->RandomFill = random_fill_sse2_;
+			d->NoiseShape = noise_shape_sse2_;
 		}
-		return val;
 	}
-	else
-		return ROUND64(Sum);
-
-#undef ROUND64
+#endif
 }
 
 #if 0
@@ -340,12 +635,20 @@ size_t FLAC__replaygain_synthesis__apply_gain(FLAC__byte *data_out, FLAC__bool l
 	const double multi_scale = scale / (double)(1u << (source_bps-1));
 
 	FLAC__byte * const start = data_out;
-	unsigned i, channel;
+	unsigned i, j, n, c, pair, channel;
 	const FLAC__int32 *input_;
 	double sample;
+	double samples[2][BLOCK_SAMPLES_];
+	FLAC__int32 random[2][2*BLOCK_SAMPLES_];
+	FLAC__int64 vals[2][BLOCK_SAMPLES_];
+	const double * const samples_[2] = { samples[0], samples[1] };
+	const FLAC__int32 * const random_[2] = { random[0], random[1] };
+	FLAC__int64 * const vals_[2] = { vals[0], vals[1] };
 	const unsigned bytes_per_sample = target_bps / 8;
-	const unsigned last_history_index = dither_context->LastHistoryIndex;
+	const unsigned incr = bytes_per_sample * channels;
 	NoiseShaping noise_shaping = dither_context->ShapingType;
+	/* a gain of exactly 0 dB needs neither the float path nor dithering */
+	const FLAC__bool pass_through = scale == 1.0 && !hard_limit && target_bps >= source_bps;
 	FLAC__int64 val64;
 	FLAC__int32 val32;
 	FLAC__int32 uval32;
@@ -358,66 +661,107 @@ size_t FLAC__replaygain_synthesis__apply_gain(FLAC__byte *data_out, FLAC__bool l
 	FLAC__ASSERT(target_bps < 32);
 	FLAC__ASSERT((target_bps & 7) == 0);
 
-	for(channel = 0; channel < channels; channel++) {
-		const unsigned incr = bytes_per_sample * channels;
-		data_out = start + bytes_per_sample * channel;
-		input_ = input[channel];
-		for(i = 0; i < wide_samples; i++, data_out += incr) {
-			sample = (double)input_[i] * multi_scale;
-
-			if(hard_limit) {
-				/* hard 6dB limiting */
-				if(sample < -0.5)
-					sample = tanh((sample + 0.5) / (1-0.5)) * (1-0.5) - 0.5;
-				else if(sample > 0.5)
-					sample = tanh((sample - 0.5) / (1-0.5)) * (1-0.5) + 0.5;
-			}
-			sample *= 2147483647.;
-
-			val64 = dither_output_(dither_context, do_dithering, noise_shaping, (i + last_history_index) % 32, sample, channel) >> conv_shift;
-
-			val32 = (FLAC__int32)val64;
-			if(val64 >= -hard_clip_factor)
-				val32 = (FLAC__int32)(-(hard_clip_factor+1));
-			else if(val64 < hard_clip_factor)
-				val32 = (FLAC__int32)hard_clip_factor;
-
-			uval32 = (FLAC__uint32)val32;
-			if (unsigned_data_out)
-				uval32 ^= twiggle;
-
-			if (little_endian_data_out) {
-				switch(target_bps) {
-					case 24:
-						data_out[2] = (FLAC__byte)(uval32 >> 16);
-						/* fall through */
-					case 16:
-						data_out[1] = (FLAC__byte)(uval32 >> 8);
-						/* fall through */
-					case 8:
-						data_out[0] = (FLAC__byte)uval32;
-						break;
+	/* the channels are done two at a time, so that their noise shaping can be interleaved */
+	for(channel = 0; channel < channels; channel += pair) {
+		pair = channels - channel < 2? channels - channel : 2;
+		for(i = 0; i < wide_samples; i += n) {
+			n = wide_samples - i < BLOCK_SAMPLES_? wide_samples - i : BLOCK_SAMPLES_;
+
+			for(c = 0; c < pair; c++) {
+				input_ = input[channel+c] + i;
+
+				if(pass_through) {
+					for(j = 0; j < n; j++)
+						vals[c][j] = (FLAC__int64)input_[j] << (32 - source_bps);
+					continue;
+				}
+
+				for(j = 0; j < n; j++) {
+					sample = (double)input_[j] * multi_scale;
+
+					if(hard_limit) {
+						/* hard 6dB limiting */
+						if(sample < -0.5)
+							sample = tanh((sample + 0.5) / (1-0.5)) * (1-0.5) - 0.5;
+						else if(sample > 0.5)
+							sample = tanh((sample - 0.5) / (1-0.5)) * (1-0.5) + 0.5;
+					}
+					samples[c][j] = sample * 2147483647.;
+				}
+
+				if(!do_dithering) {
+					for(j = 0; j < n; j++)
+						vals[c][j] = round64_(samples[c][j], dither_context->Add);
+				}
+				else if(noise_shaping == NOISE_SHAPING_NONE) {
+					/* equally distributed dither, between -2^31*Dither and +2^31*Dither */
+					int *last_random_number = &dither_context->LastRandomNumber[channel+c];
+					double tmp;
+					dither_context->RandomFill(dither_context->RandomState, random[c], (n + FLAC_SHARE__RANDOM_GENERATORS-1) & ~(FLAC_SHARE__RANDOM_GENERATORS-1));
+					for(j = 0; j < n; j++) {
+						tmp = dither_context->Dither * random[c][j];
+						samples[c][j] += tmp - *last_random_number;
+						*last_random_number = (int)tmp;
+						vals[c][j] = round64_(samples[c][j], dither_context->Add) & dither_context->Mask;
+					}
+				}
+				else {
+					/* triangular dither, between -2^32*Dither and +2^32*Dither, shaped below */
+					dither_context->RandomFill(dither_context->RandomState, random[c], (2*n + FLAC_SHARE__RANDOM_GENERATORS-1) & ~(FLAC_SHARE__RANDOM_GENERATORS-1));
 				}
 			}
-			else {
-				switch(target_bps) {
-					case 24:
-						data_out[0] = (FLAC__byte)(uval32 >> 16);
-						data_out[1] = (FLAC__byte)(uval32 >> 8);
-						data_out[2] = (FLAC__byte)uval32;
-						break;
-					case 16:
-						data_out[0] = (FLAC__byte)(uval32 >> 8);
-						data_out[1] = (FLAC__byte)uval32;
-						break;
-					case 8:
-						data_out[0] = (FLAC__byte)uval32;
-						break;
+
+			if(!pass_through && do_dithering && noise_shaping != NOISE_SHAPING_NONE)
+				dither_context->NoiseShape(dither_context, channel, pair, samples_, random_, vals_, n);
+
+			for(c = 0; c < pair; c++) {
+				data_out = start + bytes_per_sample * (channel+c) + (size_t)incr * i;
+				for(j = 0; j < n; j++, data_out += incr) {
+					val64 = vals[c][j] >> conv_shift;
+
+					val32 = (FLAC__int32)val64;
+					if(val64 >= -hard_clip_factor)
+						val32 = (FLAC__int32)(-(hard_clip_factor+1));
+					else if(val64 < hard_clip_factor)
+						val32 = (FLAC__int32)hard_clip_factor;
+
+					uval32 = (FLAC__uint32)val32;
+					if (unsigned_data_out)
+						uval32 ^= twiggle;
+
+					if (little_endian_data_out) {
+						switch(target_bps) {
+							case 24:
+								data_out[2] = (FLAC__byte)(uval32 >> 16);
+								/* fall through */
+							case 16:
+								data_out[1] = (FLAC__byte)(uval32 >> 8);
+								/* fall through */
+							case 8:
+								data_out[0] = (FLAC__byte)uval32;
+								break;
+						}
+					}
+					else {
+						switch(target_bps) {
+							case 24:
+								data_out[0] = (FLAC__byte)(uval32 >> 16);
+								data_out[1] = (FLAC__byte)(uval32 >> 8);
+								data_out[2] = (FLAC__byte)uval32;
+								break;
+							case 16:
+								data_out[0] = (FLAC__byte)(uval32 >> 8);
+								data_out[1] = (FLAC__byte)uval32;
+								break;
+							case 8:
+								data_out[0] = (FLAC__byte)uval32;
+								break;
+						}
+					}
 				}
 			}
 		}
 	}
-	dither_context->LastHistoryIndex = (last_history_index + wide_samples) % 32;
 
 	return wide_samples * channels * (target_bps/8);
 }
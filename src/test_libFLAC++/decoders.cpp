@@ -56,6 +56,7 @@ static const char * const LayerString[] = {
 };
 
 static ::FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, application2_, vorbiscomment_, cuesheet_, picture_, unknown_;
+static const unsigned flacfile_samples_ = 512 * 1024; /* the STREAMINFO leaves total_samples unknown */
 static ::FLAC__StreamMetadata *expected_metadata_sequence_[9];
 static unsigned num_expected_;
 static FLAC__off_t flacfilesize_;
@@ -110,7 +111,7 @@ static bool generate_file_(FLAC__bool is_ogg)
 	expected_metadata_sequence_[num_expected_++] = &unknown_;
 	/* WATCHOUT: for Ogg FLAC the encoder should move the VORBIS_COMMENT block to the front, right after STREAMINFO */
 
-	if(!file_utils__generate_flacfile(is_ogg, flacfilename(is_ogg), &flacfilesize_, 512 * 1024, &streaminfo_, expected_metadata_sequence_, num_expected_))
+	if(!file_utils__generate_flacfile(is_ogg, flacfilename(is_ogg), &flacfilesize_, flacfile_samples_, &streaminfo_, expected_metadata_sequence_, num_expected_))
 		return die_("creating the encoded file");
 
 	return true;
@@ -547,6 +548,26 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		return false;
 	}
 
+	if(!decoder->set_threaded_md5(true)) {
+		printf("FAILED at set_threaded_md5(), returned false\n");
+		return false;
+	}
+
+	if(!decoder->set_num_threads(2)) {
+		printf("FAILED at set_num_threads(), returned false\n");
+		return false;
+	}
+
+	if(!decoder->set_pcm_format(::FLAC__STREAM_DECODER_PCM_FORMAT_S16LE)) {
+		printf("FAILED at set_pcm_format(), returned false\n");
+		return false;
+	}
+
+	if(!decoder->set_frame_index(true)) {
+		printf("FAILED at set_frame_index(), returned false\n");
+		return false;
+	}
+
 	switch(layer) {
 		case LAYER_STREAM:
 		case LAYER_SEEKABLE_STREAM:
@@ -606,6 +627,34 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_threaded_md5()... ");
+	if(!decoder->get_threaded_md5()) {
+		printf("FAILED, returned false, expected true\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_num_threads()... ");
+	if(decoder->get_num_threads() != 2) {
+		printf("FAILED, returned %u, expected 2\n", decoder->get_num_threads());
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_pcm_format()... ");
+	if(decoder->get_pcm_format() != ::FLAC__STREAM_DECODER_PCM_FORMAT_S16LE) {
+		printf("FAILED, returned %s, expected %s\n", ::FLAC__StreamDecoderPCMFormatString[decoder->get_pcm_format()], ::FLAC__StreamDecoderPCMFormatString[::FLAC__STREAM_DECODER_PCM_FORMAT_S16LE]);
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_frame_index()... ");
+	if(!decoder->get_frame_index()) {
+		printf("FAILED, returned false, expected true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing process_until_end_of_metadata()... ");
 	if(!decoder->process_until_end_of_metadata())
 		return die_s_("returned false", decoder);
@@ -652,6 +701,32 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		return die_s_(expect? "returned false" : "returned true", decoder);
 	printf("OK\n");
 
+	expect = (!is_ogg && layer != LAYER_STREAM);
+	printf("testing find_total_samples()... ");
+	{
+		FLAC__uint64 total_samples;
+		if(decoder->find_total_samples(&total_samples) != expect)
+			return die_s_(expect? "returned false" : "returned true", decoder);
+		if(expect && total_samples != flacfile_samples_) {
+			printf("FAILED, returned %" PRIu64 " samples, expected %u\n", total_samples, flacfile_samples_);
+			return false;
+		}
+	}
+	printf("OK\n");
+
+	expect = !is_ogg;
+	printf("testing scan_until_end_of_stream()... ");
+	{
+		FLAC__uint64 total_samples;
+		if(decoder->scan_until_end_of_stream(&total_samples) != expect)
+			return die_s_(expect? "returned false" : "returned true", decoder);
+		if(expect && total_samples != flacfile_samples_) {
+			printf("FAILED, returned %" PRIu64 " samples, expected %u\n", total_samples, flacfile_samples_);
+			return false;
+		}
+	}
+	printf("OK\n");
+
 	printf("testing get_channels()... ");
 	{
 		unsigned channels = decoder->get_channels();
@@ -719,6 +794,28 @@ static bool test_stream_decoder(Layer layer, bool is_ogg)
 		if(!decoder->process_until_end_of_stream())
 			return die_s_("returned false", decoder);
 		printf("OK\n");
+
+		printf("testing compute_md5_signature()... ");
+		{
+			static const FLAC__byte zeroes[16] = { 0 };
+			FLAC__byte md5sum[16];
+			if(decoder->compute_md5_signature(md5sum))
+				return die_s_("returned true after decoding", decoder);
+			if(!decoder->reset())
+				return die_s_("reset() returned false", decoder);
+			if(layer == LAYER_STREAM && fseeko(dynamic_cast<StreamDecoder*>(decoder)->file_, 0, SEEK_SET) < 0) {
+				printf("FAILED rewinding input, errno = %d\n", errno);
+				return false;
+			}
+			dynamic_cast<DecoderCommon*>(decoder)->current_metadata_number_ = 0;
+			if(!decoder->compute_md5_signature(md5sum))
+				return die_s_("returned false", decoder);
+			if(0 == memcmp(md5sum, zeroes, 16)) {
+				printf("FAILED, returned an empty signature\n");
+				return false;
+			}
+		}
+		printf("OK\n");
 	}
 
 	printf("testing finish()... ");
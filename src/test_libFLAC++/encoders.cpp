@@ -321,6 +321,31 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing set_num_threads()... ");
+	if(!encoder->set_num_threads(2))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing set_do_parallel_subframes()... ");
+	if(!encoder->set_do_parallel_subframes(true))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing set_do_variable_blocksize()... ");
+	if(!encoder->set_do_variable_blocksize(false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing set_threaded_verify()... ");
+	if(!encoder->set_threaded_verify(false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing set_threaded_md5()... ");
+	if(!encoder->set_threaded_md5(true))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening file for FLAC output... ");
 		file = ::flac_fopen(flacfilename(is_ogg), "w+b");
@@ -497,6 +522,41 @@ static bool test_stream_encoder(Layer layer, bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing get_num_threads()... ");
+	if(encoder->get_num_threads() != 2) {
+		printf("FAILED, expected %u, got %u\n", 2, encoder->get_num_threads());
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_do_parallel_subframes()... ");
+	if(encoder->get_do_parallel_subframes() != true) {
+		printf("FAILED, expected true, got false\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_do_variable_blocksize()... ");
+	if(encoder->get_do_variable_blocksize() != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_threaded_verify()... ");
+	if(encoder->get_threaded_verify() != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing get_threaded_md5()... ");
+	if(encoder->get_threaded_md5() != true) {
+		printf("FAILED, expected true, got false\n");
+		return false;
+	}
+	printf("OK\n");
+
 	/* init the dummy sample buffer */
 	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
 		samples[i] = i & 7;
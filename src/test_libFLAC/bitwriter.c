@@ -566,6 +566,61 @@ FLAC__bool test_bitwriter(void)
 	}
 	printf("capacity = %u\n", bw->capacity);
 
+	printf("testing rice_signed_block... ");
+	{
+		/* compare against writing the same codes one at a time, across a buffer grow and with codes longer than a word */
+		static FLAC__int32 vals[1000];
+		FLAC__BitWriter *bw2 = FLAC__bitwriter_new();
+		const FLAC__byte *buffer1, *buffer2;
+		size_t bytes1, bytes2;
+		unsigned parameter;
+		ok = 0 != bw2 && FLAC__bitwriter_init(bw2);
+		for(parameter = 0; ok && parameter < 14; parameter += 3) {
+			for(i = 0; i < sizeof(vals)/sizeof(vals[0]); i++)
+				vals[i] = (FLAC__int32)((i * 2654435761u) >> ((i % 7 == 0? 23 : 29) - parameter)) * (i & 1? -1 : 1);
+			FLAC__bitwriter_clear(bw);
+			FLAC__bitwriter_clear(bw2);
+			j = bw->capacity - 2;
+			for(i = 0; i < j; i++) {
+				FLAC__bitwriter_write_raw_uint32(bw, 0x5, 3 + parameter);
+				FLAC__bitwriter_write_raw_uint32(bw2, 0x5, 3 + parameter);
+			}
+			ok = FLAC__bitwriter_write_rice_signed_block(bw, vals, sizeof(vals)/sizeof(vals[0]), parameter);
+			for(i = 0; ok && i < sizeof(vals)/sizeof(vals[0]); i++)
+				ok = FLAC__bitwriter_write_rice_signed(bw2, vals[i], parameter);
+			ok = ok && TOTAL_BITS(bw) == TOTAL_BITS(bw2) &&
+				FLAC__bitwriter_zero_pad_to_byte_boundary(bw) && FLAC__bitwriter_zero_pad_to_byte_boundary(bw2) &&
+				FLAC__bitwriter_get_buffer(bw, &buffer1, &bytes1) && FLAC__bitwriter_get_buffer(bw2, &buffer2, &bytes2) &&
+				bytes1 == bytes2 && memcmp(buffer1, buffer2, bytes1) == 0;
+			if(ok) {
+				FLAC__bitwriter_release_buffer(bw);
+				FLAC__bitwriter_release_buffer(bw2);
+			}
+		}
+		if(0 != bw2)
+			FLAC__bitwriter_delete(bw2);
+	}
+	printf("%s\n", ok?"OK":"FAILED");
+	if(!ok) {
+		FLAC__bitwriter_dump(bw, stdout);
+		return false;
+	}
+
+	printf("testing reserve... ");
+	FLAC__bitwriter_clear(bw);
+	FLAC__bitwriter_write_raw_uint32(bw, 0x5, 4);
+	j = bw->capacity;
+	ok = FLAC__bitwriter_reserve(bw, j*64) && bw->capacity >= 2*j;
+	j = bw->capacity;
+	for(i = 0; ok && i < j-2; i++)
+		ok = FLAC__bitwriter_write_raw_uint32(bw, 0xaaaaaaaa, 32);
+	ok = ok && bw->capacity == j;
+	printf("%s\n", ok?"OK":"FAILED");
+	if(!ok) {
+		FLAC__bitwriter_dump(bw, stdout);
+		return false;
+	}
+
 	printf("testing free... ");
 	FLAC__bitwriter_free(bw);
 	printf("OK\n");
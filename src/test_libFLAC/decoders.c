@@ -28,6 +28,7 @@
 #include "decoders.h"
 #include "FLAC/assert.h"
 #include "FLAC/stream_decoder.h"
+#include "private/md5.h"
 #include "share/grabbag.h"
 #include "share/compat.h"
 #include "share/safe_str.h"
@@ -38,26 +39,33 @@ typedef enum {
 	LAYER_STREAM = 0, /* FLAC__stream_decoder_init_[ogg_]stream() without seeking */
 	LAYER_SEEKABLE_STREAM, /* FLAC__stream_decoder_init_[ogg_]stream() with seeking */
 	LAYER_FILE, /* FLAC__stream_decoder_init_[ogg_]FILE() */
-	LAYER_FILENAME /* FLAC__stream_decoder_init_[ogg_]file() */
+	LAYER_FILENAME, /* FLAC__stream_decoder_init_[ogg_]file() */
+	LAYER_MAPPED_FILENAME, /* FLAC__stream_decoder_init_[ogg_]mapped_file() */
+	LAYER_MEMORY /* FLAC__stream_decoder_init_[ogg_]memory() */
 } Layer;
 
 static const char * const LayerString[] = {
 	"Stream",
 	"Seekable Stream",
 	"FILE*",
-	"Filename"
+	"Filename",
+	"Mapped Filename",
+	"Memory"
 };
 
 typedef struct {
 	Layer layer;
 	FILE *file;
 	char filename[512];
+	FLAC__byte *memory;
+	size_t memory_bytes;
 	unsigned current_metadata_number;
 	FLAC__bool ignore_errors;
 	FLAC__bool error_occurred;
 } StreamDecoderClientData;
 
 static FLAC__StreamMetadata streaminfo_, padding_, seektable_, application1_, application2_, vorbiscomment_, cuesheet_, picture_, unknown_;
+static const unsigned flacfile_samples_ = 512 * 1024; /* the STREAMINFO leaves total_samples unknown */
 static FLAC__StreamMetadata *expected_metadata_sequence_[9];
 static unsigned num_expected_;
 static FLAC__off_t flacfilesize_;
@@ -93,6 +101,21 @@ static void open_test_file(StreamDecoderClientData * pdcd, int is_ogg, const cha
 	safe_strncpy(pdcd->filename, flacfilename(is_ogg), sizeof (pdcd->filename));
 }
 
+static FLAC__bool load_test_file(StreamDecoderClientData * pdcd, int is_ogg)
+{
+	FILE *file = flac_fopen(flacfilename(is_ogg), "rb");
+	if(0 == file)
+		return false;
+	pdcd->memory_bytes = (size_t)flacfilesize_;
+	pdcd->memory = malloc(pdcd->memory_bytes);
+	if(0 == pdcd->memory || fread(pdcd->memory, 1, pdcd->memory_bytes, file) != pdcd->memory_bytes) {
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+	return true;
+}
+
 static void init_metadata_blocks_(void)
 {
 	mutils__init_metadata_blocks(&streaminfo_, &padding_, &seektable_, &application1_, &application2_, &vorbiscomment_, &cuesheet_, &picture_, &unknown_);
@@ -103,6 +126,23 @@ static void free_metadata_blocks_(void)
 	mutils__free_metadata_blocks(&streaminfo_, &padding_, &seektable_, &application1_, &application2_, &vorbiscomment_, &cuesheet_, &picture_, &unknown_);
 }
 
+/* the MD5 signature of the audio in the file; the encoder writes it through a callback with no seeking, so STREAMINFO doesn't have it */
+static void compute_flacfile_md5_(FLAC__byte md5sum[16])
+{
+	/* file_utils__generate_flacfile() encodes the samples i & 7 in blocks of 1024, and STREAMINFO says mono, 8 bps */
+	FLAC__int32 samples[1024];
+	const FLAC__int32 * const signal[1] = { samples };
+	FLAC__MD5Context context;
+	unsigned i;
+
+	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
+		samples[i] = i & 7;
+	FLAC__MD5Init(&context);
+	for(i = 0; i < flacfile_samples_; i += sizeof(samples) / sizeof(FLAC__int32))
+		(void)FLAC__MD5Accumulate(&context, signal, 1, sizeof(samples) / sizeof(FLAC__int32), 1);
+	FLAC__MD5Final(md5sum, &context);
+}
+
 static FLAC__bool generate_file_(FLAC__bool is_ogg)
 {
 	printf("\n\ngenerating %sFLAC file for decoder tests...\n", is_ogg? "Ogg ":"");
@@ -118,7 +158,7 @@ static FLAC__bool generate_file_(FLAC__bool is_ogg)
 	expected_metadata_sequence_[num_expected_++] = &unknown_;
 	/* WATCHOUT: for Ogg FLAC the encoder should move the VORBIS_COMMENT block to the front, right after STREAMINFO */
 
-	if(!file_utils__generate_flacfile(is_ogg, flacfilename(is_ogg), &flacfilesize_, 512 * 1024, &streaminfo_, expected_metadata_sequence_, num_expected_))
+	if(!file_utils__generate_flacfile(is_ogg, flacfilename(is_ogg), &flacfilesize_, flacfile_samples_, &streaminfo_, expected_metadata_sequence_, num_expected_))
 		return die_("creating the encoded file");
 
 	return true;
@@ -245,8 +285,8 @@ static FLAC__bool stream_decoder_eof_callback_(const FLAC__StreamDecoder *decode
 static FLAC__StreamDecoderWriteStatus stream_decoder_write_callback_(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	StreamDecoderClientData *dcd = (StreamDecoderClientData*)client_data;
-
-	(void)decoder, (void)buffer;
+	const FLAC__byte *pcm;
+	size_t pcm_bytes;
 
 	if(0 == dcd) {
 		printf("ERROR: client_data in write callback is NULL\n");
@@ -256,6 +296,23 @@ static FLAC__StreamDecoderWriteStatus stream_decoder_write_callback_(const FLAC_
 	if(dcd->error_occurred)
 		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
 
+	if(FLAC__stream_decoder_get_pcm_format(decoder) == FLAC__STREAM_DECODER_PCM_FORMAT_S16LE) {
+		const unsigned bps = frame->header.bits_per_sample;
+		const FLAC__int32 last = buffer[frame->header.channels-1][frame->header.blocksize-1];
+		const FLAC__int32 expect = bps <= 16? last << (16-bps) : last >> (bps-16);
+		pcm = FLAC__stream_decoder_get_pcm(decoder, &pcm_bytes);
+		if(0 == pcm || pcm_bytes != (size_t)frame->header.blocksize * frame->header.channels * 2) {
+			printf("ERROR: FLAC__stream_decoder_get_pcm() returned %u bytes, expected %u\n", (unsigned)pcm_bytes, frame->header.blocksize * frame->header.channels * 2);
+			dcd->error_occurred = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+		if((FLAC__int16)(pcm[pcm_bytes-2] | (pcm[pcm_bytes-1] << 8)) != expect) {
+			printf("ERROR: FLAC__stream_decoder_get_pcm() last sample mismatch\n");
+			dcd->error_occurred = true;
+			return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+		}
+	}
+
 	if(
 		(frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER && frame->header.number.frame_number == 0) ||
 		(frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER && frame->header.number.sample_number == 0)
@@ -320,6 +377,23 @@ static void stream_decoder_error_callback_(const FLAC__StreamDecoder *decoder, F
 	}
 }
 
+static FLAC__bool stream_decoder_scan_callback_(const FLAC__StreamDecoder *decoder, const FLAC__FrameHeader *header, FLAC__uint64 frame_offset, unsigned frame_bytes, void *client_data)
+{
+	(void)decoder, (void)frame_offset;
+
+	if(0 == client_data) {
+		printf("ERROR: client_data in scan callback is NULL\n");
+		return false;
+	}
+
+	if(header->number_type != FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER || header->blocksize == 0 || frame_bytes == 0) {
+		printf("ERROR: got bad frame in scan callback: sample %" PRIu64 ", blocksize %u, %u bytes\n", header->number.sample_number, header->blocksize, frame_bytes);
+		return false;
+	}
+
+	return true;
+}
+
 static FLAC__bool stream_decoder_test_respond_(FLAC__StreamDecoder *decoder, StreamDecoderClientData *dcd, FLAC__bool is_ogg)
 {
 	FLAC__StreamDecoderInitStatus init_status;
@@ -364,6 +438,18 @@ static FLAC__bool stream_decoder_test_respond_(FLAC__StreamDecoder *decoder, Str
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd);
 			break;
+		case LAYER_MAPPED_FILENAME:
+			printf("testing FLAC__stream_decoder_init_%smapped_file()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mapped_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd) :
+				FLAC__stream_decoder_init_mapped_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd);
+			break;
+		case LAYER_MEMORY:
+			printf("testing FLAC__stream_decoder_init_%smemory()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_memory(decoder, dcd->memory, dcd->memory_bytes, stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd) :
+				FLAC__stream_decoder_init_memory(decoder, dcd->memory, dcd->memory_bytes, stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, dcd);
+			break;
 		default:
 			die_("internal error 000");
 			return false;
@@ -401,6 +487,8 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	FLAC__bool expect;
 
 	decoder_client_data.layer = layer;
+	decoder_client_data.memory = 0;
+	decoder_client_data.memory_bytes = 0;
 
 	printf("\n+++ libFLAC unit test: FLAC__StreamDecoder (layer: %s, format: %s)\n\n", LayerString[layer], is_ogg? "Ogg FLAC" : "FLAC");
 
@@ -444,6 +532,18 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0);
 			break;
+		case LAYER_MAPPED_FILENAME:
+			printf("testing FLAC__stream_decoder_init_%smapped_file()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mapped_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0) :
+				FLAC__stream_decoder_init_mapped_file(decoder, flacfilename(is_ogg), 0, 0, 0, 0);
+			break;
+		case LAYER_MEMORY:
+			printf("testing FLAC__stream_decoder_init_%smemory()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_memory(decoder, 0, 0, 0, 0, 0, 0) :
+				FLAC__stream_decoder_init_memory(decoder, 0, 0, 0, 0, 0, 0);
+			break;
 		default:
 			die_("internal error 003");
 			return false;
@@ -479,6 +579,26 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", decoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_decoder_set_threaded_md5()... ");
+	if(!FLAC__stream_decoder_set_threaded_md5(decoder, true))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_set_num_threads()... ");
+	if(!FLAC__stream_decoder_set_num_threads(decoder, 2))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_set_pcm_format()... ");
+	if(!FLAC__stream_decoder_set_pcm_format(decoder, FLAC__STREAM_DECODER_PCM_FORMAT_S16LE))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_set_frame_index()... ");
+	if(!FLAC__stream_decoder_set_frame_index(decoder, true))
+		return die_s_("returned false", decoder);
+	printf("OK\n");
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening %sFLAC file... ", is_ogg? "Ogg ":"");
 		open_test_file(&decoder_client_data, is_ogg, "rb");
@@ -488,6 +608,14 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		}
 		printf("OK\n");
 	}
+	else if(layer == LAYER_MEMORY) {
+		printf("loading %sFLAC file... ", is_ogg? "Ogg ":"");
+		if(!load_test_file(&decoder_client_data, is_ogg)) {
+			printf("ERROR (%s)\n", strerror(errno));
+			return false;
+		}
+		printf("OK\n");
+	}
 
 	switch(layer) {
 		case LAYER_STREAM:
@@ -514,6 +642,18 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 				FLAC__stream_decoder_init_ogg_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data) :
 				FLAC__stream_decoder_init_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data);
 			break;
+		case LAYER_MAPPED_FILENAME:
+			printf("testing FLAC__stream_decoder_init_%smapped_file()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_mapped_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data) :
+				FLAC__stream_decoder_init_mapped_file(decoder, flacfilename(is_ogg), stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data);
+			break;
+		case LAYER_MEMORY:
+			printf("testing FLAC__stream_decoder_init_%smemory()... ", is_ogg? "ogg_":"");
+			init_status = is_ogg?
+				FLAC__stream_decoder_init_ogg_memory(decoder, decoder_client_data.memory, decoder_client_data.memory_bytes, stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data) :
+				FLAC__stream_decoder_init_memory(decoder, decoder_client_data.memory, decoder_client_data.memory_bytes, stream_decoder_write_callback_, stream_decoder_metadata_callback_, stream_decoder_error_callback_, &decoder_client_data);
+			break;
 		default:
 			die_("internal error 009");
 			return false;
@@ -537,6 +677,34 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_decoder_get_threaded_md5()... ");
+	if(!FLAC__stream_decoder_get_threaded_md5(decoder)) {
+		printf("FAILED, returned false, expected true\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_get_num_threads()... ");
+	if(FLAC__stream_decoder_get_num_threads(decoder) != 2) {
+		printf("FAILED, returned %u, expected 2\n", FLAC__stream_decoder_get_num_threads(decoder));
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_get_pcm_format()... ");
+	if(FLAC__stream_decoder_get_pcm_format(decoder) != FLAC__STREAM_DECODER_PCM_FORMAT_S16LE) {
+		printf("FAILED, returned %s, expected %s\n", FLAC__StreamDecoderPCMFormatString[FLAC__stream_decoder_get_pcm_format(decoder)], FLAC__StreamDecoderPCMFormatString[FLAC__STREAM_DECODER_PCM_FORMAT_S16LE]);
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_decoder_get_frame_index()... ");
+	if(!FLAC__stream_decoder_get_frame_index(decoder)) {
+		printf("FAILED, returned false, expected true\n");
+		return false;
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_decoder_process_until_end_of_metadata()... ");
 	if(!FLAC__stream_decoder_process_until_end_of_metadata(decoder))
 		return die_s_("returned false", decoder);
@@ -583,6 +751,74 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_(expect? "returned false" : "returned true", decoder);
 	printf("OK\n");
 
+	/* frames are only indexed when the decoder can tell where they are, and never for Ogg FLAC */
+	if(!is_ogg && layer != LAYER_STREAM) {
+		static const char *indexfilename = "metadata.fidx";
+		const FLAC__StreamMetadata_SeekPoint *points;
+		unsigned num_points, num_points_saved;
+
+		printf("testing FLAC__stream_decoder_get_frame_index_points()... ");
+		points = FLAC__stream_decoder_get_frame_index_points(decoder, &num_points);
+		if(0 == points || num_points == 0) {
+			printf("FAILED, returned no points\n");
+			return false;
+		}
+		if(points[0].sample_number != 0 || points[0].stream_offset != 0 || points[0].frame_samples == 0) {
+			printf("FAILED, first point is (%" PRIu64 ", %" PRIu64 ", %u), expected (0, 0, >0)\n", points[0].sample_number, points[0].stream_offset, points[0].frame_samples);
+			return false;
+		}
+		printf("returned %u points... OK\n", num_points);
+		num_points_saved = num_points;
+
+		printf("testing FLAC__stream_decoder_save_frame_index()... ");
+		if(!FLAC__stream_decoder_save_frame_index(decoder, indexfilename))
+			return die_s_("returned false", decoder);
+		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_load_frame_index()... ");
+		if(!FLAC__stream_decoder_load_frame_index(decoder, indexfilename))
+			return die_s_("returned false", decoder);
+		(void)FLAC__stream_decoder_get_frame_index_points(decoder, &num_points);
+		if(num_points != num_points_saved) {
+			printf("FAILED, index has %u points after loading, expected %u\n", num_points, num_points_saved);
+			return false;
+		}
+		printf("OK\n");
+		(void)flac_unlink(indexfilename);
+	}
+
+	/* the file's STREAMINFO leaves total_samples unknown, so this has to find the last frame */
+	expect = (!is_ogg && layer != LAYER_STREAM);
+	printf("testing FLAC__stream_decoder_find_total_samples()... ");
+	{
+		FLAC__uint64 total_samples;
+		if(FLAC__stream_decoder_find_total_samples(decoder, &total_samples) != expect)
+			return die_s_(expect? "returned false" : "returned true", decoder);
+		if(expect && total_samples != flacfile_samples_) {
+			printf("FAILED, returned %" PRIu64 " samples, expected %u\n", total_samples, flacfile_samples_);
+			return false;
+		}
+		if(expect && FLAC__stream_decoder_get_total_samples(decoder) != flacfile_samples_) {
+			printf("FAILED, FLAC__stream_decoder_get_total_samples() returned %" PRIu64 ", expected %u\n", FLAC__stream_decoder_get_total_samples(decoder), flacfile_samples_);
+			return false;
+		}
+	}
+	printf("OK\n");
+
+	/* the rest of the stream is scanned after the seek; with no seeking, the decoder is already at the end */
+	expect = !is_ogg;
+	printf("testing FLAC__stream_decoder_scan_until_end_of_stream()... ");
+	{
+		FLAC__uint64 total_samples;
+		if(FLAC__stream_decoder_scan_until_end_of_stream(decoder, stream_decoder_scan_callback_, &total_samples) != expect)
+			return die_s_(expect? "returned false" : "returned true", decoder);
+		if(expect && total_samples != flacfile_samples_) {
+			printf("FAILED, returned %" PRIu64 " samples, expected %u\n", total_samples, flacfile_samples_);
+			return false;
+		}
+	}
+	printf("OK\n");
+
 	printf("testing FLAC__stream_decoder_get_channels()... ");
 	{
 		unsigned channels = FLAC__stream_decoder_get_channels(decoder);
@@ -653,6 +889,28 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 		if(!FLAC__stream_decoder_process_until_end_of_stream(decoder))
 			return die_s_("returned false", decoder);
 		printf("OK\n");
+
+		printf("testing FLAC__stream_decoder_compute_md5_signature()... ");
+		{
+			FLAC__byte md5sum[16], expected[16];
+			if(FLAC__stream_decoder_compute_md5_signature(decoder, md5sum))
+				return die_s_("returned true after decoding", decoder);
+			if(!FLAC__stream_decoder_reset(decoder))
+				return die_s_("FLAC__stream_decoder_reset() returned false", decoder);
+			if(layer == LAYER_STREAM && fseeko(decoder_client_data.file, 0, SEEK_SET) < 0) {
+				printf("FAILED rewinding input, errno = %d\n", errno);
+				return false;
+			}
+			decoder_client_data.current_metadata_number = 0;
+			if(!FLAC__stream_decoder_compute_md5_signature(decoder, md5sum))
+				return die_s_("returned false", decoder);
+			compute_flacfile_md5_(expected);
+			if(memcmp(md5sum, expected, 16)) {
+				printf("FAILED, signature does not match the audio\n");
+				return false;
+			}
+		}
+		printf("OK\n");
 	}
 
 	printf("testing FLAC__stream_decoder_finish()... ");
@@ -1018,6 +1276,9 @@ static FLAC__bool test_stream_decoder(Layer layer, FLAC__bool is_ogg)
 	FLAC__stream_decoder_delete(decoder);
 	printf("OK\n");
 
+	if(layer == LAYER_MEMORY) /* the decoder does not free the client's buffer */
+		free(decoder_client_data.memory);
+
 	printf("\nPASSED!\n");
 
 	return true;
@@ -1045,6 +1306,12 @@ FLAC__bool test_decoders(void)
 		if(!test_stream_decoder(LAYER_FILENAME, is_ogg))
 			return false;
 
+		if(!test_stream_decoder(LAYER_MAPPED_FILENAME, is_ogg))
+			return false;
+
+		if(!test_stream_decoder(LAYER_MEMORY, is_ogg))
+			return false;
+
 		(void) grabbag__file_remove_file(flacfilename(is_ogg));
 
 		free_metadata_blocks_();
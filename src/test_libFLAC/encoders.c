@@ -275,6 +275,31 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 		return die_s_("returned false", encoder);
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_set_num_threads()... ");
+	if(!FLAC__stream_encoder_set_num_threads(encoder, 2))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_set_do_parallel_subframes()... ");
+	if(!FLAC__stream_encoder_set_do_parallel_subframes(encoder, false))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_set_do_variable_blocksize()... ");
+	if(!FLAC__stream_encoder_set_do_variable_blocksize(encoder, true))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_set_threaded_verify()... ");
+	if(!FLAC__stream_encoder_set_threaded_verify(encoder, true))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_set_threaded_md5()... ");
+	if(!FLAC__stream_encoder_set_threaded_md5(encoder, true))
+		return die_s_("returned false", encoder);
+	printf("OK\n");
+
 	if(layer < LAYER_FILENAME) {
 		printf("opening file for FLAC output... ");
 		file = flac_fopen(flacfilename(is_ogg), "w+b");
@@ -456,6 +481,41 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	}
 	printf("OK\n");
 
+	printf("testing FLAC__stream_encoder_get_num_threads()... ");
+	if(FLAC__stream_encoder_get_num_threads(encoder) != 2) {
+		printf("FAILED, expected %u, got %u\n", 2, FLAC__stream_encoder_get_num_threads(encoder));
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_get_do_parallel_subframes()... ");
+	if(FLAC__stream_encoder_get_do_parallel_subframes(encoder) != false) {
+		printf("FAILED, expected false, got true\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_get_do_variable_blocksize()... ");
+	if(FLAC__stream_encoder_get_do_variable_blocksize(encoder) != true) {
+		printf("FAILED, expected true, got false\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_get_threaded_verify()... ");
+	if(FLAC__stream_encoder_get_threaded_verify(encoder) != true) {
+		printf("FAILED, expected true, got false\n");
+		return false;
+	}
+	printf("OK\n");
+
+	printf("testing FLAC__stream_encoder_get_threaded_md5()... ");
+	if(FLAC__stream_encoder_get_threaded_md5(encoder) != true) {
+		printf("FAILED, expected true, got false\n");
+		return false;
+	}
+	printf("OK\n");
+
 	/* init the dummy sample buffer */
 	for(i = 0; i < sizeof(samples) / sizeof(FLAC__int32); i++)
 		samples[i] = i & 7;
@@ -487,6 +547,109 @@ static FLAC__bool test_stream_encoder(Layer layer, FLAC__bool is_ogg)
 	return true;
 }
 
+typedef struct {
+	FLAC__byte *data;
+	size_t bytes, capacity;
+} membuf_t;
+
+static FLAC__StreamEncoderWriteStatus membuf_write_callback_(const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned current_frame, void *client_data)
+{
+	membuf_t *buf = (membuf_t*)client_data;
+	(void)encoder, (void)samples, (void)current_frame;
+	if(buf->bytes + bytes > buf->capacity) {
+		size_t capacity = buf->capacity? buf->capacity : 65536;
+		FLAC__byte *data;
+		while(capacity < buf->bytes + bytes)
+			capacity *= 2;
+		if(0 == (data = realloc(buf->data, capacity)))
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+	memcpy(buf->data + buf->bytes, buffer, bytes);
+	buf->bytes += bytes;
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+/* Encodes a few seconds of partly correlated stereo noise and tones into 'buf'. */
+static FLAC__bool encode_parallel_subframes_(membuf_t *buf, FLAC__bool do_parallel_subframes, FLAC__bool loose_mid_side)
+{
+	static FLAC__int32 left[4096], right[4096];
+	const FLAC__int32 *signal[2];
+	FLAC__StreamEncoder *encoder;
+	FLAC__uint32 seed = 0x1234567u;
+	unsigned block, i;
+
+	if(0 == (encoder = FLAC__stream_encoder_new()))
+		return die_("FLAC__stream_encoder_new() returned NULL");
+	FLAC__stream_encoder_set_channels(encoder, 2);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+	FLAC__stream_encoder_set_sample_rate(encoder, 44100);
+	FLAC__stream_encoder_set_compression_level(encoder, 8);
+	FLAC__stream_encoder_set_loose_mid_side_stereo(encoder, loose_mid_side);
+	FLAC__stream_encoder_set_num_threads(encoder, 4);
+	FLAC__stream_encoder_set_do_parallel_subframes(encoder, do_parallel_subframes);
+	if(FLAC__stream_encoder_init_stream(encoder, membuf_write_callback_, /*seek_callback=*/0, /*tell_callback=*/0, /*metadata_callback=*/0, buf) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		die_s_("FLAC__stream_encoder_init_stream()", encoder);
+		FLAC__stream_encoder_delete(encoder);
+		return false;
+	}
+
+	signal[0] = left;
+	signal[1] = right;
+	for(block = 0; block < 32; block++) {
+		for(i = 0; i < 4096; i++) {
+			FLAC__int32 noise;
+			seed = seed * 1103515245u + 12345u;
+			noise = (FLAC__int32)((seed >> 16) & 0x3ff) - 512;
+			left[i] = (FLAC__int32)(((block * 4096 + i) * (block + 3)) % 4000) * 4 - 8000 + noise;
+			/* the correlation changes from block to block so every channel assignment gets picked */
+			right[i] = (block % 3 == 0)? left[i] - noise : (block % 3 == 1)? noise * 8 : left[i] / 2 + noise;
+		}
+		if(!FLAC__stream_encoder_process(encoder, signal, 4096)) {
+			die_s_("FLAC__stream_encoder_process()", encoder);
+			FLAC__stream_encoder_delete(encoder);
+			return false;
+		}
+	}
+
+	if(!FLAC__stream_encoder_finish(encoder)) {
+		die_s_("FLAC__stream_encoder_finish()", encoder);
+		FLAC__stream_encoder_delete(encoder);
+		return false;
+	}
+	FLAC__stream_encoder_delete(encoder);
+	return true;
+}
+
+static FLAC__bool test_parallel_subframes_(void)
+{
+	membuf_t serial = { 0, 0, 0 }, parallel = { 0, 0, 0 };
+	FLAC__bool ok = true;
+	unsigned loose_mid_side;
+
+	printf("\n+++ libFLAC unit test: parallel subframe search\n\n");
+
+	for(loose_mid_side = 0; ok && loose_mid_side <= 1; loose_mid_side++) {
+		printf("testing parallel subframes give identical output%s... ", loose_mid_side? " with loose mid-side" : "");
+		serial.bytes = parallel.bytes = 0;
+		if(!encode_parallel_subframes_(&serial, false, loose_mid_side) || !encode_parallel_subframes_(&parallel, true, loose_mid_side))
+			ok = false;
+		else if(serial.bytes != parallel.bytes || memcmp(serial.data, parallel.data, serial.bytes)) {
+			printf("FAILED, %u bytes serial vs %u bytes parallel\n", (unsigned)serial.bytes, (unsigned)parallel.bytes);
+			ok = false;
+		}
+		else
+			printf("OK\n");
+	}
+
+	free(serial.data);
+	free(parallel.data);
+	if(ok)
+		printf("\nPASSED!\n");
+	return ok;
+}
+
 FLAC__bool test_encoders(void)
 {
 	FLAC__bool is_ogg = false;
@@ -515,5 +678,8 @@ FLAC__bool test_encoders(void)
 		is_ogg = true;
 	}
 
+	if(!test_parallel_subframes_())
+		return false;
+
 	return true;
 }
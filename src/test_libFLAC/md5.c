@@ -32,6 +32,9 @@
 static FLAC__bool test_md5_clear_context(void);
 static FLAC__bool test_md5_codec(void);
 static FLAC__bool test_md5_accumulate(const FLAC__int32 * const * signal,unsigned channels, unsigned samples, unsigned bytes_per_sample, const FLAC__byte target_digest [16]);
+#ifdef HAVE_PTHREAD
+static FLAC__bool test_md5_pipeline_accumulate(const FLAC__int32 * const * signal,unsigned channels, unsigned samples, unsigned bytes_per_sample, const FLAC__byte target_digest [16]);
+#endif
 
 FLAC__bool test_md5(void)
 {
@@ -185,6 +188,10 @@ static FLAC__bool test_md5_codec(void)
 		for (byte_size = 1 ; byte_size <= 4 ; byte_size ++) {
 			if (! test_md5_accumulate((const FLAC__int32 * const *) signal, chan, MD5_SAMPLE_COUNT, byte_size, target_digests[chan-1][byte_size-1]))
 				return false;
+#ifdef HAVE_PTHREAD
+			if (! test_md5_pipeline_accumulate((const FLAC__int32 * const *) signal, chan, MD5_SAMPLE_COUNT, byte_size, target_digests[chan-1][byte_size-1]))
+				return false;
+#endif
 		}
 	}
 
@@ -220,3 +227,56 @@ static FLAC__bool test_md5_accumulate(const FLAC__int32 * const * signal, unsign
 	printf("OK\n");
 	return true;
 }
+
+#ifdef HAVE_PTHREAD
+static FLAC__bool test_md5_pipeline_accumulate(const FLAC__int32 * const * signal, unsigned channels, unsigned samples, unsigned bytes_per_sample, const FLAC__byte target_digest [16])
+{
+	FLAC__MD5Context ctx;
+	FLAC__MD5Pipeline pipeline;
+	FLAC__byte digest[16];
+	const FLAC__int32 *block[MAX_CHANNEL_COUNT];
+	unsigned chan, done, n;
+
+	memset(&ctx, 0, sizeof (ctx));
+
+	printf("testing FLAC__MD5PipelineAccumulate (samples=%u, channels=%u, bytes_per_sample=%u) ... ", samples, channels, bytes_per_sample);
+
+	FLAC__MD5Init(&ctx);
+	if (! FLAC__MD5PipelineStart(&pipeline, &ctx)) {
+		printf("FAILED, could not start the pipeline\n");
+		return false;
+	}
+	/* blocks of 1, 3, 5, ... samples, more of them than the pipeline has slots */
+	for (done = 0, n = 1 ; done < samples ; done += n, n += 2) {
+		if (n > samples - done)
+			n = samples - done;
+		for (chan = 0 ; chan < channels ; chan++)
+			block[chan] = signal[chan] + done;
+		if (! FLAC__MD5PipelineAccumulate(&pipeline, block, channels, n, bytes_per_sample)) {
+			printf("FAILED, FLAC__MD5PipelineAccumulate returned false\n");
+			return false;
+		}
+	}
+	if (! FLAC__MD5PipelineStop(&pipeline)) {
+		printf("FAILED, FLAC__MD5PipelineStop returned false\n");
+		return false;
+	}
+	FLAC__MD5Final(digest, &ctx);
+
+	if (memcmp(digest, target_digest, sizeof (digest))) {
+		int k ;
+
+		printf("\nFAILED, expected MD5 sum ");
+		for (k = 0 ; k < 16 ; k++)
+			printf("%02x", (target_digest [k] & 0xff));
+		printf (" but got ");
+		for (k = 0 ; k < 16 ; k++)
+			printf("%02x", (digest [k] & 0xff));
+		puts("\n");
+		return false;
+	}
+
+	printf("OK\n");
+	return true;
+}
+#endif
@@ -974,6 +974,143 @@ cmp noise.aiff fixup.aiff || die "ERROR: file mismatch"
 echo OK
 rm -f noise.aiff fixup.aiff fixup.flac
 
+############################################################################
+# test that multithreaded encoding gives the same output as single-threaded
+############################################################################
+
+echo -n "multithreaded encode test... "
+run_flac --verify --force $SILENT --no-padding $raw_eopt -8 -o st.flac noise.raw || die "ERROR generating FLAC file"
+run_flac --verify --force $SILENT --no-padding $raw_eopt -8 --threads=4 -o mt.flac noise.raw || die "ERROR generating FLAC file with --threads=4"
+cmp st.flac mt.flac || die "ERROR: file mismatch"
+echo OK
+rm -f st.flac mt.flac
+
+############################################################################
+# test that multithreaded decoding gives the same result as single-threaded
+############################################################################
+
+echo -n "multithreaded decode test... "
+run_flac --force $SILENT --no-padding $raw_eopt -o mt.flac noise.raw || die "ERROR generating FLAC file"
+for threads in 2 4 ; do
+	run_flac --decode --force $SILENT $raw_dopt --threads=$threads -o mt.raw mt.flac || die "ERROR decoding FLAC file with --threads=$threads"
+	cmp noise.raw mt.raw || die "ERROR: file mismatch with --threads=$threads"
+	run_flac --test $SILENT --threads=$threads mt.flac || die "ERROR testing FLAC file with --threads=$threads"
+done
+# a damaged frame must stop the decoder with the same errors and state
+cp mt.flac damaged.flac
+printf '\000\000\000\000' | dd of=damaged.flac bs=1 seek=1000000 conv=notrunc 2>/dev/null || $dddie
+run_flac --test $SILENT damaged.flac 2> st.log && die "ERROR: damaged file passed the test"
+for threads in 2 4 ; do
+	run_flac --test $SILENT --threads=$threads damaged.flac 2> mt.log && die "ERROR: damaged file passed the test with --threads=$threads"
+	cmp st.log mt.log || die "ERROR: damaged file failed differently with --threads=$threads"
+done
+echo OK
+rm -f mt.flac mt.raw damaged.flac st.log mt.log
+
+echo -n "--jobs encode/decode test... "
+for n in 1 2 3 4 5 ; do
+	dd if=noise.raw ibs=2 skip=`expr $n \* 20000` count=`expr $n \* 10000` of=jobs$n.raw 2>/dev/null || $dddie
+	run_flac --force $SILENT --no-padding $raw_eopt -o jobs$n.st.flac jobs$n.raw || die "ERROR generating FLAC file"
+done
+run_flac --force $SILENT --no-padding $raw_eopt --jobs=3 jobs?.raw || die "ERROR generating FLAC files with --jobs=3"
+for n in 1 2 3 4 5 ; do
+	cmp jobs$n.st.flac jobs$n.flac || die "ERROR: file mismatch"
+	mv jobs$n.raw jobs$n.in.raw
+done
+run_flac --decode --force $SILENT $raw_dopt --jobs=3 jobs?.flac || die "ERROR decoding FLAC files with --jobs=3"
+for n in 1 2 3 4 5 ; do
+	cmp jobs$n.in.raw jobs$n.raw || die "ERROR: file mismatch"
+done
+# the ReplayGain tags, album ones included, must come out the same as without --jobs
+run_flac --force $SILENT $raw_eopt --sample-rate=44100 --replay-gain jobs?.in.raw || die "ERROR generating FLAC files with --replay-gain"
+for n in 1 2 3 4 5 ; do
+	mv jobs$n.in.flac jobs$n.st.flac
+done
+run_flac --force $SILENT $raw_eopt --sample-rate=44100 --replay-gain --jobs=3 jobs?.in.raw || die "ERROR generating FLAC files with --replay-gain --jobs=3"
+for n in 1 2 3 4 5 ; do
+	cmp jobs$n.st.flac jobs$n.in.flac || die "ERROR: file mismatch"
+done
+echo OK
+rm -f jobs?.raw jobs?.in.raw jobs?.flac jobs?.in.flac jobs?.st.flac
+
+############################################################################
+# test variable blocksize encoding
+############################################################################
+
+echo -n "variable blocksize encode test... "
+# silence over the first pair of blocks and into the next, then noise
+dd if=/dev/zero ibs=2 count=6144 of=transients.raw 2>/dev/null || $dddie
+dd if=noise.raw ibs=2 count=10240 2>/dev/null >> transients.raw || $dddie
+run_flac --verify --force $SILENT --no-padding --force-raw-format --endian=little --sign=signed --channels=1 --bps=16 --sample-rate=44100 --variable-blocksize -o vbs.flac transients.raw || die "ERROR generating FLAC file"
+run_flac --decode --force $SILENT --force-raw-format --endian=little --sign=signed -o vbs.raw vbs.flac || die "ERROR decoding FLAC file"
+cmp transients.raw vbs.raw || die "ERROR: file mismatch"
+# the default blocksize is 2304 with --variable-blocksize
+min_blocksize=`run_metaflac --show-min-blocksize vbs.flac`
+[ "$min_blocksize" -lt 2304 ] || die "ERROR: no block was split"
+max_blocksize=`run_metaflac --show-max-blocksize vbs.flac`
+[ "$max_blocksize" -gt 2304 ] || die "ERROR: no blocks were merged"
+echo OK
+rm -f transients.raw vbs.flac vbs.raw
+
+echo -n "variable blocksize last frame test... "
+# silence and noise alternating every 1152 samples splits every full block,
+# leaving the merged last block as the largest frame in the stream
+rm -f transients.raw
+for n in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 ; do
+	dd if=/dev/zero ibs=2 count=1152 2>/dev/null >> transients.raw || $dddie
+	dd if=noise.raw ibs=2 skip=`expr $n \* 1152` count=1152 2>/dev/null >> transients.raw || $dddie
+done
+dd if=/dev/zero ibs=2 count=1048 2>/dev/null >> transients.raw || $dddie
+run_flac --force $SILENT --no-padding --force-raw-format --endian=little --sign=signed --channels=1 --bps=16 --sample-rate=44100 --variable-blocksize -o vbs.flac transients.raw || die "ERROR generating FLAC file"
+max_blocksize=`run_metaflac --show-max-blocksize vbs.flac`
+run_metaflac --rebuild-streaminfo vbs.flac || die "ERROR rebuilding STREAMINFO"
+rebuilt_max_blocksize=`run_metaflac --show-max-blocksize vbs.flac`
+[ "$max_blocksize" = "$rebuilt_max_blocksize" ] || die "ERROR: max blocksize $max_blocksize does not cover the last frame ($rebuilt_max_blocksize)"
+echo OK
+rm -f transients.raw vbs.flac
+
+############################################################################
+# test lossless cutting, splitting and joining
+############################################################################
+
+splice_opt="--force-raw-format --endian=big --sign=signed"
+run_flac --force $SILENT --no-padding $splice_opt --sample-rate=44100 --bps=16 --channels=2 -o splice.flac noise.raw || die "ERROR generating FLAC file"
+
+echo -n "testing --cut... "
+run_flac --cut --force $SILENT --skip=1000 --until=300000 -o cut.flac splice.flac || die "ERROR cutting FLAC file"
+run_flac --test $SILENT cut.flac || die "ERROR testing cut FLAC file"
+run_flac --decode --force $SILENT $splice_opt -o cut.raw cut.flac || die "ERROR decoding cut FLAC file"
+dd if=noise.raw ibs=4 skip=1000 count=299000 of=z.raw 2>/dev/null || $dddie
+cmp z.raw cut.raw || die "ERROR: file mismatch"
+echo OK
+
+echo -n "testing --join... "
+run_flac --join --force $SILENT -o join.flac cut.flac splice.flac cut.flac || die "ERROR joining FLAC files"
+run_flac --test $SILENT join.flac || die "ERROR testing joined FLAC file"
+run_flac --decode --force $SILENT $splice_opt -o join.raw join.flac || die "ERROR decoding joined FLAC file"
+cat z.raw noise.raw z.raw | cmp - join.raw || die "ERROR: file mismatch"
+echo OK
+
+echo -n "testing --split... "
+cat > splice.cue << EOF
+FILE "splice.raw" BINARY
+  TRACK 01 AUDIO
+    INDEX 01 00:00:00
+  TRACK 02 AUDIO
+    INDEX 00 00:01:00
+    INDEX 01 00:02:37
+  TRACK 03 AUDIO
+    INDEX 01 00:05:11
+EOF
+run_flac --split --force $SILENT --cuesheet=splice.cue splice.flac || die "ERROR splitting FLAC file"
+for track in 01 02 03 ; do
+	run_flac --decode --force $SILENT $splice_opt -o splice.$track.raw splice.$track.flac || die "ERROR decoding track $track"
+done
+cat splice.01.raw splice.02.raw splice.03.raw | cmp - noise.raw || die "ERROR: file mismatch"
+echo OK
+
+rm -f splice.flac splice.cue splice.0?.flac splice.0?.raw cut.flac cut.raw join.flac join.raw z.raw
+
 
 ############################################################################
 # multi-file tests
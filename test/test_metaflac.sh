@@ -365,3 +365,19 @@ cp -p metaflac.flac.in $flacfile
 run_metaflac --remove --block-type=VORBIS_COMMENT --dont-use-padding $flacfile
 cmp $flacfile metaflac.flac.ok || die "ERROR, $flacfile and metaflac.flac.ok differ"
 echo OK
+
+# STREAMINFO from a non-seekable encode
+echo -n "Testing --rebuild-streaminfo --rebuild-md5sum... "
+fn=rebuild-streaminfo.flac
+dd if=/dev/zero ibs=1 count=80000 2>/dev/null > rebuild-streaminfo.raw
+cat rebuild-streaminfo.raw | run_flac --silent --force-raw-format --endian=big --sign=signed --channels=1 --bps=8 --sample-rate=8000 -c - | cat > $fn || die "ERROR during generation"
+[ `run_metaflac --show-total-samples $fn` = 0 ] || die "ERROR, expected a stream with no total samples"
+run_metaflac --rebuild-streaminfo --rebuild-md5sum $fn
+run_flac --silent --test $fn || die "ERROR in $fn" 1>&2
+run_flac --silent --force --force-raw-format --endian=big --sign=signed --channels=1 --bps=8 --sample-rate=8000 -o rebuild-streaminfo.ok.flac rebuild-streaminfo.raw || die "ERROR during generation"
+run_metaflac --show-total-samples --show-md5sum --show-min-blocksize --show-max-blocksize $fn > rebuild-streaminfo.out
+run_metaflac --show-total-samples --show-md5sum --show-min-blocksize --show-max-blocksize rebuild-streaminfo.ok.flac > rebuild-streaminfo.ok.out
+cmp rebuild-streaminfo.out rebuild-streaminfo.ok.out || die "ERROR, rebuilt STREAMINFO does not match"
+[ `run_metaflac --list --block-type=SEEKTABLE $fn | grep -c 'point [0-9]*:'` -gt 0 ] || die "ERROR, no seek points added"
+echo OK
+rm -f rebuild-streaminfo.raw rebuild-streaminfo.out rebuild-streaminfo.ok.out rebuild-streaminfo.ok.flac $fn
@@ -129,7 +129,7 @@ tonegenerator ()
 
     }' /dev/null |
     flac${EXE} --silent --no-error-on-compression-fail --force-raw-format \
-        --endian=big --channels=1 --bps=24 --sample-rate=$1 --sign=unsigned -
+        --endian=big --channels=1 --bps=24 --sample-rate=$1 --sign=unsigned $2 -
 }
 
 REPLAYGAIN_FREQ=
@@ -182,6 +182,46 @@ for ACTION in $REPLAYGAIN_FREQ ; do
   done
 done
 
+# Files at different rates in one run - each is analyzed with the filter for
+# its own rate, so the track gains are the same as for the files on their own.
+
+echo -n "Testing FLAC replaygain 44100 and 8000 in one run ... "
+tonegenerator 44100 "--force --output-name=rg44100.flac"
+tonegenerator 8000 "--force --output-name=rg8000.flac"
+run_flac --silent --force --replay-gain --output-prefix=out- rg44100.flac rg8000.flac
+for EXPECTED in "rg44100/TRACK_GAIN=-14.17" "rg8000/TRACK_GAIN=-12.76" "rg44100/ALBUM_GAIN=-14.17" "rg8000/ALBUM_GAIN=-14.17" ; do
+  run_metaflac --export-tags-to=- out-${EXPECTED%%/*}.flac | grep -q "^REPLAYGAIN_${EXPECTED#*/} dB\$" ||
+    die "ERROR, Expected REPLAYGAIN_${EXPECTED#*/} dB in out-${EXPECTED%%/*}.flac"
+done
+rm -f rg44100.flac rg8000.flac out-rg44100.flac out-rg8000.flac
+echo OK
+
+# Loudness tests - A full scale sine is at -3 LUFS at any rate; its true peak
+# is above 0 dBTP where the tone is not much below the Nyquist frequency.
+
+LOUDNESS_FREQ=
+LOUDNESS_FREQ="$LOUDNESS_FREQ   8000/0.1"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  11025/0.2"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  16000/0.1"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  22050/0.0"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  44100/0.0"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  48000/0.0"
+LOUDNESS_FREQ="$LOUDNESS_FREQ  96000/0.0"
+LOUDNESS_FREQ="$LOUDNESS_FREQ 192000/0.0"
+
+for ACTION in $LOUDNESS_FREQ ; do
+  RATE="${ACTION%%/*}"
+  PEAK="${ACTION#*/}"
+  echo -n "Testing FLAC loudness $RATE ... "
+  tonegenerator $RATE "--force --loudness --output-name=$flacfile"
+  for EXPECTED in "TRACK_LOUDNESS=-3.0 LUFS" "TRACK_LOUDNESS_RANGE=0.0 LU" "TRACK_TRUE_PEAK=$PEAK dBTP" \
+                  "ALBUM_LOUDNESS=-3.0 LUFS" "ALBUM_LOUDNESS_RANGE=0.0 LU" "ALBUM_TRUE_PEAK=$PEAK dBTP" ; do
+    run_metaflac --export-tags-to=- $flacfile | grep -q "^R128_$EXPECTED\$" ||
+      die "ERROR, Expected R128_$EXPECTED"
+  done
+  echo OK
+done
+
 
 rm -f $testdir/out.flac $testdir/out.meta
 